@@ -49,12 +49,17 @@ check_include_file(sys/stat.h HAVE_SYS_STAT_H)
 check_include_file(sys/time.h HAVE_SYS_TIME_H)
 check_include_file(sys/un.h HAVE_SYS_UN_H)
 check_include_file(poll.h HAVE_POLL_H)
+check_include_file(sys/eventfd.h HAVE_SYS_EVENTFD_H)
 check_include_file(sys/poll.h HAVE_SYS_POLL_H)
 check_include_file(sys/select.h HAVE_SYS_SELECT_H)
 check_include_file(sched.h HAVE_SCHED_H)
 check_include_file(string.h HAVE_STRING_H)
 check_include_file(strings.h HAVE_STRINGS_H)
 
+# Found by DefineOptions
+set(HAVE_ZSTD ${WITH_ZSTD})
+set(HAVE_LZ4 ${WITH_LZ4})
+
 # Check for afunix.h on Windows (since Windows 10 Insider Build 17063):
 check_cxx_source_compiles(
   "
@@ -73,6 +78,9 @@ check_function_exists(strerror_r HAVE_STRERROR_R)
 check_function_exists(sched_get_priority_max HAVE_SCHED_GET_PRIORITY_MAX)
 check_function_exists(sched_get_priority_min HAVE_SCHED_GET_PRIORITY_MIN)
 
+# TUringServer needs the io_uring of Linux 5.19 or later, with multishot receives
+check_symbol_exists(IORING_RECV_MULTISHOT "linux/io_uring.h" HAVE_IO_URING)
+
 
 check_cxx_source_compiles(
   "
@@ -68,6 +68,10 @@ public:
     gen_moveable_ = false;
     gen_no_ostream_operators_ = false;
     gen_no_skeleton_ = false;
+    gen_slices_ = false;
+    gen_slices_binary_only_ = false;
+    gen_arena_ = false;
+    gen_pooled_args_ = false;
     has_members_ = false;
 
     for( iter = parsed_options.begin(); iter != parsed_options.end(); ++iter) {
@@ -90,11 +94,23 @@ public:
         gen_no_ostream_operators_ = true;
       } else if ( iter->first.compare("no_skeleton") == 0) {
         gen_no_skeleton_ = true;
+      } else if ( iter->first.compare("slices") == 0) {
+        gen_slices_ = true;
+        gen_slices_binary_only_ = (iter->second == "binary");
+      } else if ( iter->first.compare("arena") == 0) {
+        gen_arena_ = true;
+      } else if ( iter->first.compare("pooled_args") == 0) {
+        gen_pooled_args_ = true;
       } else {
         throw "unknown option cpp:" + iter->first;
       }
     }
 
+    if (gen_pooled_args_ && gen_arena_) {
+      // Pooled structs outlive the call, but arena memory does not.
+      throw "cpp:pooled_args cannot be combined with cpp:arena";
+    }
+
     out_dir_base_ = "gen-cpp";
   }
 
@@ -156,6 +172,7 @@ public:
   void generate_struct_writer(std::ostream& out, t_struct* tstruct, bool pointers = false);
   void generate_struct_result_writer(std::ostream& out, t_struct* tstruct, bool pointers = false);
   void generate_struct_swap(std::ostream& out, t_struct* tstruct);
+  void generate_struct_clear(std::ostream& out, t_struct* tstruct);
   void generate_struct_print_method(std::ostream& out, t_struct* tstruct);
   void generate_exception_what_method(std::ostream& out, t_struct* tstruct);
 
@@ -266,6 +283,49 @@ public:
 
   bool is_reference(t_field* tfield) { return tfield->get_reference(); }
 
+  /**
+   * True if values of this type are generated as ::apache::thrift::TSlice
+   * rather than std::string.
+   */
+  bool is_slice(t_type* ttype) {
+    ttype = get_true_type(ttype);
+    return gen_slices_ && ttype->is_string()
+           && (!gen_slices_binary_only_ || ttype->is_binary())
+           && ttype->annotations_.find("cpp.type") == ttype->annotations_.end();
+  }
+
+  /**
+   * Suffix of the TProtocol methods that read and write a whole run of elem
+   * values at once, or "" if they have to be handled one by one.
+   */
+  std::string bulk_array_method(t_type* elem) {
+    elem = get_true_type(elem);
+    if (!elem->is_base_type()
+        || elem->annotations_.find("cpp.type") != elem->annotations_.end()) {
+      return "";
+    }
+    switch (((t_base_type*)elem)->get_base()) {
+    case t_base_type::TYPE_I32:
+      return "I32Array";
+    case t_base_type::TYPE_I64:
+      return "I64Array";
+    case t_base_type::TYPE_DOUBLE:
+      return "DoubleArray";
+    default:
+      return "";
+    }
+  }
+
+  /**
+   * True if values of this type are generated as ::apache::thrift::TArenaString
+   * rather than std::string.
+   */
+  bool is_arena_string(t_type* ttype) {
+    ttype = get_true_type(ttype);
+    return gen_arena_ && ttype->is_string() && !is_slice(ttype)
+           && ttype->annotations_.find("cpp.type") == ttype->annotations_.end();
+  }
+
   bool is_complex_type(t_type* ttype) {
     ttype = get_true_type(ttype);
 
@@ -365,6 +425,29 @@ private:
    */
   bool gen_no_skeleton_;
 
+  /**
+   * True if string and binary fields should be read as slices of the
+   * receive buffer instead of being copied into std::strings.
+   */
+  bool gen_slices_;
+
+  /**
+   * True iff only binary fields should be generated as slices.
+   */
+  bool gen_slices_binary_only_;
+
+  /**
+   * True if strings and containers should allocate from the current
+   * TArena, and processors should run each call in a TArenaScope.
+   */
+  bool gen_arena_;
+
+  /**
+   * True if we should generate processors that reuse per thread args and
+   * result structs.
+   */
+  bool gen_pooled_args_;
+
   /**
    * True if thrift has member(s)
    */
@@ -442,6 +525,9 @@ void t_cpp_generator::init_generator() {
            << "#include <thrift/protocol/TProtocol.h>" << endl
            << "#include <thrift/transport/TTransport.h>" << endl
            << endl;
+  if (gen_arena_) {
+    f_types_ << "#include <thrift/TArena.h>" << endl << endl;
+  }
   // Include C++xx compatibility header
   f_types_ << "#include <functional>" << endl;
   f_types_ << "#include <memory>" << endl;
@@ -911,6 +997,9 @@ void t_cpp_generator::generate_cpp_struct(t_struct* tstruct, bool is_exception)
   generate_struct_reader(out, tstruct);
   generate_struct_writer(out, tstruct);
   generate_struct_swap(f_types_impl_, tstruct);
+  if (gen_pooled_args_) {
+    generate_struct_clear(f_types_impl_, tstruct);
+  }
   generate_copy_constructor(f_types_impl_, tstruct, is_exception);
   if (gen_moveable_) {
     generate_move_constructor(f_types_impl_, tstruct, is_exception);
@@ -1247,6 +1336,10 @@ void t_cpp_generator::generate_struct_declaration(ostream& out,
       out << " val);" << endl;
     }
   }
+
+  if (gen_pooled_args_ && !pointers) {
+    out << endl << indent() << "void __clear();" << endl;
+  }
   out << endl;
 
   if (!pointers) {
@@ -1435,19 +1528,22 @@ void t_cpp_generator::generate_struct_reader(ostream& out, t_struct* tstruct, bo
   out << endl;
 
   // Loop over reading in fields
-  indent(out) << "while (true)" << endl;
-  scope_up(out);
-
-  // Read beginning field marker
   indent(out) << "xfer += iprot->readFieldBegin(fname, ftype, fid);" << endl;
-
-  // Check for field STOP marker
-  out << indent() << "if (ftype == ::apache::thrift::protocol::T_STOP) {" << endl << indent()
-      << "  break;" << endl << indent() << "}" << endl;
+  indent(out) << "while (ftype != ::apache::thrift::protocol::T_STOP)" << endl;
+  scope_up(out);
 
   if (fields.empty()) {
     out << indent() << "xfer += iprot->skip(ftype);" << endl;
   } else {
+    // Writers send fields in id order, so after reading one field we check
+    // for its successor and jump straight to it, which is a well predicted
+    // branch, rather than going through the switch every time.
+    const vector<t_field*>& sorted = tstruct->get_sorted_members();
+    std::map<t_field*, t_field*> successor;
+    for (size_t i = 0; i + 1 < sorted.size(); ++i) {
+      successor[sorted[i]] = sorted[i + 1];
+    }
+
     // Switch statement on the field we are reading
     indent(out) << "switch (fid)" << endl;
 
@@ -1456,6 +1552,9 @@ void t_cpp_generator::generate_struct_reader(ostream& out, t_struct* tstruct, bo
     // Generate deserialization code for known cases
     for (f_iter = fields.begin(); f_iter != fields.end(); ++f_iter) {
       indent(out) << "case " << (*f_iter)->get_key() << ":" << endl;
+      if (*f_iter != sorted.front()) {
+        indent(out) << "read_" << (*f_iter)->get_name() << ":" << endl;
+      }
       indent_up();
       indent(out) << "if (ftype == " << type_to_enum((*f_iter)->get_type()) << ") {" << endl;
       indent_up();
@@ -1485,7 +1584,20 @@ void t_cpp_generator::generate_struct_reader(ostream& out, t_struct* tstruct, bo
           // TODO(dreiss): Make this an option when thrift structs
           // have a common base class.
           // indent() << "  throw TProtocolException(TProtocolException::INVALID_DATA);" << endl <<
-          indent() << "}" << endl << indent() << "break;" << endl;
+          indent() << "}" << endl;
+
+      std::map<t_field*, t_field*>::const_iterator next = successor.find(*f_iter);
+      if (next == successor.end()) {
+        indent(out) << "break;" << endl;
+      } else {
+        out << indent() << "xfer += iprot->readFieldEnd();" << endl
+            << indent() << "xfer += iprot->readFieldBegin(fname, ftype, fid);" << endl
+            << indent() << "if (fid == " << next->second->get_key()
+            << " && ftype != ::apache::thrift::protocol::T_STOP) {" << endl
+            << indent() << "  goto read_" << next->second->get_name() << ";" << endl
+            << indent() << "}" << endl
+            << indent() << "continue;" << endl;
+      }
       indent_down();
     }
 
@@ -1497,6 +1609,7 @@ void t_cpp_generator::generate_struct_reader(ostream& out, t_struct* tstruct, bo
   } //!fields.empty()
   // Read field end marker
   indent(out) << "xfer += iprot->readFieldEnd();" << endl;
+  indent(out) << "xfer += iprot->readFieldBegin(fname, ftype, fid);" << endl;
 
   scope_down(out);
 
@@ -1709,6 +1822,59 @@ void t_cpp_generator::generate_struct_swap(ostream& out, t_struct* tstruct) {
   out << endl;
 }
 
+/**
+ * Generates __clear(), which puts a struct back into its default constructed
+ * state while keeping the memory of its strings and containers.
+ */
+void t_cpp_generator::generate_struct_clear(ostream& out, t_struct* tstruct) {
+  out << indent() << "void " << tstruct->get_name() << "::__clear() {" << endl;
+  indent_up();
+
+  const vector<t_field*>& fields = tstruct->get_members();
+  bool has_nonrequired_fields = false;
+  bool has_complex_default = false;
+  for (auto tfield : fields) {
+    if (tfield->get_req() != t_field::T_REQUIRED) {
+      has_nonrequired_fields = true;
+    }
+    t_type* t = get_true_type(tfield->get_type());
+    if (tfield->get_value() != nullptr
+        && (is_reference(tfield) || !(t->is_base_type() || t->is_enum()))) {
+      has_complex_default = true;
+    }
+  }
+
+  if (has_complex_default) {
+    // Rare enough not to be worth rebuilding the default value in place.
+    out << indent() << "*this = " << tstruct->get_name() << "();" << endl;
+  } else {
+    for (auto tfield : fields) {
+      t_type* t = get_true_type(tfield->get_type());
+      t_const_value* cv = tfield->get_value();
+      string name = tfield->get_name();
+      if (is_reference(tfield)) {
+        out << indent() << name << ".reset();" << endl;
+      } else if (t->is_struct() || t->is_xception()) {
+        out << indent() << name << ".__clear();" << endl;
+      } else if (t->is_container() || (t->is_string() && cv == nullptr)) {
+        out << indent() << name << ".clear();" << endl;
+      } else if (cv != nullptr) {
+        out << indent() << name << " = " << render_const_value(out, name, t, cv) << ";" << endl;
+      } else if (t->is_enum()) {
+        out << indent() << name << " = static_cast<" << type_name(t) << ">(0);" << endl;
+      } else {
+        out << indent() << name << " = 0;" << endl;
+      }
+    }
+    if (has_nonrequired_fields) {
+      out << indent() << "__isset = _" << tstruct->get_name() << "__isset();" << endl;
+    }
+  }
+
+  scope_down(out);
+  out << endl;
+}
+
 void t_cpp_generator::generate_struct_ostream_operator_decl(std::ostream& out, t_struct* tstruct) {
   out << "std::ostream& operator<<(std::ostream& out, const "
       << tstruct->get_name()
@@ -1872,6 +2038,9 @@ void t_cpp_generator::generate_service(t_service* tservice) {
               << "class TAsyncChannel;" << endl << "}}}" << endl;
   }
   f_header_ << "#include <thrift/TDispatchProcessor.h>" << endl;
+  if (gen_pooled_args_) {
+    f_header_ << "#include <thrift/TPooled.h>" << endl;
+  }
   if (gen_cob_style_) {
     f_header_ << "#include <thrift/async/TAsyncDispatchProcessor.h>" << endl;
   }
@@ -1998,6 +2167,9 @@ void t_cpp_generator::generate_service_helpers(t_service* tservice) {
     generate_struct_definition(out, f_service_, ts, false);
     generate_struct_reader(out, ts);
     generate_struct_writer(out, ts);
+    if (gen_pooled_args_) {
+      generate_struct_clear(f_service_, ts);
+    }
     ts->set_name(tservice->get_name() + "_" + (*f_iter)->get_name() + "_pargs");
     generate_struct_declaration(f_header_, ts, false, true, false, true);
     generate_struct_definition(out, f_service_, ts, false);
@@ -3012,6 +3184,54 @@ void t_cpp_generator::generate_service_client(t_service* tservice, string style)
   }
 }
 
+/**
+ * Must match apache::thrift::detail::hashMethodName() in
+ * lib/cpp/src/thrift/TDispatchProcessor.h.
+ */
+static uint32_t hash_method_name(const string& name, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (string::const_iterator it = name.begin(); it != name.end(); ++it) {
+    hash = (hash ^ static_cast<uint8_t>(*it)) * 16777619u;
+  }
+  return hash ^ (hash >> 16);
+}
+
+/**
+ * Spreads the functions over a power of two number of hash buckets, trying
+ * a few seeds to get as few names as possible sharing a bucket.
+ */
+static vector<vector<t_function*> > hash_method_names(const vector<t_function*>& functions,
+                                                      uint32_t& seed) {
+  size_t size = 2;
+  while (size < 2 * functions.size()) {
+    size *= 2;
+  }
+
+  vector<vector<t_function*> > best;
+  size_t best_collisions = 0;
+  for (uint32_t candidate = 0; candidate < 64; ++candidate) {
+    vector<vector<t_function*> > buckets(size);
+    size_t collisions = 0;
+    for (vector<t_function*>::const_iterator f_iter = functions.begin();
+         f_iter != functions.end();
+         ++f_iter) {
+      vector<t_function*>& bucket
+          = buckets[hash_method_name((*f_iter)->get_name(), candidate) & (size - 1)];
+      collisions += bucket.size();
+      bucket.push_back(*f_iter);
+    }
+    if (best.empty() || collisions < best_collisions) {
+      best.swap(buckets);
+      best_collisions = collisions;
+      seed = candidate;
+      if (collisions == 0) {
+        break;
+      }
+    }
+  }
+  return best;
+}
+
 class ProcessorGenerator {
 public:
   ProcessorGenerator(t_cpp_generator* generator, t_service* service, const string& style);
@@ -3066,7 +3286,6 @@ protected:
   string call_context_decl_;
   string template_header_;
   string template_suffix_;
-  string typename_str_;
   string class_suffix_;
   string extends_;
 };
@@ -3105,7 +3324,6 @@ ProcessorGenerator::ProcessorGenerator(t_cpp_generator* generator,
   if (generator->gen_templates_) {
     template_header_ = "template <class Protocol_>\n";
     template_suffix_ = "<Protocol_>";
-    typename_str_ = "typename ";
     class_name_ += "T";
     factory_class_name_ += "T";
   }
@@ -3164,30 +3382,6 @@ void ProcessorGenerator::generate_class_definition() {
   f_header_ << " private:" << endl;
   indent_up();
 
-  // Declare processMap_
-  f_header_ << indent() << "typedef  void (" << class_name_ << "::*"
-            << "ProcessFunction)(" << finish_cob_decl_ << "int32_t, "
-            << "::apache::thrift::protocol::TProtocol*, "
-            << "::apache::thrift::protocol::TProtocol*" << call_context_decl_ << ");" << endl;
-  if (generator_->gen_templates_) {
-    f_header_ << indent() << "typedef void (" << class_name_ << "::*"
-              << "SpecializedProcessFunction)(" << finish_cob_decl_ << "int32_t, "
-              << "Protocol_*, Protocol_*" << call_context_decl_ << ");" << endl << indent()
-              << "struct ProcessFunctions {" << endl << indent() << "  ProcessFunction generic;"
-              << endl << indent() << "  SpecializedProcessFunction specialized;" << endl << indent()
-              << "  ProcessFunctions(ProcessFunction g, "
-              << "SpecializedProcessFunction s) :" << endl << indent() << "    generic(g)," << endl
-              << indent() << "    specialized(s) {}" << endl << indent()
-              << "  ProcessFunctions() : generic(nullptr), specialized(nullptr) "
-              << "{}" << endl << indent() << "};" << endl << indent()
-              << "typedef std::map<std::string, ProcessFunctions> "
-              << "ProcessMap;" << endl;
-  } else {
-    f_header_ << indent() << "typedef std::map<std::string, ProcessFunction> "
-              << "ProcessMap;" << endl;
-  }
-  f_header_ << indent() << "ProcessMap processMap_;" << endl;
-
   for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
     indent(f_header_) << "void process_" << (*f_iter)->get_name() << "(" << finish_cob_
                       << "int32_t seqid, ::apache::thrift::protocol::TProtocol* iprot, "
@@ -3232,26 +3426,6 @@ void ProcessorGenerator::generate_class_definition() {
     f_header_ << indent() << "  " << extends_ << "(iface)," << endl;
   }
   f_header_ << indent() << "  iface_(iface) {" << endl;
-  indent_up();
-
-  for (f_iter = functions.begin(); f_iter != functions.end(); ++f_iter) {
-    f_header_ << indent() << "processMap_[\"" << (*f_iter)->get_name() << "\"] = ";
-    if (generator_->gen_templates_) {
-      f_header_ << "ProcessFunctions(" << endl;
-      if (generator_->gen_templates_only_) {
-        indent(f_header_) << "  nullptr," << endl;
-      } else {
-        indent(f_header_) << "  &" << class_name_ << "::process_" << (*f_iter)->get_name() << ","
-                          << endl;
-      }
-      indent(f_header_) << "  &" << class_name_ << "::process_" << (*f_iter)->get_name() << ")";
-    } else {
-      f_header_ << "&" << class_name_ << "::process_" << (*f_iter)->get_name();
-    }
-    f_header_ << ";" << endl;
-  }
-
-  indent_down();
   f_header_ << indent() << "}" << endl << endl << indent() << "virtual ~" << class_name_ << "() {}"
             << endl;
   indent_down();
@@ -3293,50 +3467,50 @@ void ProcessorGenerator::generate_dispatch_call(bool template_protocol) {
          << "const std::string& fname, int32_t seqid" << call_context_ << ") {" << endl;
   indent_up();
 
-  // HOT: member function pointer map
-  f_out_ << indent() << typename_str_ << "ProcessMap::iterator pfn;" << endl << indent()
-         << "pfn = processMap_.find(fname);" << endl << indent()
-         << "if (pfn == processMap_.end()) {" << endl;
+  // HOT: switch over a hash of the method name
+  vector<t_function*> functions = service_->get_functions();
+  if (!functions.empty()) {
+    uint32_t seed;
+    vector<vector<t_function*> > buckets = hash_method_names(functions, seed);
+    f_out_ << indent() << "switch (::apache::thrift::detail::hashMethodName(fname, " << seed
+           << "u) & " << (buckets.size() - 1) << ") {" << endl;
+    for (size_t i = 0; i < buckets.size(); ++i) {
+      if (buckets[i].empty()) {
+        continue;
+      }
+      f_out_ << indent() << "case " << i << ":" << endl;
+      indent_up();
+      for (vector<t_function*>::iterator b_iter = buckets[i].begin(); b_iter != buckets[i].end();
+           ++b_iter) {
+        f_out_ << indent() << "if (fname == \"" << (*b_iter)->get_name() << "\") {" << endl
+               << indent() << "  process_" << (*b_iter)->get_name() << "(" << cob_arg_
+               << "seqid, iprot, oprot" << call_context_arg_ << ");" << endl
+               << indent() << (style_ == "Cob" ? "  return;" : "  return true;") << endl
+               << indent() << "}" << endl;
+      }
+      f_out_ << indent() << "break;" << endl;
+      indent_down();
+    }
+    f_out_ << indent() << "}" << endl;
+  }
   if (extends_.empty()) {
-    f_out_ << indent() << "  iprot->skip(::apache::thrift::protocol::T_STRUCT);" << endl << indent()
-           << "  iprot->readMessageEnd();" << endl << indent()
-           << "  iprot->getTransport()->readEnd();" << endl << indent()
-           << "  ::apache::thrift::TApplicationException "
+    f_out_ << indent() << "iprot->skip(::apache::thrift::protocol::T_STRUCT);" << endl << indent()
+           << "iprot->readMessageEnd();" << endl << indent()
+           << "iprot->getTransport()->readEnd();" << endl << indent()
+           << "::apache::thrift::TApplicationException "
               "x(::apache::thrift::TApplicationException::UNKNOWN_METHOD, \"Invalid method name: "
               "'\"+fname+\"'\");" << endl << indent()
-           << "  oprot->writeMessageBegin(fname, ::apache::thrift::protocol::T_EXCEPTION, seqid);"
-           << endl << indent() << "  x.write(oprot);" << endl << indent()
-           << "  oprot->writeMessageEnd();" << endl << indent()
-           << "  oprot->getTransport()->writeEnd();" << endl << indent()
-           << "  oprot->getTransport()->flush();" << endl << indent()
-           << (style_ == "Cob" ? "  return cob(true);" : "  return true;") << endl;
+           << "oprot->writeMessageBegin(fname, ::apache::thrift::protocol::T_EXCEPTION, seqid);"
+           << endl << indent() << "x.write(oprot);" << endl << indent()
+           << "oprot->writeMessageEnd();" << endl << indent()
+           << "oprot->getTransport()->writeEnd();" << endl << indent()
+           << "oprot->getTransport()->flush();" << endl << indent()
+           << (style_ == "Cob" ? "return cob(true);" : "return true;") << endl;
   } else {
-    f_out_ << indent() << "  return " << extends_ << "::dispatchCall("
+    f_out_ << indent() << "return " << extends_ << "::dispatchCall("
            << (style_ == "Cob" ? "cob, " : "") << "iprot, oprot, fname, seqid" << call_context_arg_
            << ");" << endl;
   }
-  f_out_ << indent() << "}" << endl;
-  if (template_protocol) {
-    f_out_ << indent() << "(this->*(pfn->second.specialized))";
-  } else {
-    if (generator_->gen_templates_only_) {
-      // TODO: This is a null pointer, so nothing good will come from calling
-      // it.  Throw an exception instead.
-      f_out_ << indent() << "(this->*(pfn->second.generic))";
-    } else if (generator_->gen_templates_) {
-      f_out_ << indent() << "(this->*(pfn->second.generic))";
-    } else {
-      f_out_ << indent() << "(this->*(pfn->second))";
-    }
-  }
-  f_out_ << "(" << cob_arg_ << "seqid, iprot, oprot" << call_context_arg_ << ");" << endl;
-
-  // TODO(dreiss): return pfn ret?
-  if (style_ == "Cob") {
-    f_out_ << indent() << "return;" << endl;
-  } else {
-    f_out_ << indent() << "return true;" << endl;
-  }
 
   indent_down();
   f_out_ << "}" << endl << endl;
@@ -3445,6 +3619,9 @@ void t_cpp_generator::generate_function_helpers(t_service* tservice, t_function*
   generate_struct_definition(out, f_service_, &result, false);
   generate_struct_reader(out, &result);
   generate_struct_result_writer(out, &result);
+  if (gen_pooled_args_) {
+    generate_struct_clear(f_service_, &result);
+  }
 
   result.set_name(tservice->get_name() + "_" + tfunction->get_name() + "_presult");
   generate_struct_declaration(f_header_, &result, false, true, true, gen_cob_style_);
@@ -3502,6 +3679,11 @@ void t_cpp_generator::generate_process_function(t_service* tservice,
       out << indent() << "(void) seqid;" << endl << indent() << "(void) oprot;" << endl;
     }
 
+    if (gen_arena_) {
+      out << indent() << "// args and result are released with the arena when the call is done"
+          << endl << indent() << "::apache::thrift::TArenaScope arenaScope;" << endl << endl;
+    }
+
     out << indent() << "void* ctx = nullptr;" << endl << indent()
         << "if (this->eventHandler_.get() != nullptr) {" << endl << indent()
         << "  ctx = this->eventHandler_->getContext(" << service_func_name << ", callContext);"
@@ -3510,8 +3692,14 @@ void t_cpp_generator::generate_process_function(t_service* tservice,
         << "this->eventHandler_.get(), ctx, " << service_func_name << ");" << endl << endl
         << indent() << "if (this->eventHandler_.get() != nullptr) {" << endl << indent()
         << "  this->eventHandler_->preRead(ctx, " << service_func_name << ");" << endl << indent()
-        << "}" << endl << endl << indent() << argsname << " args;" << endl << indent()
-        << "args.read(iprot);" << endl << indent() << "iprot->readMessageEnd();" << endl << indent()
+        << "}" << endl << endl;
+    if (gen_pooled_args_) {
+      out << indent() << "::apache::thrift::TPooled<" << argsname << " > pooledArgs;" << endl
+          << indent() << argsname << "& args = *pooledArgs;" << endl;
+    } else {
+      out << indent() << argsname << " args;" << endl;
+    }
+    out << indent() << "args.read(iprot);" << endl << indent() << "iprot->readMessageEnd();" << endl << indent()
         << "uint32_t bytes = iprot->getTransport()->readEnd();" << endl << endl << indent()
         << "if (this->eventHandler_.get() != nullptr) {" << endl << indent()
         << "  this->eventHandler_->postRead(ctx, " << service_func_name << ", bytes);" << endl
@@ -3519,7 +3707,12 @@ void t_cpp_generator::generate_process_function(t_service* tservice,
 
     // Declare result
     if (!tfunction->is_oneway()) {
-      out << indent() << resultname << " result;" << endl;
+      if (gen_pooled_args_) {
+        out << indent() << "::apache::thrift::TPooled<" << resultname << " > pooledResult;" << endl
+            << indent() << resultname << "& result = *pooledResult;" << endl;
+      } else {
+        out << indent() << resultname << " result;" << endl;
+      }
     }
 
     // Try block for functions with exceptions
@@ -3963,6 +4156,10 @@ void t_cpp_generator::generate_deserialize_field(ostream& out,
     generate_deserialize_struct(out, (t_struct*)type, name, is_reference(tfield));
   } else if (type->is_container()) {
     generate_deserialize_container(out, type, name);
+  } else if (is_arena_string(type)) {
+    indent(out) << "xfer += ::apache::thrift::"
+                << (type->is_binary() ? "readArenaBinary" : "readArenaString") << "(iprot, "
+                << name << ");" << endl;
   } else if (type->is_base_type()) {
     indent(out) << "xfer += iprot->";
     t_base_type::t_base tbase = ((t_base_type*)type)->get_base();
@@ -3972,9 +4169,9 @@ void t_cpp_generator::generate_deserialize_field(ostream& out,
       break;
     case t_base_type::TYPE_STRING:
       if (type->is_binary()) {
-        out << "readBinary(" << name << ");";
+        out << (is_slice(type) ? "readBinarySlice(" : "readBinary(") << name << ");";
       } else {
-        out << "readString(" << name << ");";
+        out << (is_slice(type) ? "readStringSlice(" : "readString(") << name << ");";
       }
       break;
     case t_base_type::TYPE_BOOL:
@@ -4070,22 +4267,46 @@ void t_cpp_generator::generate_deserialize_container(ostream& out, t_type* ttype
     }
   }
 
-  // For loop iterates over elements
-  string i = tmp("_i");
-  out << indent() << "uint32_t " << i << ";" << endl << indent() << "for (" << i << " = 0; " << i
-      << " < " << size << "; ++" << i << ")" << endl;
+  string bulk_array;
+  if (ttype->is_list() && !use_push) {
+    bulk_array = bulk_array_method(((t_list*)ttype)->get_elem_type());
+  } else if (ttype->is_set() && !use_push) {
+    bulk_array = bulk_array_method(((t_set*)ttype)->get_elem_type());
+  }
 
-  scope_up(out);
+  if (!bulk_array.empty()) {
+    // Runs of fixed width values are decoded in one call rather than
+    // element by element
+    if (ttype->is_list()) {
+      indent(out) << "xfer += iprot->read" << bulk_array << "(" << prefix << ".data(), " << size
+                  << ");" << endl;
+    } else {
+      string elems = tmp("_elems");
+      t_type* elem_type = ((t_set*)ttype)->get_elem_type();
+      indent(out) << "std::vector<" << type_name(elem_type) << " > " << elems << "(" << size
+                  << ");" << endl;
+      indent(out) << "xfer += iprot->read" << bulk_array << "(" << elems << ".data(), " << size
+                  << ");" << endl;
+      indent(out) << prefix << ".insert(" << elems << ".begin(), " << elems << ".end());" << endl;
+    }
+  } else {
+    // For loop iterates over elements
+    string i = tmp("_i");
+    out << indent() << "uint32_t " << i << ";" << endl << indent() << "for (" << i << " = 0; "
+        << i << " < " << size << "; ++" << i << ")" << endl;
 
-  if (ttype->is_map()) {
-    generate_deserialize_map_element(out, (t_map*)ttype, prefix);
-  } else if (ttype->is_set()) {
-    generate_deserialize_set_element(out, (t_set*)ttype, prefix);
-  } else if (ttype->is_list()) {
-    generate_deserialize_list_element(out, (t_list*)ttype, prefix, use_push, i);
-  }
+    scope_up(out);
 
-  scope_down(out);
+    if (ttype->is_map()) {
+      generate_deserialize_map_element(out, (t_map*)ttype, prefix);
+    } else if (ttype->is_set()) {
+      generate_deserialize_set_element(out, (t_set*)ttype, prefix);
+    } else if (ttype->is_list()) {
+      generate_deserialize_list_element(out, (t_list*)ttype, prefix, use_push, i);
+    }
+
+    scope_down(out);
+  }
 
   // Read container end
   if (ttype->is_map()) {
@@ -4139,6 +4360,13 @@ void t_cpp_generator::generate_deserialize_list_element(ostream& out,
     indent(out) << declare_field(&felem) << endl;
     generate_deserialize_field(out, &felem);
     indent(out) << prefix << ".push_back(" << elem << ");" << endl;
+  } else if (gen_arena_ && get_true_type(tlist->get_elem_type())->is_bool()) {
+    // readBool() only takes references into a std::vector<bool>
+    string elem = tmp("_elem");
+    t_field felem(tlist->get_elem_type(), elem);
+    indent(out) << declare_field(&felem) << endl;
+    generate_deserialize_field(out, &felem);
+    indent(out) << prefix << "[" << index << "] = " << elem << ";" << endl;
   } else {
     t_field felem(tlist->get_elem_type(), prefix + "[" + index + "]");
     generate_deserialize_field(out, &felem);
@@ -4168,6 +4396,10 @@ void t_cpp_generator::generate_serialize_field(ostream& out,
     generate_serialize_struct(out, (t_struct*)type, name, is_reference(tfield));
   } else if (type->is_container()) {
     generate_serialize_container(out, type, name);
+  } else if (is_arena_string(type)) {
+    indent(out) << "xfer += ::apache::thrift::"
+                << (type->is_binary() ? "writeArenaBinary" : "writeArenaString") << "(oprot, "
+                << name << ");" << endl;
   } else if (type->is_base_type() || type->is_enum()) {
 
     indent(out) << "xfer += oprot->";
@@ -4180,9 +4412,9 @@ void t_cpp_generator::generate_serialize_field(ostream& out,
         break;
       case t_base_type::TYPE_STRING:
         if (type->is_binary()) {
-          out << "writeBinary(" << name << ");";
+          out << (is_slice(type) ? "writeBinarySlice(" : "writeBinary(") << name << ");";
         } else {
-          out << "writeString(" << name << ");";
+          out << (is_slice(type) ? "writeStringSlice(" : "writeString(") << name << ");";
         }
         break;
       case t_base_type::TYPE_BOOL:
@@ -4258,19 +4490,30 @@ void t_cpp_generator::generate_serialize_container(ostream& out, t_type* ttype,
                 << "static_cast<uint32_t>(" << prefix << ".size()));" << endl;
   }
 
-  string iter = tmp("_iter");
-  out << indent() << type_name(ttype) << "::const_iterator " << iter << ";" << endl << indent()
-      << "for (" << iter << " = " << prefix << ".begin(); " << iter << " != " << prefix
-      << ".end(); ++" << iter << ")" << endl;
-  scope_up(out);
-  if (ttype->is_map()) {
-    generate_serialize_map_element(out, (t_map*)ttype, iter);
-  } else if (ttype->is_set()) {
-    generate_serialize_set_element(out, (t_set*)ttype, iter);
-  } else if (ttype->is_list()) {
-    generate_serialize_list_element(out, (t_list*)ttype, iter);
+  string bulk_array;
+  if (ttype->is_list() && !((t_container*)ttype)->has_cpp_name()) {
+    bulk_array = bulk_array_method(((t_list*)ttype)->get_elem_type());
+  }
+
+  if (!bulk_array.empty()) {
+    // std::vector is contiguous, so the elements go out in one call
+    indent(out) << "xfer += oprot->write" << bulk_array << "(" << prefix << ".data(), "
+                << "static_cast<uint32_t>(" << prefix << ".size()));" << endl;
+  } else {
+    string iter = tmp("_iter");
+    out << indent() << type_name(ttype) << "::const_iterator " << iter << ";" << endl << indent()
+        << "for (" << iter << " = " << prefix << ".begin(); " << iter << " != " << prefix
+        << ".end(); ++" << iter << ")" << endl;
+    scope_up(out);
+    if (ttype->is_map()) {
+      generate_serialize_map_element(out, (t_map*)ttype, iter);
+    } else if (ttype->is_set()) {
+      generate_serialize_set_element(out, (t_set*)ttype, iter);
+    } else if (ttype->is_list()) {
+      generate_serialize_list_element(out, (t_list*)ttype, iter);
+    }
+    scope_down(out);
   }
-  scope_down(out);
 
   if (ttype->is_map()) {
     indent(out) << "xfer += oprot->writeMapEnd();" << endl;
@@ -4400,6 +4643,10 @@ string t_cpp_generator::type_name(t_type* ttype, bool in_typedef, bool arg) {
     std::map<string, string>::iterator it = ttype->annotations_.find("cpp.type");
     if (it != ttype->annotations_.end()) {
       bname = it->second;
+    } else if (is_slice(ttype)) {
+      bname = "::apache::thrift::TSlice";
+    } else if (is_arena_string(ttype)) {
+      bname = "::apache::thrift::TArenaString";
     }
 
     if (!arg) {
@@ -4418,18 +4665,22 @@ string t_cpp_generator::type_name(t_type* ttype, bool in_typedef, bool arg) {
     string cname;
 
     t_container* tcontainer = (t_container*)ttype;
+    string container_prefix = gen_arena_ ? "::apache::thrift::TArena" : "std::";
     if (tcontainer->has_cpp_name()) {
       cname = tcontainer->get_cpp_name();
     } else if (ttype->is_map()) {
       t_map* tmap = (t_map*)ttype;
-      cname = "std::map<" + type_name(tmap->get_key_type(), in_typedef) + ", "
+      cname = container_prefix + (gen_arena_ ? "Map<" : "map<")
+              + type_name(tmap->get_key_type(), in_typedef) + ", "
               + type_name(tmap->get_val_type(), in_typedef) + "> ";
     } else if (ttype->is_set()) {
       t_set* tset = (t_set*)ttype;
-      cname = "std::set<" + type_name(tset->get_elem_type(), in_typedef) + "> ";
+      cname = container_prefix + (gen_arena_ ? "Set<" : "set<")
+              + type_name(tset->get_elem_type(), in_typedef) + "> ";
     } else if (ttype->is_list()) {
       t_list* tlist = (t_list*)ttype;
-      cname = "std::vector<" + type_name(tlist->get_elem_type(), in_typedef) + "> ";
+      cname = container_prefix + (gen_arena_ ? "Vector<" : "vector<")
+              + type_name(tlist->get_elem_type(), in_typedef) + "> ";
     }
 
     if (arg) {
@@ -4762,4 +5013,11 @@ THRIFT_REGISTER_GENERATOR(
     "    moveable_types:  Generate move constructors and assignment operators.\n"
     "    no_ostream_operators:\n"
     "                     Omit generation of ostream definitions.\n"
-    "    no_skeleton:     Omits generation of skeleton.\n")
+    "    no_skeleton:     Omits generation of skeleton.\n"
+    "    slices[=binary]: Read string and binary fields (or only binary ones) as\n"
+    "                     reference counted slices of the receive buffer.\n"
+    "    arena:           Allocate strings and containers from a per-request arena\n"
+    "                     that processors release in one go after each call.\n"
+    "    pooled_args:     Processors reuse per-thread args and result structs, cleared\n"
+    "                     between calls but keeping the capacity of their strings\n"
+    "                     and containers.\n")
@@ -0,0 +1,167 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/TArena.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace apache {
+namespace thrift {
+
+namespace {
+
+// Blocks never grow beyond this, larger allocations get a block of their own.
+const size_t MAX_BLOCK_SIZE = 1024 * 1024;
+
+// The scratch string is freed after reading a value larger than this.
+const size_t MAX_SCRATCH_SIZE = 1024 * 1024;
+
+thread_local TArena* currentArena = nullptr;
+
+// How many default TArenaScopes are open on this thread.
+thread_local unsigned requestDepth = 0;
+
+TArena& requestArena() {
+  static thread_local TArena arena;
+  return arena;
+}
+}
+
+TArena::TArena(size_t blockSize, size_t maxRetained)
+  : blocks_(nullptr),
+    pos_(nullptr),
+    end_(nullptr),
+    last_(nullptr),
+    firstBlockSize_(blockSize),
+    nextBlockSize_(blockSize),
+    maxRetained_(maxRetained),
+    allocated_(0) {
+}
+
+TArena::~TArena() {
+  while (blocks_ != nullptr) {
+    Block* next = blocks_->next;
+    std::free(blocks_);
+    blocks_ = next;
+  }
+}
+
+TArena::Block* TArena::newBlock(size_t size) {
+  void* mem = std::malloc(sizeof(Block) + size);
+  if (mem == nullptr) {
+    throw std::bad_alloc();
+  }
+  auto* block = static_cast<Block*>(mem);
+  block->next = blocks_;
+  block->size = size;
+  blocks_ = block;
+  pos_ = reinterpret_cast<char*>(block + 1);
+  end_ = pos_ + size;
+  return block;
+}
+
+void* TArena::allocateSlow(size_t size, size_t alignment) {
+  if (size > static_cast<size_t>(-1) - sizeof(Block) - alignment) {
+    throw std::bad_alloc();
+  }
+  size_t needed = size + alignment;
+  if (needed > nextBlockSize_) {
+    // Oversized values get a block of their own.  The block being filled
+    // stays current only if it is still the head of the list, so put the
+    // dedicated block behind it.
+    Block* current = blocks_;
+    char* pos = pos_;
+    char* end = end_;
+    newBlock(needed);
+    void* result = allocate(size, alignment);
+    if (current != nullptr) {
+      Block* big = blocks_;
+      blocks_ = current;
+      big->next = current->next;
+      current->next = big;
+      pos_ = pos;
+      end_ = end;
+      last_ = nullptr;
+    }
+    return result;
+  }
+  newBlock(nextBlockSize_);
+  nextBlockSize_ = (std::min)(nextBlockSize_ * 2, MAX_BLOCK_SIZE);
+  return allocate(size, alignment);
+}
+
+void TArena::reset() {
+  if (blocks_ != nullptr && (blocks_->next != nullptr || blocks_->size > maxRetained_)) {
+    // Replace all blocks with a single one big enough for the whole
+    // request, so the next one of the same size does not allocate.
+    size_t total = 0;
+    while (blocks_ != nullptr) {
+      Block* next = blocks_->next;
+      total += blocks_->size;
+      std::free(blocks_);
+      blocks_ = next;
+    }
+    pos_ = end_ = nullptr;
+    total = (std::min)(total, maxRetained_);
+    if (total >= firstBlockSize_) {
+      newBlock(total);
+    }
+    nextBlockSize_ = (std::max)(firstBlockSize_, (std::min)(total, MAX_BLOCK_SIZE));
+  } else if (blocks_ != nullptr) {
+    pos_ = reinterpret_cast<char*>(blocks_ + 1);
+    end_ = pos_ + blocks_->size;
+  }
+  last_ = nullptr;
+  allocated_ = 0;
+}
+
+TArena* TArena::current() {
+  return currentArena;
+}
+
+std::string& TArena::scratchString() {
+  static thread_local std::string scratch;
+  return scratch;
+}
+
+void TArena::trimScratchString() {
+  std::string& scratch = scratchString();
+  if (scratch.capacity() > MAX_SCRATCH_SIZE) {
+    std::string().swap(scratch);
+  }
+}
+
+TArenaScope::TArenaScope() : previous_(currentArena), request_(true) {
+  ++requestDepth;
+  currentArena = &requestArena();
+}
+
+TArenaScope::TArenaScope(TArena* arena) : previous_(currentArena), request_(false) {
+  currentArena = arena;
+}
+
+TArenaScope::~TArenaScope() {
+  currentArena = previous_;
+  if (request_ && --requestDepth == 0) {
+    requestArena().reset();
+  }
+}
+}
+} // apache::thrift
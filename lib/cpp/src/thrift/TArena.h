@@ -0,0 +1,275 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TARENA_H_
+#define _THRIFT_TARENA_H_ 1
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <new>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <thrift/TNonCopyable.h>
+#include <thrift/TSlice.h>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * A bump pointer allocator for objects that all die at the same time.
+ *
+ * Memory is carved out of a list of blocks and only given back all at once,
+ * by reset() or the destructor.  The only exception is the most recent
+ * allocation, which deallocate() hands back if nothing was allocated after
+ * it.  A growing container allocates its new buffer before it frees the old
+ * one, so each buffer it outgrows stays in the arena until reset() or the
+ * destructor; reserving the final size up front avoids that.
+ *
+ * Code generated with the cpp:arena option allocates the strings and
+ * containers of structs read by a processor from a per thread arena that is
+ * reset when the call completes (see TArenaScope), so a request costs a
+ * handful of block allocations rather than one malloc per field.
+ *
+ * Not thread safe; each thread uses its own arena.
+ */
+class TArena : TNonCopyable {
+public:
+  /**
+   * @param blockSize      size of the first block, later ones grow from it
+   * @param maxRetained    reset() keeps up to this much memory around for
+   *                       reuse, so steady state requests do not allocate
+   */
+  explicit TArena(size_t blockSize = 4096, size_t maxRetained = 1024 * 1024);
+
+  ~TArena();
+
+  void* allocate(size_t size, size_t alignment = alignof(std::max_align_t)) {
+    auto addr = reinterpret_cast<uintptr_t>(pos_);
+    uintptr_t aligned = (addr + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+    if (pos_ != nullptr && aligned <= reinterpret_cast<uintptr_t>(end_)
+        && size <= reinterpret_cast<uintptr_t>(end_) - aligned) {
+      char* result = reinterpret_cast<char*>(aligned);
+      pos_ = result + size;
+      last_ = result;
+      allocated_ += size;
+      return result;
+    }
+    return allocateSlow(size, alignment);
+  }
+
+  /**
+   * Gives the memory back if it was the last allocation.  Otherwise it is
+   * only reclaimed by reset().
+   */
+  void deallocate(void* ptr, size_t size) {
+    if (ptr == last_ && static_cast<char*>(ptr) + size == pos_) {
+      pos_ = static_cast<char*>(ptr);
+      last_ = nullptr;
+      allocated_ -= size;
+    }
+  }
+
+  /**
+   * Releases everything allocated so far.  Objects living in the arena must
+   * have been destroyed before.
+   */
+  void reset();
+
+  /**
+   * Bytes handed out since the last reset().
+   */
+  size_t bytesAllocated() const { return allocated_; }
+
+  /**
+   * The arena TArenaAllocator draws from on this thread, or nullptr for
+   * the global heap.
+   */
+  static TArena* current();
+
+  /**
+   * Scratch space for reading strings before copying them into the arena.
+   * It keeps its capacity, so reads do not allocate in the steady state.
+   */
+  static std::string& scratchString();
+
+  /**
+   * Frees the scratch string if a large value made it grow.
+   */
+  static void trimScratchString();
+
+private:
+  struct Block {
+    Block* next;
+    size_t size;
+  };
+
+  void* allocateSlow(size_t size, size_t alignment);
+  Block* newBlock(size_t size);
+
+  Block* blocks_;
+  char* pos_;
+  char* end_;
+  void* last_;
+  size_t firstBlockSize_;
+  size_t nextBlockSize_;
+  size_t maxRetained_;
+  size_t allocated_;
+};
+
+/**
+ * Installs an arena for TArenaAllocator on the current thread for the
+ * lifetime of the scope.
+ *
+ * The default constructor uses a per thread request arena, which is reset
+ * when the outermost such scope ends.  Generated processors open one around
+ * each call, so the args and result structs are released in one go.
+ *
+ * Objects of arena backed types built inside the scope must not outlive it.
+ * Copies are safe: a copy constructed container uses whatever arena is
+ * current at that point, so a handler that keeps data beyond the call
+ * should copy it inside a TArenaScope(nullptr), which selects the global
+ * heap.  Swapping with an arena backed object moves its memory along with
+ * it, so swap cannot be used for that.
+ */
+class TArenaScope : TNonCopyable {
+public:
+  TArenaScope();
+
+  explicit TArenaScope(TArena* arena);
+
+  ~TArenaScope();
+
+private:
+  TArena* previous_;
+  bool request_;
+};
+
+/**
+ * A standard library allocator that draws from the arena that was current
+ * when it was created, or from the global heap if there was none.
+ */
+template <typename T>
+class TArenaAllocator {
+public:
+  typedef T value_type;
+  typedef std::false_type propagate_on_container_copy_assignment;
+  typedef std::false_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  TArenaAllocator() : arena_(TArena::current()) {}
+
+  explicit TArenaAllocator(TArena* arena) : arena_(arena) {}
+
+  template <typename U>
+  TArenaAllocator(const TArenaAllocator<U>& other) : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    if (n > static_cast<size_t>(-1) / sizeof(T)) {
+      throw std::bad_alloc();
+    }
+    if (arena_ == nullptr) {
+      return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+
+  void deallocate(T* ptr, size_t n) {
+    if (arena_ == nullptr) {
+      ::operator delete(ptr);
+    } else {
+      arena_->deallocate(ptr, n * sizeof(T));
+    }
+  }
+
+  /**
+   * Copies use the arena current at the time of the copy rather than the
+   * one of the original.
+   */
+  TArenaAllocator select_on_container_copy_construction() const { return TArenaAllocator(); }
+
+  TArena* arena() const { return arena_; }
+
+private:
+  TArena* arena_;
+};
+
+template <typename T, typename U>
+bool operator==(const TArenaAllocator<T>& a, const TArenaAllocator<U>& b) {
+  return a.arena() == b.arena();
+}
+
+template <typename T, typename U>
+bool operator!=(const TArenaAllocator<T>& a, const TArenaAllocator<U>& b) {
+  return a.arena() != b.arena();
+}
+
+typedef std::basic_string<char, std::char_traits<char>, TArenaAllocator<char> > TArenaString;
+
+template <typename T>
+using TArenaVector = std::vector<T, TArenaAllocator<T> >;
+
+template <typename T>
+using TArenaSet = std::set<T, std::less<T>, TArenaAllocator<T> >;
+
+template <typename K, typename V>
+using TArenaMap = std::map<K, V, std::less<K>, TArenaAllocator<std::pair<const K, V> > >;
+
+/*
+ * Protocols only deal in std::string, so arena strings are read through
+ * TArena::scratchString() and written as slices that reference them.
+ */
+template <class Protocol_>
+uint32_t readArenaString(Protocol_* prot, TArenaString& str) {
+  std::string& scratch = TArena::scratchString();
+  uint32_t result = prot->readString(scratch);
+  str.assign(scratch.data(), scratch.size());
+  TArena::trimScratchString();
+  return result;
+}
+
+template <class Protocol_>
+uint32_t readArenaBinary(Protocol_* prot, TArenaString& str) {
+  std::string& scratch = TArena::scratchString();
+  uint32_t result = prot->readBinary(scratch);
+  str.assign(scratch.data(), scratch.size());
+  TArena::trimScratchString();
+  return result;
+}
+
+template <class Protocol_>
+uint32_t writeArenaString(Protocol_* prot, const TArenaString& str) {
+  return prot->writeStringSlice(
+      TSlice(reinterpret_cast<const uint8_t*>(str.data()), str.size(), nullptr));
+}
+
+template <class Protocol_>
+uint32_t writeArenaBinary(Protocol_* prot, const TArenaString& str) {
+  return prot->writeBinarySlice(
+      TSlice(reinterpret_cast<const uint8_t*>(str.data()), str.size(), nullptr));
+}
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TARENA_H_
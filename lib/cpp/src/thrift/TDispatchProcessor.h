@@ -24,6 +24,22 @@
 namespace apache {
 namespace thrift {
 
+namespace detail {
+
+/**
+ * Hash generated processors use to find the process function for a call.
+ * The compiler picks the seed for each service so that the names spread
+ * well, so changing it requires regenerating every processor.
+ */
+inline uint32_t hashMethodName(const std::string& name, uint32_t seed) {
+  uint32_t hash = 2166136261u ^ seed;
+  for (char c : name) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+  }
+  return hash ^ (hash >> 16);
+}
+}
+
 /**
  * TDispatchProcessor is a helper class to parse the message header then call
  * another function to dispatch based on the function name.
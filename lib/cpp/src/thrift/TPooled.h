@@ -0,0 +1,89 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#ifndef _THRIFT_TPOOLED_H_
+#define _THRIFT_TPOOLED_H_ 1
+
+#include <memory>
+
+#include <thrift/TNonCopyable.h>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * Borrows the calling thread's instance of a generated struct for as long as
+ * the handle lives.
+ *
+ * Code generated with the cpp:pooled_args option uses this for the args and
+ * result structs of processor calls.  The instance is reset with __clear(),
+ * which keeps the capacity of its strings and containers, so a thread that
+ * handles similar requests stops allocating for them after the first few.
+ * The price is that each thread holds on to the memory of the largest
+ * request it has seen until it exits.
+ *
+ * If the thread's instance is still borrowed, for example because a handler
+ * calls back into the same processor, a fresh heap allocated one is used.
+ */
+template <typename T>
+class TPooled : TNonCopyable {
+public:
+  TPooled() {
+    Slot& slot = threadSlot();
+    if (slot.inUse) {
+      owned_.reset(new T());
+      object_ = owned_.get();
+    } else {
+      // Cleared here rather than on release so that a throwing __clear()
+      // reaches the caller instead of a destructor.
+      slot.object.__clear();
+      slot.inUse = true;
+      object_ = &slot.object;
+    }
+  }
+
+  ~TPooled() {
+    if (!owned_) {
+      threadSlot().inUse = false;
+    }
+  }
+
+  T& operator*() const { return *object_; }
+  T* operator->() const { return object_; }
+
+private:
+  struct Slot {
+    Slot() : inUse(false) {}
+    T object;
+    bool inUse;
+  };
+
+  static Slot& threadSlot() {
+    static thread_local Slot slot;
+    return slot;
+  }
+
+  T* object_;
+  std::unique_ptr<T> owned_;
+};
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TPOOLED_H_
@@ -0,0 +1,198 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/TRequestDeadline.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace apache {
+namespace thrift {
+
+namespace {
+
+struct ThreadDeadline {
+  ThreadDeadline() : active(false), deadline(TRequestDeadline::Clock::time_point::max()) {}
+
+  bool active;
+  TRequestDeadline::Clock::time_point deadline;
+};
+
+thread_local ThreadDeadline threadDeadline;
+
+// The header format of THeaderTransport
+const uint32_t HEADER_MAGIC = 0x0FFF0000;
+const uint32_t HEADER_MASK = 0xFFFF0000;
+const int32_t INFO_KEYVALUE = 1;
+
+/**
+ * Reads a varint of THeaderTransport's header section, as
+ * THeaderTransport::readVarint32() does.
+ */
+bool readVarint(const uint8_t*& ptr, const uint8_t* boundary, int32_t& value) {
+  uint32_t result = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (ptr == boundary) {
+      return false;
+    }
+    uint8_t byte = *(ptr++);
+    result |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      value = static_cast<int32_t>(result);
+      return true;
+    }
+  }
+  return false;
+}
+}
+
+const char* const TRequestDeadline::HEADER = "client_timeout";
+
+const std::chrono::milliseconds TRequestDeadline::MAX_TIMEOUT = std::chrono::hours(24);
+
+bool TRequestDeadline::parseTimeout(const std::string& value, std::chrono::milliseconds& timeout) {
+  if (value.empty()) {
+    return false;
+  }
+  char* end;
+  errno = 0;
+  long long milliseconds = std::strtoll(value.c_str(), &end, 10);
+  if (errno != 0 || *end != '\0' || milliseconds > MAX_TIMEOUT.count()) {
+    return false;
+  }
+  // Kept within range, as it is added to the time the request was received
+  timeout = std::chrono::milliseconds((std::max)(milliseconds, 0LL));
+  return true;
+}
+
+bool TRequestDeadline::fromHeaders(const std::map<std::string, std::string>& headers,
+                                   Clock::time_point received,
+                                   Clock::time_point& deadline) {
+  auto found = headers.find(HEADER);
+  std::chrono::milliseconds timeout;
+  if (found == headers.end() || !parseTimeout(found->second, timeout)) {
+    return false;
+  }
+  deadline = received + timeout;
+  return true;
+}
+
+bool TRequestDeadline::fromFrame(const uint8_t* frame,
+                                 uint32_t size,
+                                 Clock::time_point received,
+                                 Clock::time_point& deadline) {
+  // magic and flags(4), seqId(4), headerSize(2)
+  if (size < 10) {
+    return false;
+  }
+  uint32_t magic = static_cast<uint32_t>(frame[0]) << 24 | static_cast<uint32_t>(frame[1]) << 16;
+  if ((magic & HEADER_MASK) != HEADER_MAGIC) {
+    return false;
+  }
+  uint32_t headerSize = (static_cast<uint32_t>(frame[8]) << 8 | frame[9]) * 4;
+  if (headerSize > size - 10) {
+    return false;
+  }
+
+  const uint8_t* ptr = frame + 10;
+  const uint8_t* const boundary = ptr + headerSize;
+  int32_t protocolId;
+  int32_t numTransforms;
+  if (!readVarint(ptr, boundary, protocolId) || !readVarint(ptr, boundary, numTransforms)) {
+    return false;
+  }
+  for (int32_t i = 0; i < numTransforms; ++i) {
+    int32_t transformId;
+    if (!readVarint(ptr, boundary, transformId)) {
+      return false;
+    }
+  }
+
+  const size_t keySize = std::strlen(HEADER);
+  while (ptr < boundary) {
+    int32_t infoId;
+    int32_t numHeaders;
+    if (!readVarint(ptr, boundary, infoId)
+        || infoId != INFO_KEYVALUE
+        || !readVarint(ptr, boundary, numHeaders)) {
+      // Padding, or an info block THeaderTransport would stop at too
+      return false;
+    }
+    for (; numHeaders > 0; --numHeaders) {
+      int32_t keyLength;
+      if (!readVarint(ptr, boundary, keyLength) || keyLength < 0 || keyLength > boundary - ptr) {
+        return false;
+      }
+      const uint8_t* key = ptr;
+      ptr += keyLength;
+      int32_t valueLength;
+      if (!readVarint(ptr, boundary, valueLength) || valueLength < 0
+          || valueLength > boundary - ptr) {
+        return false;
+      }
+      if (static_cast<size_t>(keyLength) == keySize && std::memcmp(key, HEADER, keySize) == 0) {
+        std::chrono::milliseconds timeout;
+        if (!parseTimeout(std::string(reinterpret_cast<const char*>(ptr), valueLength), timeout)) {
+          return false;
+        }
+        deadline = received + timeout;
+        return true;
+      }
+      ptr += valueLength;
+    }
+  }
+  return false;
+}
+
+TRequestDeadline::Clock::time_point TRequestDeadline::get() {
+  return threadDeadline.deadline;
+}
+
+std::chrono::milliseconds TRequestDeadline::remaining() {
+  Clock::time_point deadline = get();
+  if (deadline == Clock::time_point::max()) {
+    return std::chrono::milliseconds::max();
+  }
+  Clock::time_point now = Clock::now();
+  if (deadline <= now) {
+    return std::chrono::milliseconds(0);
+  }
+  return std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+}
+
+void TRequestDeadline::tighten(Clock::time_point deadline) {
+  if (threadDeadline.active && deadline < threadDeadline.deadline) {
+    threadDeadline.deadline = deadline;
+  }
+}
+
+TRequestDeadline::Scope::Scope(Clock::time_point deadline)
+  : previousActive_(threadDeadline.active), previous_(threadDeadline.deadline) {
+  threadDeadline.active = true;
+  threadDeadline.deadline = deadline;
+}
+
+TRequestDeadline::Scope::~Scope() {
+  threadDeadline.active = previousActive_;
+  threadDeadline.deadline = previous_;
+}
+}
+} // apache::thrift
@@ -0,0 +1,139 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TREQUESTDEADLINE_H_
+#define _THRIFT_TREQUESTDEADLINE_H_ 1
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+#include <thrift/TNonCopyable.h>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * The deadline of the request the calling thread is serving.
+ *
+ * A client sends how long it will wait for a reply in the client_timeout
+ * header of THeaderTransport, in milliseconds:
+ *
+ *   headerTransport->setHeader(TRequestDeadline::HEADER, "250");
+ *   client.call();
+ *
+ * The servers run each request in a Scope, and the deadline is the time the
+ * request was received plus the timeout.  TNonblockingServer reads the
+ * header before dispatching, and drops requests whose deadline has passed,
+ * whether on arrival, in the ThreadManager queue or before the handler runs,
+ * without a reply; the client has given up on them already.  The other
+ * servers take the deadline from THeaderTransport as it reads the request.
+ *
+ * Handlers can look at the deadline to give up on work nobody is waiting
+ * for, or to pass the remaining time on to the services they call:
+ *
+ *   if (TRequestDeadline::expired()) {
+ *     throw TApplicationException("deadline exceeded");
+ *   }
+ */
+class TRequestDeadline {
+public:
+  typedef std::chrono::steady_clock Clock;
+
+  /**
+   * The THeaderTransport header holding the client's timeout.
+   */
+  static const char* const HEADER;
+
+  /**
+   * The longest timeout taken from HEADER; a longer one means no deadline.
+   */
+  static const std::chrono::milliseconds MAX_TIMEOUT;
+
+  /**
+   * Parses the value of HEADER.  Returns false if it is not a number of
+   * milliseconds, or exceeds MAX_TIMEOUT; zero or less means the client has
+   * already given up, and becomes zero.
+   */
+  static bool parseTimeout(const std::string& value, std::chrono::milliseconds& timeout);
+
+  /**
+   * Reads HEADER from a set of headers, and returns false if it is absent or
+   * malformed.
+   */
+  static bool fromHeaders(const std::map<std::string, std::string>& headers,
+                          Clock::time_point received,
+                          Clock::time_point& deadline);
+
+  /**
+   * Reads HEADER from a THeaderTransport frame held in memory, without
+   * reading the rest of the frame.  frame points just past the frame size.
+   * Returns false if the frame is not in header format, is malformed, or has
+   * no valid HEADER.
+   */
+  static bool fromFrame(const uint8_t* frame,
+                        uint32_t size,
+                        Clock::time_point received,
+                        Clock::time_point& deadline);
+
+  /**
+   * Whether the calling thread's request has a deadline.
+   */
+  static bool isSet() { return get() != Clock::time_point::max(); }
+
+  /**
+   * The deadline of the calling thread's request, or Clock::time_point::max()
+   * if it has none.
+   */
+  static Clock::time_point get();
+
+  /**
+   * The time left until the deadline, zero if it has passed, and
+   * std::chrono::milliseconds::max() if there is none.
+   */
+  static std::chrono::milliseconds remaining();
+
+  static bool expired() { return get() <= Clock::now(); }
+
+  /**
+   * Brings the deadline of the calling thread's request forward to the
+   * given time.  Does nothing outside a Scope, so reading a frame on a
+   * client thread leaves no deadline behind.
+   */
+  static void tighten(Clock::time_point deadline);
+
+  /**
+   * Sets the deadline of the calling thread for the lifetime of the scope,
+   * and restores the previous one afterwards.
+   */
+  class Scope : TNonCopyable {
+  public:
+    explicit Scope(Clock::time_point deadline = Clock::time_point::max());
+    ~Scope();
+
+  private:
+    bool previousActive_;
+    Clock::time_point previous_;
+  };
+};
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TREQUESTDEADLINE_H_
@@ -0,0 +1,152 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TSLICE_H_
+#define _THRIFT_TSLICE_H_ 1
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <utility>
+
+namespace apache {
+namespace thrift {
+
+/**
+ * An immutable, reference counted range of bytes.
+ *
+ * A slice either owns a private copy of its contents or points into memory
+ * owned by someone else, typically the receive buffer of a transport.  In
+ * the latter case the slice holds a reference that keeps that memory alive
+ * for as long as the slice (or any copy of it) exists, so it can safely
+ * outlive the message it was read from.  Copying a slice never copies the
+ * bytes.
+ *
+ * Code generated with the cpp:slices option uses TSlice instead of
+ * std::string for string and binary fields.  Protocols that can borrow from
+ * their transport hand out slices pointing into the frame; the others fall
+ * back to an owned copy.
+ */
+class TSlice {
+public:
+  TSlice() : data_(nullptr), size_(0) {}
+
+  /**
+   * Slices built from strings take a private copy of the contents.
+   */
+  TSlice(const std::string& str) { own(std::string(str)); }
+
+  TSlice(std::string&& str) { own(std::move(str)); }
+
+  TSlice(const char* str) { own(std::string(str)); }
+
+  TSlice(const char* data, size_t size) { own(std::string(data, size)); }
+
+  /**
+   * References size bytes at data without copying them.  owner must keep
+   * that memory valid and unmodified for as long as it is referenced.
+   */
+  TSlice(const uint8_t* data, size_t size, std::shared_ptr<const void> owner)
+    : data_(reinterpret_cast<const char*>(data)), size_(size), owner_(std::move(owner)) {}
+
+  const char* data() const { return size_ ? data_ : ""; }
+
+  size_t size() const { return size_; }
+
+  size_t length() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+  const char* begin() const { return data(); }
+
+  const char* end() const { return data() + size_; }
+
+  char operator[](size_t pos) const { return data_[pos]; }
+
+  void clear() {
+    data_ = nullptr;
+    size_ = 0;
+    owner_.reset();
+  }
+
+  /**
+   * Copies the contents out into a std::string.
+   */
+  std::string str() const { return std::string(data(), size_); }
+
+  int compare(const TSlice& that) const {
+    int result = std::memcmp(data(), that.data(), (std::min)(size_, that.size_));
+    if (result != 0) {
+      return result;
+    }
+    return size_ < that.size_ ? -1 : (size_ > that.size_ ? 1 : 0);
+  }
+
+  void swap(TSlice& that) {
+    using std::swap;
+    swap(data_, that.data_);
+    swap(size_, that.size_);
+    swap(owner_, that.owner_);
+  }
+
+private:
+  void own(std::string&& str) {
+    if (str.empty()) {
+      data_ = nullptr;
+      size_ = 0;
+      return;
+    }
+    std::shared_ptr<std::string> copy = std::make_shared<std::string>(std::move(str));
+    data_ = copy->data();
+    size_ = copy->size();
+    owner_ = std::move(copy);
+  }
+
+  const char* data_;
+  size_t size_;
+  std::shared_ptr<const void> owner_;
+};
+
+inline void swap(TSlice& a, TSlice& b) {
+  a.swap(b);
+}
+
+inline bool operator==(const TSlice& a, const TSlice& b) {
+  return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+inline bool operator!=(const TSlice& a, const TSlice& b) {
+  return !(a == b);
+}
+
+inline bool operator<(const TSlice& a, const TSlice& b) {
+  return a.compare(b) < 0;
+}
+
+inline std::ostream& operator<<(std::ostream& out, const TSlice& slice) {
+  out.write(slice.data(), static_cast<std::streamsize>(slice.size()));
+  return out;
+}
+}
+} // apache::thrift
+
+#endif // #ifndef _THRIFT_TSLICE_H_
@@ -0,0 +1,379 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/async/TPipelinedClient.h>
+
+#include <thrift/TApplicationException.h>
+#include <thrift/concurrency/ThreadFactory.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TTransportException.h>
+
+namespace apache {
+namespace thrift {
+namespace async {
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::Synchronized;
+using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::protocol::TMessageType;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TTransportException;
+
+namespace {
+const uint32_t MAX_IN_FLIGHT = 1 << 24;
+const uint64_t INDEX_MASK = 0xffffffff;
+}
+
+class TPipelinedClient::Reader : public Runnable {
+public:
+  explicit Reader(TPipelinedClient* client) : client_(client) {}
+
+  void run() override { client_->readReplies(); }
+
+private:
+  TPipelinedClient* client_;
+};
+
+TPipelinedClient::TPipelinedClient(std::shared_ptr<TTransport> transport,
+                                   std::shared_ptr<protocol::TProtocolFactory> protocolFactory,
+                                   uint32_t maxInFlight)
+  : transport_(transport),
+    protocolFactory_(protocolFactory),
+    maxInFlight_(maxInFlight),
+    slotBits_(0),
+    freeSlots_(0),
+    inFlight_(0),
+    slotWaiters_(0),
+    writing_(false),
+    open_(false),
+    failed_(false),
+    closing_(false) {
+  if (maxInFlight_ == 0 || maxInFlight_ > MAX_IN_FLIGHT) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TPipelinedClient: maxInFlight out of range");
+  }
+  while ((uint32_t(1) << slotBits_) < maxInFlight_) {
+    ++slotBits_;
+  }
+
+  slots_.reset(new Slot[maxInFlight_]);
+  for (uint32_t i = 0; i + 1 < maxInFlight_; ++i) {
+    slots_[i].next = i + 2;
+  }
+  freeSlots_ = 1;
+}
+
+TPipelinedClient::~TPipelinedClient() {
+  try {
+    close();
+  } catch (...) {
+    // ignore
+  }
+}
+
+void TPipelinedClient::open() {
+  if (closing_) {
+    throw TTransportException(TTransportException::NOT_OPEN, "TPipelinedClient: closed");
+  }
+  if (reader_) {
+    return;
+  }
+  if (!transport_->isOpen()) {
+    transport_->open();
+  }
+  reader_ = ThreadFactory(false).newThread(std::make_shared<Reader>(this));
+  reader_->start();
+  open_ = true;
+}
+
+void TPipelinedClient::close() {
+  closing_ = true;
+  open_ = false;
+  if (transport_->isOpen()) {
+    transport_->close();
+  }
+  if (reader_) {
+    reader_->join();
+    reader_.reset();
+  }
+  fail(std::make_exception_ptr(
+      TTransportException(TTransportException::NOT_OPEN, "TPipelinedClient: closed")));
+}
+
+std::future<std::shared_ptr<TProtocol> > TPipelinedClient::call(const std::string& name,
+                                                                const ArgsWriter& writeArgs) {
+  checkOpen();
+  uint32_t index = acquireSlot();
+  Slot& slot = slots_[index];
+  slot.generation = (slot.generation + 1) & (0xffffffffu >> slotBits_);
+  int32_t seqid = static_cast<int32_t>((slot.generation << slotBits_) | index);
+  slot.name = name;
+  slot.promise = std::promise<std::shared_ptr<TProtocol> >();
+  std::future<std::shared_ptr<TProtocol> > result = slot.promise.get_future();
+  slot.seqid = seqid;
+  slot.state = SLOT_IN_FLIGHT;
+
+  // Either fail() sees the slot in flight, or this sees the failure
+  if (failed_) {
+    int expected = SLOT_IN_FLIGHT;
+    if (slot.state.compare_exchange_strong(expected, SLOT_DONE)) {
+      std::promise<std::shared_ptr<TProtocol> > promise(std::move(slot.promise));
+      releaseSlot(index);
+    }
+    checkOpen();
+  }
+
+  try {
+    writeFrame(name, protocol::T_CALL, seqid, writeArgs);
+  } catch (...) {
+    int expected = SLOT_IN_FLIGHT;
+    if (slot.state.compare_exchange_strong(expected, SLOT_DONE)) {
+      std::promise<std::shared_ptr<TProtocol> > promise(std::move(slot.promise));
+      releaseSlot(index);
+    }
+    throw;
+  }
+  return result;
+}
+
+void TPipelinedClient::send(const std::string& name, const ArgsWriter& writeArgs) {
+  checkOpen();
+  writeFrame(name, protocol::T_ONEWAY, 0, writeArgs);
+}
+
+void TPipelinedClient::checkOpen() const {
+  if (!open_ || failed_) {
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "TPipelinedClient: connection is not open");
+  }
+}
+
+uint32_t TPipelinedClient::acquireSlot() {
+  uint32_t index;
+  if (tryAcquireSlot(index)) {
+    return index;
+  }
+
+  Synchronized s(slotMonitor_);
+  ++slotWaiters_;
+  while (!tryAcquireSlot(index)) {
+    if (failed_) {
+      --slotWaiters_;
+      checkOpen();
+    }
+    slotMonitor_.waitForever();
+  }
+  --slotWaiters_;
+  return index;
+}
+
+bool TPipelinedClient::tryAcquireSlot(uint32_t& index) {
+  uint64_t head = freeSlots_.load();
+  while (true) {
+    uint32_t top = static_cast<uint32_t>(head & INDEX_MASK);
+    if (top == 0) {
+      return false;
+    }
+    uint64_t next = ((head >> 32) + 1) << 32 | slots_[top - 1].next.load();
+    if (freeSlots_.compare_exchange_weak(head, next)) {
+      index = top - 1;
+      ++inFlight_;
+      return true;
+    }
+  }
+}
+
+void TPipelinedClient::releaseSlot(uint32_t index) {
+  Slot& slot = slots_[index];
+  slot.state = SLOT_FREE;
+  uint64_t head = freeSlots_.load();
+  do {
+    slot.next = static_cast<uint32_t>(head & INDEX_MASK);
+  } while (!freeSlots_.compare_exchange_weak(head, ((head >> 32) + 1) << 32 | (index + 1)));
+  --inFlight_;
+
+  // A caller about to wait holds the monitor from its last attempt until it
+  // waits, so taking it here cannot miss the wakeup
+  if (slotWaiters_ > 0) {
+    Synchronized s(slotMonitor_);
+    slotMonitor_.notify();
+  }
+}
+
+TPipelinedClient::Slot* TPipelinedClient::claimSlot(int32_t seqid) {
+  uint32_t index = static_cast<uint32_t>(seqid) & ((uint32_t(1) << slotBits_) - 1);
+  if (index >= maxInFlight_) {
+    return nullptr;
+  }
+  Slot& slot = slots_[index];
+  if (slot.seqid != seqid) {
+    return nullptr;
+  }
+  int expected = SLOT_IN_FLIGHT;
+  if (!slot.state.compare_exchange_strong(expected, SLOT_DONE)) {
+    return nullptr;
+  }
+  return &slot;
+}
+
+void TPipelinedClient::writeFrame(const std::string& name,
+                                  TMessageType type,
+                                  int32_t seqid,
+                                  const ArgsWriter& writeArgs) {
+  // Serialize on the calling thread, leaving room for the frame size
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  uint8_t frameSize[4] = {0, 0, 0, 0};
+  buffer->write(frameSize, sizeof(frameSize));
+  std::shared_ptr<TProtocol> prot = protocolFactory_->getProtocol(buffer);
+  prot->writeMessageBegin(name, type, seqid);
+  writeArgs(prot.get());
+  prot->writeMessageEnd();
+
+  uint8_t* frame;
+  uint32_t size;
+  buffer->getBuffer(&frame, &size);
+  uint32_t payload = size - sizeof(frameSize);
+  frame[0] = static_cast<uint8_t>(payload >> 24);
+  frame[1] = static_cast<uint8_t>(payload >> 16);
+  frame[2] = static_cast<uint8_t>(payload >> 8);
+  frame[3] = static_cast<uint8_t>(payload);
+
+  {
+    Guard g(writeMutex_);
+    pendingFrames_.append(reinterpret_cast<const char*>(frame), size);
+    if (writing_) {
+      // The writer picks it up with its next batch
+      return;
+    }
+    writing_ = true;
+  }
+  flushFrames();
+}
+
+void TPipelinedClient::flushFrames() {
+  std::string batch;
+  while (true) {
+    {
+      Guard g(writeMutex_);
+      batch.clear();
+      batch.swap(pendingFrames_);
+      if (batch.empty()) {
+        writing_ = false;
+        return;
+      }
+    }
+
+    try {
+      transport_->write(reinterpret_cast<const uint8_t*>(batch.data()),
+                        static_cast<uint32_t>(batch.size()));
+      transport_->writeEnd();
+      transport_->flush();
+    } catch (...) {
+      {
+        Guard g(writeMutex_);
+        pendingFrames_.clear();
+        writing_ = false;
+      }
+      fail(std::current_exception());
+      throw;
+    }
+  }
+}
+
+void TPipelinedClient::readReplies() {
+  try {
+    auto config = transport_->getConfiguration();
+    while (true) {
+      uint8_t frameSize[4];
+      transport_->readAll(frameSize, sizeof(frameSize));
+      uint32_t size = (static_cast<uint32_t>(frameSize[0]) << 24)
+                      | (static_cast<uint32_t>(frameSize[1]) << 16)
+                      | (static_cast<uint32_t>(frameSize[2]) << 8)
+                      | static_cast<uint32_t>(frameSize[3]);
+      if (size == 0 || size > static_cast<uint32_t>(config->getMaxFrameSize())) {
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "TPipelinedClient: invalid frame size");
+      }
+      std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(size, config));
+      transport_->readAll(buffer->getWritePtr(size), size);
+      buffer->wroteBytes(size);
+      transport_->readEnd();
+
+      std::shared_ptr<TProtocol> prot = protocolFactory_->getProtocol(buffer);
+      std::string fname;
+      TMessageType mtype;
+      int32_t seqid;
+      prot->readMessageBegin(fname, mtype, seqid);
+
+      Slot* slot = claimSlot(seqid);
+      if (slot == nullptr) {
+        // Like the concurrent client, a reply nobody waits for ends the connection
+        throw TApplicationException(TApplicationException::BAD_SEQUENCE_ID,
+                                    "server sent a bad seqid");
+      }
+      bool wrongName = fname != slot->name;
+      std::promise<std::shared_ptr<TProtocol> > promise(std::move(slot->promise));
+      releaseSlot(static_cast<uint32_t>(slot - slots_.get()));
+
+      if (mtype == protocol::T_EXCEPTION) {
+        TApplicationException x;
+        x.read(prot.get());
+        prot->readMessageEnd();
+        promise.set_exception(std::make_exception_ptr(x));
+      } else if (mtype != protocol::T_REPLY) {
+        promise.set_exception(std::make_exception_ptr(
+            TApplicationException(TApplicationException::INVALID_MESSAGE_TYPE)));
+      } else if (wrongName) {
+        promise.set_exception(std::make_exception_ptr(
+            TApplicationException(TApplicationException::WRONG_METHOD_NAME)));
+      } else {
+        promise.set_value(prot);
+      }
+    }
+  } catch (...) {
+    if (closing_) {
+      fail(std::make_exception_ptr(
+          TTransportException(TTransportException::NOT_OPEN, "TPipelinedClient: closed")));
+    } else {
+      fail(std::current_exception());
+    }
+  }
+}
+
+void TPipelinedClient::fail(std::exception_ptr error) {
+  failed_ = true;
+  for (uint32_t i = 0; i < maxInFlight_; ++i) {
+    Slot& slot = slots_[i];
+    int expected = SLOT_IN_FLIGHT;
+    if (slot.state.compare_exchange_strong(expected, SLOT_DONE)) {
+      std::promise<std::shared_ptr<TProtocol> > promise(std::move(slot.promise));
+      releaseSlot(i);
+      promise.set_exception(error);
+    }
+  }
+
+  Synchronized s(slotMonitor_);
+  slotMonitor_.notifyAll();
+}
+}
+}
+} // apache::thrift::async
@@ -0,0 +1,174 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_ASYNC_TPIPELINEDCLIENT_H_
+#define _THRIFT_ASYNC_TPIPELINEDCLIENT_H_ 1
+
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/concurrency/Thread.h>
+#include <thrift/protocol/TProtocol.h>
+#include <thrift/transport/TTransport.h>
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+
+namespace apache {
+namespace thrift {
+namespace async {
+
+/**
+ * A thread safe client connection that keeps many calls in flight at once.
+ *
+ * Callers serialize their calls on their own thread and get a future of the
+ * reply.  Frames queued while another caller is writing go out together in
+ * one write, and a dedicated reader thread hands each reply to its caller by
+ * seqid, in whatever order the server sends them.  The seqid names a slot in
+ * a fixed table, so matching a reply to its caller takes no locks.
+ *
+ * Calls are framed as with TFramedTransport, so the transport given is the
+ * raw connection, e.g. a TSocket.  The server has to be able to read the next
+ * call before it has answered the previous one.
+ *
+ * A call looks like this, with the _pargs and _presult structs of a
+ * generated client:
+ *
+ *   Service_method_pargs args;
+ *   args.arg = &arg;
+ *   auto reply = client.call("method", [&](protocol::TProtocol* prot) { args.write(prot); });
+ *   Service_method_presult result;
+ *   result.success = &_return;
+ *   result.read(reply.get().get());
+ */
+class TPipelinedClient {
+public:
+  typedef std::function<void(protocol::TProtocol*)> ArgsWriter;
+
+  /**
+   * @param maxInFlight the most calls awaiting a reply; further calls block
+   *        until one completes
+   */
+  TPipelinedClient(std::shared_ptr<transport::TTransport> transport,
+                   std::shared_ptr<protocol::TProtocolFactory> protocolFactory,
+                   uint32_t maxInFlight = 1024);
+
+  /**
+   * Closes the connection.
+   */
+  ~TPipelinedClient();
+
+  /**
+   * Opens the transport if it is not open yet and starts the reader.
+   */
+  void open();
+
+  /**
+   * Closes the transport, and fails the calls still waiting for a reply.
+   * The client cannot be opened again.
+   */
+  void close();
+
+  /**
+   * Sends a call and returns a future of the protocol to read the result
+   * struct from.  The future throws TApplicationException if the server
+   * answered with one, and TTransportException if the connection failed
+   * before the reply arrived.
+   *
+   * @param writeArgs serializes the arguments struct; it is called before
+   *        call() returns
+   * @throws TTransportException if the connection is not open or has failed
+   */
+  std::future<std::shared_ptr<protocol::TProtocol> > call(const std::string& name,
+                                                          const ArgsWriter& writeArgs);
+
+  /**
+   * Sends a oneway call.
+   */
+  void send(const std::string& name, const ArgsWriter& writeArgs);
+
+  /**
+   * The number of calls awaiting a reply.
+   */
+  uint32_t getInFlight() const { return inFlight_.load(); }
+
+  uint32_t getMaxInFlight() const { return maxInFlight_; }
+
+private:
+  enum SlotState { SLOT_FREE, SLOT_IN_FLIGHT, SLOT_DONE };
+
+  struct Slot {
+    Slot() : state(SLOT_FREE), seqid(0), generation(0), next(0) {}
+
+    std::atomic<int> state;
+    std::atomic<int32_t> seqid;
+    uint32_t generation;
+    std::string name;
+    std::promise<std::shared_ptr<protocol::TProtocol> > promise;
+
+    // Free list link, as slot index + 1
+    std::atomic<uint32_t> next;
+  };
+
+  class Reader;
+
+  uint32_t acquireSlot();
+  bool tryAcquireSlot(uint32_t& index);
+  void releaseSlot(uint32_t index);
+  Slot* claimSlot(int32_t seqid);
+  void writeFrame(const std::string& name,
+                  protocol::TMessageType type,
+                  int32_t seqid,
+                  const ArgsWriter& writeArgs);
+  void flushFrames();
+  void readReplies();
+  void fail(std::exception_ptr error);
+  void checkOpen() const;
+
+  std::shared_ptr<transport::TTransport> transport_;
+  std::shared_ptr<protocol::TProtocolFactory> protocolFactory_;
+  const uint32_t maxInFlight_;
+  uint32_t slotBits_;
+  std::unique_ptr<Slot[]> slots_;
+
+  // Free slot stack: a modification count in the upper half against ABA,
+  // and the top slot index + 1 in the lower half
+  std::atomic<uint64_t> freeSlots_;
+  std::atomic<uint32_t> inFlight_;
+  std::atomic<uint32_t> slotWaiters_;
+  concurrency::Monitor slotMonitor_;
+
+  // Frames waiting to be written, and whether a caller is writing
+  concurrency::Mutex writeMutex_;
+  std::string pendingFrames_;
+  bool writing_;
+
+  std::atomic<bool> open_;
+  std::atomic<bool> failed_;
+  std::atomic<bool> closing_;
+  std::shared_ptr<concurrency::Thread> reader_;
+};
+}
+}
+} // apache::thrift::async
+
+#endif // #ifndef _THRIFT_ASYNC_TPIPELINEDCLIENT_H_
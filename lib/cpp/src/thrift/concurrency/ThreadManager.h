@@ -200,6 +200,16 @@ public:
   static std::shared_ptr<ThreadManager> newSimpleThreadManager(size_t count = 4,
                                                                  size_t pendingTaskCountMax = 0);
 
+  /**
+   * Creates a thread manager like newSimpleThreadManager whose workers each
+   * have their own lock free task queue and steal from the others when it
+   * runs dry, so adding and running tasks does not contend on one mutex.
+   * Tasks are not run in strict FIFO order, and remove(), removeNextPending()
+   * and removeExpiredTasks() are comparatively slow.
+   */
+  static std::shared_ptr<ThreadManager> newWorkStealingThreadManager(size_t count = 4,
+                                                                       size_t pendingTaskCountMax = 0);
+
   class Task;
 
   class Worker;
@@ -22,8 +22,10 @@
 
 #include <assert.h>
 #include <iostream>
+#include <limits>
 #include <memory>
 #include <set>
+#include <vector>
 
 namespace apache {
 namespace thrift {
@@ -42,7 +44,8 @@ class TimerManager::Task : public Runnable {
 public:
   enum STATE { WAITING, EXECUTING, CANCELLED, COMPLETE };
 
-  Task(shared_ptr<Runnable> runnable) : runnable_(runnable), state_(WAITING) {}
+  Task(shared_ptr<Runnable> runnable)
+    : prev_(nullptr), next_(nullptr), slot_(nullptr), tick_(0), runnable_(runnable), state_(WAITING) {}
 
   ~Task() override = default;
 
@@ -57,12 +60,253 @@ public:
 
   task_iterator it_;
 
+  // Timing wheel bookkeeping: the slot list the task is linked into, or
+  // nullptr once it has expired or been removed, and the tick it is due in.
+  Task* prev_;
+  Task* next_;
+  Task** slot_;
+  uint64_t tick_;
+
+  // Keeps the task alive while it is in the wheel
+  shared_ptr<Task> self_;
+
 private:
   shared_ptr<Runnable> runnable_;
   friend class TimerManager::Dispatcher;
+  friend class TimerManager;
   STATE state_;
 };
 
+/**
+ * A hierarchical timing wheel.
+ *
+ * Level 0 has a slot for each of the next 256 ticks, and a slot of level n
+ * spans 256^n ticks.  A task goes into the lowest level whose range reaches
+ * its tick; when the time of a higher level slot comes, its tasks are
+ * cascaded into the levels below.  Tasks beyond the top level wait in its
+ * last slot and are placed again when that slot cascades.  Slots are
+ * intrusive lists, so adding and removing a task is O(1).
+ *
+ * Protected by the manager's monitor.
+ */
+class TimerManager::TimingWheel {
+public:
+  static const unsigned LEVELS = 4;
+  static const unsigned SLOT_BITS = 8;
+  static const uint64_t SLOTS = 1 << SLOT_BITS;
+  static const uint64_t NEVER = (std::numeric_limits<uint64_t>::max)();
+
+  TimingWheel(std::chrono::steady_clock::duration tick)
+    : wakeTick_(0),
+      tick_(tick),
+      origin_(std::chrono::steady_clock::now()),
+      current_(0),
+      size_(0) {
+    for (unsigned level = 0; level < LEVELS; ++level) {
+      count_[level] = 0;
+      for (uint64_t index = 0; index < SLOTS; ++index) {
+        slots_[level][index] = nullptr;
+      }
+    }
+  }
+
+  ~TimingWheel() { clear(); }
+
+  /**
+   * The last tick that has started by the given time.
+   */
+  uint64_t tickOf(const std::chrono::time_point<std::chrono::steady_clock>& time) const {
+    if (time <= origin_) {
+      return 0;
+    }
+    return static_cast<uint64_t>((time - origin_) / tick_);
+  }
+
+  std::chrono::time_point<std::chrono::steady_clock> timeOf(uint64_t tick) const {
+    return origin_ + tick_ * static_cast<std::chrono::steady_clock::rep>(tick);
+  }
+
+  /**
+   * Adds a task due at the given time.  It runs in the first tick that
+   * starts at or after that time, or the next tick if that one has passed.
+   * Returns the tick it will run in.
+   */
+  uint64_t add(Task* task, const std::chrono::time_point<std::chrono::steady_clock>& abstime) {
+    uint64_t tick = 0;
+    if (abstime > origin_) {
+      tick = static_cast<uint64_t>((abstime - origin_ + tick_ - std::chrono::steady_clock::duration(1))
+                                   / tick_);
+    }
+    task->tick_ = tick > current_ ? tick : current_ + 1;
+    insert(task);
+    ++size_;
+    return task->tick_;
+  }
+
+  void remove(Task* task) {
+    unlink(task);
+    --size_;
+  }
+
+  /**
+   * Removes the tasks that run the given runnable, and returns how many
+   * there were.
+   */
+  size_t remove(const shared_ptr<Runnable>& runnable) {
+    size_t removed = 0;
+    for (unsigned level = 0; level < LEVELS; ++level) {
+      for (uint64_t index = 0; index < SLOTS && count_[level] > 0; ++index) {
+        Task* task = slots_[level][index];
+        while (task != nullptr) {
+          Task* next = task->next_;
+          if (*task == runnable) {
+            unlink(task);
+            --size_;
+            task->self_.reset();
+            ++removed;
+          }
+          task = next;
+        }
+      }
+    }
+    return removed;
+  }
+
+  void clear() {
+    for (unsigned level = 0; level < LEVELS; ++level) {
+      for (uint64_t index = 0; index < SLOTS && count_[level] > 0; ++index) {
+        while (slots_[level][index] != nullptr) {
+          Task* task = slots_[level][index];
+          unlink(task);
+          task->self_.reset();
+        }
+      }
+    }
+    size_ = 0;
+  }
+
+  /**
+   * Moves the tasks due by the given tick to expired, in one batch.
+   */
+  void advance(uint64_t now, std::vector<shared_ptr<Task> >& expired) {
+    while (size_ > 0) {
+      uint64_t tick = nextEventTick();
+      if (tick > now) {
+        break;
+      }
+      current_ = tick;
+
+      // Top down, so a task can move down more than one level at once
+      for (unsigned level = LEVELS - 1; level > 0; --level) {
+        if ((tick & ((uint64_t(1) << (SLOT_BITS * level)) - 1)) != 0) {
+          continue;
+        }
+        Task** slot = &slots_[level][(tick >> (SLOT_BITS * level)) & (SLOTS - 1)];
+        Task* task = *slot;
+        while (task != nullptr) {
+          Task* next = task->next_;
+          unlink(task);
+          insert(task);
+          task = next;
+        }
+      }
+
+      Task** slot = &slots_[0][tick & (SLOTS - 1)];
+      while (*slot != nullptr) {
+        Task* task = *slot;
+        unlink(task);
+        --size_;
+        expired.push_back(std::move(task->self_));
+      }
+    }
+
+    // Nothing happens in between, so skipping ahead keeps every task where
+    // it belongs
+    if (current_ < now) {
+      current_ = now;
+    }
+  }
+
+  /**
+   * The next tick at which a slot expires or cascades, or NEVER.
+   */
+  uint64_t nextEventTick() const {
+    uint64_t result = NEVER;
+    for (unsigned level = 0; level < LEVELS; ++level) {
+      if (count_[level] == 0) {
+        continue;
+      }
+      unsigned shift = SLOT_BITS * level;
+      uint64_t base = current_ >> shift;
+      for (uint64_t offset = 1; offset < SLOTS; ++offset) {
+        if (slots_[level][(base + offset) & (SLOTS - 1)] != nullptr) {
+          uint64_t tick = (base + offset) << shift;
+          if (tick < result) {
+            result = tick;
+          }
+          break;
+        }
+      }
+    }
+    return result;
+  }
+
+  size_t size() const { return size_; }
+
+  /**
+   * The tick the dispatcher sleeps until, NEVER if it waits for a task to
+   * be added, or 0 if it is awake and needs no notification.
+   */
+  uint64_t wakeTick_;
+
+private:
+  void insert(Task* task) {
+    uint64_t tick = task->tick_;
+    unsigned level = 0;
+    while (level + 1 < LEVELS
+           && (tick >> (SLOT_BITS * level)) - (current_ >> (SLOT_BITS * level)) >= SLOTS) {
+      ++level;
+    }
+    uint64_t index = tick >> (SLOT_BITS * level);
+    uint64_t last = (current_ >> (SLOT_BITS * level)) + SLOTS - 1;
+    if (index > last) {
+      index = last;
+    }
+
+    Task** slot = &slots_[level][index & (SLOTS - 1)];
+    task->prev_ = nullptr;
+    task->next_ = *slot;
+    if (*slot != nullptr) {
+      (*slot)->prev_ = task;
+    }
+    *slot = task;
+    task->slot_ = slot;
+    ++count_[level];
+  }
+
+  void unlink(Task* task) {
+    if (task->prev_ != nullptr) {
+      task->prev_->next_ = task->next_;
+    } else {
+      *task->slot_ = task->next_;
+    }
+    if (task->next_ != nullptr) {
+      task->next_->prev_ = task->prev_;
+    }
+    --count_[(task->slot_ - &slots_[0][0]) / SLOTS];
+    task->prev_ = nullptr;
+    task->next_ = nullptr;
+    task->slot_ = nullptr;
+  }
+
+  const std::chrono::steady_clock::duration tick_;
+  const std::chrono::time_point<std::chrono::steady_clock> origin_;
+  uint64_t current_;
+  size_t size_;
+  size_t count_[LEVELS];
+  Task* slots_[LEVELS][SLOTS];
+};
+
 class TimerManager::Dispatcher : public Runnable {
 
 public:
@@ -85,6 +329,24 @@ public:
       }
     }
 
+    if (manager_->wheel_) {
+      dispatchWheel();
+    } else {
+      dispatchOrdered();
+    }
+
+    {
+      Synchronized s(manager_->monitor_);
+      if (manager_->state_ == TimerManager::STOPPING) {
+        manager_->state_ = TimerManager::STOPPED;
+        manager_->monitor_.notifyAll();
+      }
+    }
+    return;
+  }
+
+private:
+  void dispatchOrdered() {
     do {
       std::set<shared_ptr<TimerManager::Task> > expiredTasks;
       {
@@ -127,18 +389,44 @@ public:
       }
 
     } while (manager_->state_ == TimerManager::STARTED);
+  }
 
-    {
-      Synchronized s(manager_->monitor_);
-      if (manager_->state_ == TimerManager::STOPPING) {
-        manager_->state_ = TimerManager::STOPPED;
-        manager_->monitor_.notifyAll();
+  void dispatchWheel() {
+    TimerManager::TimingWheel& wheel = *manager_->wheel_;
+    do {
+      std::vector<shared_ptr<TimerManager::Task> > expiredTasks;
+      {
+        Synchronized s(manager_->monitor_);
+        while (manager_->state_ == TimerManager::STARTED) {
+          wheel.advance(wheel.tickOf(std::chrono::steady_clock::now()), expiredTasks);
+          if (!expiredTasks.empty()) {
+            break;
+          }
+          uint64_t next = wheel.nextEventTick();
+          wheel.wakeTick_ = next;
+          if (next == TimerManager::TimingWheel::NEVER) {
+            manager_->monitor_.waitForever();
+          } else {
+            manager_->monitor_.waitForTime(wheel.timeOf(next));
+          }
+          wheel.wakeTick_ = 0;
+        }
+
+        for (const auto& task : expiredTasks) {
+          if (task->state_ == TimerManager::Task::WAITING) {
+            task->state_ = TimerManager::Task::EXECUTING;
+          }
+        }
+        manager_->taskCount_ -= expiredTasks.size();
       }
-    }
-    return;
+
+      for (const auto& expiredTask : expiredTasks) {
+        expiredTask->run();
+      }
+
+    } while (manager_->state_ == TimerManager::STARTED);
   }
 
-private:
   TimerManager* manager_;
   friend class TimerManager;
 };
@@ -154,6 +442,12 @@ TimerManager::TimerManager()
     dispatcher_(std::make_shared<Dispatcher>(this)) {
 }
 
+TimerManager::TimerManager(const std::chrono::milliseconds& tick) : TimerManager() {
+  if (tick.count() > 0) {
+    wheel_.reset(new TimingWheel(tick));
+  }
+}
+
 #if defined(_MSC_VER)
 #pragma warning(pop)
 #endif
@@ -218,6 +512,9 @@ void TimerManager::stop() {
   if (doStop) {
     // Clean up any outstanding tasks
     taskMap_.clear();
+    if (wheel_) {
+      wheel_->clear();
+    }
 
     // Remove dispatcher's reference to us.
     dispatcher_->manager_ = nullptr;
@@ -254,6 +551,21 @@ TimerManager::Timer TimerManager::add(shared_ptr<Runnable> task,
     throw IllegalStateException();
   }
 
+  if (wheel_) {
+    shared_ptr<Task> timer(new Task(task));
+    timer->self_ = timer;
+    uint64_t tick = wheel_->add(timer.get(), abstime);
+    taskCount_++;
+
+    // Only wake the dispatcher if it sleeps past the new task; it is woken
+    // once however many tasks are added before it gets to run
+    if (tick < wheel_->wakeTick_) {
+      wheel_->wakeTick_ = 0;
+      monitor_.notify();
+    }
+    return timer;
+  }
+
   // If the task map is empty, we will kick the dispatcher for sure. Otherwise, we kick him
   // if the expiration time is shorter than the current value. Need to test before we insert,
   // because the new task might insert at the front.
@@ -279,6 +591,11 @@ void TimerManager::remove(shared_ptr<Runnable> task) {
     throw IllegalStateException();
   }
   bool found = false;
+  if (wheel_) {
+    size_t removed = wheel_->remove(task);
+    taskCount_ -= removed;
+    found = removed > 0;
+  }
   for (auto ix = taskMap_.begin(); ix != taskMap_.end();) {
     if (*ix->second == task) {
       found = true;
@@ -304,6 +621,18 @@ void TimerManager::remove(Timer handle) {
     throw NoSuchTaskException();
   }
 
+  if (wheel_) {
+    if (task->slot_ == nullptr) {
+      // Task is being executed
+      throw UncancellableTaskException();
+    }
+    wheel_->remove(task.get());
+    task->state_ = Task::CANCELLED;
+    task->self_.reset();
+    taskCount_--;
+    return;
+  }
+
   if (task->it_ == taskMap_.end()) {
     // Task is being executed
     throw UncancellableTaskException();
@@ -23,6 +23,7 @@
 #include <thrift/concurrency/Monitor.h>
 #include <thrift/concurrency/ThreadFactory.h>
 
+#include <chrono>
 #include <memory>
 #include <map>
 
@@ -35,6 +36,14 @@ namespace concurrency {
  *
  * This class dispatches timer tasks when they fall due.
  *
+ * By default tasks are kept in a map ordered by expiration time, which is
+ * exact but makes adding and removing a task O(log n).  Constructed with a
+ * tick, the manager uses a hierarchical timing wheel instead: adding and
+ * removing a timer is O(1) and all tasks due in a tick are dispatched in one
+ * batch, at the price of tasks running up to one tick late (never early).
+ * This suits large numbers of timeouts that are mostly cancelled before
+ * they expire.
+ *
  * @version $Id:$
  */
 class TimerManager {
@@ -45,6 +54,12 @@ public:
 
   TimerManager();
 
+  /**
+   * Creates a timer manager backed by a timing wheel with the given tick.
+   * A zero tick selects the ordered map, as the default constructor does.
+   */
+  explicit TimerManager(const std::chrono::milliseconds& tick);
+
   virtual ~TimerManager();
 
   virtual std::shared_ptr<const ThreadFactory> threadFactory() const;
@@ -88,7 +103,8 @@ public:
    * Removes a pending task
    *
    * @param task The task to remove. All timers which execute this task will
-   * be removed.
+   * be removed.  This looks at every pending timer; removing timers through
+   * their handle is cheaper.
    * @throws NoSuchTaskException Specified task doesn't exist. It was either
    *                             processed already or this call was made for a
    *                             task that was never added to this timer
@@ -129,6 +145,9 @@ private:
   std::shared_ptr<Thread> dispatcherThread_;
   using task_iterator = decltype(taskMap_)::iterator;
   typedef std::pair<task_iterator, task_iterator> task_range;
+  class TimingWheel;
+  friend class TimingWheel;
+  std::unique_ptr<TimingWheel> wheel_;
 };
 }
 }
@@ -0,0 +1,775 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/concurrency/Exception.h>
+#include <thrift/concurrency/Monitor.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace concurrency {
+
+using std::shared_ptr;
+
+/**
+ * A ThreadManager that gives every worker its own bounded lock free task
+ * queue instead of sharing one deque behind the manager mutex.
+ *
+ * Tasks added from a worker thread go to that worker's queue, tasks added
+ * from any other thread are spread over the queues round robin.  A worker
+ * runs its own queue first and steals from the others when it is empty.
+ * Only when every queue is full do tasks spill into an overflow deque that
+ * is guarded by a mutex.
+ *
+ * The mutex_ is only taken by workers that have nothing to do and go to
+ * sleep, by producers that have to wake them up, and by the rarely used
+ * management calls, so adding and running tasks under load does not
+ * serialize on it.
+ *
+ * Tasks are not run in a strict global FIFO order, and remove(),
+ * removeNextPending() and removeExpiredTasks() work by draining and
+ * refilling the queues, so they are slower than the SimpleThreadManager
+ * ones and may reorder the remaining tasks.
+ */
+class WorkStealingThreadManager : public ThreadManager {
+
+public:
+  WorkStealingThreadManager(size_t workerCount, size_t pendingTaskCountMax);
+
+  ~WorkStealingThreadManager() override { stop(); }
+
+  void start() override;
+  void stop() override;
+
+  ThreadManager::STATE state() const override { return state_; }
+
+  shared_ptr<ThreadFactory> threadFactory() const override {
+    Guard g(mutex_);
+    return threadFactory_;
+  }
+
+  void threadFactory(shared_ptr<ThreadFactory> value) override {
+    Guard g(mutex_);
+    if (threadFactory_ && threadFactory_->isDetached() != value->isDetached()) {
+      throw InvalidArgumentException();
+    }
+    threadFactory_ = value;
+  }
+
+  void addWorker(size_t value) override;
+
+  void removeWorker(size_t value) override;
+
+  size_t idleWorkerCount() const override { return idleCount_; }
+
+  size_t workerCount() const override { return workerCount_; }
+
+  size_t pendingTaskCount() const override { return pendingCount_; }
+
+  size_t totalTaskCount() const override {
+    return pendingCount_ + workerCount_ - idleCount_;
+  }
+
+  size_t pendingTaskCountMax() const override { return pendingTaskCountMax_; }
+
+  size_t expiredTaskCount() const override { return expiredCount_; }
+
+  void add(shared_ptr<Runnable> value, int64_t timeout, int64_t expiration) override;
+
+  void remove(shared_ptr<Runnable> task) override;
+
+  shared_ptr<Runnable> removeNextPending() override;
+
+  void removeExpiredTasks() override {
+    Guard g(mutex_);
+    removeExpired(false);
+  }
+
+  void setExpireCallback(ExpireCallback expireCallback) override {
+    Guard g(mutex_);
+    expireCallback_ = expireCallback;
+  }
+
+  class Worker;
+
+private:
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  /**
+   * A queued task.  Tasks that never expire carry TimePoint::max().
+   */
+  struct PendingTask {
+    shared_ptr<Runnable> runnable;
+    TimePoint expireTime;
+  };
+
+  /**
+   * Bounded multi producer, multi consumer queue (after Dmitry Vyukov).
+   * Every slot carries a sequence number that tells producers and consumers
+   * whose turn it is, so each side only needs one CAS on its own index and
+   * the tasks live in the slots themselves rather than in a node allocated
+   * per task.
+   */
+  class TaskRing {
+  public:
+    explicit TaskRing(size_t capacity);
+
+    bool push(PendingTask& task);
+
+    bool pop(PendingTask& task);
+
+  private:
+    struct Slot {
+      std::atomic<size_t> sequence;
+      PendingTask task;
+    };
+
+    // Keeps the indices that producers and consumers update off each other's
+    // cache lines.
+    static const size_t CACHE_LINE = 64;
+
+    char pad0_[CACHE_LINE];
+    std::unique_ptr<Slot[]> slots_;
+    size_t mask_;
+    char pad1_[CACHE_LINE];
+    std::atomic<size_t> enqueuePos_;
+    char pad2_[CACHE_LINE];
+    std::atomic<size_t> dequeuePos_;
+    char pad3_[CACHE_LINE];
+  };
+
+  static const size_t RING_CAPACITY = 1024;
+
+  /**
+   * Reserves a pending slot if that stays within pendingTaskCountMax_.
+   */
+  bool reservePending();
+
+  void enqueue(PendingTask& task);
+
+  /**
+   * Takes the next task, starting with queue home and stealing from the
+   * others when it is empty.
+   */
+  bool dequeue(size_t home, PendingTask& task);
+
+  /**
+   * Accounts for a task that left the queues without being run by a worker.
+   */
+  void taken(const PendingTask& task);
+
+  /**
+   * Removes one or more expired tasks.  The caller must hold mutex_.
+   * \param[in]  justOne  if true, try to remove just one task and return
+   */
+  void removeExpired(bool justOne);
+
+  bool isExpired(const PendingTask& task, TimePoint now) const {
+    return task.expireTime != TimePoint::max() && task.expireTime < now;
+  }
+
+  /**
+   * \returns whether it is acceptable to block, depending on the current thread
+   */
+  bool canSleep() const;
+
+  /**
+   * Whether a worker should keep running.  The caller must hold mutex_.
+   */
+  bool isActive() const {
+    return workerCount_ <= workerMaxCount_
+           || (state_ == ThreadManager::JOINING && pendingCount_ > 0);
+  }
+
+  void removeWorkersUnderLock(size_t value);
+
+  const size_t initialWorkerCount_;
+  const size_t pendingTaskCountMax_;
+
+  std::vector<std::unique_ptr<TaskRing> > rings_;
+  std::deque<PendingTask> overflow_;
+  Mutex overflowMutex_;
+  std::atomic<size_t> overflowCount_;
+
+  std::atomic<size_t> pendingCount_;
+  std::atomic<size_t> expiringCount_;
+  std::atomic<size_t> idleCount_;
+  std::atomic<size_t> sleepingCount_;
+  std::atomic<size_t> maxWaiterCount_;
+  std::atomic<size_t> expiredCount_;
+  std::atomic<size_t> workerCount_;
+  std::atomic<size_t> workerMaxCount_;
+  std::atomic<ThreadManager::STATE> state_;
+  size_t nextWorkerRing_;
+  ExpireCallback expireCallback_;
+
+  shared_ptr<ThreadFactory> threadFactory_;
+  Mutex mutex_;
+  Monitor monitor_;             // idle workers wait here for tasks
+  Monitor maxMonitor_;          // add() waits here for pending slots
+  Monitor workerMonitor_;       // used to synchronize changes in worker count
+
+  std::set<shared_ptr<Thread> > workers_;
+  std::set<shared_ptr<Thread> > deadWorkers_;
+
+  /**
+   * The manager and queue of the worker running on this thread, if any.
+   */
+  static thread_local WorkStealingThreadManager* currentManager_;
+  static thread_local size_t currentRing_;
+
+  /**
+   * Round robin position of threads that are not workers.
+   */
+  static thread_local size_t nextRing_;
+};
+
+thread_local WorkStealingThreadManager* WorkStealingThreadManager::currentManager_ = nullptr;
+thread_local size_t WorkStealingThreadManager::currentRing_ = 0;
+thread_local size_t WorkStealingThreadManager::nextRing_ = 0;
+
+WorkStealingThreadManager::TaskRing::TaskRing(size_t capacity)
+  : slots_(new Slot[capacity]), mask_(capacity - 1), enqueuePos_(0), dequeuePos_(0) {
+  for (size_t ix = 0; ix < capacity; ix++) {
+    slots_[ix].sequence.store(ix, std::memory_order_relaxed);
+  }
+}
+
+bool WorkStealingThreadManager::TaskRing::push(PendingTask& task) {
+  size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;) {
+    slot = &slots_[pos & mask_];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+    if (diff == 0) {
+      if (enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = enqueuePos_.load(std::memory_order_relaxed);
+    }
+  }
+  slot->task.runnable = std::move(task.runnable);
+  slot->task.expireTime = task.expireTime;
+  slot->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+bool WorkStealingThreadManager::TaskRing::pop(PendingTask& task) {
+  size_t pos = dequeuePos_.load(std::memory_order_relaxed);
+  Slot* slot;
+  for (;;) {
+    slot = &slots_[pos & mask_];
+    size_t sequence = slot->sequence.load(std::memory_order_acquire);
+    auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+    if (diff == 0) {
+      if (dequeuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = dequeuePos_.load(std::memory_order_relaxed);
+    }
+  }
+  task.runnable = std::move(slot->task.runnable);
+  task.expireTime = slot->task.expireTime;
+  slot->sequence.store(pos + mask_ + 1, std::memory_order_release);
+  return true;
+}
+
+class WorkStealingThreadManager::Worker : public Runnable {
+
+public:
+  Worker(WorkStealingThreadManager* manager, size_t ring) : manager_(manager), ring_(ring) {}
+
+  /**
+   * Worker entry point
+   *
+   * Takes tasks from the queues without holding the manager mutex.  The
+   * mutex is only taken to go to sleep when there is nothing to do, and to
+   * leave the pool, so that deciding to exit and decrementing the worker
+   * count happen atomically.
+   */
+  void run() override {
+    {
+      Guard g(manager_->mutex_);
+      if (manager_->workerCount_ >= manager_->workerMaxCount_) {
+        manager_->deadWorkers_.insert(this->thread());
+        return;
+      }
+      manager_->idleCount_++;
+      if (++manager_->workerCount_ == manager_->workerMaxCount_) {
+        manager_->workerMonitor_.notify();
+      }
+    }
+
+    currentManager_ = manager_;
+    currentRing_ = ring_;
+
+    PendingTask task;
+    for (;;) {
+      if (manager_->workerCount_ > manager_->workerMaxCount_
+          || manager_->state_ == ThreadManager::JOINING) {
+        Guard g(manager_->mutex_);
+        if (!manager_->isActive()) {
+          break;
+        }
+      }
+
+      if (manager_->dequeue(ring_, task)) {
+        // Become busy before the task stops being pending, so that
+        // totalTaskCount() never misses it.
+        manager_->idleCount_--;
+        manager_->pendingCount_--;
+        // If we have a pending task max, wake up a thread that might be
+        // blocked on add.
+        if (manager_->maxWaiterCount_ > 0) {
+          Guard g(manager_->mutex_);
+          manager_->maxMonitor_.notify();
+        }
+        execute(task);
+        manager_->idleCount_++;
+        continue;
+      }
+
+      if (manager_->pendingCount_ > 0) {
+        // A producer is between reserving its task and publishing it, or a
+        // remove() is refilling the queues; it will be there in a moment.
+        std::this_thread::yield();
+        continue;
+      }
+
+      Guard g(manager_->mutex_);
+      // Producers count their task before they look for sleepers, and we
+      // count ourselves as a sleeper before we look for tasks, so one of
+      // the two always sees the other.
+      manager_->sleepingCount_++;
+      if (manager_->pendingCount_ == 0 && manager_->isActive()) {
+        manager_->monitor_.wait();
+      }
+      manager_->sleepingCount_--;
+    }
+
+    /**
+     * Final accounting for the worker thread that is done working
+     */
+    currentManager_ = nullptr;
+    {
+      Guard g(manager_->mutex_);
+      manager_->idleCount_--;
+      manager_->deadWorkers_.insert(this->thread());
+      if (--manager_->workerCount_ == manager_->workerMaxCount_) {
+        manager_->workerMonitor_.notify();
+      }
+    }
+  }
+
+private:
+  void execute(PendingTask& task) {
+    shared_ptr<Runnable> runnable = std::move(task.runnable);
+
+    if (task.expireTime != TimePoint::max()) {
+      manager_->expiringCount_--;
+      if (task.expireTime < std::chrono::steady_clock::now()) {
+        ExpireCallback expireCallback;
+        {
+          Guard g(manager_->mutex_);
+          expireCallback = manager_->expireCallback_;
+        }
+        if (expireCallback) {
+          expireCallback(runnable);
+          manager_->expiredCount_++;
+        }
+        return;
+      }
+    }
+
+    try {
+      runnable->run();
+    } catch (const std::exception& e) {
+      GlobalOutput.printf("[ERROR] task->run() raised an exception: %s", e.what());
+    } catch (...) {
+      GlobalOutput.printf("[ERROR] task->run() raised an unknown exception");
+    }
+  }
+
+  WorkStealingThreadManager* manager_;
+  size_t ring_;
+};
+
+WorkStealingThreadManager::WorkStealingThreadManager(size_t workerCount, size_t pendingTaskCountMax)
+  : initialWorkerCount_(workerCount),
+    pendingTaskCountMax_(pendingTaskCountMax),
+    overflowCount_(0),
+    pendingCount_(0),
+    expiringCount_(0),
+    idleCount_(0),
+    sleepingCount_(0),
+    maxWaiterCount_(0),
+    expiredCount_(0),
+    workerCount_(0),
+    workerMaxCount_(0),
+    state_(ThreadManager::UNINITIALIZED),
+    nextWorkerRing_(0),
+    monitor_(&mutex_),
+    maxMonitor_(&mutex_),
+    workerMonitor_(&mutex_) {
+  size_t ringCount = workerCount > 0 ? workerCount : 1;
+  for (size_t ix = 0; ix < ringCount; ix++) {
+    rings_.emplace_back(new TaskRing(RING_CAPACITY));
+  }
+}
+
+void WorkStealingThreadManager::start() {
+  {
+    Guard g(mutex_);
+    if (state_ != ThreadManager::UNINITIALIZED) {
+      return;
+    }
+    if (!threadFactory_) {
+      throw InvalidArgumentException();
+    }
+    state_ = ThreadManager::STARTED;
+  }
+  addWorker(initialWorkerCount_);
+}
+
+void WorkStealingThreadManager::stop() {
+  Guard g(mutex_);
+  bool doStop = false;
+
+  if (state_ != ThreadManager::STOPPING && state_ != ThreadManager::JOINING
+      && state_ != ThreadManager::STOPPED) {
+    doStop = true;
+    state_ = ThreadManager::JOINING;
+  }
+
+  if (doStop) {
+    removeWorkersUnderLock(workerCount_);
+  }
+
+  state_ = ThreadManager::STOPPED;
+}
+
+void WorkStealingThreadManager::addWorker(size_t value) {
+  Guard g(mutex_);
+  std::set<shared_ptr<Thread> > newThreads;
+  for (size_t ix = 0; ix < value; ix++) {
+    size_t ring = nextWorkerRing_++ % rings_.size();
+    newThreads.insert(threadFactory_->newThread(std::make_shared<Worker>(this, ring)));
+  }
+
+  workerMaxCount_ += value;
+  workers_.insert(newThreads.begin(), newThreads.end());
+
+  for (const auto& newThread : newThreads) {
+    newThread->start();
+  }
+
+  while (workerCount_ != workerMaxCount_) {
+    workerMonitor_.wait();
+  }
+}
+
+void WorkStealingThreadManager::removeWorker(size_t value) {
+  Guard g(mutex_);
+  removeWorkersUnderLock(value);
+}
+
+void WorkStealingThreadManager::removeWorkersUnderLock(size_t value) {
+  if (value > workerMaxCount_) {
+    throw InvalidArgumentException();
+  }
+
+  workerMaxCount_ -= value;
+  monitor_.notifyAll();
+
+  while (workerCount_ != workerMaxCount_) {
+    workerMonitor_.wait();
+  }
+
+  for (const auto& deadWorker : deadWorkers_) {
+
+    // when used with a joinable thread factory, we join the threads as we remove them
+    if (!threadFactory_->isDetached()) {
+      deadWorker->join();
+    }
+
+    workers_.erase(deadWorker);
+  }
+
+  deadWorkers_.clear();
+}
+
+bool WorkStealingThreadManager::canSleep() const {
+  return currentManager_ != this;
+}
+
+bool WorkStealingThreadManager::reservePending() {
+  size_t pending = pendingCount_.load();
+  while (pending < pendingTaskCountMax_) {
+    if (pendingCount_.compare_exchange_weak(pending, pending + 1)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void WorkStealingThreadManager::add(shared_ptr<Runnable> value,
+                                    int64_t timeout,
+                                    int64_t expiration) {
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "WorkStealingThreadManager::add ThreadManager "
+        "not started");
+  }
+
+  if (pendingTaskCountMax_ == 0) {
+    pendingCount_++;
+  } else if (!reservePending()) {
+    // if we're at a limit, remove an expired task to see if the limit clears
+    if (expiringCount_ > 0) {
+      Guard g(mutex_);
+      removeExpired(true);
+    }
+
+    if (!reservePending()) {
+      if (!canSleep() || timeout < 0) {
+        throw TooManyPendingTasksException();
+      }
+
+      Guard g(mutex_);
+      // Workers look for waiters after they take a task, so counting
+      // ourselves before checking again means no wakeup is lost.
+      maxWaiterCount_++;
+      try {
+        while (!reservePending()) {
+          maxMonitor_.wait(timeout);
+        }
+      } catch (...) {
+        maxWaiterCount_--;
+        throw;
+      }
+      maxWaiterCount_--;
+    }
+  }
+
+  PendingTask task;
+  task.runnable = std::move(value);
+  if (expiration != 0LL) {
+    task.expireTime = std::chrono::steady_clock::now() + std::chrono::milliseconds(expiration);
+    expiringCount_++;
+  } else {
+    task.expireTime = TimePoint::max();
+  }
+  enqueue(task);
+
+  // If an idle thread is asleep wake it, otherwise the workers are either
+  // running and will get around to this task in time, or about to look.
+  if (sleepingCount_ > 0) {
+    Guard g(mutex_);
+    monitor_.notify();
+  }
+}
+
+void WorkStealingThreadManager::enqueue(PendingTask& task) {
+  size_t first = currentManager_ == this ? currentRing_ : nextRing_++;
+  for (size_t ix = 0; ix < rings_.size(); ix++) {
+    if (rings_[(first + ix) % rings_.size()]->push(task)) {
+      return;
+    }
+  }
+
+  Guard g(overflowMutex_);
+  overflow_.push_back(std::move(task));
+  overflowCount_++;
+}
+
+bool WorkStealingThreadManager::dequeue(size_t home, PendingTask& task) {
+  bool found = false;
+  for (size_t ix = 0; ix < rings_.size() && !found; ix++) {
+    found = rings_[(home + ix) % rings_.size()]->pop(task);
+  }
+
+  if (!found && overflowCount_ > 0) {
+    Guard g(overflowMutex_);
+    if (!overflow_.empty()) {
+      task = std::move(overflow_.front());
+      overflow_.pop_front();
+      overflowCount_--;
+      found = true;
+    }
+  }
+
+  return found;
+}
+
+void WorkStealingThreadManager::taken(const PendingTask& task) {
+  if (task.expireTime != TimePoint::max()) {
+    expiringCount_--;
+  }
+}
+
+void WorkStealingThreadManager::remove(shared_ptr<Runnable> task) {
+  Guard g(mutex_);
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "WorkStealingThreadManager::remove ThreadManager not "
+        "started");
+  }
+
+  std::vector<PendingTask> drained;
+  bool removed = false;
+  for (size_t ix = 0; ix < rings_.size() && !removed; ix++) {
+    PendingTask pending;
+    while (rings_[ix]->pop(pending)) {
+      drained.push_back(std::move(pending));
+    }
+    for (auto it = drained.begin(); it != drained.end(); ++it) {
+      if (it->runnable == task) {
+        taken(*it);
+        drained.erase(it);
+        pendingCount_--;
+        removed = true;
+        break;
+      }
+    }
+    for (auto& remaining : drained) {
+      enqueue(remaining);
+    }
+    drained.clear();
+  }
+
+  if (!removed && overflowCount_ > 0) {
+    Guard og(overflowMutex_);
+    for (auto it = overflow_.begin(); it != overflow_.end(); ++it) {
+      if (it->runnable == task) {
+        taken(*it);
+        overflow_.erase(it);
+        overflowCount_--;
+        pendingCount_--;
+        removed = true;
+        break;
+      }
+    }
+  }
+
+  if (removed && maxWaiterCount_ > 0) {
+    maxMonitor_.notify();
+  }
+}
+
+std::shared_ptr<Runnable> WorkStealingThreadManager::removeNextPending() {
+  Guard g(mutex_);
+  if (state_ != ThreadManager::STARTED) {
+    throw IllegalStateException(
+        "WorkStealingThreadManager::removeNextPending "
+        "ThreadManager not started");
+  }
+
+  PendingTask task;
+  if (!dequeue(0, task)) {
+    return shared_ptr<Runnable>();
+  }
+  taken(task);
+  pendingCount_--;
+  if (maxWaiterCount_ > 0) {
+    maxMonitor_.notify();
+  }
+  return task.runnable;
+}
+
+void WorkStealingThreadManager::removeExpired(bool justOne) {
+  if (expiringCount_ == 0) {
+    return;
+  }
+  auto now = std::chrono::steady_clock::now();
+
+  std::vector<PendingTask> expired;
+  std::vector<PendingTask> drained;
+  for (size_t ix = 0; ix < rings_.size(); ix++) {
+    PendingTask pending;
+    while (rings_[ix]->pop(pending)) {
+      if (isExpired(pending, now) && !(justOne && !expired.empty())) {
+        expired.push_back(std::move(pending));
+      } else {
+        drained.push_back(std::move(pending));
+      }
+    }
+    for (auto& remaining : drained) {
+      enqueue(remaining);
+    }
+    drained.clear();
+    if (justOne && !expired.empty()) {
+      break;
+    }
+  }
+
+  if (!(justOne && !expired.empty()) && overflowCount_ > 0) {
+    Guard og(overflowMutex_);
+    for (auto it = overflow_.begin(); it != overflow_.end();) {
+      if (isExpired(*it, now)) {
+        expired.push_back(std::move(*it));
+        it = overflow_.erase(it);
+        overflowCount_--;
+        if (justOne) {
+          break;
+        }
+      } else {
+        ++it;
+      }
+    }
+  }
+
+  for (auto& task : expired) {
+    taken(task);
+    pendingCount_--;
+    if (expireCallback_) {
+      expireCallback_(task.runnable);
+    }
+    ++expiredCount_;
+  }
+
+  if (!expired.empty() && maxWaiterCount_ > 0) {
+    maxMonitor_.notifyAll();
+  }
+}
+
+shared_ptr<ThreadManager> ThreadManager::newWorkStealingThreadManager(size_t count,
+                                                                     size_t pendingTaskCountMax) {
+  return shared_ptr<ThreadManager>(new WorkStealingThreadManager(count, pendingTaskCountMax));
+}
+}
+}
+} // apache::thrift::concurrency
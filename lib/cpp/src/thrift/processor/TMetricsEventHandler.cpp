@@ -0,0 +1,363 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/processor/TMetricsEventHandler.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <unordered_map>
+
+using apache::thrift::concurrency::Guard;
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+typedef TMetricsEventHandler::Histogram Histogram;
+
+/**
+ * The start of the current phase of a call.
+ */
+struct Context {
+  Clock::time_point mark;
+};
+
+/**
+ * Contexts freed on this thread, for the next calls to reuse.
+ */
+class ContextPool {
+public:
+  ~ContextPool() {
+    for (Context* context : free_) {
+      delete context;
+    }
+  }
+
+  Context* get() {
+    if (free_.empty()) {
+      return new Context();
+    }
+    Context* context = free_.back();
+    free_.pop_back();
+    return context;
+  }
+
+  void put(Context* context) {
+    if (free_.size() < MAX_FREE) {
+      free_.push_back(context);
+    } else {
+      delete context;
+    }
+  }
+
+private:
+  static const size_t MAX_FREE = 64;
+
+  std::vector<Context*> free_;
+};
+
+ContextPool& contextPool() {
+  static thread_local ContextPool pool;
+  return pool;
+}
+
+// Only the thread that owns a shard writes its counters, so a relaxed load
+// and store is enough, and readers see each value whole
+inline void bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+  counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+/**
+ * The live side of a Histogram, written by one thread and read by any.
+ */
+class LiveHistogram {
+public:
+  LiveHistogram() : sum_(0), max_(0) {
+    for (auto& count : counts_) {
+      count.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  void record(Clock::time_point from, Clock::time_point to) {
+    uint64_t latency
+        = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(to - from)
+                                    .count());
+    bump(counts_[Histogram::bucketOf(latency)], 1);
+    bump(sum_, latency);
+    if (latency > max_.load(std::memory_order_relaxed)) {
+      max_.store(latency, std::memory_order_relaxed);
+    }
+  }
+
+  void addTo(std::vector<uint64_t>& counts, uint64_t& sum, uint64_t& max) const {
+    for (size_t i = 0; i < Histogram::BUCKETS; ++i) {
+      counts[i] += counts_[i].load(std::memory_order_relaxed);
+    }
+    sum += sum_.load(std::memory_order_relaxed);
+    max = (std::max)(max, max_.load(std::memory_order_relaxed));
+  }
+
+private:
+  std::atomic<uint64_t> counts_[Histogram::BUCKETS];
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+};
+
+std::atomic<uint64_t> nextHandlerId(0);
+}
+
+struct TMetricsEventHandler::Counters {
+  Counters() : calls(0), errors(0), bytesRead(0), bytesWritten(0) {}
+
+  std::atomic<uint64_t> calls;
+  std::atomic<uint64_t> errors;
+  std::atomic<uint64_t> bytesRead;
+  std::atomic<uint64_t> bytesWritten;
+  LiveHistogram readLatency;
+  LiveHistogram handlerLatency;
+  LiveHistogram writeLatency;
+};
+
+/**
+ * The counters of one thread.  The method names are looked up by the
+ * address of the name the processor passes, which is a string literal in
+ * generated code, and only the owning thread uses that index.  The mutex
+ * guards adding a method against getMetrics() walking the methods.
+ */
+struct TMetricsEventHandler::Shard {
+  concurrency::Mutex mutex;
+  std::map<std::string, std::unique_ptr<Counters> > methods;
+  std::unordered_map<const char*, Counters*> byAddress;
+};
+
+Histogram::Histogram() : counts_(BUCKETS, 0), count_(0), sum_(0), max_(0) {}
+
+size_t Histogram::bucketOf(uint64_t latency) {
+  if (latency < 2 * SUB_BUCKETS) {
+    return static_cast<size_t>(latency);
+  }
+  latency = (std::min)(latency, (static_cast<uint64_t>(1) << MAX_BITS) - 1);
+#if defined(__GNUC__)
+  int topBit = 63 - __builtin_clzll(latency);
+#else
+  int topBit = 0;
+  for (uint64_t rest = latency; rest > 1; rest >>= 1) {
+    ++topBit;
+  }
+#endif
+  int shift = topBit - SUB_BITS;
+  return static_cast<size_t>(shift) * SUB_BUCKETS + static_cast<size_t>(latency >> shift);
+}
+
+uint64_t Histogram::bucketLowest(size_t bucket) {
+  if (bucket < 2 * SUB_BUCKETS) {
+    return bucket;
+  }
+  size_t shift = bucket / SUB_BUCKETS - 1;
+  return static_cast<uint64_t>(bucket - shift * SUB_BUCKETS) << shift;
+}
+
+uint64_t Histogram::bucketHighest(size_t bucket) {
+  if (bucket < 2 * SUB_BUCKETS) {
+    return bucket;
+  }
+  size_t shift = bucket / SUB_BUCKETS - 1;
+  return bucketLowest(bucket) + (static_cast<uint64_t>(1) << shift) - 1;
+}
+
+uint64_t Histogram::percentile(double percentile) const {
+  if (count_ == 0) {
+    return 0;
+  }
+  uint64_t wanted = static_cast<uint64_t>(std::ceil(percentile / 100 * count_));
+  wanted = (std::max)(wanted, static_cast<uint64_t>(1));
+  uint64_t seen = 0;
+  for (size_t i = 0; i < BUCKETS; ++i) {
+    seen += counts_[i];
+    if (seen >= wanted) {
+      return (std::min)(bucketHighest(i), max_);
+    }
+  }
+  return max_;
+}
+
+void Histogram::add(const Histogram& other) {
+  for (size_t i = 0; i < BUCKETS; ++i) {
+    counts_[i] += other.counts_[i];
+  }
+  count_ += other.count_;
+  sum_ += other.sum_;
+  max_ = (std::max)(max_, other.max_);
+}
+
+TMetricsEventHandler::TMetricsEventHandler() : id_(nextHandlerId.fetch_add(1)) {}
+
+TMetricsEventHandler::~TMetricsEventHandler() = default;
+
+std::map<std::string, TMetricsEventHandler::MethodMetrics> TMetricsEventHandler::getMetrics()
+    const {
+  std::vector<std::shared_ptr<Shard> > shards;
+  {
+    Guard g(mutex_);
+    shards = shards_;
+  }
+
+  std::map<std::string, MethodMetrics> metrics;
+  for (const std::shared_ptr<Shard>& shard : shards) {
+    Guard g(shard->mutex);
+    for (const auto& method : shard->methods) {
+      const Counters& counters = *method.second;
+      MethodMetrics& out = metrics[method.first];
+      out.calls += counters.calls.load(std::memory_order_relaxed);
+      out.errors += counters.errors.load(std::memory_order_relaxed);
+      out.bytesRead += counters.bytesRead.load(std::memory_order_relaxed);
+      out.bytesWritten += counters.bytesWritten.load(std::memory_order_relaxed);
+      counters.readLatency.addTo(out.readLatency.counts_, out.readLatency.sum_,
+                                 out.readLatency.max_);
+      counters.handlerLatency.addTo(out.handlerLatency.counts_, out.handlerLatency.sum_,
+                                    out.handlerLatency.max_);
+      counters.writeLatency.addTo(out.writeLatency.counts_, out.writeLatency.sum_,
+                                  out.writeLatency.max_);
+    }
+  }
+
+  // The counts are summed from the buckets, so that they agree with the
+  // percentiles even if a latency was recorded while they were copied
+  for (auto& method : metrics) {
+    for (Histogram* histogram : {&method.second.readLatency, &method.second.handlerLatency,
+                                 &method.second.writeLatency}) {
+      histogram->count_ = 0;
+      for (uint64_t count : histogram->counts_) {
+        histogram->count_ += count;
+      }
+    }
+  }
+  return metrics;
+}
+
+TMetricsEventHandler::Shard& TMetricsEventHandler::localShard() {
+  // The shards of each handler this thread has used.  A shard whose handler
+  // is gone is only held here, and is dropped when the next one is added.
+  static thread_local std::vector<std::pair<uint64_t, std::shared_ptr<Shard> > > shards;
+
+  for (auto& entry : shards) {
+    if (entry.first == id_) {
+      return *entry.second;
+    }
+  }
+
+  shards.erase(std::remove_if(shards.begin(),
+                              shards.end(),
+                              [](const std::pair<uint64_t, std::shared_ptr<Shard> >& entry) {
+                                return entry.second.use_count() == 1;
+                              }),
+               shards.end());
+
+  std::shared_ptr<Shard> shard(new Shard());
+  {
+    Guard g(mutex_);
+    shards_.push_back(shard);
+  }
+  shards.push_back(std::make_pair(id_, shard));
+  return *shard;
+}
+
+TMetricsEventHandler::Counters& TMetricsEventHandler::localCounters(const char* fn_name) {
+  Shard& shard = localShard();
+  auto found = shard.byAddress.find(fn_name);
+  if (found != shard.byAddress.end()) {
+    return *found->second;
+  }
+
+  Counters* counters;
+  {
+    Guard g(shard.mutex);
+    std::unique_ptr<Counters>& method = shard.methods[fn_name];
+    if (!method) {
+      method.reset(new Counters());
+    }
+    counters = method.get();
+  }
+  shard.byAddress[fn_name] = counters;
+  return *counters;
+}
+
+void* TMetricsEventHandler::getContext(const char* fn_name, void* serverContext) {
+  (void)serverContext;
+  bump(localCounters(fn_name).calls, 1);
+  Context* context = contextPool().get();
+  context->mark = Clock::now();
+  return context;
+}
+
+void TMetricsEventHandler::freeContext(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  if (ctx != nullptr) {
+    contextPool().put(static_cast<Context*>(ctx));
+  }
+}
+
+void TMetricsEventHandler::preRead(void* ctx, const char* fn_name) {
+  (void)fn_name;
+  static_cast<Context*>(ctx)->mark = Clock::now();
+}
+
+void TMetricsEventHandler::postRead(void* ctx, const char* fn_name, uint32_t bytes) {
+  Context* context = static_cast<Context*>(ctx);
+  Clock::time_point now = Clock::now();
+  Counters& counters = localCounters(fn_name);
+  counters.readLatency.record(context->mark, now);
+  bump(counters.bytesRead, bytes);
+  context->mark = now;
+}
+
+void TMetricsEventHandler::preWrite(void* ctx, const char* fn_name) {
+  Context* context = static_cast<Context*>(ctx);
+  Clock::time_point now = Clock::now();
+  localCounters(fn_name).handlerLatency.record(context->mark, now);
+  context->mark = now;
+}
+
+void TMetricsEventHandler::postWrite(void* ctx, const char* fn_name, uint32_t bytes) {
+  Context* context = static_cast<Context*>(ctx);
+  Counters& counters = localCounters(fn_name);
+  counters.writeLatency.record(context->mark, Clock::now());
+  bump(counters.bytesWritten, bytes);
+}
+
+void TMetricsEventHandler::asyncComplete(void* ctx, const char* fn_name) {
+  Context* context = static_cast<Context*>(ctx);
+  localCounters(fn_name).handlerLatency.record(context->mark, Clock::now());
+}
+
+void TMetricsEventHandler::handlerError(void* ctx, const char* fn_name) {
+  Context* context = static_cast<Context*>(ctx);
+  Counters& counters = localCounters(fn_name);
+  counters.handlerLatency.record(context->mark, Clock::now());
+  bump(counters.errors, 1);
+}
+}
+}
+} // apache::thrift::processor
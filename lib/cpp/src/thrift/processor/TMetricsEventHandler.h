@@ -0,0 +1,167 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_PROCESSOR_TMETRICSEVENTHANDLER_H_
+#define _THRIFT_PROCESSOR_TMETRICSEVENTHANDLER_H_ 1
+
+#include <thrift/TProcessor.h>
+#include <thrift/concurrency/Mutex.h>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace processor {
+
+/**
+ * Processor event handler that keeps per-method call, error and byte counts,
+ * and latency histograms of the read, handler and write phases of each call.
+ *
+ * Every thread records into a shard of its own, so the hooks take no locks
+ * and do no atomic read-modify-writes; a lock is only taken the first
+ * time a thread sees a method.  getMetrics() sums the shards into a
+ * snapshot.  The counts are cumulative; to get rates, take the difference
+ * of two snapshots.
+ *
+ * The read phase runs from preRead() to postRead(), the handler phase from
+ * postRead() to preWrite(), handlerError() or asyncComplete(), and the write
+ * phase from preWrite() to postWrite().  Latencies are in nanoseconds.
+ *
+ *   std::shared_ptr<TMetricsEventHandler> metrics(new TMetricsEventHandler());
+ *   processor->setEventHandler(metrics);
+ *   ...
+ *   for (const auto& method : metrics->getMetrics()) {
+ *     export(method.first, method.second.calls, method.second.handlerLatency.percentile(99));
+ *   }
+ */
+class TMetricsEventHandler : public TProcessorEventHandler {
+public:
+  /**
+   * Counts of latencies, in buckets that are within 1/8 of each other above
+   * 16 ns, the layout of an HdrHistogram with three significant bits.
+   * Latencies of more than about 68 seconds are counted as 68 seconds.
+   */
+  class Histogram {
+  public:
+    static const int SUB_BITS = 3;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int MAX_BITS = 36;
+    static const size_t BUCKETS = (MAX_BITS - SUB_BITS + 1) * SUB_BUCKETS;
+
+    Histogram();
+
+    uint64_t count() const { return count_; }
+
+    uint64_t max() const { return max_; }
+
+    uint64_t sum() const { return sum_; }
+
+    double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0; }
+
+    /**
+     * The highest latency in the bucket that holds the given percentile, in
+     * the range [0, 100].  Zero if nothing has been counted.
+     */
+    uint64_t percentile(double percentile) const;
+
+    /**
+     * The number of latencies in a bucket, and the range of latencies the
+     * bucket holds, for exporting the whole distribution.
+     */
+    uint64_t bucketCount(size_t bucket) const { return counts_[bucket]; }
+
+    static uint64_t bucketLowest(size_t bucket);
+
+    static uint64_t bucketHighest(size_t bucket);
+
+    static size_t bucketOf(uint64_t latency);
+
+    void add(const Histogram& other);
+
+  private:
+    friend class TMetricsEventHandler;
+
+    std::vector<uint64_t> counts_;
+    uint64_t count_;
+    uint64_t sum_;
+    uint64_t max_;
+  };
+
+  struct MethodMetrics {
+    MethodMetrics() : calls(0), errors(0), bytesRead(0), bytesWritten(0) {}
+
+    // Calls started, whether or not they finished
+    uint64_t calls;
+    // Calls whose handler threw an undeclared exception
+    uint64_t errors;
+    uint64_t bytesRead;
+    uint64_t bytesWritten;
+    Histogram readLatency;
+    Histogram handlerLatency;
+    Histogram writeLatency;
+  };
+
+  TMetricsEventHandler();
+
+  ~TMetricsEventHandler() override;
+
+  /**
+   * A snapshot of the metrics of every method called so far, by the name
+   * the processor gives it, e.g. "Calculator.add".  Calls still in flight
+   * may be counted in some fields and not yet in others.
+   */
+  std::map<std::string, MethodMetrics> getMetrics() const;
+
+  void* getContext(const char* fn_name, void* serverContext) override;
+
+  void freeContext(void* ctx, const char* fn_name) override;
+
+  void preRead(void* ctx, const char* fn_name) override;
+
+  void postRead(void* ctx, const char* fn_name, uint32_t bytes) override;
+
+  void preWrite(void* ctx, const char* fn_name) override;
+
+  void postWrite(void* ctx, const char* fn_name, uint32_t bytes) override;
+
+  void asyncComplete(void* ctx, const char* fn_name) override;
+
+  void handlerError(void* ctx, const char* fn_name) override;
+
+private:
+  struct Counters;
+  struct Shard;
+
+  Counters& localCounters(const char* fn_name);
+
+  Shard& localShard();
+
+  const uint64_t id_;
+  mutable concurrency::Mutex mutex_;
+  std::vector<std::shared_ptr<Shard> > shards_;
+};
+}
+}
+} // apache::thrift::processor
+
+#endif // #ifndef _THRIFT_PROCESSOR_TMETRICSEVENTHANDLER_H_
@@ -119,6 +119,20 @@ public:
 
   inline uint32_t writeBinary(const std::string& str);
 
+  inline uint32_t writeStringSlice(const TSlice& str);
+
+  inline uint32_t writeBinarySlice(const TSlice& str);
+
+  /**
+   * Write runs of list or set elements with one byte swapping pass and as
+   * few transport writes as possible, instead of one write per element.
+   */
+  uint32_t writeI32Array(const int32_t* values, uint32_t count);
+
+  uint32_t writeI64Array(const int64_t* values, uint32_t count);
+
+  uint32_t writeDoubleArray(const double* values, uint32_t count);
+
   /**
    * Reading functions
    */
@@ -166,6 +180,24 @@ public:
 
   inline uint32_t readBinary(std::string& str);
 
+  /**
+   * Reads a string as a slice of the transport's read buffer if the
+   * transport can borrow and pin it, and as a copy otherwise.
+   */
+  inline uint32_t readStringSlice(TSlice& str);
+
+  inline uint32_t readBinarySlice(TSlice& str);
+
+  /**
+   * Read runs of list or set elements with a single transport read and one
+   * byte swapping pass.
+   */
+  uint32_t readI32Array(int32_t* values, uint32_t count);
+
+  uint32_t readI64Array(int64_t* values, uint32_t count);
+
+  uint32_t readDoubleArray(double* values, uint32_t count);
+
   int getMinSerializedSize(TType type);
 
   void checkReadBytesAvailable(TSet& set)
@@ -188,6 +220,19 @@ protected:
   template <typename StrType>
   uint32_t readStringBody(StrType& str, int32_t sz);
 
+  uint32_t readSliceBody(TSlice& str, int32_t sz);
+
+  template <typename Wire, typename T>
+  uint32_t writeFixedArray(const T* values, uint32_t count);
+
+  template <typename Wire, typename T>
+  uint32_t readFixedArray(T* values, uint32_t count);
+
+  static uint32_t toWire(uint32_t x) { return ByteOrder_::toWire32(x); }
+  static uint64_t toWire(uint64_t x) { return ByteOrder_::toWire64(x); }
+  static uint32_t fromWire(uint32_t x) { return ByteOrder_::fromWire32(x); }
+  static uint64_t fromWire(uint64_t x) { return ByteOrder_::fromWire64(x); }
+
   Transport_* trans_;
 
   int32_t string_limit_;
@@ -23,6 +23,8 @@
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/transport/TTransportException.h>
 
+#include <algorithm>
+#include <cstring>
 #include <limits>
 
 namespace apache {
@@ -193,6 +195,73 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeBinary(const std::string
   return TBinaryProtocolT<Transport_, ByteOrder_>::writeString(str);
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeStringSlice(const TSlice& str) {
+  return TBinaryProtocolT<Transport_, ByteOrder_>::writeString(str);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeBinarySlice(const TSlice& str) {
+  return TBinaryProtocolT<Transport_, ByteOrder_>::writeString(str);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeI32Array(const int32_t* values,
+                                                                 uint32_t count) {
+  return writeFixedArray<uint32_t>(values, count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeI64Array(const int64_t* values,
+                                                                 uint32_t count) {
+  return writeFixedArray<uint64_t>(values, count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeDoubleArray(const double* values,
+                                                                    uint32_t count) {
+  static_assert(sizeof(double) == sizeof(uint64_t), "sizeof(double) == sizeof(uint64_t)");
+  static_assert(std::numeric_limits<double>::is_iec559, "std::numeric_limits<double>::is_iec559");
+  return writeFixedArray<uint64_t>(values, count);
+}
+
+template <class Transport_, class ByteOrder_>
+template <typename Wire, typename T>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::writeFixedArray(const T* values,
+                                                                   uint32_t count) {
+  static_assert(sizeof(Wire) == sizeof(T), "sizeof(Wire) == sizeof(T)");
+  // Chunks keep each transport write well below 4GB.
+  const uint32_t maxChunk = 1 << 20;
+
+  if (toWire(Wire(1)) == Wire(1)) {
+    // The host already uses the wire byte order, so the array is written
+    // exactly as it is laid out in memory.
+    for (uint32_t done = 0; done < count;) {
+      uint32_t n = (std::min)(count - done, maxChunk);
+      this->trans_->write(reinterpret_cast<const uint8_t*>(values + done),
+                          static_cast<uint32_t>(n * sizeof(Wire)));
+      done += n;
+    }
+    return static_cast<uint32_t>(count * sizeof(Wire));
+  }
+
+  // Swap through a small buffer that stays in cache.  The loop is simple
+  // enough for the compiler to vectorize.
+  Wire swapped[512];
+  const uint32_t swappedSize = sizeof(swapped) / sizeof(swapped[0]);
+  for (uint32_t done = 0; done < count;) {
+    uint32_t n = (std::min)(count - done, swappedSize);
+    std::memcpy(swapped, values + done, n * sizeof(Wire));
+    for (uint32_t i = 0; i < n; ++i) {
+      swapped[i] = toWire(swapped[i]);
+    }
+    this->trans_->write(reinterpret_cast<const uint8_t*>(swapped),
+                        static_cast<uint32_t>(n * sizeof(Wire)));
+    done += n;
+  }
+  return static_cast<uint32_t>(count * sizeof(Wire));
+}
+
 /**
  * Reading functions
  */
@@ -414,6 +483,49 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readDouble(double& dub) {
   return 8;
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readI32Array(int32_t* values, uint32_t count) {
+  return readFixedArray<uint32_t>(values, count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readI64Array(int64_t* values, uint32_t count) {
+  return readFixedArray<uint64_t>(values, count);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readDoubleArray(double* values, uint32_t count) {
+  static_assert(sizeof(double) == sizeof(uint64_t), "sizeof(double) == sizeof(uint64_t)");
+  static_assert(std::numeric_limits<double>::is_iec559, "std::numeric_limits<double>::is_iec559");
+  return readFixedArray<uint64_t>(values, count);
+}
+
+template <class Transport_, class ByteOrder_>
+template <typename Wire, typename T>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readFixedArray(T* values, uint32_t count) {
+  static_assert(sizeof(Wire) == sizeof(T), "sizeof(Wire) == sizeof(T)");
+  const uint32_t maxChunk = 1 << 20;
+
+  for (uint32_t done = 0; done < count;) {
+    uint32_t n = (std::min)(count - done, maxChunk);
+    this->trans_->readAll(reinterpret_cast<uint8_t*>(values + done),
+                          static_cast<uint32_t>(n * sizeof(Wire)));
+    done += n;
+  }
+
+  if (toWire(Wire(1)) != Wire(1)) {
+    // Swap in place, going through memcpy so doubles are never accessed
+    // through an integer pointer.
+    for (uint32_t i = 0; i < count; ++i) {
+      Wire wire;
+      std::memcpy(&wire, values + i, sizeof(wire));
+      wire = fromWire(wire);
+      std::memcpy(values + i, &wire, sizeof(wire));
+    }
+  }
+  return static_cast<uint32_t>(count * sizeof(Wire));
+}
+
 template <class Transport_, class ByteOrder_>
 template <typename StrType>
 uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readString(StrType& str) {
@@ -428,6 +540,19 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readBinary(std::string& str)
   return TBinaryProtocolT<Transport_, ByteOrder_>::readString(str);
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readStringSlice(TSlice& str) {
+  uint32_t result;
+  int32_t size;
+  result = readI32(size);
+  return result + readSliceBody(str, size);
+}
+
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readBinarySlice(TSlice& str) {
+  return TBinaryProtocolT<Transport_, ByteOrder_>::readStringSlice(str);
+}
+
 template <class Transport_, class ByteOrder_>
 template <typename StrType>
 uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readStringBody(StrType& str, int32_t size) {
@@ -461,6 +586,29 @@ uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readStringBody(StrType& str,
   return (uint32_t)size;
 }
 
+template <class Transport_, class ByteOrder_>
+uint32_t TBinaryProtocolT<Transport_, ByteOrder_>::readSliceBody(TSlice& str, int32_t size) {
+  // Error cases and transports that can't pin their buffer are left to
+  // readStringBody.
+  if (size > 0 && (this->string_limit_ <= 0 || size <= this->string_limit_)) {
+    const uint8_t* borrow_buf;
+    uint32_t got = size;
+    if ((borrow_buf = this->trans_->borrow(nullptr, &got))) {
+      std::shared_ptr<const void> owner = this->trans_->pinReadBuffer();
+      if (owner) {
+        str = TSlice(borrow_buf, size, std::move(owner));
+        this->trans_->consume(size);
+        return (uint32_t)size;
+      }
+    }
+  }
+
+  std::string copy;
+  uint32_t result = readStringBody(copy, size);
+  str = TSlice(std::move(copy));
+  return result;
+}
+
 // Return the minimum number of bytes a type will consume on the wire
 template <class Transport_, class ByteOrder_>
 int TBinaryProtocolT<Transport_, ByteOrder_>::getMinSerializedSize(TType type)
@@ -0,0 +1,213 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/protocol/TCompactProtocol.h>
+
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace apache {
+namespace thrift {
+namespace protocol {
+namespace detail {
+namespace compact {
+
+namespace {
+
+inline int32_t zigzagDecode(uint64_t n, int32_t*) {
+  // Same truncation as readVarint32() followed by zigzagToI32().
+  auto u = static_cast<uint32_t>(n);
+  return static_cast<int32_t>((u >> 1) ^ static_cast<uint32_t>(-static_cast<int32_t>(u & 1)));
+}
+
+inline int64_t zigzagDecode(uint64_t n, int64_t*) {
+  return static_cast<int64_t>((n >> 1) ^ static_cast<uint64_t>(-static_cast<int64_t>(n & 1)));
+}
+
+#if __THRIFT_BYTE_ORDER == __THRIFT_LITTLE_ENDIAN \
+    && (defined(__GNUC__) || (defined(_MSC_VER) && defined(_M_X64)))
+#define THRIFT_COMPACT_WORD_DECODE 1
+
+const uint64_t CONTINUATION_BITS = 0x8080808080808080ULL;
+const uint64_t PAYLOAD_BITS = 0x7f7f7f7f7f7f7f7fULL;
+
+inline unsigned countTrailingZeros(uint64_t word) {
+#ifdef _MSC_VER
+  unsigned long index;
+  _BitScanForward64(&index, word);
+  return static_cast<unsigned>(index);
+#else
+  return static_cast<unsigned>(__builtin_ctzll(word));
+#endif
+}
+
+/*
+ * Concatenate the 7 bit payloads of a varint of up to 8 bytes that has been
+ * loaded into a little endian word, with everything past its last byte
+ * already masked off.
+ */
+struct GatherPortable {
+  static uint64_t gather(uint64_t word) {
+    return (word & 0x7fULL) | ((word >> 1) & (0x7fULL << 7)) | ((word >> 2) & (0x7fULL << 14))
+           | ((word >> 3) & (0x7fULL << 21)) | ((word >> 4) & (0x7fULL << 28))
+           | ((word >> 5) & (0x7fULL << 35)) | ((word >> 6) & (0x7fULL << 42))
+           | ((word >> 7) & (0x7fULL << 49));
+  }
+};
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define THRIFT_COMPACT_PEXT 1
+
+/*
+ * Same as GatherPortable with a single BMI2 instruction.  Inline assembly
+ * keeps this usable without compiling the library for BMI2; callers have to
+ * check that the CPU supports it.
+ */
+struct GatherPext {
+  static uint64_t gather(uint64_t word) {
+    uint64_t result;
+    __asm__("pextq %2, %1, %0" : "=r"(result) : "r"(word), "r"(PAYLOAD_BITS));
+    return result;
+  }
+};
+#endif
+#endif
+
+/*
+ * Byte at a time decoding, used near the end of the buffer and for varints
+ * too long for a single word.  Returns false, without moving pos, if the
+ * buffer ends before the varint does.
+ */
+inline bool readVarintBytes(const uint8_t*& pos, const uint8_t* end, uint64_t& value) {
+  const uint8_t* p = pos;
+  uint64_t val = 0;
+  int shift = 0;
+  while (p != end) {
+    uint8_t byte = *p++;
+    val |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      value = val;
+      pos = p;
+      return true;
+    }
+    // Have to check for invalid data so we don't crash.
+    if (p - pos == 10) {
+      throw TProtocolException(TProtocolException::INVALID_DATA,
+                               "Variable-length int over 10 bytes.");
+    }
+    shift += 7;
+  }
+  return false;
+}
+
+template <typename T>
+uint32_t readVarintsBytewise(const uint8_t** buf, const uint8_t* end, T* values, uint32_t count) {
+  const uint8_t* pos = *buf;
+  uint32_t i = 0;
+  uint64_t value;
+  while (i < count && readVarintBytes(pos, end, value)) {
+    values[i++] = zigzagDecode(value, values);
+  }
+  *buf = pos;
+  return i;
+}
+
+#ifdef THRIFT_COMPACT_WORD_DECODE
+/*
+ * Looks at eight bytes at a time and finds the end of the varint from the
+ * continuation bits, so a value costs the same no matter how many bytes it
+ * takes up, instead of one branch per byte.
+ */
+template <typename Gather, typename T>
+uint32_t readVarintsWordwise(const uint8_t** buf, const uint8_t* end, T* values, uint32_t count) {
+  const uint8_t* pos = *buf;
+  uint32_t i = 0;
+  while (i < count && end - pos >= 8) {
+    uint64_t word;
+    std::memcpy(&word, pos, sizeof(word));
+    if (!(word & 0x80)) {
+      // Single byte values are common enough to be worth a shortcut.
+      values[i++] = zigzagDecode(word & 0x7f, values);
+      ++pos;
+      continue;
+    }
+    uint64_t stops = ~word & CONTINUATION_BITS;
+    if (stops == 0) {
+      // Nine or ten bytes long.
+      uint64_t value;
+      if (!readVarintBytes(pos, end, value)) {
+        break;
+      }
+      values[i++] = zigzagDecode(value, values);
+      continue;
+    }
+    unsigned bits = countTrailingZeros(stops) + 1;
+    if (bits < 64) {
+      word &= (1ULL << bits) - 1;
+    }
+    values[i++] = zigzagDecode(Gather::gather(word), values);
+    pos += bits / 8;
+  }
+  *buf = pos;
+  return i + readVarintsBytewise(buf, end, values + i, count - i);
+}
+
+bool useGatherPext() {
+#ifdef THRIFT_COMPACT_PEXT
+  // pext is microcoded, and slower than the portable code, on AMD CPUs
+  // before Zen 3, so only use it where it is known to be fast.
+  static const bool use = __builtin_cpu_supports("bmi2") && __builtin_cpu_is("intel");
+  return use;
+#else
+  return false;
+#endif
+}
+
+template <typename T>
+uint32_t readVarints(const uint8_t** buf, const uint8_t* end, T* values, uint32_t count) {
+#ifdef THRIFT_COMPACT_PEXT
+  if (useGatherPext()) {
+    return readVarintsWordwise<GatherPext>(buf, end, values, count);
+  }
+#endif
+  return readVarintsWordwise<GatherPortable>(buf, end, values, count);
+}
+#else
+template <typename T>
+uint32_t readVarints(const uint8_t** buf, const uint8_t* end, T* values, uint32_t count) {
+  return readVarintsBytewise(buf, end, values, count);
+}
+#endif
+}
+
+uint32_t readZigzagVarints(const uint8_t** buf, const uint8_t* end, int32_t* values, uint32_t count) {
+  return readVarints(buf, end, values, count);
+}
+
+uint32_t readZigzagVarints(const uint8_t** buf, const uint8_t* end, int64_t* values, uint32_t count) {
+  return readVarints(buf, end, values, count);
+}
+}
+}
+}
+}
+} // apache::thrift::protocol::detail::compact
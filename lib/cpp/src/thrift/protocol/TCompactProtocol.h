@@ -29,6 +29,22 @@ namespace apache {
 namespace thrift {
 namespace protocol {
 
+namespace detail {
+namespace compact {
+
+/**
+ * Decodes up to count zigzag varints from the buffer starting at *buf into
+ * values, and advances *buf past them.  Stops early if the buffer ends in
+ * the middle of a varint.
+ *
+ * @return the number of values decoded
+ * @throws TProtocolException if a varint is longer than 10 bytes
+ */
+uint32_t readZigzagVarints(const uint8_t** buf, const uint8_t* end, int32_t* values, uint32_t count);
+uint32_t readZigzagVarints(const uint8_t** buf, const uint8_t* end, int64_t* values, uint32_t count);
+}
+} // detail::compact
+
 /**
  * C++ Implementation of the Compact Protocol as described in THRIFT-110
  */
@@ -140,6 +156,10 @@ public:
 
   uint32_t writeBinary(const std::string& str);
 
+  uint32_t writeStringSlice(const TSlice& str);
+
+  uint32_t writeBinarySlice(const TSlice& str);
+
   int getMinSerializedSize(TType type);
 
   void checkReadBytesAvailable(TSet& set)
@@ -213,6 +233,22 @@ public:
 
   uint32_t readBinary(std::string& str);
 
+  /**
+   * Reads a string as a slice of the transport's read buffer if the
+   * transport can borrow and pin it, and as a copy otherwise.
+   */
+  uint32_t readStringSlice(TSlice& str);
+
+  uint32_t readBinarySlice(TSlice& str);
+
+  /**
+   * Decode runs of list or set elements straight out of the transport's
+   * buffer instead of one varint at a time.
+   */
+  uint32_t readI32Array(int32_t* values, uint32_t count);
+
+  uint32_t readI64Array(int64_t* values, uint32_t count);
+
   /*
    *These methods are here for the struct to call, but don't have any wire
    * encoding.
@@ -224,6 +260,12 @@ public:
   uint32_t readSetEnd() { return 0; }
 
 protected:
+  uint32_t writeBinaryBody(const char* data, size_t size);
+  uint32_t readBinaryBody(std::string& str, int32_t size);
+
+  template <typename T>
+  uint32_t readVarintArray(T* values, uint32_t count, uint32_t (TCompactProtocolT::*readOne)(T&));
+
   uint32_t readVarint32(int32_t& i32);
   uint32_t readVarint64(int64_t& i64);
   int32_t zigzagToI32(uint32_t n);
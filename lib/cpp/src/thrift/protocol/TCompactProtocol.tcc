@@ -273,16 +273,31 @@ uint32_t TCompactProtocolT<Transport_>::writeString(const std::string& str) {
 
 template <class Transport_>
 uint32_t TCompactProtocolT<Transport_>::writeBinary(const std::string& str) {
-  if(str.size() > (std::numeric_limits<uint32_t>::max)())
+  return writeBinaryBody(str.data(), str.size());
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeStringSlice(const TSlice& str) {
+  return writeBinaryBody(str.data(), str.size());
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeBinarySlice(const TSlice& str) {
+  return writeBinaryBody(str.data(), str.size());
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::writeBinaryBody(const char* data, size_t size) {
+  if(size > (std::numeric_limits<uint32_t>::max)())
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
-  auto ssize = static_cast<uint32_t>(str.size());
+  auto ssize = static_cast<uint32_t>(size);
   uint32_t wsize = writeVarint32(ssize) ;
   // checking ssize + wsize > uint_max, but we don't want to overflow while checking for overflows.
   // transforming the check to ssize > uint_max - wsize
   if(ssize > (std::numeric_limits<uint32_t>::max)() - wsize)
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
   wsize += ssize;
-  trans_->write((uint8_t*)str.data(), ssize);
+  trans_->write((const uint8_t*)data, ssize);
   return wsize;
 }
 
@@ -655,6 +670,51 @@ uint32_t TCompactProtocolT<Transport_>::readI64(int64_t& i64) {
   return rsize;
 }
 
+/**
+ * Read count i32s, as written by consecutive writeI32 calls.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readI32Array(int32_t* values, uint32_t count) {
+  return readVarintArray(values, count, &TCompactProtocolT<Transport_>::readI32);
+}
+
+/**
+ * Read count i64s, as written by consecutive writeI64 calls.
+ */
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readI64Array(int64_t* values, uint32_t count) {
+  return readVarintArray(values, count, &TCompactProtocolT<Transport_>::readI64);
+}
+
+template <class Transport_>
+template <typename T>
+uint32_t TCompactProtocolT<Transport_>::readVarintArray(T* values,
+                                                       uint32_t count,
+                                                       uint32_t (TCompactProtocolT::*readOne)(T&)) {
+  uint32_t rsize = 0;
+  while (count > 0) {
+    uint32_t avail = 1;
+    const uint8_t* borrowed = trans_->borrow(nullptr, &avail);
+    uint32_t decoded = 0;
+    if (borrowed != nullptr) {
+      const uint8_t* pos = borrowed;
+      decoded = detail::compact::readZigzagVarints(&pos, borrowed + avail, values, count);
+      auto used = static_cast<uint32_t>(pos - borrowed);
+      trans_->consume(used);
+      rsize += used;
+    }
+
+    // Nothing to borrow, or the next varint spans the end of the buffer.
+    if (decoded == 0) {
+      rsize += (this->*readOne)(*values);
+      decoded = 1;
+    }
+    values += decoded;
+    count -= decoded;
+  }
+  return rsize;
+}
+
 /**
  * No magic here - just read a double off the wire.
  */
@@ -687,10 +747,48 @@ uint32_t TCompactProtocolT<Transport_>::readBinary(std::string& str) {
   int32_t size;
 
   rsize += readVarint32(size);
+  return rsize + readBinaryBody(str, size);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readStringSlice(TSlice& str) {
+  return readBinarySlice(str);
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readBinarySlice(TSlice& str) {
+  int32_t rsize = 0;
+  int32_t size;
+
+  rsize += readVarint32(size);
+
+  // Error cases and transports that can't pin their buffer are left to
+  // readBinaryBody.
+  if (size > 0 && (string_limit_ <= 0 || size <= string_limit_)) {
+    const uint8_t* borrow_buf;
+    uint32_t got = size;
+    if ((borrow_buf = trans_->borrow(nullptr, &got))) {
+      std::shared_ptr<const void> owner = trans_->pinReadBuffer();
+      if (owner) {
+        str = TSlice(borrow_buf, size, std::move(owner));
+        trans_->consume(size);
+        return rsize + (uint32_t)size;
+      }
+    }
+  }
+
+  std::string copy;
+  rsize += readBinaryBody(copy, size);
+  str = TSlice(std::move(copy));
+  return rsize;
+}
+
+template <class Transport_>
+uint32_t TCompactProtocolT<Transport_>::readBinaryBody(std::string& str, int32_t size) {
   // Catch empty string case
   if (size == 0) {
     str = "";
-    return rsize;
+    return 0;
   }
 
   // Catch error cases
@@ -713,9 +811,9 @@ uint32_t TCompactProtocolT<Transport_>::readBinary(std::string& str) {
   trans_->readAll(string_buf_, size);
   str.assign((char*)string_buf_, size);
 
-  trans_->checkReadBytesAvailable(rsize + (uint32_t)size);
+  trans_->checkReadBytesAvailable((uint32_t)size);
 
-  return rsize + (uint32_t)size;
+  return (uint32_t)size;
 }
 
 /**
@@ -146,6 +146,26 @@ uint32_t THeaderProtocol::writeBinary(const std::string& str) {
   return proto_->writeBinary(str);
 }
 
+uint32_t THeaderProtocol::writeStringSlice(const TSlice& str) {
+  return proto_->writeStringSlice(str);
+}
+
+uint32_t THeaderProtocol::writeBinarySlice(const TSlice& str) {
+  return proto_->writeBinarySlice(str);
+}
+
+uint32_t THeaderProtocol::writeI32Array(const int32_t* values, uint32_t count) {
+  return proto_->writeI32Array(values, count);
+}
+
+uint32_t THeaderProtocol::writeI64Array(const int64_t* values, uint32_t count) {
+  return proto_->writeI64Array(values, count);
+}
+
+uint32_t THeaderProtocol::writeDoubleArray(const double* values, uint32_t count) {
+  return proto_->writeDoubleArray(values, count);
+}
+
 /**
  * Reading functions
  */
@@ -246,6 +266,26 @@ uint32_t THeaderProtocol::readString(std::string& str) {
 uint32_t THeaderProtocol::readBinary(std::string& binary) {
   return proto_->readBinary(binary);
 }
+
+uint32_t THeaderProtocol::readStringSlice(TSlice& str) {
+  return proto_->readStringSlice(str);
+}
+
+uint32_t THeaderProtocol::readBinarySlice(TSlice& binary) {
+  return proto_->readBinarySlice(binary);
+}
+
+uint32_t THeaderProtocol::readI32Array(int32_t* values, uint32_t count) {
+  return proto_->readI32Array(values, count);
+}
+
+uint32_t THeaderProtocol::readI64Array(int64_t* values, uint32_t count) {
+  return proto_->readI64Array(values, count);
+}
+
+uint32_t THeaderProtocol::readDoubleArray(double* values, uint32_t count) {
+  return proto_->readDoubleArray(values, count);
+}
 }
 }
 } // apache::thrift::protocol
@@ -135,6 +135,16 @@ public:
 
   uint32_t writeBinary(const std::string& str);
 
+  uint32_t writeStringSlice(const TSlice& str);
+
+  uint32_t writeBinarySlice(const TSlice& str);
+
+  uint32_t writeI32Array(const int32_t* values, uint32_t count);
+
+  uint32_t writeI64Array(const int64_t* values, uint32_t count);
+
+  uint32_t writeDoubleArray(const double* values, uint32_t count);
+
   /**
    * Reading functions
    */
@@ -181,6 +191,16 @@ public:
 
   uint32_t readBinary(std::string& binary);
 
+  uint32_t readStringSlice(TSlice& str);
+
+  uint32_t readBinarySlice(TSlice& binary);
+
+  uint32_t readI32Array(int32_t* values, uint32_t count);
+
+  uint32_t readI64Array(int64_t* values, uint32_t count);
+
+  uint32_t readDoubleArray(double* values, uint32_t count);
+
 protected:
   std::shared_ptr<THeaderTransport> trans_;
 
@@ -21,12 +21,19 @@
 
 #include <boost/locale.hpp>
 
+#include <clocale>
 #include <cmath>
+#include <cstdio>
+#include <cstring>
 #include <limits>
 #include <locale>
 #include <sstream>
 #include <stdexcept>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <thrift/protocol/TBase64Utils.h>
 #include <thrift/transport/TTransportException.h>
 #include <thrift/TToString.h>
@@ -294,134 +301,246 @@ static bool isLowSurrogate(uint16_t val) {
   return val >= 0xDC00 && val <= 0xDFFF;
 }
 
-/**
- * Class to serve as base JSON context and as base class for other context
- * implementations
- */
-class TJSONContext {
-
-public:
-  TJSONContext() = default;
-
-  virtual ~TJSONContext() = default;
-
-  /**
-   * Write context data to the transport. Default is to do nothing.
-   */
-  virtual uint32_t write(TTransport& trans) {
-    (void)trans;
-    return 0;
-  };
-
-  /**
-   * Read context data from the transport. Default is to do nothing.
-   */
-  virtual uint32_t read(TJSONProtocol::LookaheadReader& reader) {
-    (void)reader;
-    return 0;
-  };
-
-  /**
-   * Return true if numbers need to be escaped as strings in this context.
-   * Default behavior is to return false.
-   */
-  virtual bool escapeNum() { return false; }
-};
-
-// Context class for object member key-value pairs
-class JSONPairContext : public TJSONContext {
-
-public:
-  JSONPairContext() : first_(true), colon_(true) {}
-
-  uint32_t write(TTransport& trans) override {
-    if (first_) {
-      first_ = false;
-      colon_ = true;
-      return 0;
-    } else {
-      trans.write(colon_ ? &kJSONPairSeparator : &kJSONElemSeparator, 1);
-      colon_ = !colon_;
-      return 1;
+// Return the length of the run of characters at the start of buf that can be
+// copied as they are into or out of a JSON string: up to the string delimiter
+// or a backslash, and when writing, a control character.
+static uint32_t scanJSONStringRun(const uint8_t* buf, uint32_t len, bool stopAtControl) {
+  uint32_t i = 0;
+#ifdef __SSE2__
+  // 16 characters at a time
+  const __m128i delimiter = _mm_set1_epi8(kJSONStringDelimiter);
+  const __m128i backslash = _mm_set1_epi8(kJSONBackslash);
+  const __m128i lastControl = _mm_set1_epi8(0x1f);
+  for (; i + 16 <= len; i += 16) {
+    __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i));
+    __m128i stop = _mm_or_si128(_mm_cmpeq_epi8(chars, delimiter), _mm_cmpeq_epi8(chars, backslash));
+    if (stopAtControl) {
+      // saturates to zero for 0x00-0x1f
+      __m128i control = _mm_cmpeq_epi8(_mm_subs_epu8(chars, lastControl), _mm_setzero_si128());
+      stop = _mm_or_si128(stop, control);
+    }
+    int mask = _mm_movemask_epi8(stop);
+    if (mask) {
+      return i + __builtin_ctz(mask);
     }
   }
-
-  uint32_t read(TJSONProtocol::LookaheadReader& reader) override {
-    if (first_) {
-      first_ = false;
-      colon_ = true;
-      return 0;
-    } else {
-      uint8_t ch = (colon_ ? kJSONPairSeparator : kJSONElemSeparator);
-      colon_ = !colon_;
-      return readSyntaxChar(reader, ch);
+#endif
+  for (; i < len; ++i) {
+    uint8_t ch = buf[i];
+    if (ch == kJSONStringDelimiter || ch == kJSONBackslash || (stopAtControl && ch < 0x20)) {
+      break;
     }
   }
+  return i;
+}
+
+// Format num in decimal into buf, which must hold at least 20 characters;
+// returns the length
+static uint32_t formatJSONInteger(int64_t num, char* buf) {
+  char digits[20];
+  uint32_t len = 0;
+  uint64_t magnitude = num < 0 ? 0 - static_cast<uint64_t>(num) : static_cast<uint64_t>(num);
+  do {
+    digits[len++] = static_cast<char>('0' + magnitude % 10);
+    magnitude /= 10;
+  } while (magnitude);
+  uint32_t pos = 0;
+  if (num < 0) {
+    buf[pos++] = '-';
+  }
+  while (len) {
+    buf[pos++] = digits[--len];
+  }
+  return pos;
+}
 
-  // Numbers must be turned into strings if they are the key part of a pair
-  bool escapeNum() override { return colon_; }
+// Parse [+-]?[0-9]+ into num, failing if it is malformed or out of range
+template <typename NumberType>
+static bool parseJSONInteger(const std::string& str, NumberType& num) {
+  const char* p = str.c_str();
+  const char* end = p + str.length();
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    ++p;
+  }
+  if (p == end) {
+    return false;
+  }
 
-private:
-  bool first_;
-  bool colon_;
-};
+  uint64_t magnitude = 0;
+  for (; p != end; ++p) {
+    if (*p < '0' || *p > '9') {
+      return false;
+    }
+    uint64_t digit = *p - '0';
+    if (magnitude > ((std::numeric_limits<uint64_t>::max)() - digit) / 10) {
+      return false;
+    }
+    magnitude = magnitude * 10 + digit;
+  }
 
-// Context class for lists
-class JSONListContext : public TJSONContext {
+  typedef std::numeric_limits<NumberType> limits;
+  if (negative) {
+    // the magnitude of the minimum is one more than the maximum
+    uint64_t limit = limits::is_signed ? static_cast<uint64_t>((limits::max)()) + 1 : 0;
+    if (magnitude > limit) {
+      return false;
+    }
+    num = magnitude ? static_cast<NumberType>(-static_cast<int64_t>(magnitude - 1) - 1)
+                    : static_cast<NumberType>(0);
+  } else {
+    if (magnitude > static_cast<uint64_t>((limits::max)())) {
+      return false;
+    }
+    num = static_cast<NumberType>(magnitude);
+  }
+  return true;
+}
 
-public:
-  JSONListContext() : first_(true) {}
+// Bools are read as 0 or 1
+template <>
+bool parseJSONInteger<bool>(const std::string& str, bool& num) {
+  uint8_t value;
+  if (!parseJSONInteger(str, value) || value > 1) {
+    return false;
+  }
+  num = (value == 1);
+  return true;
+}
+
+// Parse a plain decimal number exactly, when its digits and its power of ten
+// are both exactly representable as doubles.  A single multiplication or
+// division is then correctly rounded.  Anything else is left to the caller.
+static bool parseJSONDoubleFast(const std::string& str, double& num) {
+  static const double kPowersOfTen[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,
+                                        1e8,  1e9,  1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+                                        1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+  const char* p = str.c_str();
+  const char* end = p + str.length();
+  bool negative = false;
+  if (p != end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    ++p;
+  }
 
-  uint32_t write(TTransport& trans) override {
-    if (first_) {
-      first_ = false;
-      return 0;
-    } else {
-      trans.write(&kJSONElemSeparator, 1);
-      return 1;
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+    mantissa = mantissa * 10 + (*p - '0');
+    ++digits;
+  }
+  if (p != end && *p == '.') {
+    ++p;
+    for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+      mantissa = mantissa * 10 + (*p - '0');
+      ++digits;
+      --exponent;
     }
   }
-
-  uint32_t read(TJSONProtocol::LookaheadReader& reader) override {
-    if (first_) {
-      first_ = false;
-      return 0;
-    } else {
-      return readSyntaxChar(reader, kJSONElemSeparator);
+  if (digits == 0 || digits > 19) {
+    return false;
+  }
+  if (p != end && (*p == 'e' || *p == 'E')) {
+    ++p;
+    bool negativeExponent = false;
+    if (p != end && (*p == '-' || *p == '+')) {
+      negativeExponent = (*p == '-');
+      ++p;
+    }
+    if (p == end) {
+      return false;
+    }
+    int value = 0;
+    for (; p != end && *p >= '0' && *p <= '9'; ++p) {
+      if (value > 1000) {
+        return false;
+      }
+      value = value * 10 + (*p - '0');
     }
+    exponent += negativeExponent ? -value : value;
+  }
+  if (p != end || mantissa > (uint64_t(1) << 53) || exponent < -22 || exponent > 22) {
+    return false;
   }
 
-private:
-  bool first_;
-};
+  num = static_cast<double>(mantissa);
+  num = exponent < 0 ? num / kPowersOfTen[-exponent] : num * kPowersOfTen[exponent];
+  if (negative) {
+    num = -num;
+  }
+  return true;
+}
 
 TJSONProtocol::TJSONProtocol(std::shared_ptr<TTransport> ptrans)
   : TVirtualProtocol<TJSONProtocol>(ptrans),
     trans_(ptrans.get()),
-    context_(new TJSONContext()),
     reader_(*ptrans) {
+  contexts_.reserve(16);
+  pushContext(CONTEXT_BASE);
 }
 
 TJSONProtocol::~TJSONProtocol() = default;
 
-void TJSONProtocol::pushContext(std::shared_ptr<TJSONContext> c) {
-  contexts_.push(context_);
-  context_ = c;
+void TJSONProtocol::pushContext(ContextType type) {
+  Context context;
+  context.type = type;
+  context.first = true;
+  context.colon = true;
+  contexts_.push_back(context);
 }
 
 void TJSONProtocol::popContext() {
-  context_ = contexts_.top();
-  contexts_.pop();
+  contexts_.pop_back();
+}
+
+uint32_t TJSONProtocol::writeContext() {
+  Context& context = contexts_.back();
+  if (context.type == CONTEXT_BASE) {
+    return 0;
+  }
+  if (context.first) {
+    context.first = false;
+    context.colon = true;
+    return 0;
+  }
+  if (context.type == CONTEXT_PAIR) {
+    trans_->write(context.colon ? &kJSONPairSeparator : &kJSONElemSeparator, 1);
+    context.colon = !context.colon;
+  } else {
+    trans_->write(&kJSONElemSeparator, 1);
+  }
+  return 1;
+}
+
+uint32_t TJSONProtocol::readContext() {
+  Context& context = contexts_.back();
+  if (context.type == CONTEXT_BASE) {
+    return 0;
+  }
+  if (context.first) {
+    context.first = false;
+    context.colon = true;
+    return 0;
+  }
+  if (context.type == CONTEXT_PAIR) {
+    uint8_t ch = (context.colon ? kJSONPairSeparator : kJSONElemSeparator);
+    context.colon = !context.colon;
+    return readSyntaxChar(reader_, ch);
+  }
+  return readSyntaxChar(reader_, kJSONElemSeparator);
+}
+
+bool TJSONProtocol::escapeNum() const {
+  const Context& context = contexts_.back();
+  return context.type == CONTEXT_PAIR && context.colon;
 }
 
 // Write the character ch as a JSON escape sequence ("\u00xx")
 uint32_t TJSONProtocol::writeJSONEscapeChar(uint8_t ch) {
-  trans_->write((const uint8_t*)kJSONEscapePrefix.c_str(),
-                static_cast<uint32_t>(kJSONEscapePrefix.length()));
-  uint8_t outCh = hexChar(ch >> 4);
-  trans_->write(&outCh, 1);
-  outCh = hexChar(ch);
-  trans_->write(&outCh, 1);
+  uint8_t buf[6] = {kJSONBackslash, kJSONEscapeChar, '0', '0', hexChar(ch >> 4), hexChar(ch)};
+  trans_->write(buf, 6);
   return 6;
 }
 
@@ -443,8 +562,8 @@ uint32_t TJSONProtocol::writeJSONChar(uint8_t ch) {
       trans_->write(&ch, 1);
       return 1;
     } else if (outCh > 1) {
-      trans_->write(&kJSONBackslash, 1);
-      trans_->write(&outCh, 1);
+      uint8_t buf[2] = {kJSONBackslash, outCh};
+      trans_->write(buf, 2);
       return 2;
     } else {
       return writeJSONEscapeChar(ch);
@@ -453,15 +572,28 @@ uint32_t TJSONProtocol::writeJSONChar(uint8_t ch) {
 }
 
 // Write out the contents of the string str as a JSON string, escaping
-// characters as appropriate.
+// characters as appropriate.  Runs that need no escaping are written as
+// they are.
 uint32_t TJSONProtocol::writeJSONString(const std::string& str) {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   result += 2; // For quotes
+  if (str.length() > (std::numeric_limits<uint32_t>::max)())
+    throw TProtocolException(TProtocolException::SIZE_LIMIT);
   trans_->write(&kJSONStringDelimiter, 1);
-  std::string::const_iterator iter(str.begin());
-  std::string::const_iterator end(str.end());
-  while (iter != end) {
-    result += writeJSONChar(*iter++);
+  const auto* bytes = (const uint8_t*)str.data();
+  auto len = static_cast<uint32_t>(str.length());
+  while (len) {
+    uint32_t run = scanJSONStringRun(bytes, len, true);
+    if (run) {
+      trans_->write(bytes, run);
+      result += run;
+      bytes += run;
+      len -= run;
+    }
+    if (len) {
+      result += writeJSONChar(*bytes++);
+      --len;
+    }
   }
   trans_->write(&kJSONStringDelimiter, 1);
   return result;
@@ -470,109 +602,109 @@ uint32_t TJSONProtocol::writeJSONString(const std::string& str) {
 // Write out the contents of the string as JSON string, base64-encoding
 // the string's contents, and escaping as appropriate
 uint32_t TJSONProtocol::writeJSONBase64(const std::string& str) {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   result += 2; // For quotes
   trans_->write(&kJSONStringDelimiter, 1);
-  uint8_t b[4];
+  uint8_t b[256];
+  uint32_t pos = 0;
   const auto* bytes = (const uint8_t*)str.c_str();
   if (str.length() > (std::numeric_limits<uint32_t>::max)())
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
   auto len = static_cast<uint32_t>(str.length());
   while (len >= 3) {
     // Encode 3 bytes at a time
-    base64_encode(bytes, 3, b);
-    trans_->write(b, 4);
-    result += 4;
+    base64_encode(bytes, 3, b + pos);
+    pos += 4;
+    if (pos == sizeof(b)) {
+      trans_->write(b, pos);
+      result += pos;
+      pos = 0;
+    }
     bytes += 3;
     len -= 3;
   }
   if (len) { // Handle remainder
-    base64_encode(bytes, len, b);
-    trans_->write(b, len + 1);
-    result += len + 1;
+    base64_encode(bytes, len, b + pos);
+    pos += len + 1;
+  }
+  if (pos) {
+    trans_->write(b, pos);
+    result += pos;
   }
   trans_->write(&kJSONStringDelimiter, 1);
   return result;
 }
 
-// Convert the given integer type to a JSON number, or a string
-// if the context requires it (eg: key in a map pair).
-template <typename NumberType>
-uint32_t TJSONProtocol::writeJSONInteger(NumberType num) {
-  uint32_t result = context_->write(*trans_);
-  std::string val(to_string(num));
-  bool escapeNum = context_->escapeNum();
+// Write out a number, quoted if escapeNum is set, in one write
+uint32_t TJSONProtocol::writeJSONNumber(const char* num, uint32_t len, bool escapeNum) {
+  char buf[40];
+  uint32_t pos = 0;
   if (escapeNum) {
-    trans_->write(&kJSONStringDelimiter, 1);
-    result += 1;
+    buf[pos++] = kJSONStringDelimiter;
   }
-  if (val.length() > (std::numeric_limits<uint32_t>::max)())
-    throw TProtocolException(TProtocolException::SIZE_LIMIT);
-  trans_->write((const uint8_t*)val.c_str(), static_cast<uint32_t>(val.length()));
-  result += static_cast<uint32_t>(val.length());
+  std::memcpy(buf + pos, num, len);
+  pos += len;
   if (escapeNum) {
-    trans_->write(&kJSONStringDelimiter, 1);
-    result += 1;
+    buf[pos++] = kJSONStringDelimiter;
   }
-  return result;
+  trans_->write((const uint8_t*)buf, pos);
+  return pos;
 }
 
-namespace {
-std::string doubleToString(double d) {
-  std::ostringstream str;
-  str.imbue(std::locale::classic());
-  const std::streamsize max_digits10 = 2 + std::numeric_limits<double>::digits10;
-  str.precision(max_digits10);
-  str << d;
-  return str.str();
-}
+// Convert the given integer type to a JSON number, or a string
+// if the context requires it (eg: key in a map pair).
+template <typename NumberType>
+uint32_t TJSONProtocol::writeJSONInteger(NumberType num) {
+  uint32_t result = writeContext();
+  char val[24];
+  uint32_t len = formatJSONInteger(static_cast<int64_t>(num), val);
+  return result + writeJSONNumber(val, len, escapeNum());
 }
 
 // Convert the given double to a JSON string, which is either the number,
 // "NaN" or "Infinity" or "-Infinity".
 uint32_t TJSONProtocol::writeJSONDouble(double num) {
-  uint32_t result = context_->write(*trans_);
-  std::string val;
+  uint32_t result = writeContext();
+  char val[32];
+  uint32_t len;
 
   bool special = false;
   switch (std::fpclassify(num)) {
   case FP_INFINITE:
     if (std::signbit(num)) {
-      val = kThriftNegativeInfinity;
+      len = static_cast<uint32_t>(kThriftNegativeInfinity.copy(val, sizeof(val)));
     } else {
-      val = kThriftInfinity;
+      len = static_cast<uint32_t>(kThriftInfinity.copy(val, sizeof(val)));
     }
     special = true;
     break;
   case FP_NAN:
-    val = kThriftNan;
+    len = static_cast<uint32_t>(kThriftNan.copy(val, sizeof(val)));
     special = true;
     break;
   default:
-    val = doubleToString(num);
+    // Enough digits to read back the same double
+    len = static_cast<uint32_t>(snprintf(val, sizeof(val), "%.17g", num));
+    {
+      // snprintf follows the C locale's decimal point
+      char point = localeconv()->decimal_point[0];
+      if (point != '.') {
+        char* p = static_cast<char*>(std::memchr(val, point, len));
+        if (p) {
+          *p = '.';
+        }
+      }
+    }
     break;
   }
 
-  bool escapeNum = special || context_->escapeNum();
-  if (escapeNum) {
-    trans_->write(&kJSONStringDelimiter, 1);
-    result += 1;
-  }
-  if (val.length() > (std::numeric_limits<uint32_t>::max)())
-    throw TProtocolException(TProtocolException::SIZE_LIMIT);
-  trans_->write((const uint8_t*)val.c_str(), static_cast<uint32_t>(val.length()));
-  result += static_cast<uint32_t>(val.length());
-  if (escapeNum) {
-    trans_->write(&kJSONStringDelimiter, 1);
-    result += 1;
-  }
-  return result;
+  return result + writeJSONNumber(val, len, special || escapeNum());
 }
 
 uint32_t TJSONProtocol::writeJSONObjectStart() {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   trans_->write(&kJSONObjectStart, 1);
-  pushContext(std::shared_ptr<TJSONContext>(new JSONPairContext()));
+  pushContext(CONTEXT_PAIR);
   return result + 1;
 }
 
@@ -583,9 +715,9 @@ uint32_t TJSONProtocol::writeJSONObjectEnd() {
 }
 
 uint32_t TJSONProtocol::writeJSONArrayStart() {
-  uint32_t result = context_->write(*trans_);
+  uint32_t result = writeContext();
   trans_->write(&kJSONArrayStart, 1);
-  pushContext(std::shared_ptr<TJSONContext>(new JSONListContext()));
+  pushContext(CONTEXT_LIST);
   return result + 1;
 }
 
@@ -681,8 +813,6 @@ uint32_t TJSONProtocol::writeBool(const bool value) {
 }
 
 uint32_t TJSONProtocol::writeByte(const int8_t byte) {
-  // writeByte() must be handled specially because to_string sees
-  // int8_t as a text type instead of an integer type
   return writeJSONInteger((int16_t)byte);
 }
 
@@ -736,12 +866,28 @@ uint32_t TJSONProtocol::readJSONEscapeChar(uint16_t* out) {
 
 // Decodes a JSON string, including unescaping, and returns the string via str
 uint32_t TJSONProtocol::readJSONString(std::string& str, bool skipContext) {
-  uint32_t result = (skipContext ? 0 : context_->read(reader_));
+  uint32_t result = (skipContext ? 0 : readContext());
   result += readJSONSyntaxChar(kJSONStringDelimiter);
   std::vector<uint16_t> codeunits;
   uint8_t ch;
   str.clear();
   while (true) {
+    // Scan plain runs in the transport's buffer and read them in one go
+    uint32_t len;
+    const uint8_t* buf = reader_.borrow(len);
+    if (buf) {
+      uint32_t run = scanJSONStringRun(buf, len, false);
+      if (run) {
+        if (!codeunits.empty()) {
+          throw TProtocolException(TProtocolException::INVALID_DATA,
+                                   "Missing UTF-16 low surrogate pair.");
+        }
+        size_t size = str.size();
+        str.resize(size + run);
+        reader_.readAll((uint8_t*)&str[size], run);
+        result += run;
+      }
+    }
     ch = reader_.read();
     ++result;
     if (ch == kJSONStringDelimiter) {
@@ -791,15 +937,16 @@ uint32_t TJSONProtocol::readJSONString(std::string& str, bool skipContext) {
   return result;
 }
 
-// Reads a block of base64 characters, decoding it, and returns via str
+// Reads a block of base64 characters, decoding it in place, and returns via str
 uint32_t TJSONProtocol::readJSONBase64(std::string& str) {
-  std::string tmp;
-  uint32_t result = readJSONString(tmp);
-  auto* b = (uint8_t*)tmp.c_str();
-  if (tmp.length() > (std::numeric_limits<uint32_t>::max)())
+  uint32_t result = readJSONString(str);
+  if (str.length() > (std::numeric_limits<uint32_t>::max)())
     throw TProtocolException(TProtocolException::SIZE_LIMIT);
-  auto len = static_cast<uint32_t>(tmp.length());
-  str.clear();
+  auto len = static_cast<uint32_t>(str.length());
+  if (len == 0) {
+    return result;
+  }
+  auto* b = (uint8_t*)&str[0];
   // Ignore padding
   if (len >= 2)  {
     uint32_t bound = len - 2;
@@ -807,18 +954,24 @@ uint32_t TJSONProtocol::readJSONBase64(std::string& str) {
       --len;
     }
   }
-  while (len >= 4) {
-    base64_decode(b, 4);
-    str.append((const char*)b, 3);
-    b += 4;
-    len -= 4;
+  // Each group of 4 characters decodes to 3 bytes, behind the next group
+  uint32_t in = 0;
+  uint32_t out = 0;
+  while (len - in >= 4) {
+    base64_decode(b + in, 4);
+    std::memmove(b + out, b + in, 3);
+    in += 4;
+    out += 3;
   }
   // Don't decode if we hit the end or got a single leftover byte (invalid
   // base64 but legal for skip of regular string type)
-  if (len > 1) {
-    base64_decode(b, len);
-    str.append((const char*)b, len - 1);
+  if (len - in > 1) {
+    uint32_t rest = len - in;
+    base64_decode(b + in, rest);
+    std::memmove(b + out, b + in, rest - 1);
+    out += rest - 1;
   }
+  str.resize(out);
   return result;
 }
 
@@ -828,6 +981,23 @@ uint32_t TJSONProtocol::readJSONNumericChars(std::string& str) {
   uint32_t result = 0;
   str.clear();
   while (true) {
+    uint32_t len;
+    const uint8_t* buf = reader_.borrow(len);
+    if (buf) {
+      uint32_t run = 0;
+      while (run < len && isJSONNumeric(buf[run])) {
+        ++run;
+      }
+      if (run) {
+        size_t size = str.size();
+        str.resize(size + run);
+        reader_.readAll((uint8_t*)&str[size], run);
+        result += run;
+      }
+      if (run < len) {
+        break;
+      }
+    }
     uint8_t ch = reader_.peek();
     if (!isJSONNumeric(ch)) {
       break;
@@ -850,25 +1020,34 @@ T fromString(const std::string& s) {
     throw std::runtime_error(s);
   return t;
 }
+
+bool parseJSONDouble(const std::string& str, double& num) {
+  if (parseJSONDoubleFast(str, num)) {
+    return true;
+  }
+  try {
+    num = fromString<double>(str);
+  } catch (const std::runtime_error&) {
+    return false;
+  }
+  return true;
+}
 }
 
 // Reads a sequence of characters and assembles them into a number,
 // returning them via num
 template <typename NumberType>
 uint32_t TJSONProtocol::readJSONInteger(NumberType& num) {
-  uint32_t result = context_->read(reader_);
-  if (context_->escapeNum()) {
+  uint32_t result = readContext();
+  if (escapeNum()) {
     result += readJSONSyntaxChar(kJSONStringDelimiter);
   }
-  std::string str;
-  result += readJSONNumericChars(str);
-  try {
-    num = fromString<NumberType>(str);
-  } catch (const std::runtime_error&) {
+  result += readJSONNumericChars(numberBuffer_);
+  if (!parseJSONInteger(numberBuffer_, num)) {
     throw TProtocolException(TProtocolException::INVALID_DATA,
-                             "Expected numeric value; got \"" + str + "\"");
+                             "Expected numeric value; got \"" + numberBuffer_ + "\"");
   }
-  if (context_->escapeNum()) {
+  if (escapeNum()) {
     result += readJSONSyntaxChar(kJSONStringDelimiter);
   }
   return result;
@@ -876,8 +1055,8 @@ uint32_t TJSONProtocol::readJSONInteger(NumberType& num) {
 
 // Reads a JSON number or string and interprets it as a double.
 uint32_t TJSONProtocol::readJSONDouble(double& num) {
-  uint32_t result = context_->read(reader_);
-  std::string str;
+  uint32_t result = readContext();
+  std::string& str = numberBuffer_;
   if (reader_.peek() == kJSONStringDelimiter) {
     result += readJSONString(str, true);
     // Check for NaN, Infinity and -Infinity
@@ -888,27 +1067,23 @@ uint32_t TJSONProtocol::readJSONDouble(double& num) {
     } else if (str == kThriftNegativeInfinity) {
       num = -HUGE_VAL;
     } else {
-      if (!context_->escapeNum()) {
+      if (!escapeNum()) {
         // Throw exception -- we should not be in a string in this case
         throw TProtocolException(TProtocolException::INVALID_DATA,
                                      "Numeric data unexpectedly quoted");
       }
-      try {
-        num = fromString<double>(str);
-      } catch (const std::runtime_error&) {
+      if (!parseJSONDouble(str, num)) {
         throw TProtocolException(TProtocolException::INVALID_DATA,
                                      "Expected numeric value; got \"" + str + "\"");
       }
     }
   } else {
-    if (context_->escapeNum()) {
+    if (escapeNum()) {
       // This will throw - we should have had a quote if escapeNum == true
       readJSONSyntaxChar(kJSONStringDelimiter);
     }
     result += readJSONNumericChars(str);
-    try {
-      num = fromString<double>(str);
-    } catch (const std::runtime_error&) {
+    if (!parseJSONDouble(str, num)) {
       throw TProtocolException(TProtocolException::INVALID_DATA,
                                    "Expected numeric value; got \"" + str + "\"");
     }
@@ -917,9 +1092,9 @@ uint32_t TJSONProtocol::readJSONDouble(double& num) {
 }
 
 uint32_t TJSONProtocol::readJSONObjectStart() {
-  uint32_t result = context_->read(reader_);
+  uint32_t result = readContext();
   result += readJSONSyntaxChar(kJSONObjectStart);
-  pushContext(std::shared_ptr<TJSONContext>(new JSONPairContext()));
+  pushContext(CONTEXT_PAIR);
   return result;
 }
 
@@ -930,9 +1105,9 @@ uint32_t TJSONProtocol::readJSONObjectEnd() {
 }
 
 uint32_t TJSONProtocol::readJSONArrayStart() {
-  uint32_t result = context_->read(reader_);
+  uint32_t result = readContext();
   result += readJSONSyntaxChar(kJSONArrayStart);
-  pushContext(std::shared_ptr<TJSONContext>(new JSONListContext()));
+  pushContext(CONTEXT_LIST);
   return result;
 }
 
@@ -1072,8 +1247,6 @@ uint32_t TJSONProtocol::readBool(bool& value) {
   return readJSONInteger(value);
 }
 
-// readByte() must be handled properly because boost::lexical cast sees int8_t
-// as a text type instead of an integer type
 uint32_t TJSONProtocol::readByte(int8_t& byte) {
   auto tmp = (int16_t)byte;
   uint32_t result = readJSONInteger(tmp);
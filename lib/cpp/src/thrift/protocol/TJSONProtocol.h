@@ -22,15 +22,12 @@
 
 #include <thrift/protocol/TVirtualProtocol.h>
 
-#include <stack>
+#include <vector>
 
 namespace apache {
 namespace thrift {
 namespace protocol {
 
-// Forward declaration
-class TJSONContext;
-
 /**
  * JSON protocol for Thrift.
  *
@@ -101,10 +98,31 @@ public:
   ~TJSONProtocol() override;
 
 private:
-  void pushContext(std::shared_ptr<TJSONContext> c);
+  /**
+   * Where we are in the JSON document: at the top level, in the members of
+   * an object, or in the elements of an array.  Kept by value on a stack
+   * that is reused from message to message.
+   */
+  enum ContextType { CONTEXT_BASE, CONTEXT_PAIR, CONTEXT_LIST };
+
+  struct Context {
+    ContextType type;
+    bool first;
+    bool colon;
+  };
+
+  void pushContext(ContextType type);
 
   void popContext();
 
+  // Write or read the separator due before the next value in this context
+  uint32_t writeContext();
+
+  uint32_t readContext();
+
+  // Numbers must be turned into strings if they are the key part of a pair
+  bool escapeNum() const;
+
   uint32_t writeJSONEscapeChar(uint8_t ch);
 
   uint32_t writeJSONChar(uint8_t ch);
@@ -136,6 +154,8 @@ private:
 
   uint32_t readJSONNumericChars(std::string& str);
 
+  uint32_t writeJSONNumber(const char* num, uint32_t len, bool escapeNum);
+
   template <typename NumberType>
   uint32_t readJSONInteger(NumberType& num);
 
@@ -263,6 +283,11 @@ public:
       trans_->checkReadBytesAvailable(map.size_ * elmSize);
   }
 
+  /**
+   * Reads a byte at a time, with one byte of lookahead.  Where the transport
+   * can lend its buffer, runs of bytes can be scanned in place with borrow()
+   * and then read all at once.
+   */
   class LookaheadReader {
 
   public:
@@ -279,12 +304,31 @@ public:
 
     uint8_t peek() {
       if (!hasData_) {
+        uint32_t len = 1;
+        const uint8_t* buf = trans_->borrow(nullptr, &len);
+        if (buf) {
+          return buf[0];
+        }
         trans_->readAll(&data_, 1);
       }
       hasData_ = true;
       return data_;
     }
 
+    /**
+     * Returns the bytes the transport has buffered, without taking them, or
+     * nullptr if it can't lend them.
+     */
+    const uint8_t* borrow(uint32_t& len) {
+      if (hasData_) {
+        return nullptr;
+      }
+      len = 1;
+      return trans_->borrow(nullptr, &len);
+    }
+
+    void readAll(uint8_t* buf, uint32_t len) { trans_->readAll(buf, len); }
+
   private:
     TTransport* trans_;
     bool hasData_;
@@ -294,9 +338,12 @@ public:
 private:
   TTransport* trans_;
 
-  std::stack<std::shared_ptr<TJSONContext> > contexts_;
-  std::shared_ptr<TJSONContext> context_;
+  // The current context is at the back
+  std::vector<Context> contexts_;
   LookaheadReader reader_;
+
+  // Reused to collect numbers as they are read
+  std::string numberBuffer_;
 };
 
 /**
@@ -25,6 +25,7 @@
 #include <winsock2.h>
 #endif
 
+#include <thrift/TSlice.h>
 #include <thrift/transport/TTransport.h>
 #include <thrift/protocol/TProtocolException.h>
 #include <thrift/protocol/TEnum.h>
@@ -243,6 +244,38 @@ public:
 
   virtual uint32_t writeBinary_virt(const std::string& str) = 0;
 
+  virtual uint32_t writeStringSlice_virt(const TSlice& str) { return writeString_virt(str.str()); }
+
+  virtual uint32_t writeBinarySlice_virt(const TSlice& str) { return writeBinary_virt(str.str()); }
+
+  /*
+   * Write count consecutive list or set elements in one call.  Protocols
+   * that can encode them faster in bulk override these.
+   */
+  virtual uint32_t writeI32Array_virt(const int32_t* values, uint32_t count) {
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      result += writeI32_virt(values[i]);
+    }
+    return result;
+  }
+
+  virtual uint32_t writeI64Array_virt(const int64_t* values, uint32_t count) {
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      result += writeI64_virt(values[i]);
+    }
+    return result;
+  }
+
+  virtual uint32_t writeDoubleArray_virt(const double* values, uint32_t count) {
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      result += writeDouble_virt(values[i]);
+    }
+    return result;
+  }
+
   uint32_t writeMessageBegin(const std::string& name,
                              const TMessageType messageType,
                              const int32_t seqid) {
@@ -350,6 +383,31 @@ public:
     return writeBinary_virt(str);
   }
 
+  uint32_t writeStringSlice(const TSlice& str) {
+    T_VIRTUAL_CALL();
+    return writeStringSlice_virt(str);
+  }
+
+  uint32_t writeBinarySlice(const TSlice& str) {
+    T_VIRTUAL_CALL();
+    return writeBinarySlice_virt(str);
+  }
+
+  uint32_t writeI32Array(const int32_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return writeI32Array_virt(values, count);
+  }
+
+  uint32_t writeI64Array(const int64_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return writeI64Array_virt(values, count);
+  }
+
+  uint32_t writeDoubleArray(const double* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return writeDoubleArray_virt(values, count);
+  }
+
   /**
    * Reading functions
    */
@@ -398,6 +456,52 @@ public:
 
   virtual uint32_t readBinary_virt(std::string& str) = 0;
 
+  /*
+   * Protocols that can borrow from their transport override these to
+   * return slices of the receive buffer.  The defaults read a copy.
+   */
+  virtual uint32_t readStringSlice_virt(TSlice& str) {
+    std::string copy;
+    uint32_t result = readString_virt(copy);
+    str = TSlice(std::move(copy));
+    return result;
+  }
+
+  virtual uint32_t readBinarySlice_virt(TSlice& str) {
+    std::string copy;
+    uint32_t result = readBinary_virt(copy);
+    str = TSlice(std::move(copy));
+    return result;
+  }
+
+  /*
+   * Read count consecutive list or set elements in one call.  Protocols
+   * that can decode them faster in bulk override these.
+   */
+  virtual uint32_t readI32Array_virt(int32_t* values, uint32_t count) {
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      result += readI32_virt(values[i]);
+    }
+    return result;
+  }
+
+  virtual uint32_t readI64Array_virt(int64_t* values, uint32_t count) {
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      result += readI64_virt(values[i]);
+    }
+    return result;
+  }
+
+  virtual uint32_t readDoubleArray_virt(double* values, uint32_t count) {
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      result += readDouble_virt(values[i]);
+    }
+    return result;
+  }
+
   uint32_t readMessageBegin(std::string& name, TMessageType& messageType, int32_t& seqid) {
     T_VIRTUAL_CALL();
     return readMessageBegin_virt(name, messageType, seqid);
@@ -498,6 +602,31 @@ public:
     return readBinary_virt(str);
   }
 
+  uint32_t readStringSlice(TSlice& str) {
+    T_VIRTUAL_CALL();
+    return readStringSlice_virt(str);
+  }
+
+  uint32_t readBinarySlice(TSlice& str) {
+    T_VIRTUAL_CALL();
+    return readBinarySlice_virt(str);
+  }
+
+  uint32_t readI32Array(int32_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return readI32Array_virt(values, count);
+  }
+
+  uint32_t readI64Array(int64_t* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return readI64Array_virt(values, count);
+  }
+
+  uint32_t readDoubleArray(double* values, uint32_t count) {
+    T_VIRTUAL_CALL();
+    return readDoubleArray_virt(values, count);
+  }
+
   /*
    * std::vector is specialized for bool, and its elements are individual bits
    * rather than bools.   We need to define a different version of readBool()
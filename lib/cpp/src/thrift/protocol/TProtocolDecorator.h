@@ -92,6 +92,21 @@ public:
   uint32_t writeDouble_virt(const double dub) override { return protocol->writeDouble(dub); }
   uint32_t writeString_virt(const std::string& str) override { return protocol->writeString(str); }
   uint32_t writeBinary_virt(const std::string& str) override { return protocol->writeBinary(str); }
+  uint32_t writeStringSlice_virt(const TSlice& str) override {
+    return protocol->writeStringSlice(str);
+  }
+  uint32_t writeBinarySlice_virt(const TSlice& str) override {
+    return protocol->writeBinarySlice(str);
+  }
+  uint32_t writeI32Array_virt(const int32_t* values, uint32_t count) override {
+    return protocol->writeI32Array(values, count);
+  }
+  uint32_t writeI64Array_virt(const int64_t* values, uint32_t count) override {
+    return protocol->writeI64Array(values, count);
+  }
+  uint32_t writeDoubleArray_virt(const double* values, uint32_t count) override {
+    return protocol->writeDoubleArray(values, count);
+  }
 
   uint32_t readMessageBegin_virt(std::string& name,
                                          TMessageType& messageType,
@@ -140,6 +155,18 @@ public:
 
   uint32_t readString_virt(std::string& str) override { return protocol->readString(str); }
   uint32_t readBinary_virt(std::string& str) override { return protocol->readBinary(str); }
+  uint32_t readStringSlice_virt(TSlice& str) override { return protocol->readStringSlice(str); }
+  uint32_t readBinarySlice_virt(TSlice& str) override { return protocol->readBinarySlice(str); }
+
+  uint32_t readI32Array_virt(int32_t* values, uint32_t count) override {
+    return protocol->readI32Array(values, count);
+  }
+  uint32_t readI64Array_virt(int64_t* values, uint32_t count) override {
+    return protocol->readI64Array(values, count);
+  }
+  uint32_t readDoubleArray_virt(double* values, uint32_t count) override {
+    return protocol->readDoubleArray(values, count);
+  }
 
 private:
   shared_ptr<TProtocol> protocol;
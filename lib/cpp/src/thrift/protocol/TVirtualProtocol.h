@@ -169,6 +169,10 @@ public:
                              "this protocol does not support reading (yet).");
   }
 
+  uint32_t readStringSlice(TSlice& str) { return TProtocol::readStringSlice_virt(str); }
+
+  uint32_t readBinarySlice(TSlice& str) { return TProtocol::readBinarySlice_virt(str); }
+
   uint32_t writeMessageBegin(const std::string& name,
                              const TMessageType messageType,
                              const int32_t seqid) {
@@ -298,6 +302,10 @@ public:
                              "this protocol does not support writing (yet).");
   }
 
+  uint32_t writeStringSlice(const TSlice& str) { return TProtocol::writeStringSlice_virt(str); }
+
+  uint32_t writeBinarySlice(const TSlice& str) { return TProtocol::writeBinarySlice_virt(str); }
+
   uint32_t skip(TType type) { return ::apache::thrift::protocol::skip(*this, type); }
 
 protected:
@@ -393,6 +401,26 @@ public:
     return static_cast<Protocol_*>(this)->writeBinary(str);
   }
 
+  uint32_t writeStringSlice_virt(const TSlice& str) override {
+    return static_cast<Protocol_*>(this)->writeStringSlice(str);
+  }
+
+  uint32_t writeBinarySlice_virt(const TSlice& str) override {
+    return static_cast<Protocol_*>(this)->writeBinarySlice(str);
+  }
+
+  uint32_t writeI32Array_virt(const int32_t* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->writeI32Array(values, count);
+  }
+
+  uint32_t writeI64Array_virt(const int64_t* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->writeI64Array(values, count);
+  }
+
+  uint32_t writeDoubleArray_virt(const double* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->writeDoubleArray(values, count);
+  }
+
   /**
    * Reading functions
    */
@@ -471,6 +499,26 @@ public:
     return static_cast<Protocol_*>(this)->readBinary(str);
   }
 
+  uint32_t readStringSlice_virt(TSlice& str) override {
+    return static_cast<Protocol_*>(this)->readStringSlice(str);
+  }
+
+  uint32_t readBinarySlice_virt(TSlice& str) override {
+    return static_cast<Protocol_*>(this)->readBinarySlice(str);
+  }
+
+  uint32_t readI32Array_virt(int32_t* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->readI32Array(values, count);
+  }
+
+  uint32_t readI64Array_virt(int64_t* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->readI64Array(values, count);
+  }
+
+  uint32_t readDoubleArray_virt(double* values, uint32_t count) override {
+    return static_cast<Protocol_*>(this)->readDoubleArray(values, count);
+  }
+
   uint32_t skip_virt(TType type) override { return static_cast<Protocol_*>(this)->skip(type); }
 
   /*
@@ -503,6 +551,65 @@ public:
   }
   using Super_::readBool; // so we don't hide readBool(bool&)
 
+  /*
+   * Provide default bulk element readers and writers that loop over the
+   * non-virtual single element methods.  Protocols with a faster bulk
+   * encoding define their own.
+   */
+  uint32_t writeI32Array(const int32_t* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      result += prot->writeI32(values[i]);
+    }
+    return result;
+  }
+
+  uint32_t writeI64Array(const int64_t* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      result += prot->writeI64(values[i]);
+    }
+    return result;
+  }
+
+  uint32_t writeDoubleArray(const double* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      result += prot->writeDouble(values[i]);
+    }
+    return result;
+  }
+
+  uint32_t readI32Array(int32_t* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      result += prot->readI32(values[i]);
+    }
+    return result;
+  }
+
+  uint32_t readI64Array(int64_t* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      result += prot->readI64(values[i]);
+    }
+    return result;
+  }
+
+  uint32_t readDoubleArray(double* values, uint32_t count) {
+    auto* const prot = static_cast<Protocol_*>(this);
+    uint32_t result = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+      result += prot->readDouble(values[i]);
+    }
+    return result;
+  }
+
 protected:
   TVirtualProtocol(std::shared_ptr<TTransport> ptrans) : Super_(ptrans) {}
 };
@@ -17,6 +17,7 @@
  * under the License.
  */
 
+#include <thrift/TRequestDeadline.h>
 #include <thrift/server/TConnectedClient.h>
 
 namespace apache {
@@ -58,6 +59,8 @@ void TConnectedClient::run() {
     }
 
     try {
+      // Holds the deadline THeaderTransport reads with the request, if any
+      TRequestDeadline::Scope deadline;
       if (!processor_->process(inputProtocol_, outputProtocol_, opaqueContext_)) {
         break;
       }
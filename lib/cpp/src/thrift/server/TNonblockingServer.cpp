@@ -20,6 +20,7 @@
 #include <thrift/thrift-config.h>
 
 #include <thrift/server/TNonblockingServer.h>
+#include <thrift/TRequestDeadline.h>
 #include <thrift/concurrency/Exception.h>
 #include <thrift/transport/TSocket.h>
 #include <thrift/concurrency/ThreadFactory.h>
@@ -57,7 +58,12 @@
 #include <fcntl.h>
 #endif
 
+#ifdef HAVE_SYS_EVENTFD_H
+#include <sys/eventfd.h>
+#endif
+
 #include <assert.h>
+#include <deque>
 
 #ifdef HAVE_SCHED_H
 #include <sched.h>
@@ -112,9 +118,14 @@ enum TAppState {
  */
 class TNonblockingServer::TConnection {
 private:
+  friend class TNonblockingIOThread;
+
   /// Server IO Thread handling this connection
   TNonblockingIOThread* ioThread_;
 
+  /// Next connection in the completion queue of ioThread_
+  TConnection* nextCompleted_;
+
   /// Server handle
   TNonblockingServer* server_;
 
@@ -185,6 +196,53 @@ private:
   /// Thrift call context, if any
   void* connectionContext_;
 
+  /// The requests in flight, when pipelining; see setPipelineDepth()
+  struct PipelinedRequest;
+  struct Pipeline;
+  std::unique_ptr<Pipeline> pipeline_;
+
+  /**
+   * Hands the request just read to the ThreadManager, and returns false if
+   * the connection was closed instead.
+   */
+  bool dispatchPipelined(TRequestDeadline::Clock::time_point deadline);
+
+  /// Takes back the requests the workers finished and queues their responses
+  void drainPipelined();
+
+  /// Queues the response of a finished request, if it has one
+  void queuePipelined(PipelinedRequest* request);
+
+  /**
+   * Writes queued responses until the socket is full, and returns false if
+   * the connection was closed instead.
+   */
+  bool writePipelined();
+
+  /// Returns a request whose response was written or dropped to the pool
+  void releasePipelined(PipelinedRequest* request);
+
+  /// Reads while fewer than the pipeline depth are in flight, and writes while responses are queued
+  void setPipelineFlags();
+
+  /**
+   * Called when the client closed its end.  Closes the connection, or when
+   * pipelining, once the requests already read have been answered.
+   */
+  void remoteClosed();
+
+  /**
+   * Writes what the socket takes of the response in the write buffer, and
+   * returns false if the connection was closed instead.
+   */
+  bool writeResult();
+
+  /**
+   * The deadline the client sent with the request in the read buffer, or
+   * time_point::max() if it sent none.
+   */
+  TRequestDeadline::Clock::time_point readDeadline() const;
+
   /// Go into read mode
   void setRead() { setFlags(EV_READ | EV_PERSIST); }
 
@@ -209,6 +267,9 @@ private:
    */
   void workSocket();
 
+  /// Libevent handler of a pipelining connection
+  void workPipelined(short which);
+
 public:
   class Task;
 
@@ -232,7 +293,7 @@ public:
     init(ioThread);
   }
 
-  ~TConnection() { std::free(readBuffer_); }
+  ~TConnection();
 
   /// Close this connection and free or reset its resources.
   void close();
@@ -266,9 +327,13 @@ public:
    * @param which the flags associated with the event.
    * @param v void* callback arg where we placed TConnection's "this".
    */
-  static void eventHandler(evutil_socket_t fd, short /* which */, void* v) {
+  static void eventHandler(evutil_socket_t fd, short which, void* v) {
     assert(fd == static_cast<evutil_socket_t>(((TConnection*)v)->getTSocket()->getSocketFD()));
-    ((TConnection*)v)->workSocket();
+    if (((TConnection*)v)->pipeline_) {
+      ((TConnection*)v)->workPipelined(which);
+    } else {
+      ((TConnection*)v)->workSocket();
+    }
   }
 
   /**
@@ -282,6 +347,25 @@ public:
    */
   bool notifyIOThread() { return ioThread_->notify(this); }
 
+  /**
+   * Called on the IO thread for each notifyIOThread().
+   */
+  void notified() {
+    if (pipeline_ && appState_ != APP_INIT) {
+      drainPipelined();
+    } else {
+      transition();
+    }
+  }
+
+  /**
+   * Hands a pipelined request whose task finished, or was dropped, back to
+   * the IO thread.  Called from any thread.
+   *
+   * @return false if unable to notify the IO thread.
+   */
+  bool completePipelined(PipelinedRequest* request);
+
   /*
    * Returns the number of this connection's currently assigned IO
    * thread.
@@ -319,23 +403,34 @@ public:
   Task(std::shared_ptr<TProcessor> processor,
        std::shared_ptr<TProtocol> input,
        std::shared_ptr<TProtocol> output,
-       TConnection* connection)
+       TConnection* connection,
+       TRequestDeadline::Clock::time_point deadline,
+       PipelinedRequest* request = nullptr)
     : processor_(processor),
       input_(input),
       output_(output),
       connection_(connection),
       serverEventHandler_(connection_->getServerEventHandler()),
-      connectionContext_(connection_->getConnectionContext()) {}
+      connectionContext_(connection_->getConnectionContext()),
+      deadline_(deadline),
+      request_(request) {}
 
   void run() override {
     try {
-      for (;;) {
-        if (serverEventHandler_) {
-          serverEventHandler_->processContext(connectionContext_, connection_->getTSocket());
-        }
-        if (!processor_->process(input_, output_, connectionContext_)
-            || !input_->getTransport()->peek()) {
-          break;
+      if (deadline_ <= TRequestDeadline::Clock::now()) {
+        // The client gave up while the request was queued; nothing is
+        // written, so the connection goes back to reading as after a oneway
+        connection_->getServer()->incrementShedRequests();
+      } else {
+        TRequestDeadline::Scope deadline(deadline_);
+        for (;;) {
+          if (serverEventHandler_) {
+            serverEventHandler_->processContext(connectionContext_, connection_->getTSocket());
+          }
+          if (!processor_->process(input_, output_, connectionContext_)
+              || !input_->getTransport()->peek()) {
+            break;
+          }
         }
       }
     } catch (const TTransportException& ttx) {
@@ -351,6 +446,16 @@ public:
       GlobalOutput.printf("TNonblockingServer: unknown exception while processing.");
     }
 
+    if (request_) {
+      // Other requests of the connection may still be running, so it is
+      // left to the IO thread to close it
+      if (!connection_->completePipelined(request_)) {
+        GlobalOutput.printf("TNonblockingServer: failed to notifyIOThread.");
+        throw TException("TNonblockingServer::Task::run: failed write on notify pipe");
+      }
+      return;
+    }
+
     // Signal completion back to the libevent thread via a pipe
     if (!connection_->notifyIOThread()) {
       GlobalOutput.printf("TNonblockingServer: failed to notifyIOThread, closing.");
@@ -362,6 +467,11 @@ public:
 
   TConnection* getTConnection() { return connection_; }
 
+  TRequestDeadline::Clock::time_point getDeadline() const { return deadline_; }
+
+  /// The request of a pipelining connection, or nullptr
+  PipelinedRequest* getRequest() { return request_; }
+
 private:
   std::shared_ptr<TProcessor> processor_;
   std::shared_ptr<TProtocol> input_;
@@ -369,11 +479,131 @@ private:
   TConnection* connection_;
   std::shared_ptr<TServerEventHandler> serverEventHandler_;
   void* connectionContext_;
+  TRequestDeadline::Clock::time_point deadline_;
+  PipelinedRequest* request_;
 };
 
+/**
+ * A request of a pipelining connection: the frame it was read from, and its
+ * own transports and protocols, as it is processed alongside the others.
+ * Reused for the later requests of the connection.
+ */
+struct TNonblockingServer::TConnection::PipelinedRequest {
+  PipelinedRequest() : frame(nullptr), frameSize(0), sequence(0), closeConnection(false) {}
+
+  ~PipelinedRequest() { std::free(frame); }
+
+  /// The read buffer the request was read into, traded for this one's
+  uint8_t* frame;
+  uint32_t frameSize;
+  std::shared_ptr<TMemoryBuffer> inputTransport;
+  std::shared_ptr<TMemoryBuffer> outputTransport;
+  std::shared_ptr<TTransport> factoryInputTransport;
+  std::shared_ptr<TTransport> factoryOutputTransport;
+  std::shared_ptr<TProtocol> inputProtocol;
+  std::shared_ptr<TProtocol> outputProtocol;
+  /// The order the request was read in
+  uint64_t sequence;
+  /// Whether the task was dropped in a way that closes the connection
+  bool closeConnection;
+};
+
+/**
+ * The requests of a pipelining connection.  Only completed is shared with
+ * the workers; the IO thread owns the rest.
+ */
+struct TNonblockingServer::TConnection::Pipeline {
+  Pipeline(uint32_t depth, bool inOrder)
+    : depth(depth),
+      inOrder(inOrder),
+      reorder(inOrder ? depth : 0, nullptr),
+      writePos(0),
+      nextSequence(0),
+      nextWrite(0),
+      inFlight(0),
+      running(0),
+      closing(false),
+      eof(false) {}
+
+  ~Pipeline() {
+    reset();
+    for (PipelinedRequest* request : free) {
+      delete request;
+    }
+  }
+
+  /// Returns the requests that are not running to the pool
+  void reset() {
+    for (PipelinedRequest* request : writeQueue) {
+      free.push_back(request);
+    }
+    writeQueue.clear();
+    for (PipelinedRequest*& request : reorder) {
+      if (request) {
+        free.push_back(request);
+        request = nullptr;
+      }
+    }
+    writePos = 0;
+    nextSequence = 0;
+    nextWrite = 0;
+    inFlight = 0;
+    closing = false;
+    eof = false;
+  }
+
+  /// The most responses gathered into one write
+  static const int WRITE_BATCH = 64;
+
+  const uint32_t depth;
+  const bool inOrder;
+
+  /// Guards completed
+  Mutex mutex;
+  /// Requests the workers finished, for the IO thread to take
+  std::vector<PipelinedRequest*> completed;
+  /// What the IO thread took of completed, kept for its capacity
+  std::vector<PipelinedRequest*> taken;
+
+  std::vector<PipelinedRequest*> free;
+  /// Responses to write, the first one writePos bytes in
+  std::deque<PipelinedRequest*> writeQueue;
+  /// With inOrder, finished requests waiting for the ones before them, by
+  /// sequence modulo depth
+  std::vector<PipelinedRequest*> reorder;
+  uint32_t writePos;
+  uint64_t nextSequence;
+  uint64_t nextWrite;
+  /// Requests read and not yet written or dropped
+  uint32_t inFlight;
+  /// Requests handed to the ThreadManager and not yet taken back
+  uint32_t running;
+  /// Whether the connection is to be closed once nothing is running
+  bool closing;
+  /// Whether the client is done sending, so the connection is closed once
+  /// nothing is in flight
+  bool eof;
+};
+
+TNonblockingServer::TConnection::~TConnection() {
+  std::free(readBuffer_);
+}
+
+TRequestDeadline::Clock::time_point TNonblockingServer::TConnection::readDeadline() const {
+  // Both with and without header transport, the frame follows its size
+  TRequestDeadline::Clock::time_point deadline;
+  if (readBufferPos_ > 4
+      && TRequestDeadline::fromFrame(readBuffer_ + 4, readBufferPos_ - 4,
+                                     TRequestDeadline::Clock::now(), deadline)) {
+    return deadline;
+  }
+  return TRequestDeadline::Clock::time_point::max();
+}
+
 void TNonblockingServer::TConnection::init(TNonblockingIOThread* ioThread) {
   ioThread_ = ioThread;
   server_ = ioThread->getServer();
+  nextCompleted_ = nullptr;
   appState_ = APP_INIT;
   eventFlags_ = 0;
 
@@ -412,6 +642,14 @@ void TNonblockingServer::TConnection::init(TNonblockingIOThread* ioThread) {
 
   // Get the processor
   processor_ = server_->getProcessor(inputProtocol_, outputProtocol_, tSocket_);
+
+  if (server_->isThreadPoolProcessing() && server_->getPipelineDepth() > 1) {
+    if (!pipeline_) {
+      pipeline_.reset(new Pipeline(server_->getPipelineDepth(), server_->getPipelineInOrder()));
+    }
+  } else {
+    pipeline_.reset();
+  }
 }
 
 void TNonblockingServer::TConnection::setSocket(std::shared_ptr<TSocket> socket) {
@@ -420,7 +658,7 @@ void TNonblockingServer::TConnection::setSocket(std::shared_ptr<TSocket> socket)
 
 void TNonblockingServer::TConnection::workSocket() {
   while (true) {
-    int got = 0, left = 0, sent = 0;
+    int got = 0;
     uint32_t fetch = 0;
 
     switch (socketState_) {
@@ -439,7 +677,7 @@ void TNonblockingServer::TConnection::workSocket() {
                                uint32_t(sizeof(framing.size) - readBufferPos_));
         if (fetch == 0) {
           // Whenever we get here it means a remote disconnect
-          close();
+          remoteClosed();
           return;
         }
         readBufferPos_ += fetch;
@@ -533,7 +771,7 @@ void TNonblockingServer::TConnection::workSocket() {
       }
 
       // Whenever we get down here it means a remote disconnect
-      close();
+      remoteClosed();
 
       return;
 
@@ -548,22 +786,8 @@ void TNonblockingServer::TConnection::workSocket() {
         return;
       }
 
-      try {
-        left = writeBufferSize_ - writeBufferPos_;
-        sent = tSocket_->write_partial(writeBuffer_ + writeBufferPos_, left);
-      } catch (TTransportException& te) {
-        GlobalOutput.printf("TConnection::workSocket(): %s ", te.what());
-        close();
-        return;
-      }
-
-      writeBufferPos_ += sent;
-
-      // Did we overdo it?
-      assert(writeBufferPos_ <= writeBufferSize_);
-
       // We are done!
-      if (writeBufferPos_ == writeBufferSize_) {
+      if (writeResult() && writeBufferPos_ == writeBufferSize_) {
         transition();
       }
 
@@ -577,6 +801,24 @@ void TNonblockingServer::TConnection::workSocket() {
   }
 }
 
+bool TNonblockingServer::TConnection::writeResult() {
+  uint32_t sent;
+  try {
+    sent = tSocket_->write_partial(writeBuffer_ + writeBufferPos_,
+                                   writeBufferSize_ - writeBufferPos_);
+  } catch (TTransportException& te) {
+    GlobalOutput.printf("TConnection::writeResult(): %s ", te.what());
+    close();
+    return false;
+  }
+
+  writeBufferPos_ += sent;
+
+  // Did we overdo it?
+  assert(writeBufferPos_ <= writeBufferSize_);
+  return true;
+}
+
 bool TNonblockingServer::getHeaderTransport() {
   // Currently if there is no output protocol factory,
   // we assume header transport (without having to create
@@ -594,10 +836,27 @@ void TNonblockingServer::TConnection::transition() {
   assert(ioThread_);
   assert(server_);
 
+  TRequestDeadline::Clock::time_point deadline;
+
   // Switch upon the state that we are currently in and move to a new state
   switch (appState_) {
 
   case APP_READ_REQUEST:
+    // A request the client has already given up on is dropped unread
+    deadline = readDeadline();
+    if (deadline <= TRequestDeadline::Clock::now()) {
+      server_->incrementShedRequests();
+      goto LABEL_APP_INIT;
+    }
+
+    if (pipeline_) {
+      // Go on reading while the request is processed
+      if (!dispatchPipelined(deadline)) {
+        return;
+      }
+      goto LABEL_APP_INIT;
+    }
+
     // We are done reading the request, package the read buffer into transport
     // and get back some data from the dispatch function
     if (server_->getHeaderTransport()) {
@@ -622,7 +881,7 @@ void TNonblockingServer::TConnection::transition() {
 
       // Create task and dispatch to the thread manager
       std::shared_ptr<Runnable> task = std::shared_ptr<Runnable>(
-          new Task(processor_, inputProtocol_, outputProtocol_, this));
+          new Task(processor_, inputProtocol_, outputProtocol_, this, deadline));
       // The application is now waiting on the task to finish
       appState_ = APP_WAIT_TASK;
 
@@ -632,7 +891,7 @@ void TNonblockingServer::TConnection::transition() {
       setIdle();
 
       try {
-        server_->addTask(task);
+        server_->addTask(task, deadline);
       } catch (IllegalStateException& ise) {
         // The ThreadManager is not ready to handle any more tasks (it's probably shutting down).
         GlobalOutput.printf("IllegalStateException: Server::process() %s", ise.what());
@@ -647,6 +906,7 @@ void TNonblockingServer::TConnection::transition() {
       return;
     } else {
       try {
+        TRequestDeadline::Scope scope(deadline);
         if (serverEventHandler_) {
           serverEventHandler_->processContext(connectionContext_, getTSocket());
         }
@@ -701,9 +961,17 @@ void TNonblockingServer::TConnection::transition() {
       auto frameSize = (int32_t)htonl(writeBufferSize_ - 4);
       memcpy(writeBuffer_, &frameSize, 4);
 
-      // Socket into write mode
+      // Most responses fit in the socket's send buffer, so send right away
+      // and only wait for the socket to become writable if it is full
       appState_ = APP_SEND_RESULT;
-      setWrite();
+      if (!writeResult()) {
+        return;
+      }
+      if (writeBufferPos_ == writeBufferSize_) {
+        transition();
+      } else {
+        setWrite();
+      }
 
       return;
     }
@@ -742,7 +1010,11 @@ void TNonblockingServer::TConnection::transition() {
     readBufferPos_ = 0;
 
     // Register read event
-    setRead();
+    if (pipeline_) {
+      setPipelineFlags();
+    } else {
+      setRead();
+    }
 
     return;
 
@@ -789,6 +1061,267 @@ void TNonblockingServer::TConnection::transition() {
   }
 }
 
+bool TNonblockingServer::TConnection::dispatchPipelined(
+    TRequestDeadline::Clock::time_point deadline) {
+  Pipeline& pipeline = *pipeline_;
+  PipelinedRequest* request;
+  if (pipeline.free.empty()) {
+    request = new PipelinedRequest();
+    request->inputTransport.reset(new TMemoryBuffer(request->frame, request->frameSize));
+    request->outputTransport.reset(
+        new TMemoryBuffer(static_cast<uint32_t>(server_->getWriteBufferDefaultSize())));
+    request->factoryInputTransport
+        = server_->getInputTransportFactory()->getTransport(request->inputTransport);
+    request->factoryOutputTransport
+        = server_->getOutputTransportFactory()->getTransport(request->outputTransport);
+    if (server_->getHeaderTransport()) {
+      request->inputProtocol = server_->getInputProtocolFactory()->getProtocol(
+          request->factoryInputTransport, request->factoryOutputTransport);
+      request->outputProtocol = request->inputProtocol;
+    } else {
+      request->inputProtocol
+          = server_->getInputProtocolFactory()->getProtocol(request->factoryInputTransport);
+      request->outputProtocol
+          = server_->getOutputProtocolFactory()->getProtocol(request->factoryOutputTransport);
+    }
+  } else {
+    request = pipeline.free.back();
+    pipeline.free.pop_back();
+  }
+
+  // The request keeps the frame, and the next one is read into the buffer
+  // of the request it last belonged to
+  std::swap(request->frame, readBuffer_);
+  std::swap(request->frameSize, readBufferSize_);
+  if (server_->getHeaderTransport()) {
+    request->inputTransport->resetBuffer(request->frame, readBufferPos_);
+    request->outputTransport->resetBuffer();
+  } else {
+    request->inputTransport->resetBuffer(request->frame + 4, readBufferPos_ - 4);
+    request->outputTransport->resetBuffer();
+    request->outputTransport->getWritePtr(4);
+    request->outputTransport->wroteBytes(4);
+  }
+  request->sequence = pipeline.nextSequence++;
+  request->closeConnection = false;
+  ++pipeline.inFlight;
+  ++pipeline.running;
+  server_->incrementActiveProcessors();
+
+  std::shared_ptr<Runnable> task(new Task(processor_,
+                                          request->inputProtocol,
+                                          request->outputProtocol,
+                                          this,
+                                          deadline,
+                                          request));
+  try {
+    server_->addTask(task, deadline);
+    return true;
+  } catch (IllegalStateException& ise) {
+    // The ThreadManager is not ready to handle any more tasks (it's probably shutting down).
+    GlobalOutput.printf("IllegalStateException: Server::process() %s", ise.what());
+  } catch (TimedOutException& to) {
+    GlobalOutput.printf("[ERROR] TimedOutException: Server::process() %s", to.what());
+  }
+
+  --pipeline.running;
+  server_->decrementActiveProcessors();
+  releasePipelined(request);
+  close();
+  return false;
+}
+
+bool TNonblockingServer::TConnection::completePipelined(PipelinedRequest* request) {
+  bool wasEmpty;
+  {
+    Guard g(pipeline_->mutex);
+    wasEmpty = pipeline_->completed.empty();
+    pipeline_->completed.push_back(request);
+  }
+  // The IO thread takes all of them at once, so only the first one since it
+  // last did has to tell it
+  return !wasEmpty || notifyIOThread();
+}
+
+void TNonblockingServer::TConnection::drainPipelined() {
+  Pipeline& pipeline = *pipeline_;
+  {
+    Guard g(pipeline.mutex);
+    pipeline.taken.swap(pipeline.completed);
+  }
+
+  bool closeConnection = false;
+  for (PipelinedRequest* request : pipeline.taken) {
+    --pipeline.running;
+    server_->decrementActiveProcessors();
+    if (pipeline.closing || request->closeConnection) {
+      closeConnection = closeConnection || request->closeConnection;
+      releasePipelined(request);
+    } else if (pipeline.inOrder) {
+      pipeline.reorder[request->sequence % pipeline.depth] = request;
+    } else {
+      queuePipelined(request);
+    }
+  }
+  pipeline.taken.clear();
+
+  if (closeConnection || pipeline.closing) {
+    if (pipeline.running == 0 || !pipeline.closing) {
+      close();
+    }
+    return;
+  }
+
+  if (pipeline.inOrder) {
+    PipelinedRequest** next;
+    while (*(next = &pipeline.reorder[pipeline.nextWrite % pipeline.depth]) != nullptr) {
+      queuePipelined(*next);
+      *next = nullptr;
+      ++pipeline.nextWrite;
+    }
+  }
+
+  // Most of the time the socket can take the responses right away
+  writePipelined();
+}
+
+void TNonblockingServer::TConnection::queuePipelined(PipelinedRequest* request) {
+  uint8_t* buffer;
+  uint32_t size;
+  request->outputTransport->getBuffer(&buffer, &size);
+
+  // 4 bytes were reserved for frame size; a oneway request has no response
+  if (size > 4) {
+    auto frameSize = (int32_t)htonl(size - 4);
+    memcpy(buffer, &frameSize, 4);
+    pipeline_->writeQueue.push_back(request);
+  } else {
+    releasePipelined(request);
+  }
+}
+
+bool TNonblockingServer::TConnection::writePipelined() {
+  Pipeline& pipeline = *pipeline_;
+  while (!pipeline.writeQueue.empty()) {
+    uint8_t* buffer;
+    uint32_t size;
+    uint32_t sent;
+    size_t wanted = 0;
+    try {
+#ifndef _WIN32
+      // The queued responses go out together, in one sendmsg()
+      struct iovec iov[Pipeline::WRITE_BATCH];
+      int count = 0;
+      for (auto it = pipeline.writeQueue.begin();
+           it != pipeline.writeQueue.end() && count < Pipeline::WRITE_BATCH;
+           ++it, ++count) {
+        (*it)->outputTransport->getBuffer(&buffer, &size);
+        iov[count].iov_base = buffer;
+        iov[count].iov_len = size;
+      }
+      iov[0].iov_base = static_cast<uint8_t*>(iov[0].iov_base) + pipeline.writePos;
+      iov[0].iov_len -= pipeline.writePos;
+      for (int i = 0; i < count; ++i) {
+        wanted += iov[i].iov_len;
+      }
+      sent = tSocket_->writev_partial(iov, count);
+#else
+      pipeline.writeQueue.front()->outputTransport->getBuffer(&buffer, &size);
+      wanted = size - pipeline.writePos;
+      sent = tSocket_->write_partial(buffer + pipeline.writePos, size - pipeline.writePos);
+#endif
+    } catch (TTransportException& te) {
+      GlobalOutput.printf("TConnection::writePipelined(): %s ", te.what());
+      close();
+      return false;
+    }
+
+    // Release the responses that were written whole
+    for (uint32_t left = sent; left > 0;) {
+      PipelinedRequest* request = pipeline.writeQueue.front();
+      request->outputTransport->getBuffer(&buffer, &size);
+      if (left < size - pipeline.writePos) {
+        pipeline.writePos += left;
+        break;
+      }
+      left -= size - pipeline.writePos;
+      pipeline.writeQueue.pop_front();
+      pipeline.writePos = 0;
+      releasePipelined(request);
+    }
+
+    if (sent < wanted) {
+      // The socket is full; go on when it is writable again
+      break;
+    }
+  }
+
+  if (pipeline.eof && pipeline.inFlight == 0) {
+    // Every request the client sent before closing has been answered
+    close();
+    return false;
+  }
+  setPipelineFlags();
+  return true;
+}
+
+void TNonblockingServer::TConnection::releasePipelined(PipelinedRequest* request) {
+  // The frame becomes a read buffer again when the request is reused, so
+  // both limits apply here, as checkIdleBufferMemLimit() applies them to the
+  // buffers of a connection that does not pipeline
+  size_t readLimit = server_->getIdleReadBufferLimit();
+  if (readLimit > 0 && request->frameSize > readLimit) {
+    request->inputTransport->resetBuffer(nullptr, 0);
+    std::free(request->frame);
+    request->frame = nullptr;
+    request->frameSize = 0;
+  }
+
+  size_t writeLimit = server_->getIdleWriteBufferLimit();
+  uint8_t* buffer;
+  uint32_t size;
+  request->outputTransport->getBuffer(&buffer, &size);
+  if (writeLimit > 0 && size > writeLimit) {
+    request->outputTransport->resetBuffer(
+        static_cast<uint32_t>(server_->getWriteBufferDefaultSize()));
+  }
+
+  --pipeline_->inFlight;
+  pipeline_->free.push_back(request);
+}
+
+void TNonblockingServer::TConnection::setPipelineFlags() {
+  short flags = 0;
+  if (!pipeline_->closing && !pipeline_->eof && pipeline_->inFlight < pipeline_->depth) {
+    flags |= EV_READ;
+  }
+  if (!pipeline_->writeQueue.empty()) {
+    flags |= EV_WRITE;
+  }
+  setFlags(flags ? flags | EV_PERSIST : 0);
+}
+
+void TNonblockingServer::TConnection::remoteClosed() {
+  if (!pipeline_ || pipeline_->inFlight == 0) {
+    close();
+    return;
+  }
+  // A request the client only sent part of is dropped, and the ones read
+  // whole are answered before the connection is closed
+  pipeline_->eof = true;
+  writePipelined();
+}
+
+void TNonblockingServer::TConnection::workPipelined(short which) {
+  if ((which & EV_WRITE) && !writePipelined()) {
+    return;
+  }
+  // Writing may have closed the connection, or stopped reading
+  if ((which & EV_READ) && (eventFlags_ & EV_READ)) {
+    workSocket();
+  }
+}
+
 void TNonblockingServer::TConnection::setFlags(short eventFlags) {
   // Catch the do nothing case
   if (eventFlags_ == eventFlags) {
@@ -849,6 +1382,17 @@ void TNonblockingServer::TConnection::setFlags(short eventFlags) {
  * Closes a connection
  */
 void TNonblockingServer::TConnection::close() {
+  if (pipeline_) {
+    if (pipeline_->running > 0 && !pipeline_->closing) {
+      // Tasks still point at the connection, so it is closed when the last
+      // one is taken back.  A second close() does not wait.
+      pipeline_->closing = true;
+      setIdle();
+      return;
+    }
+    pipeline_->reset();
+  }
+
   setIdle();
 
   if (serverEventHandler_) {
@@ -909,16 +1453,19 @@ TNonblockingServer::~TNonblockingServer() {
  * Creates a new connection either by reusing an object off the stack or
  * by allocating a new one entirely
  */
-TNonblockingServer::TConnection* TNonblockingServer::createConnection(std::shared_ptr<TSocket> socket) {
+TNonblockingServer::TConnection* TNonblockingServer::createConnection(std::shared_ptr<TSocket> socket,
+                                                                     TNonblockingIOThread* ioThread) {
   // Check the stack
   Guard g(connMutex_);
 
   // pick an IO thread to handle this connection -- currently round robin
-  assert(nextIOThread_ < ioThreads_.size());
-  int selectedThreadIdx = nextIOThread_;
-  nextIOThread_ = static_cast<uint32_t>((nextIOThread_ + 1) % ioThreads_.size());
+  if (ioThread == nullptr) {
+    assert(nextIOThread_ < ioThreads_.size());
+    int selectedThreadIdx = nextIOThread_;
+    nextIOThread_ = static_cast<uint32_t>((nextIOThread_ + 1) % ioThreads_.size());
 
-  TNonblockingIOThread* ioThread = ioThreads_[selectedThreadIdx].get();
+    ioThread = ioThreads_[selectedThreadIdx].get();
+  }
 
   // Check the connection stack to see if we can re-use
   TConnection* result = nullptr;
@@ -959,15 +1506,19 @@ void TNonblockingServer::returnConnection(TConnection* connection) {
  * Server socket had something happen.  We accept all waiting client
  * connections on fd and assign TConnection objects to handle those requests.
  */
-void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
+void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which, TNonblockingIOThread* ioThread) {
   (void)which;
   // Make sure that libevent didn't mess up the socket handles
-  assert(fd == serverSocket_);
+  assert(fd == serverSocket_ || useReusePortListeners_);
 
   // Going to accept a new client socket
   std::shared_ptr<TSocket> clientSocket;
 
-  clientSocket = serverTransport_->accept();
+  if (fd == serverSocket_) {
+    clientSocket = serverTransport_->accept();
+  } else {
+    clientSocket = serverTransport_->acceptShard(fd);
+  }
   if (clientSocket) {
     // If we're overloaded, take action here
     if (overloadAction_ != T_OVERLOAD_NO_ACTION && serverOverloaded()) {
@@ -986,8 +1537,10 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
       }
     }
 
-    // Create a new TConnection for this client socket.
-    TConnection* clientConnection = createConnection(clientSocket);
+    // Create a new TConnection for this client socket.  With a listen socket
+    // per IO thread the connection stays on the thread that accepted it.
+    TConnection* clientConnection
+        = createConnection(clientSocket, useReusePortListeners_ ? ioThread : nullptr);
 
     // Fail fast if we could not create a TConnection object
     if (clientConnection == nullptr) {
@@ -1004,11 +1557,10 @@ void TNonblockingServer::handleEvent(THRIFT_SOCKET fd, short which) {
      * (We need to avoid writing to our own notification pipe, to
      * avoid possible deadlocks if the pipe is full.)
      *
-     * The IO thread #0 is the only one that handles these listen
-     * events, so unless the connection has been assigned to thread #0
-     * we know it's not on our thread.
+     * Unless the connection has been assigned to the thread that
+     * accepted it we know it's not on our thread.
      */
-    if (clientConnection->getIOThreadNumber() == 0) {
+    if (clientConnection->getIOThreadNumber() == ioThread->getThreadNumber()) {
       clientConnection->transition();
     } else {
       if (!clientConnection->notifyIOThread()) {
@@ -1068,7 +1620,17 @@ bool TNonblockingServer::drainPendingTask() {
   if (threadManager_) {
     std::shared_ptr<Runnable> task = threadManager_->removeNextPending();
     if (task) {
-      TConnection* connection = static_cast<TConnection::Task*>(task.get())->getTConnection();
+      auto* connectionTask = static_cast<TConnection::Task*>(task.get());
+      TConnection* connection = connectionTask->getTConnection();
+      if (auto* request = connectionTask->getRequest()) {
+        // Other requests of the connection may be running; it is closed
+        // once they are done
+        request->closeConnection = true;
+        if (!connection->completePipelined(request)) {
+          throw TException("TNonblockingServer::drainPendingTask: failed write on notify pipe");
+        }
+        return true;
+      }
       assert(connection && connection->getServer() && connection->getState() == APP_WAIT_TASK);
       connection->forceClose();
       return true;
@@ -1078,8 +1640,33 @@ bool TNonblockingServer::drainPendingTask() {
 }
 
 void TNonblockingServer::expireClose(std::shared_ptr<Runnable> task) {
-  TConnection* connection = static_cast<TConnection::Task*>(task.get())->getTConnection();
+  auto* connectionTask = static_cast<TConnection::Task*>(task.get());
+  TConnection* connection = connectionTask->getTConnection();
+  if (auto* request = connectionTask->getRequest()) {
+    // Only the request is dropped if its deadline passed, and otherwise the
+    // connection is closed once its other requests are done
+    if (connectionTask->getDeadline() <= TRequestDeadline::Clock::now()) {
+      incrementShedRequests();
+    } else {
+      request->closeConnection = true;
+    }
+    if (!connection->completePipelined(request)) {
+      throw TException("TNonblockingServer::expireClose: failed write on notify pipe");
+    }
+    return;
+  }
   assert(connection && connection->getServer() && connection->getState() == APP_WAIT_TASK);
+  if (connectionTask->getDeadline() <= TRequestDeadline::Clock::now()) {
+    // Only the request expired, not the connection; hand it back without a
+    // reply, as the task would have
+    incrementShedRequests();
+    if (!connection->notifyIOThread()) {
+      decrementActiveProcessors();
+      connection->close();
+      throw TException("TNonblockingServer::expireClose: failed write on notify pipe");
+    }
+    return;
+  }
   connection->forceClose();
 }
 
@@ -1093,21 +1680,38 @@ void TNonblockingServer::stop() {
 void TNonblockingServer::registerEvents(event_base* user_event_base) {
   userEventBase_ = user_event_base;
 
+  if (!numIOThreads_) {
+    numIOThreads_ = DEFAULT_IO_THREADS;
+  }
+  // User-provided event-base doesn't works for multi-threaded servers
+  assert(numIOThreads_ == 1 || !userEventBase_);
+
+  if (useReusePortListeners_) {
+    if (numIOThreads_ == 1) {
+      useReusePortListeners_ = false;
+    } else if (serverSocket_ == THRIFT_INVALID_SOCKET && !serverTransport_->setReusePort(true)) {
+      GlobalOutput.printf("TNonblockingServer: transport does not support SO_REUSEPORT, "
+                          "accepting on IO thread #0 only.");
+      useReusePortListeners_ = false;
+    }
+  }
+
   // init listen socket
   if (serverSocket_ == THRIFT_INVALID_SOCKET)
     createAndListenOnSocket();
 
   // set up the IO threads
   assert(ioThreads_.empty());
-  if (!numIOThreads_) {
-    numIOThreads_ = DEFAULT_IO_THREADS;
-  }
-  // User-provided event-base doesn't works for multi-threaded servers
-  assert(numIOThreads_ == 1 || !userEventBase_);
 
   for (uint32_t id = 0; id < numIOThreads_; ++id) {
-    // the first IO thread also does the listening on server socket
-    THRIFT_SOCKET listenFd = (id == 0 ? serverSocket_ : THRIFT_INVALID_SOCKET);
+    // the first IO thread also does the listening on server socket, and with
+    // reuse port listeners every other one opens its own
+    THRIFT_SOCKET listenFd = THRIFT_INVALID_SOCKET;
+    if (id == 0) {
+      listenFd = serverSocket_;
+    } else if (useReusePortListeners_) {
+      listenFd = serverTransport_->listenShard();
+    }
 
     shared_ptr<TNonblockingIOThread> thread(
         new TNonblockingIOThread(this, id, listenFd, useHighPriorityIOThreads_));
@@ -1179,9 +1783,15 @@ TNonblockingIOThread::TNonblockingIOThread(TNonblockingServer* server,
     eventBase_(nullptr),
     ownEventBase_(false),
     serverEvent_{},
-    notificationEvent_{} {
+    notificationEvent_{},
+    useCompletionQueue_(server->useCompletionQueue()),
+    completed_(nullptr),
+    stopRequested_(false) {
   notificationPipeFDs_[0] = -1;
   notificationPipeFDs_[1] = -1;
+  // Other threads may hand us connections as soon as the server runs, which
+  // can be before our own thread gets to registerEvents()
+  createNotificationPipe();
 }
 
 TNonblockingIOThread::~TNonblockingIOThread() {
@@ -1200,6 +1810,10 @@ TNonblockingIOThread::~TNonblockingIOThread() {
     listenSocket_ = THRIFT_INVALID_SOCKET;
   }
 
+  if (notificationPipeFDs_[1] == notificationPipeFDs_[0]) {
+    // a single eventfd
+    notificationPipeFDs_[1] = -1;
+  }
   for (auto notificationPipeFD : notificationPipeFDs_) {
     if (notificationPipeFD >= 0) {
       if (0 != ::THRIFT_CLOSESOCKET(notificationPipeFD)) {
@@ -1212,6 +1826,18 @@ TNonblockingIOThread::~TNonblockingIOThread() {
 }
 
 void TNonblockingIOThread::createNotificationPipe() {
+#ifdef HAVE_SYS_EVENTFD_H
+  if (useCompletionQueue_) {
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd < 0) {
+      GlobalOutput.perror("TNonblockingServer::createNotificationPipe eventfd() ", errno);
+      throw TException("can't create notification eventfd");
+    }
+    notificationPipeFDs_[0] = fd;
+    notificationPipeFDs_[1] = fd;
+    return;
+  }
+#endif
   if (evutil_socketpair(AF_LOCAL, SOCK_STREAM, 0, notificationPipeFDs_) == -1) {
     GlobalOutput.perror("TNonblockingServer::createNotificationPipe ", EVUTIL_SOCKET_ERROR());
     throw TException("can't create notification pipe");
@@ -1265,7 +1891,7 @@ void TNonblockingIOThread::registerEvents() {
               listenSocket_,
               EV_READ | EV_PERSIST,
               TNonblockingIOThread::listenHandler,
-              server_);
+              this);
     event_base_set(eventBase_, &serverEvent_);
 
     // Add the event and start up the server
@@ -1277,13 +1903,12 @@ void TNonblockingIOThread::registerEvents() {
     GlobalOutput.printf("TNonblocking: IO thread #%d registered for listen.", number_);
   }
 
-  createNotificationPipe();
-
   // Create an event to be notified when a task finishes
   event_set(&notificationEvent_,
             getNotificationRecvFD(),
             EV_READ | EV_PERSIST,
-            TNonblockingIOThread::notifyHandler,
+            useCompletionQueue_ ? TNonblockingIOThread::completionHandler
+                                : TNonblockingIOThread::notifyHandler,
             this);
 
   // Attach to the base
@@ -1299,6 +1924,10 @@ void TNonblockingIOThread::registerEvents() {
 }
 
 bool TNonblockingIOThread::notify(TNonblockingServer::TConnection* conn) {
+  if (useCompletionQueue_) {
+    return notifyQueued(conn);
+  }
+
   auto fd = getNotificationSendFD();
   if (fd < 0) {
     return false;
@@ -1396,7 +2025,7 @@ void TNonblockingIOThread::notifyHandler(evutil_socket_t fd, short which, void*
         ioThread->breakLoop(false);
         return;
       }
-      connection->transition();
+      connection->notified();
     } else if (nBytes > 0) {
       // throw away these bytes and hope that next time we get a solid read
       GlobalOutput.printf("notifyHandler: Bad read of %d bytes, wanted %d", nBytes, kSize);
@@ -1420,6 +2049,114 @@ void TNonblockingIOThread::notifyHandler(evutil_socket_t fd, short which, void*
   }
 }
 
+bool TNonblockingIOThread::notifyQueued(TNonblockingServer::TConnection* conn) {
+  if (conn == nullptr) {
+    stopRequested_ = true;
+    return signalCompletion();
+  }
+
+  // A connection has at most one notification outstanding, as pipelining
+  // ones only notify for the first of the requests taken back together, so
+  // it is never queued twice.  Only the push that finds the queue empty has to wake the thread;
+  // the others are picked up by the same wakeup.
+  TNonblockingServer::TConnection* head = completed_.load(std::memory_order_relaxed);
+  do {
+    conn->nextCompleted_ = head;
+  } while (!completed_.compare_exchange_weak(head,
+                                             conn,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed));
+
+  return head != nullptr || signalCompletion();
+}
+
+bool TNonblockingIOThread::signalCompletion() {
+  auto fd = getNotificationSendFD();
+  if (fd < 0) {
+    return false;
+  }
+
+#ifdef HAVE_SYS_EVENTFD_H
+  uint64_t one = 1;
+  // EAGAIN means the counter is about to overflow, so a wakeup is pending anyway
+  if (::write(fd, &one, sizeof(one)) < 0 && errno != EAGAIN) {
+    return false;
+  }
+#else
+  char one = 1;
+  // A full pipe already holds a wakeup
+  if (send(fd, &one, 1, 0) < 0 && THRIFT_GET_SOCKET_ERROR != THRIFT_EWOULDBLOCK
+      && THRIFT_GET_SOCKET_ERROR != THRIFT_EAGAIN) {
+    return false;
+  }
+#endif
+  return true;
+}
+
+/* static */
+void TNonblockingIOThread::completionHandler(evutil_socket_t fd, short which, void* v) {
+  auto* ioThread = (TNonblockingIOThread*)v;
+  assert(ioThread);
+  (void)which;
+
+  // Consume the wakeups before taking the queue, so that anything queued
+  // after we took it comes with a wakeup we have not consumed yet.
+#ifdef HAVE_SYS_EVENTFD_H
+  uint64_t count;
+  if (::read(fd, &count, sizeof(count)) < 0 && errno != EAGAIN) {
+    GlobalOutput.perror("TNonblocking: completionHandler read() failed: ", errno);
+    ioThread->breakLoop(true);
+    return;
+  }
+#else
+  while (true) {
+    char buf[64];
+    long nBytes = recv(fd, cast_sockopt(buf), sizeof(buf), 0);
+    if (nBytes == 0) {
+      GlobalOutput.printf("completionHandler: Notify socket closed!");
+      ioThread->breakLoop(false);
+      return;
+    } else if (nBytes < 0) {
+      if (THRIFT_GET_SOCKET_ERROR != THRIFT_EWOULDBLOCK
+          && THRIFT_GET_SOCKET_ERROR != THRIFT_EAGAIN) {
+        GlobalOutput.perror("TNonblocking: completionHandler read() failed: ",
+                            THRIFT_GET_SOCKET_ERROR);
+        ioThread->breakLoop(true);
+        return;
+      }
+      break;
+    }
+  }
+#endif
+
+  if (ioThread->stopRequested_) {
+    // this is the command to stop our thread, exit the handler!
+    ioThread->breakLoop(false);
+    return;
+  }
+
+  // The queue is a stack, so reverse it to handle connections in the order
+  // their tasks finished
+  TNonblockingServer::TConnection* connection
+      = ioThread->completed_.exchange(nullptr, std::memory_order_acquire);
+  TNonblockingServer::TConnection* ordered = nullptr;
+  while (connection != nullptr) {
+    TNonblockingServer::TConnection* next = connection->nextCompleted_;
+    connection->nextCompleted_ = ordered;
+    ordered = connection;
+    connection = next;
+  }
+
+  while (ordered != nullptr) {
+    // notified() may hand the connection to a worker which can queue it
+    // again, so step past it first
+    TNonblockingServer::TConnection* next = ordered->nextCompleted_;
+    ordered->nextCompleted_ = nullptr;
+    ordered->notified();
+    ordered = next;
+  }
+}
+
 void TNonblockingIOThread::breakLoop(bool error) {
   if (error) {
     GlobalOutput.printf("TNonblockingServer: IO thread #%d exiting with error.", number_);
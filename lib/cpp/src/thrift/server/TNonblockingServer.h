@@ -32,6 +32,9 @@
 #include <thrift/concurrency/Thread.h>
 #include <thrift/concurrency/ThreadFactory.h>
 #include <thrift/concurrency/Mutex.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <stack>
 #include <vector>
 #include <string>
@@ -100,13 +103,6 @@ inline SOCKOPT_CAST_T* cast_sockopt(T* v) {
  * writes out responses using the same framing.
  */
 
-/// Overload condition actions.
-enum TOverloadAction {
-  T_OVERLOAD_NO_ACTION,       ///< Don't handle overload */
-  T_OVERLOAD_CLOSE_ON_ACCEPT, ///< Drop new connections immediately */
-  T_OVERLOAD_DRAIN_TASK_QUEUE ///< Drop some tasks from head of task queue */
-};
-
 class TNonblockingIOThread;
 
 class TNonblockingServer : public TServer {
@@ -152,6 +148,18 @@ private:
   /// Whether to set high scheduling priority for IO threads
   bool useHighPriorityIOThreads_;
 
+  /// Whether each IO thread accepts on its own SO_REUSEPORT listen socket
+  bool useReusePortListeners_;
+
+  /// Whether finished tasks are handed back to IO threads in batches
+  bool useCompletionQueue_;
+
+  /// The most requests of one connection processed at once
+  uint32_t pipelineDepth_;
+
+  /// Whether pipelined responses are written in the order of the requests
+  bool pipelineInOrder_;
+
   /// Server socket file descriptor
   THRIFT_SOCKET serverSocket_;
 
@@ -245,6 +253,9 @@ private:
   /// Count of connections dropped on overload since server started
   uint64_t nTotalConnectionsDropped_;
 
+  /// Count of requests dropped because their client's deadline had passed
+  std::atomic<uint64_t> nShedRequests_;
+
   /**
    * This is a stack of all the objects that have been created but that
    * are NOT currently in use. When we close a connection, we place it on this
@@ -271,14 +282,19 @@ private:
    * to handle those requests.
    *
    * @param which the event flag that triggered the handler.
+   * @param ioThread the IO thread that listens on fd.
    */
-  void handleEvent(THRIFT_SOCKET fd, short which);
+  void handleEvent(THRIFT_SOCKET fd, short which, TNonblockingIOThread* ioThread);
 
   void init() {
     serverSocket_ = THRIFT_INVALID_SOCKET;
     numIOThreads_ = DEFAULT_IO_THREADS;
     nextIOThread_ = 0;
     useHighPriorityIOThreads_ = false;
+    useReusePortListeners_ = false;
+    useCompletionQueue_ = false;
+    pipelineDepth_ = 1;
+    pipelineInOrder_ = false;
     userEventBase_ = nullptr;
     threadPoolProcessing_ = false;
     numTConnections_ = 0;
@@ -297,6 +313,7 @@ private:
     overloaded_ = false;
     nConnectionsDropped_ = 0;
     nTotalConnectionsDropped_ = 0;
+    nShedRequests_ = 0;
   }
 
 public:
@@ -399,6 +416,62 @@ public:
   /** Set whether the IO threads will get high scheduling priority. */
   void setUseHighPriorityIOThreads(bool val) { useHighPriorityIOThreads_ = val; }
 
+  /** Return whether each IO thread accepts on its own listen socket. */
+  bool useReusePortListeners() const { return useReusePortListeners_; }
+
+  /**
+   * Set whether each IO thread listens on its own SO_REUSEPORT socket and
+   * accepts connections directly, rather than IO thread #0 accepting them
+   * all and handing them out round robin.  The kernel then balances new
+   * connections across the threads.  Can only be used before the call to
+   * serve(), and only has an effect with more than one IO thread and a
+   * server transport that supports it.
+   */
+  void setUseReusePortListeners(bool val) { useReusePortListeners_ = val; }
+
+  /** Return whether finished tasks are handed back through a completion queue. */
+  bool useCompletionQueue() const { return useCompletionQueue_; }
+
+  /**
+   * Set whether connections whose task finished are handed back to their IO
+   * thread through a lock free queue, with one wakeup for everything that
+   * finished in the meantime, instead of one write to the notification pipe
+   * per task.  The wakeup uses an eventfd where available.  Can only be used
+   * before the call to serve().
+   */
+  void setUseCompletionQueue(bool val) { useCompletionQueue_ = val; }
+
+  /** Return the most requests of one connection processed at once. */
+  uint32_t getPipelineDepth() const { return pipelineDepth_; }
+
+  /**
+   * Set how many requests of one connection may be processed at once.  With
+   * the default of 1, a connection reads its next request only after the
+   * response to the previous one has been written.  With more, and a
+   * ThreadManager, each request is handed to the ThreadManager as soon as it
+   * has been read, and reading goes on until this many requests are being
+   * processed or have responses waiting to be written.  A client that sends
+   * many requests without waiting for each response, like TPipelinedClient,
+   * then has them processed concurrently.
+   *
+   * The processor, its handler and the server event handler's
+   * processContext() are then called concurrently for one connection, and
+   * must be thread safe.  Responses are written as they complete, so the
+   * client has to match them to its requests by seqid, unless
+   * setPipelineInOrder() is set.  Can only be used before the call to serve().
+   */
+  void setPipelineDepth(uint32_t depth) { pipelineDepth_ = (std::max)(depth, 1u); }
+
+  /** Return whether pipelined responses are written in request order. */
+  bool getPipelineInOrder() const { return pipelineInOrder_; }
+
+  /**
+   * Set whether the responses to pipelined requests are written in the order
+   * the requests arrived in, holding back those that complete early, for
+   * clients that do not match responses by seqid.
+   */
+  void setPipelineInOrder(bool inOrder) { pipelineInOrder_ = inOrder; }
+
   /** Return the number of IO threads used by this server. */
   size_t getNumIOThreads() const { return numIOThreads_; }
 
@@ -422,6 +495,23 @@ public:
     threadManager_->add(task, 0LL, taskExpireTime_);
   }
 
+  /**
+   * Adds a task that also expires at the deadline of its request, if that
+   * comes before the task expire time.
+   */
+  void addTask(std::shared_ptr<Runnable> task, std::chrono::steady_clock::time_point deadline) {
+    int64_t expireTime = taskExpireTime_;
+    if (deadline != std::chrono::steady_clock::time_point::max()) {
+      // Round up, as an expiration of 0 would mean none
+      int64_t remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                              deadline - std::chrono::steady_clock::now()).count() + 1;
+      if (expireTime == 0 || remaining < expireTime) {
+        expireTime = (std::max)(remaining, static_cast<int64_t>(1));
+      }
+    }
+    threadManager_->add(task, 0LL, expireTime);
+  }
+
   /**
    * Return the count of sockets currently connected to.
    *
@@ -453,6 +543,18 @@ public:
    */
   size_t getNumActiveProcessors() const { return numActiveProcessors_; }
 
+  /**
+   * Return the count of requests dropped unprocessed because the deadline
+   * their client sent in the client_timeout header (see TRequestDeadline)
+   * had passed, on arrival, in the task queue or before they ran.
+   *
+   * @return count of requests shed since the server started.
+   */
+  uint64_t getShedRequestCount() const { return nShedRequests_; }
+
+  /// Increment the count of requests shed.
+  void incrementShedRequests() { ++nShedRequests_; }
+
   /// Increment the count of connections currently processing.
   void incrementActiveProcessors() {
     Guard g(connMutex_);
@@ -716,9 +818,12 @@ private:
    * @param socket FD of socket associated with this connection.
    * @param addr the sockaddr of the client
    * @param addrLen the length of addr
+   * @param ioThread the IO thread to serve the connection on, or nullptr to
+   * pick one round robin.
    * @return pointer to initialized TConnection object.
    */
-  TConnection* createConnection(std::shared_ptr<TSocket> socket);
+  TConnection* createConnection(std::shared_ptr<TSocket> socket,
+                                TNonblockingIOThread* ioThread = nullptr);
 
   /**
    * Returns a connection to pool or deletion.  If the connection pool
@@ -793,16 +898,32 @@ private:
    */
   static void notifyHandler(evutil_socket_t fd, short which, void* v);
 
+  /**
+   * C-callable event handler for the completion queue.  Drains the wakeup
+   * descriptor and calls transition() for every connection in the queue, in
+   * the order their tasks finished.
+   *
+   * @param fd the descriptor the event occurred on.
+   */
+  static void completionHandler(evutil_socket_t fd, short which, void* v);
+
+  /// Queues a finished connection (or nullptr to stop) for notify().
+  bool notifyQueued(TNonblockingServer::TConnection* conn);
+
+  /// Wakes the thread up to look at the completion queue.
+  bool signalCompletion();
+
   /**
    * C-callable event handler for listener events.  Provides a callback
    * that libevent can understand which invokes server->handleEvent().
    *
    * @param fd the descriptor the event occurred on.
    * @param which the flags associated with the event.
-   * @param v void* callback arg where we placed TNonblockingServer's "this".
+   * @param v void* callback arg where we placed TNonblockingIOThread's "this".
    */
   static void listenHandler(evutil_socket_t fd, short which, void* v) {
-    ((TNonblockingServer*)v)->handleEvent(fd, which);
+    auto* ioThread = static_cast<TNonblockingIOThread*>(v);
+    ioThread->server_->handleEvent(fd, which, ioThread);
   }
 
   /// Exits the loop ASAP in case of shutdown or error.
@@ -846,9 +967,20 @@ private:
   /// Used with eventBase_ for task completion notification
   struct event notificationEvent_;
 
-  /// File descriptors for pipe used for task completion notification.
+  /// File descriptors for pipe used for task completion notification.  With
+  /// the completion queue both may be the same eventfd.
   evutil_socket_t notificationPipeFDs_[2];
 
+  /// Whether notify() goes through completed_ rather than the pipe.
+  const bool useCompletionQueue_;
+
+  /// Connections whose task finished, most recent first, linked through
+  /// TConnection::nextCompleted_.
+  std::atomic<TNonblockingServer::TConnection*> completed_;
+
+  /// Set by notify(nullptr) when using the completion queue.
+  std::atomic<bool> stopRequested_;
+
   /// Actual IO Thread
   std::shared_ptr<Thread> thread_;
 };
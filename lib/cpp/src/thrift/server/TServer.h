@@ -92,6 +92,13 @@ protected:
   TServerEventHandler() = default;
 };
 
+/// Overload condition actions, of the servers that detect overload.
+enum TOverloadAction {
+  T_OVERLOAD_NO_ACTION,       ///< Don't handle overload */
+  T_OVERLOAD_CLOSE_ON_ACCEPT, ///< Drop new connections immediately */
+  T_OVERLOAD_DRAIN_TASK_QUEUE ///< Drop some tasks from head of task queue */
+};
+
 /**
  * Thrift server.
  *
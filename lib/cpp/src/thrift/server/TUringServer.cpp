@@ -0,0 +1,1249 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/server/TUringServer.h>
+#include <thrift/TRequestDeadline.h>
+#include <thrift/concurrency/Exception.h>
+#include <thrift/concurrency/Mutex.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TSocket.h>
+
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::IllegalStateException;
+using apache::thrift::concurrency::Mutex;
+using apache::thrift::concurrency::TimedOutException;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransportException;
+
+namespace {
+
+// What a completion is for is kept in the low bits of its user data, and
+// the connection it belongs to, if any, in the rest
+const uint64_t OP_RECV = 1;
+const uint64_t OP_SEND = 2;
+const uint64_t OP_CANCEL = 3;
+const uint64_t OP_ACCEPT = 4;
+const uint64_t OP_WAKE = 5;
+const uint64_t OP_MASK = 7;
+
+/// The buffer group of the receive buffers
+const uint16_t RECV_GROUP = 0;
+
+/// How much a connection reads ahead of the request it is processing
+const uint32_t READ_AHEAD_LIMIT = 64 * 1024;
+
+int ioUringSetup(uint32_t entries, struct io_uring_params* params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, uint32_t toSubmit, uint32_t minComplete, uint32_t flags) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+int ioUringRegister(int fd, uint32_t opcode, void* arg, uint32_t count) {
+  return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+void* mapRegion(size_t size, int fd, off_t offset) {
+  void* region = mmap(nullptr,
+                      size,
+                      PROT_READ | PROT_WRITE,
+                      fd < 0 ? MAP_PRIVATE | MAP_ANONYMOUS : MAP_SHARED | MAP_POPULATE,
+                      fd,
+                      offset);
+  return region == MAP_FAILED ? nullptr : region;
+}
+}
+
+/**
+ * The io_uring of a serve(): the submission and completion queues shared
+ * with the kernel, and the receive buffers the kernel picks from.  This is
+ * the little of liburing the server needs.
+ */
+class TUringServer::Ring {
+public:
+  Ring(uint32_t entries, uint32_t bufferCount, uint32_t bufferSize);
+
+  ~Ring();
+
+  /// A cleared submission queue entry; the queue is submitted first if full
+  struct io_uring_sqe* getSqe();
+
+  /// Submits the queued entries and waits for a completion
+  void submitAndWait() { submit(1); }
+
+  /// The next completion, or nullptr if there is none
+  struct io_uring_cqe* peekCqe() {
+    if (cqHead_ == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+      return nullptr;
+    }
+    return &cqes_[cqHead_ & cqMask_];
+  }
+
+  /// Hands the slot of the completion peekCqe() returned back to the kernel
+  void seenCqe() { __atomic_store_n(cqHeadShared_, ++cqHead_, __ATOMIC_RELEASE); }
+
+  /// Counts an operation as finished, on its last completion
+  void finished() { --inFlight_; }
+
+  /// The operations submitted or queued that have not finished
+  uint32_t getInFlight() const { return inFlight_; }
+
+  uint8_t* getBuffer(uint16_t id) { return buffers_ + static_cast<size_t>(id) * bufferSize_; }
+
+  /// Gives a receive buffer back to the kernel
+  void recycleBuffer(uint16_t id);
+
+private:
+  void submit(uint32_t minComplete);
+
+  /// Unmaps the queues and buffers and closes the ring
+  void destroy();
+
+  int fd_;
+  void* sqRing_;
+  size_t sqRingSize_;
+  void* cqRing_;
+  size_t cqRingSize_;
+  struct io_uring_sqe* sqes_;
+  size_t sqesSize_;
+
+  uint32_t* sqTail_;
+  uint32_t* sqHead_;
+  uint32_t sqMask_;
+  uint32_t sqEntries_;
+  uint32_t sqLocalTail_;
+  uint32_t toSubmit_;
+
+  uint32_t* cqHeadShared_;
+  uint32_t* cqTail_;
+  uint32_t cqHead_;
+  uint32_t cqMask_;
+  struct io_uring_cqe* cqes_;
+
+  uint32_t inFlight_;
+
+  struct io_uring_buf* bufRing_;
+  size_t bufRingSize_;
+  uint8_t* buffers_;
+  size_t buffersSize_;
+  uint32_t bufferMask_;
+  uint32_t bufferSize_;
+  uint16_t bufTail_;
+};
+
+TUringServer::Ring::Ring(uint32_t entries, uint32_t bufferCount, uint32_t bufferSize)
+  : fd_(-1),
+    sqRing_(nullptr),
+    sqRingSize_(0),
+    cqRing_(nullptr),
+    cqRingSize_(0),
+    sqes_(nullptr),
+    sqesSize_(0),
+    sqLocalTail_(0),
+    toSubmit_(0),
+    cqHead_(0),
+    inFlight_(0),
+    bufRing_(nullptr),
+    bufRingSize_(0),
+    buffers_(nullptr),
+    buffersSize_(0),
+    bufferSize_(bufferSize),
+    bufTail_(0) {
+  struct io_uring_params params;
+  std::memset(&params, 0, sizeof(params));
+  params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+  // Every connection can have a receive and a send completing at once
+  params.cq_entries = entries * 4;
+#if defined(IORING_SETUP_SUBMIT_ALL) && defined(IORING_SETUP_COOP_TASKRUN)
+  params.flags |= IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
+#endif
+  fd_ = ioUringSetup(entries, &params);
+  if (fd_ < 0 && errno == EINVAL) {
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP;
+    fd_ = ioUringSetup(entries, &params);
+  }
+  if (fd_ < 0) {
+    throw TException("TUringServer: io_uring_setup() failed: "
+                     + TOutput::strerror_s(errno));
+  }
+
+  try {
+    sqRingSize_ = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    cqRingSize_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      sqRingSize_ = cqRingSize_ = (std::max)(sqRingSize_, cqRingSize_);
+    }
+    sqRing_ = mapRegion(sqRingSize_, fd_, IORING_OFF_SQ_RING);
+    if (sqRing_ == nullptr) {
+      throw TException("TUringServer: mmap() of the submission queue failed: "
+                       + TOutput::strerror_s(errno));
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      cqRing_ = sqRing_;
+    } else {
+      cqRing_ = mapRegion(cqRingSize_, fd_, IORING_OFF_CQ_RING);
+      if (cqRing_ == nullptr) {
+        throw TException("TUringServer: mmap() of the completion queue failed: "
+                         + TOutput::strerror_s(errno));
+      }
+    }
+    sqesSize_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes_ = static_cast<struct io_uring_sqe*>(mapRegion(sqesSize_, fd_, IORING_OFF_SQES));
+    if (sqes_ == nullptr) {
+      throw TException("TUringServer: mmap() of the submission entries failed: "
+                       + TOutput::strerror_s(errno));
+    }
+
+    auto* sq = static_cast<uint8_t*>(sqRing_);
+    sqHead_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.head);
+    sqTail_ = reinterpret_cast<uint32_t*>(sq + params.sq_off.tail);
+    sqMask_ = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_mask);
+    sqEntries_ = *reinterpret_cast<uint32_t*>(sq + params.sq_off.ring_entries);
+    sqLocalTail_ = *sqTail_;
+    // Entry i always sits in slot i
+    auto* array = reinterpret_cast<uint32_t*>(sq + params.sq_off.array);
+    for (uint32_t i = 0; i < sqEntries_; ++i) {
+      array[i] = i;
+    }
+
+    auto* cq = static_cast<uint8_t*>(cqRing_);
+    cqHeadShared_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.head);
+    cqTail_ = reinterpret_cast<uint32_t*>(cq + params.cq_off.tail);
+    cqHead_ = *cqHeadShared_;
+    cqMask_ = *reinterpret_cast<uint32_t*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    // The receive buffers, and the ring the kernel takes them from
+    bufRingSize_ = bufferCount * sizeof(struct io_uring_buf);
+    bufRing_ = static_cast<struct io_uring_buf*>(mapRegion(bufRingSize_, -1, 0));
+    buffersSize_ = static_cast<size_t>(bufferCount) * bufferSize;
+    buffers_ = static_cast<uint8_t*>(mapRegion(buffersSize_, -1, 0));
+    if (bufRing_ == nullptr || buffers_ == nullptr) {
+      throw TException("TUringServer: mmap() of the receive buffers failed: "
+                       + TOutput::strerror_s(errno));
+    }
+    struct io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(bufRing_);
+    reg.ring_entries = bufferCount;
+    reg.bgid = RECV_GROUP;
+    if (ioUringRegister(fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+      throw TException("TUringServer: registering the receive buffers failed: "
+                       + TOutput::strerror_s(errno));
+    }
+    bufferMask_ = bufferCount - 1;
+    for (uint32_t id = 0; id < bufferCount; ++id) {
+      recycleBuffer(static_cast<uint16_t>(id));
+    }
+  } catch (...) {
+    destroy();
+    throw;
+  }
+}
+
+void TUringServer::Ring::destroy() {
+  if (buffers_) {
+    munmap(buffers_, buffersSize_);
+    buffers_ = nullptr;
+  }
+  if (bufRing_) {
+    munmap(bufRing_, bufRingSize_);
+    bufRing_ = nullptr;
+  }
+  if (sqes_) {
+    munmap(sqes_, sqesSize_);
+    sqes_ = nullptr;
+  }
+  if (cqRing_ && cqRing_ != sqRing_) {
+    munmap(cqRing_, cqRingSize_);
+  }
+  cqRing_ = nullptr;
+  if (sqRing_) {
+    munmap(sqRing_, sqRingSize_);
+    sqRing_ = nullptr;
+  }
+  if (fd_ >= 0) {
+    ::close(fd_);
+    fd_ = -1;
+  }
+}
+
+TUringServer::Ring::~Ring() {
+  destroy();
+}
+
+struct io_uring_sqe* TUringServer::Ring::getSqe() {
+  if (sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) == sqEntries_) {
+    submit(0);
+    if (sqLocalTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) == sqEntries_) {
+      throw TException("TUringServer: submission queue full");
+    }
+  }
+  struct io_uring_sqe* sqe = &sqes_[sqLocalTail_ & sqMask_];
+  std::memset(sqe, 0, sizeof(*sqe));
+  ++sqLocalTail_;
+  ++toSubmit_;
+  ++inFlight_;
+  return sqe;
+}
+
+void TUringServer::Ring::submit(uint32_t minComplete) {
+  __atomic_store_n(sqTail_, sqLocalTail_, __ATOMIC_RELEASE);
+  int submitted = ioUringEnter(fd_, toSubmit_, minComplete,
+                               minComplete ? IORING_ENTER_GETEVENTS : 0);
+  if (submitted < 0) {
+    // Interrupted, or too many completions are waiting: the caller reaps
+    // them and comes back
+    if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+      return;
+    }
+    throw TException("TUringServer: io_uring_enter() failed: " + TOutput::strerror_s(errno));
+  }
+  toSubmit_ -= (std::min)(static_cast<uint32_t>(submitted), toSubmit_);
+}
+
+void TUringServer::Ring::recycleBuffer(uint16_t id) {
+  // The tail overlays the reserved field of the first entry, so the fields
+  // are set one by one
+  struct io_uring_buf* buf = &bufRing_[bufTail_ & bufferMask_];
+  buf->addr = reinterpret_cast<uint64_t>(getBuffer(id));
+  buf->len = bufferSize_;
+  buf->bid = id;
+  ++bufTail_;
+  __atomic_store_n(&bufRing_[0].resv, bufTail_, __ATOMIC_RELEASE);
+}
+
+/**
+ * Where tasks hand their connections back to the IO thread.  Only the first
+ * one to find it empty writes to the eventfd, and the IO thread takes all
+ * of them at once.  Tasks share it with the server, so that it stays valid
+ * for one that finishes after serve() has returned.
+ */
+struct TUringServer::Completions {
+  /// How a connection's request ended
+  enum Outcome {
+    DONE, ///< The response, if any, is in the output buffer
+    SHED, ///< The request was dropped; there is no response
+    CLOSE ///< The connection is to be closed
+  };
+
+  struct Entry {
+    std::shared_ptr<Connection> connection;
+    Outcome outcome;
+  };
+
+  explicit Completions(int eventFd) : eventFd(eventFd), wakeValue(0) {}
+
+  ~Completions() { ::close(eventFd); }
+
+  void add(std::shared_ptr<Connection> connection, Outcome outcome) {
+    bool wasEmpty;
+    {
+      Guard g(mutex);
+      wasEmpty = entries.empty();
+      entries.push_back(Entry{std::move(connection), outcome});
+    }
+    if (wasEmpty) {
+      wake();
+    }
+  }
+
+  void wake() {
+    uint64_t one = 1;
+    if (::write(eventFd, &one, sizeof(one)) != sizeof(one) && errno != EAGAIN) {
+      GlobalOutput.perror("TUringServer: write() to eventfd ", errno);
+    }
+  }
+
+  Mutex mutex;
+  std::vector<Entry> entries;
+  const int eventFd;
+  /// What the IO thread reads from the eventfd into
+  uint64_t wakeValue;
+};
+
+/**
+ * A client connection.  Everything but what the Task uses belongs to the IO
+ * thread.
+ */
+class TUringServer::Connection : public std::enable_shared_from_this<Connection> {
+public:
+  Connection(TUringServer* server, std::shared_ptr<TSocket> socket);
+
+  ~Connection();
+
+  /// Starts reading requests
+  void start() { next(); }
+
+  void received(int result, uint32_t flags);
+
+  void sent(int result);
+
+  void cancelled() { --pendingOps_; }
+
+  /// The request in processing ended
+  void processed(Completions::Outcome outcome);
+
+  /// Closes the connection once nothing is in flight for it
+  void close();
+
+  /// Whether the connection is closed and nothing refers to it any more
+  bool isReleasable() const { return closing_ && pendingOps_ == 0 && !processing_; }
+
+  /// Ends the connection; the server drops it afterwards
+  void release();
+
+  std::shared_ptr<TProcessor> getProcessor() { return processor_; }
+  std::shared_ptr<TProtocol> getInputProtocol() { return inputProtocol_; }
+  std::shared_ptr<TProtocol> getOutputProtocol() { return outputProtocol_; }
+  std::shared_ptr<TServerEventHandler> getServerEventHandler() { return serverEventHandler_; }
+  void* getConnectionContext() { return connectionContext_; }
+  std::shared_ptr<TSocket> getSocket() { return socket_; }
+
+private:
+  /// Processes the requests read, and reads on while the connection may
+  void next();
+
+  /// Processes the frame at the start of the read buffer
+  void process(uint32_t frameLength);
+
+  /// Ends the request in processing, and sends its response; false if the
+  /// connection closed
+  bool finish(Completions::Outcome outcome);
+
+  void append(const uint8_t* data, uint32_t size);
+
+  void armRecv();
+
+  /// Cancels the receive, or with all set, everything in flight
+  void cancel(bool all);
+
+  void send();
+
+  TUringServer* server_;
+  std::shared_ptr<TSocket> socket_;
+  const int fd_;
+
+  /// Bytes read and not processed yet
+  uint8_t* readBuffer_;
+  uint32_t readBufferSize_;
+  uint32_t readStart_;
+  uint32_t readEnd_;
+
+  /// The frame of the request in processing
+  uint8_t* frame_;
+  uint32_t frameSize_;
+
+  std::shared_ptr<TMemoryBuffer> inputTransport_;
+  std::shared_ptr<TMemoryBuffer> outputTransport_;
+  std::shared_ptr<TTransport> factoryInputTransport_;
+  std::shared_ptr<TTransport> factoryOutputTransport_;
+  std::shared_ptr<TProtocol> inputProtocol_;
+  std::shared_ptr<TProtocol> outputProtocol_;
+  std::shared_ptr<TProcessor> processor_;
+  std::shared_ptr<TServerEventHandler> serverEventHandler_;
+  void* connectionContext_;
+
+  /// The response being sent
+  uint8_t* writeBuffer_;
+  uint32_t writeBufferSize_;
+  uint32_t writeBufferPos_;
+
+  /// Operations in flight in the ring
+  uint32_t pendingOps_;
+  bool recvArmed_;
+  bool recvCancelling_;
+  bool processing_;
+  bool sending_;
+  bool eof_;
+  bool closing_;
+  bool released_;
+};
+
+/**
+ * Processes a request on a ThreadManager thread, and hands the connection
+ * back to the IO thread.
+ */
+class TUringServer::Task : public Runnable {
+public:
+  Task(std::shared_ptr<Connection> connection,
+       std::shared_ptr<Completions> completions,
+       TRequestDeadline::Clock::time_point deadline)
+    : connection_(connection),
+      completions_(completions),
+      processor_(connection->getProcessor()),
+      input_(connection->getInputProtocol()),
+      output_(connection->getOutputProtocol()),
+      serverEventHandler_(connection->getServerEventHandler()),
+      connectionContext_(connection->getConnectionContext()),
+      deadline_(deadline) {}
+
+  void run() override {
+    Completions::Outcome outcome = Completions::DONE;
+    try {
+      if (deadline_ <= TRequestDeadline::Clock::now()) {
+        // The client gave up while the request was queued
+        outcome = Completions::SHED;
+      } else {
+        TRequestDeadline::Scope deadline(deadline_);
+        for (;;) {
+          if (serverEventHandler_) {
+            serverEventHandler_->processContext(connectionContext_, connection_->getSocket());
+          }
+          if (!processor_->process(input_, output_, connectionContext_)
+              || !input_->getTransport()->peek()) {
+            break;
+          }
+        }
+      }
+    } catch (const TTransportException& ttx) {
+      GlobalOutput.printf("TUringServer: client died: %s", ttx.what());
+      outcome = Completions::CLOSE;
+    } catch (const std::bad_alloc&) {
+      GlobalOutput("TUringServer: caught bad_alloc exception.");
+      exit(1);
+    } catch (const std::exception& x) {
+      GlobalOutput.printf("TUringServer: process() exception: %s: %s",
+                          typeid(x).name(),
+                          x.what());
+      outcome = Completions::CLOSE;
+    } catch (...) {
+      GlobalOutput.printf("TUringServer: unknown exception while processing.");
+      outcome = Completions::CLOSE;
+    }
+    completions_->add(connection_, outcome);
+  }
+
+  const std::shared_ptr<Connection>& getConnection() const { return connection_; }
+
+  const std::shared_ptr<Completions>& getCompletions() const { return completions_; }
+
+  TRequestDeadline::Clock::time_point getDeadline() const { return deadline_; }
+
+private:
+  std::shared_ptr<Connection> connection_;
+  std::shared_ptr<Completions> completions_;
+  std::shared_ptr<TProcessor> processor_;
+  std::shared_ptr<TProtocol> input_;
+  std::shared_ptr<TProtocol> output_;
+  std::shared_ptr<TServerEventHandler> serverEventHandler_;
+  void* connectionContext_;
+  TRequestDeadline::Clock::time_point deadline_;
+};
+
+TUringServer::Connection::Connection(TUringServer* server, std::shared_ptr<TSocket> socket)
+  : server_(server),
+    socket_(socket),
+    fd_(socket->getSocketFD()),
+    readBuffer_(nullptr),
+    readBufferSize_(0),
+    readStart_(0),
+    readEnd_(0),
+    frame_(nullptr),
+    frameSize_(0),
+    inputTransport_(new TMemoryBuffer()),
+    outputTransport_(new TMemoryBuffer()),
+    writeBuffer_(nullptr),
+    writeBufferSize_(0),
+    writeBufferPos_(0),
+    pendingOps_(0),
+    recvArmed_(false),
+    recvCancelling_(false),
+    processing_(false),
+    sending_(false),
+    eof_(false),
+    closing_(false),
+    released_(false) {
+  factoryInputTransport_ = server_->getInputTransportFactory()->getTransport(inputTransport_);
+  factoryOutputTransport_ = server_->getOutputTransportFactory()->getTransport(outputTransport_);
+
+  if (server_->getHeaderTransport()) {
+    inputProtocol_ = server_->getInputProtocolFactory()->getProtocol(factoryInputTransport_,
+                                                                     factoryOutputTransport_);
+    outputProtocol_ = inputProtocol_;
+  } else {
+    inputProtocol_ = server_->getInputProtocolFactory()->getProtocol(factoryInputTransport_);
+    outputProtocol_ = server_->getOutputProtocolFactory()->getProtocol(factoryOutputTransport_);
+  }
+
+  serverEventHandler_ = server_->getEventHandler();
+  if (serverEventHandler_) {
+    connectionContext_ = serverEventHandler_->createContext(inputProtocol_, outputProtocol_);
+  } else {
+    connectionContext_ = nullptr;
+  }
+
+  processor_ = server_->getProcessor(inputProtocol_, outputProtocol_, socket_);
+}
+
+TUringServer::Connection::~Connection() {
+  // A connection whose task outlived the server ends here
+  if (!released_ && serverEventHandler_) {
+    serverEventHandler_->deleteContext(connectionContext_, inputProtocol_, outputProtocol_);
+  }
+  std::free(readBuffer_);
+  std::free(frame_);
+}
+
+void TUringServer::Connection::next() {
+  while (!closing_ && !processing_ && !sending_ && readEnd_ - readStart_ >= 4) {
+    uint32_t frameSize;
+    std::memcpy(&frameSize, readBuffer_ + readStart_, 4);
+    frameSize = ntohl(frameSize);
+    if (frameSize > server_->getMaxFrameSize()) {
+      GlobalOutput.printf(
+          "TUringServer: frame size too large "
+          "(%" PRIu32 " > %" PRIu64
+          ") from client %s. "
+          "Remote side not using TFramedTransport?",
+          frameSize,
+          (uint64_t)server_->getMaxFrameSize(),
+          socket_->getSocketInfo().c_str());
+      close();
+      return;
+    }
+    if (readEnd_ - readStart_ - 4 < frameSize) {
+      break;
+    }
+    process(frameSize + 4);
+  }
+  if (closing_) {
+    return;
+  }
+
+  bool busy = processing_ || sending_;
+  if (eof_ && !busy) {
+    // The client is done, and has been answered
+    close();
+    return;
+  }
+  // Read on while idle, and a little ahead while busy
+  bool wanted = !eof_ && (!busy || readEnd_ - readStart_ < READ_AHEAD_LIMIT);
+  if (wanted && !recvArmed_) {
+    armRecv();
+  } else if (!wanted && recvArmed_ && !recvCancelling_) {
+    cancel(false);
+  }
+}
+
+void TUringServer::Connection::process(uint32_t frameLength) {
+  // Both with and without header transport, the frame follows its size
+  TRequestDeadline::Clock::time_point deadline = TRequestDeadline::Clock::time_point::max();
+  TRequestDeadline::fromFrame(readBuffer_ + readStart_ + 4,
+                              frameLength - 4,
+                              TRequestDeadline::Clock::now(),
+                              deadline);
+  if (deadline <= TRequestDeadline::Clock::now()) {
+    // A request the client has already given up on is dropped unread
+    server_->incrementShedRequests();
+    readStart_ += frameLength;
+    return;
+  }
+
+  // The frame leaves the read buffer, which reads on while it is processed.
+  // Most of the time it is all there is, and the buffers trade places.
+  uint8_t* frame;
+  if (readStart_ + frameLength == readEnd_) {
+    std::swap(readBuffer_, frame_);
+    std::swap(readBufferSize_, frameSize_);
+    frame = frame_ + readStart_;
+    readStart_ = readEnd_ = 0;
+  } else {
+    if (frameSize_ < frameLength) {
+      auto* newFrame = static_cast<uint8_t*>(std::realloc(frame_, frameLength));
+      if (newFrame == nullptr) {
+        throw std::bad_alloc();
+      }
+      frame_ = newFrame;
+      frameSize_ = frameLength;
+    }
+    std::memcpy(frame_, readBuffer_ + readStart_, frameLength);
+    frame = frame_;
+    readStart_ += frameLength;
+  }
+
+  if (server_->getHeaderTransport()) {
+    inputTransport_->resetBuffer(frame, frameLength);
+    outputTransport_->resetBuffer();
+  } else {
+    inputTransport_->resetBuffer(frame + 4, frameLength - 4);
+    outputTransport_->resetBuffer();
+
+    // Room for the frame size, written when the response is sent
+    outputTransport_->getWritePtr(4);
+    outputTransport_->wroteBytes(4);
+  }
+
+  ++server_->numActiveProcessors_;
+  processing_ = true;
+
+  if (server_->isThreadPoolProcessing()) {
+    std::shared_ptr<Runnable> task(new Task(shared_from_this(), server_->completions_, deadline));
+    try {
+      server_->addTask(task, deadline);
+    } catch (IllegalStateException& ise) {
+      // The ThreadManager is not ready to handle any more tasks (it's probably shutting down).
+      GlobalOutput.printf("IllegalStateException: Server::process() %s", ise.what());
+      finish(Completions::CLOSE);
+    } catch (TimedOutException& to) {
+      GlobalOutput.printf("[ERROR] TimedOutException: Server::process() %s", to.what());
+      finish(Completions::CLOSE);
+    }
+    return;
+  }
+
+  Completions::Outcome outcome = Completions::DONE;
+  try {
+    TRequestDeadline::Scope scope(deadline);
+    if (serverEventHandler_) {
+      serverEventHandler_->processContext(connectionContext_, socket_);
+    }
+    processor_->process(inputProtocol_, outputProtocol_, connectionContext_);
+  } catch (const TTransportException& ttx) {
+    GlobalOutput.printf("TUringServer transport error in process(): %s", ttx.what());
+    outcome = Completions::CLOSE;
+  } catch (const std::exception& x) {
+    GlobalOutput.printf("Server::process() uncaught exception: %s: %s",
+                        typeid(x).name(),
+                        x.what());
+    outcome = Completions::CLOSE;
+  } catch (...) {
+    GlobalOutput.printf("Server::process() unknown exception");
+    outcome = Completions::CLOSE;
+  }
+  // next() goes on with the frames after, rather than nesting a call per
+  // frame a client sends ahead
+  finish(outcome);
+}
+
+void TUringServer::Connection::processed(Completions::Outcome outcome) {
+  if (finish(outcome)) {
+    next();
+  }
+}
+
+bool TUringServer::Connection::finish(Completions::Outcome outcome) {
+  processing_ = false;
+  --server_->numActiveProcessors_;
+  if (outcome == Completions::SHED) {
+    server_->incrementShedRequests();
+  }
+  if (closing_) {
+    return false;
+  }
+  if (outcome == Completions::CLOSE) {
+    close();
+    return false;
+  }
+
+  // 4 bytes were reserved for the frame size; a oneway request has no response
+  outputTransport_->getBuffer(&writeBuffer_, &writeBufferSize_);
+  if (outcome == Completions::DONE && writeBufferSize_ > 4) {
+    auto frameSize = static_cast<uint32_t>(htonl(writeBufferSize_ - 4));
+    std::memcpy(writeBuffer_, &frameSize, 4);
+    writeBufferPos_ = 0;
+    sending_ = true;
+    send();
+  }
+  return true;
+}
+
+void TUringServer::Connection::received(int result, uint32_t flags) {
+  if (!(flags & IORING_CQE_F_MORE)) {
+    recvArmed_ = false;
+    recvCancelling_ = false;
+    --pendingOps_;
+  }
+  if (flags & IORING_CQE_F_BUFFER) {
+    auto id = static_cast<uint16_t>(flags >> IORING_CQE_BUFFER_SHIFT);
+    if (result > 0 && !closing_) {
+      append(server_->ring_->getBuffer(id), static_cast<uint32_t>(result));
+    }
+    server_->ring_->recycleBuffer(id);
+  }
+  if (closing_) {
+    return;
+  }
+
+  if (result == 0) {
+    eof_ = true;
+  } else if (result == -EINVAL && server_->multishotRecv_) {
+    // The kernel predates multishot receives; one at a time then
+    server_->multishotRecv_ = false;
+  } else if (result < 0 && result != -ENOBUFS && result != -ECANCELED) {
+    // Running out of buffers only ends the receive, and a cancelled one
+    // was stopped by next()
+    if (result != -ECONNRESET) {
+      GlobalOutput.perror("TUringServer: recv() ", -result);
+    }
+    close();
+    return;
+  }
+  next();
+}
+
+void TUringServer::Connection::sent(int result) {
+  --pendingOps_;
+  if (closing_) {
+    return;
+  }
+  if (result < 0) {
+    if (result != -EPIPE && result != -ECONNRESET) {
+      GlobalOutput.perror("TUringServer: send() ", -result);
+    }
+    close();
+    return;
+  }
+
+  writeBufferPos_ += static_cast<uint32_t>(result);
+  assert(writeBufferPos_ <= writeBufferSize_);
+  if (writeBufferPos_ < writeBufferSize_) {
+    send();
+    return;
+  }
+  sending_ = false;
+  next();
+}
+
+void TUringServer::Connection::append(const uint8_t* data, uint32_t size) {
+  if (readEnd_ + size > readBufferSize_) {
+    if (readStart_ > 0) {
+      std::memmove(readBuffer_, readBuffer_ + readStart_, readEnd_ - readStart_);
+      readEnd_ -= readStart_;
+      readStart_ = 0;
+    }
+    if (readEnd_ + size > readBufferSize_) {
+      uint32_t newSize = (std::max)(readBufferSize_ * 2, readEnd_ + size);
+      auto* newBuffer = static_cast<uint8_t*>(std::realloc(readBuffer_, newSize));
+      if (newBuffer == nullptr) {
+        throw std::bad_alloc();
+      }
+      readBuffer_ = newBuffer;
+      readBufferSize_ = newSize;
+    }
+  }
+  std::memcpy(readBuffer_ + readEnd_, data, size);
+  readEnd_ += size;
+}
+
+void TUringServer::Connection::armRecv() {
+  struct io_uring_sqe* sqe = server_->ring_->getSqe();
+  sqe->opcode = IORING_OP_RECV;
+  sqe->fd = fd_;
+  sqe->flags = IOSQE_BUFFER_SELECT;
+  sqe->buf_group = RECV_GROUP;
+  sqe->ioprio = server_->multishotRecv_ ? IORING_RECV_MULTISHOT : 0;
+  sqe->user_data = reinterpret_cast<uint64_t>(this) | OP_RECV;
+  recvArmed_ = true;
+  ++pendingOps_;
+}
+
+void TUringServer::Connection::cancel(bool all) {
+  struct io_uring_sqe* sqe = server_->ring_->getSqe();
+  sqe->opcode = IORING_OP_ASYNC_CANCEL;
+  if (all) {
+    sqe->fd = fd_;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+  } else {
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(this) | OP_RECV;
+  }
+  sqe->user_data = reinterpret_cast<uint64_t>(this) | OP_CANCEL;
+  recvCancelling_ = recvArmed_;
+  ++pendingOps_;
+}
+
+void TUringServer::Connection::send() {
+  struct io_uring_sqe* sqe = server_->ring_->getSqe();
+  sqe->opcode = IORING_OP_SEND;
+  sqe->fd = fd_;
+  sqe->addr = reinterpret_cast<uint64_t>(writeBuffer_ + writeBufferPos_);
+  sqe->len = writeBufferSize_ - writeBufferPos_;
+  sqe->msg_flags = MSG_NOSIGNAL;
+  sqe->user_data = reinterpret_cast<uint64_t>(this) | OP_SEND;
+  ++pendingOps_;
+}
+
+void TUringServer::Connection::close() {
+  if (closing_) {
+    return;
+  }
+  closing_ = true;
+  if (recvArmed_ || sending_) {
+    cancel(true);
+  }
+}
+
+void TUringServer::Connection::release() {
+  assert(isReleasable());
+  released_ = true;
+  if (serverEventHandler_) {
+    serverEventHandler_->deleteContext(connectionContext_, inputProtocol_, outputProtocol_);
+  }
+
+  // Close the socket
+  socket_->close();
+
+  // close any factory produced transports
+  factoryInputTransport_->close();
+  factoryOutputTransport_->close();
+
+  // release processor and handler
+  processor_.reset();
+}
+
+std::shared_ptr<TUringServer::Completions> TUringServer::createCompletions() {
+  int eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (eventFd < 0) {
+    int errno_copy = errno;
+    GlobalOutput.perror("TUringServer: eventfd() ", errno_copy);
+    throw TException("TUringServer: eventfd() failed: " + TOutput::strerror_s(errno_copy));
+  }
+  return std::make_shared<Completions>(eventFd);
+}
+
+TUringServer::~TUringServer() = default;
+
+bool TUringServer::isSupported() {
+  try {
+    Ring ring(2, 1, 64);
+  } catch (const TException&) {
+    return false;
+  }
+  return true;
+}
+
+void TUringServer::setThreadManager(std::shared_ptr<ThreadManager> threadManager) {
+  threadManager_ = threadManager;
+  if (threadManager) {
+    threadManager->setExpireCallback(
+        std::bind(&TUringServer::expireClose, this, std::placeholders::_1));
+    threadPoolProcessing_ = true;
+  } else {
+    threadPoolProcessing_ = false;
+  }
+}
+
+bool TUringServer::getHeaderTransport() {
+  // As with TNonblockingServer, no output protocol factory means header
+  // transport
+  return getOutputProtocolFactory() == nullptr;
+}
+
+void TUringServer::addTask(std::shared_ptr<Runnable> task,
+                           std::chrono::steady_clock::time_point deadline) {
+  int64_t expireTime = taskExpireTime_;
+  if (deadline != TRequestDeadline::Clock::time_point::max()) {
+    // Round up, as an expiration of 0 would mean none
+    int64_t remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                            deadline - TRequestDeadline::Clock::now()).count() + 1;
+    if (expireTime == 0 || remaining < expireTime) {
+      expireTime = (std::max)(remaining, static_cast<int64_t>(1));
+    }
+  }
+  threadManager_->add(task, 0LL, expireTime);
+}
+
+bool TUringServer::serverOverloaded() {
+  size_t activeConnections = numConnections_;
+  size_t activeProcessors = numActiveProcessors_;
+  if (activeProcessors > maxActiveProcessors_ || activeConnections > maxConnections_) {
+    if (!overloaded_) {
+      GlobalOutput.printf("TUringServer: overload condition begun.");
+      overloaded_ = true;
+    }
+  } else {
+    if (overloaded_ && (activeProcessors <= overloadHysteresis_ * maxActiveProcessors_)
+        && (activeConnections <= overloadHysteresis_ * maxConnections_)) {
+      GlobalOutput.printf(
+          "TUringServer: overload ended; "
+          "%u dropped (%llu total)",
+          nConnectionsDropped_,
+          nTotalConnectionsDropped_);
+      nConnectionsDropped_ = 0;
+      overloaded_ = false;
+    }
+  }
+
+  return overloaded_;
+}
+
+bool TUringServer::drainPendingTask() {
+  if (threadManager_) {
+    std::shared_ptr<Runnable> task = threadManager_->removeNextPending();
+    if (task) {
+      auto* connectionTask = static_cast<Task*>(task.get());
+      connectionTask->getCompletions()->add(connectionTask->getConnection(),
+                                            Completions::CLOSE);
+      return true;
+    }
+  }
+  return false;
+}
+
+void TUringServer::expireClose(std::shared_ptr<Runnable> task) {
+  auto* connectionTask = static_cast<Task*>(task.get());
+  // Only the request expired if its deadline passed, and then it is handed
+  // back without a reply, as the task would have
+  connectionTask->getCompletions()->add(connectionTask->getConnection(),
+                                        connectionTask->getDeadline()
+                                                <= TRequestDeadline::Clock::now()
+                                            ? Completions::SHED
+                                            : Completions::CLOSE);
+}
+
+void TUringServer::stop() {
+  stop_ = true;
+  completions_->wake();
+}
+
+void TUringServer::armAccept() {
+  struct io_uring_sqe* sqe = ring_->getSqe();
+  sqe->opcode = IORING_OP_ACCEPT;
+  sqe->fd = listenSocket_;
+  sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+  sqe->accept_flags = SOCK_CLOEXEC;
+  sqe->user_data = OP_ACCEPT;
+  acceptArmed_ = true;
+}
+
+void TUringServer::armWake() {
+  struct io_uring_sqe* sqe = ring_->getSqe();
+  sqe->opcode = IORING_OP_READ;
+  sqe->fd = completions_->eventFd;
+  sqe->addr = reinterpret_cast<uint64_t>(&completions_->wakeValue);
+  sqe->len = sizeof(completions_->wakeValue);
+  sqe->user_data = OP_WAKE;
+  wakeArmed_ = true;
+}
+
+void TUringServer::handleAccept(int result, uint32_t flags) {
+  if (!(flags & IORING_CQE_F_MORE)) {
+    acceptArmed_ = false;
+  }
+
+  if (result >= 0) {
+    THRIFT_SOCKET clientSocket = result;
+    // If we're overloaded, take action here
+    if (overloadAction_ != T_OVERLOAD_NO_ACTION && serverOverloaded()) {
+      nConnectionsDropped_++;
+      nTotalConnectionsDropped_++;
+      if (overloadAction_ == T_OVERLOAD_CLOSE_ON_ACCEPT
+          || (overloadAction_ == T_OVERLOAD_DRAIN_TASK_QUEUE && !drainPendingTask())) {
+        // Nothing left to discard, so we drop connection instead.
+        ::THRIFT_CLOSESOCKET(clientSocket);
+        clientSocket = THRIFT_INVALID_SOCKET;
+      }
+    }
+
+    if (clientSocket != THRIFT_INVALID_SOCKET) {
+      std::shared_ptr<TSocket> socket(new TSocket(clientSocket));
+      // Responses go out whole, so there is nothing to gain from Nagle
+      socket->setNoDelay(true);
+      std::shared_ptr<Connection> connection(new Connection(this, socket));
+      connections_[connection.get()] = connection;
+      ++numConnections_;
+      connection->start();
+      releaseIfClosed(connection.get());
+    }
+  } else if (result != -ECANCELED) {
+    GlobalOutput.perror("TUringServer: accept() ", -result);
+  }
+
+  if (!acceptArmed_ && !stop_ && !closingAll_ && result != -ECANCELED) {
+    armAccept();
+  }
+}
+
+void TUringServer::handleCompletion(uint64_t userData, int result, uint32_t flags) {
+  if (!(flags & IORING_CQE_F_MORE)) {
+    ring_->finished();
+  }
+
+  auto* connection = reinterpret_cast<Connection*>(userData & ~OP_MASK);
+  switch (userData & OP_MASK) {
+  case OP_ACCEPT:
+    handleAccept(result, flags);
+    return;
+  case OP_WAKE:
+    // The completions themselves are taken after every batch
+    wakeArmed_ = false;
+    if (result < 0 && result != -ECANCELED && result != -EAGAIN) {
+      GlobalOutput.perror("TUringServer: read() of eventfd ", -result);
+    }
+    if (!stop_ && !closingAll_ && result != -ECANCELED) {
+      armWake();
+    }
+    return;
+  case OP_RECV:
+    connection->received(result, flags);
+    break;
+  case OP_SEND:
+    connection->sent(result);
+    break;
+  case OP_CANCEL:
+    if (connection == nullptr) {
+      return;
+    }
+    connection->cancelled();
+    break;
+  default:
+    assert(0);
+    return;
+  }
+  releaseIfClosed(connection);
+}
+
+void TUringServer::handleCompletions() {
+  std::vector<Completions::Entry> entries;
+  {
+    Guard g(completions_->mutex);
+    entries.swap(completions_->entries);
+  }
+  for (Completions::Entry& entry : entries) {
+    Connection* connection = entry.connection.get();
+    if (connections_.find(connection) == connections_.end()) {
+      // Dropped by an earlier serve() while its task ran
+      continue;
+    }
+    connection->processed(entry.outcome);
+    releaseIfClosed(connection);
+  }
+}
+
+void TUringServer::releaseIfClosed(Connection* connection) {
+  if (connection->isReleasable()) {
+    connection->release();
+    connections_.erase(connection);
+    --numConnections_;
+  }
+}
+
+void TUringServer::serve() {
+  serverTransport_->listen();
+  listenSocket_ = serverTransport_->getSocketFD();
+
+  // The buffer ring must have a power of two entries, of at most 32768
+  uint32_t bufferCount = 1;
+  while (bufferCount < recvBufferCount_ && bufferCount < 32768) {
+    bufferCount *= 2;
+  }
+  Ring ring(ringEntries_, bufferCount, recvBufferSize_);
+  ring_ = &ring;
+  multishotRecv_ = true;
+
+  armAccept();
+  armWake();
+
+  // Notify handler of the preServe event
+  if (eventHandler_) {
+    eventHandler_->preServe();
+  }
+
+  try {
+    while (!stop_) {
+      ring.submitAndWait();
+      while (struct io_uring_cqe* cqe = ring.peekCqe()) {
+        uint64_t userData = cqe->user_data;
+        int result = cqe->res;
+        uint32_t flags = cqe->flags;
+        ring.seenCqe();
+        handleCompletion(userData, result, flags);
+      }
+      handleCompletions();
+    }
+  } catch (...) {
+    closeAll();
+    ring_ = nullptr;
+    throw;
+  }
+
+  closeAll();
+  ring_ = nullptr;
+}
+
+void TUringServer::closeAll() {
+  // serve() may end on an exception while stop_ is not set
+  closingAll_ = true;
+  try {
+    // Cancel everything in flight, and wait until the kernel is done with
+    // the buffers of the connections and the ring
+    for (auto& entry : connections_) {
+      entry.second->close();
+    }
+    for (uint64_t op : {OP_ACCEPT, OP_WAKE}) {
+      if ((op == OP_ACCEPT && acceptArmed_) || (op == OP_WAKE && wakeArmed_)) {
+        struct io_uring_sqe* sqe = ring_->getSqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = op;
+        sqe->user_data = OP_CANCEL;
+      }
+    }
+    while (ring_->getInFlight() > 0) {
+      ring_->submitAndWait();
+      while (struct io_uring_cqe* cqe = ring_->peekCqe()) {
+        uint64_t userData = cqe->user_data;
+        int result = cqe->res;
+        uint32_t flags = cqe->flags;
+        ring_->seenCqe();
+        handleCompletion(userData, result, flags);
+      }
+      handleCompletions();
+    }
+  } catch (const TException& tx) {
+    GlobalOutput.printf("TUringServer: %s", tx.what());
+  }
+  acceptArmed_ = false;
+  wakeArmed_ = false;
+  closingAll_ = false;
+
+  // The connections whose task is still running end with it
+  connections_.clear();
+  numConnections_ = 0;
+}
+}
+}
+} // apache::thrift::server
@@ -0,0 +1,439 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_SERVER_TURINGSERVER_H_
+#define _THRIFT_SERVER_TURINGSERVER_H_ 1
+
+#include <thrift/Thrift.h>
+#include <thrift/server/TServer.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/transport/PlatformSocket.h>
+#include <thrift/transport/TNonblockingServerTransport.h>
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+
+namespace apache {
+namespace thrift {
+namespace server {
+
+using apache::thrift::concurrency::Runnable;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::transport::TNonblockingServerTransport;
+
+/**
+ * A Linux server that, like TNonblockingServer, serves framed requests from
+ * many connections on a single IO thread, processing them on that thread or
+ * on a ThreadManager, but drives its sockets through an io_uring instead of
+ * libevent.
+ *
+ * One multishot accept takes all new connections, and one multishot receive
+ * per connection reads into a ring of buffers that the kernel picks from, so
+ * that no buffer is tied up by an idle connection.  Responses are sent as
+ * they are ready.  All of it is submitted and reaped together, with one
+ * io_uring_enter() per loop rather than a system call per socket and event.
+ *
+ * Requests are processed one at a time per connection, as with
+ * TNonblockingServer, and the same overload controls, frame size limit and
+ * deadline shedding (see TRequestDeadline) apply.  Needs Linux 5.19 or
+ * later; isSupported() tells whether the running kernel allows it.
+ *
+ *   std::shared_ptr<TNonblockingServerSocket> socket(new TNonblockingServerSocket(9090));
+ *   TUringServer server(processor, socket);
+ *   server.setThreadManager(threadManager);
+ *   server.serve();
+ */
+class TUringServer : public TServer {
+public:
+  /// Default number of entries of the submission queue
+  static const uint32_t RING_ENTRIES = 4096;
+
+  /// Default number of receive buffers the connections share
+  static const uint32_t RECV_BUFFER_COUNT = 1024;
+
+  /// Default size of a receive buffer
+  static const uint32_t RECV_BUFFER_SIZE = 8192;
+
+  /// Default limit on frame size
+  static const int MAX_FRAME_SIZE = 256 * 1024 * 1024;
+
+  /// Default limit on total number of connected sockets
+  static const int MAX_CONNECTIONS = INT_MAX;
+
+  /// Default limit on connections in handler/task processing
+  static const int MAX_ACTIVE_PROCESSORS = INT_MAX;
+
+  TUringServer(const std::shared_ptr<TProcessorFactory>& processorFactory,
+               const std::shared_ptr<TNonblockingServerTransport>& serverTransport)
+    : TServer(processorFactory), serverTransport_(serverTransport) {
+    init();
+  }
+
+  TUringServer(const std::shared_ptr<TProcessor>& processor,
+               const std::shared_ptr<TNonblockingServerTransport>& serverTransport)
+    : TServer(processor), serverTransport_(serverTransport) {
+    init();
+  }
+
+  TUringServer(const std::shared_ptr<TProcessorFactory>& processorFactory,
+               const std::shared_ptr<TProtocolFactory>& protocolFactory,
+               const std::shared_ptr<TNonblockingServerTransport>& serverTransport,
+               const std::shared_ptr<ThreadManager>& threadManager
+               = std::shared_ptr<ThreadManager>())
+    : TServer(processorFactory), serverTransport_(serverTransport) {
+    init();
+
+    setInputProtocolFactory(protocolFactory);
+    setOutputProtocolFactory(protocolFactory);
+    setThreadManager(threadManager);
+  }
+
+  TUringServer(const std::shared_ptr<TProcessor>& processor,
+               const std::shared_ptr<TProtocolFactory>& protocolFactory,
+               const std::shared_ptr<TNonblockingServerTransport>& serverTransport,
+               const std::shared_ptr<ThreadManager>& threadManager
+               = std::shared_ptr<ThreadManager>())
+    : TServer(processor), serverTransport_(serverTransport) {
+    init();
+
+    setInputProtocolFactory(protocolFactory);
+    setOutputProtocolFactory(protocolFactory);
+    setThreadManager(threadManager);
+  }
+
+  ~TUringServer() override;
+
+  /**
+   * Whether the running kernel provides the io_uring features the server
+   * needs; serve() throws if it does not.
+   */
+  static bool isSupported();
+
+  void setThreadManager(std::shared_ptr<ThreadManager> threadManager);
+
+  std::shared_ptr<ThreadManager> getThreadManager() { return threadManager_; }
+
+  bool isThreadPoolProcessing() const { return threadPoolProcessing_; }
+
+  int getListenPort() { return serverTransport_->getListenPort(); }
+
+  /** Return the number of entries of the submission queue. */
+  uint32_t getRingEntries() const { return ringEntries_; }
+
+  /**
+   * Set the number of entries of the submission queue; the completion queue
+   * is four times as large.  Can only be used before the call to serve().
+   */
+  void setRingEntries(uint32_t entries) { ringEntries_ = entries; }
+
+  /** Return the number of receive buffers. */
+  uint32_t getRecvBufferCount() const { return recvBufferCount_; }
+
+  /**
+   * Set the number of receive buffers the connections share, rounded up to a
+   * power of two of at most 32768.  A connection only holds one while its
+   * data is copied out, so a few are enough for many connections.  Can only
+   * be used before the call to serve().
+   */
+  void setRecvBufferCount(uint32_t count) { recvBufferCount_ = count; }
+
+  /** Return the size of a receive buffer. */
+  uint32_t getRecvBufferSize() const { return recvBufferSize_; }
+
+  /**
+   * Set the size of a receive buffer, the most read from a connection at
+   * once.  Can only be used before the call to serve().
+   */
+  void setRecvBufferSize(uint32_t size) { recvBufferSize_ = size; }
+
+  /**
+   * Return the count of sockets currently connected to.
+   *
+   * @return count of connected sockets.
+   */
+  size_t getNumConnections() const { return numConnections_; }
+
+  /**
+   * Return count of number of connections which are currently processing.
+   *
+   * @return # of connections currently processing.
+   */
+  size_t getNumActiveProcessors() const { return numActiveProcessors_; }
+
+  /**
+   * Return the count of requests dropped unprocessed because the deadline
+   * their client sent (see TRequestDeadline) had passed.
+   *
+   * @return count of requests shed since the server started.
+   */
+  uint64_t getShedRequestCount() const { return nShedRequests_; }
+
+  /**
+   * Get the maximum # of connections allowed before overload.
+   *
+   * @return current setting.
+   */
+  size_t getMaxConnections() const { return maxConnections_; }
+
+  /**
+   * Set the maximum # of connections allowed before overload.
+   *
+   * @param maxConnections new setting for maximum # of connections.
+   */
+  void setMaxConnections(size_t maxConnections) { maxConnections_ = maxConnections; }
+
+  /**
+   * Get the maximum # of connections waiting in handler/task before overload.
+   *
+   * @return current setting.
+   */
+  size_t getMaxActiveProcessors() const { return maxActiveProcessors_; }
+
+  /**
+   * Set the maximum # of connections waiting in handler/task before overload.
+   *
+   * @param maxActiveProcessors new setting for maximum # of active processes.
+   */
+  void setMaxActiveProcessors(size_t maxActiveProcessors) {
+    maxActiveProcessors_ = maxActiveProcessors;
+  }
+
+  /**
+   * Get the maximum allowed frame size.
+   *
+   * If a client tries to send a message larger than this limit,
+   * its connection will be closed.
+   *
+   * @return Maxium frame size, in bytes.
+   */
+  size_t getMaxFrameSize() const { return maxFrameSize_; }
+
+  /**
+   * Set the maximum allowed frame size.
+   *
+   * @param maxFrameSize The new maximum frame size.
+   */
+  void setMaxFrameSize(size_t maxFrameSize) { maxFrameSize_ = maxFrameSize; }
+
+  /**
+   * Get fraction of maximum limits before an overload condition is cleared.
+   *
+   * @return hysteresis fraction
+   */
+  double getOverloadHysteresis() const { return overloadHysteresis_; }
+
+  /**
+   * Set fraction of maximum limits before an overload condition is cleared.
+   * A good value would probably be between 0.5 and 0.9.
+   *
+   * @param hysteresisFraction fraction <= 1.0.
+   */
+  void setOverloadHysteresis(double hysteresisFraction) {
+    if (hysteresisFraction <= 1.0 && hysteresisFraction > 0.0) {
+      overloadHysteresis_ = hysteresisFraction;
+    }
+  }
+
+  /**
+   * Get the action the server will take on overload.
+   *
+   * @return a TOverloadAction enum value for the currently set action.
+   */
+  TOverloadAction getOverloadAction() const { return overloadAction_; }
+
+  /**
+   * Set the action the server is to take on overload.
+   *
+   * @param overloadAction a TOverloadAction enum value for the action.
+   */
+  void setOverloadAction(TOverloadAction overloadAction) { overloadAction_ = overloadAction; }
+
+  /**
+   * Get the time in milliseconds after which a task expires (0 == infinite).
+   *
+   * @return a 64-bit time in milliseconds.
+   */
+  int64_t getTaskExpireTime() const { return taskExpireTime_; }
+
+  /**
+   * Set the time in milliseconds after which a task expires (0 == infinite).
+   *
+   * @param taskExpireTime a 64-bit time in milliseconds.
+   */
+  void setTaskExpireTime(int64_t taskExpireTime) { taskExpireTime_ = taskExpireTime; }
+
+  /**
+   * Determine if the server is currently overloaded.
+   * This function checks the maximums for open connections and connections
+   * currently in processing, and sets an overload condition if they are
+   * exceeded.  The overload will persist until both values are below the
+   * current hysteresis fraction of their maximums.
+   *
+   * @return true if an overload condition exists, false if not.
+   */
+  bool serverOverloaded();
+
+  /** Pop and discard next task on threadpool wait queue.
+   *
+   * @return true if a task was discarded, false if the wait queue was empty.
+   */
+  bool drainPendingTask();
+
+  /**
+   * Main workhorse function, starts up the server listening on a port and
+   * loops over the io_uring until stop() is called.
+   */
+  void serve() override;
+
+  /** Causes the server to terminate gracefully (can be called from any thread). */
+  void stop() override;
+
+private:
+  class Connection;
+  class Ring;
+  class Task;
+  struct Completions;
+
+  void init() {
+    threadPoolProcessing_ = false;
+    ringEntries_ = RING_ENTRIES;
+    recvBufferCount_ = RECV_BUFFER_COUNT;
+    recvBufferSize_ = RECV_BUFFER_SIZE;
+    maxFrameSize_ = MAX_FRAME_SIZE;
+    maxConnections_ = MAX_CONNECTIONS;
+    maxActiveProcessors_ = MAX_ACTIVE_PROCESSORS;
+    overloadHysteresis_ = 0.8;
+    overloadAction_ = T_OVERLOAD_NO_ACTION;
+    taskExpireTime_ = 0;
+    overloaded_ = false;
+    nConnectionsDropped_ = 0;
+    nTotalConnectionsDropped_ = 0;
+    numConnections_ = 0;
+    numActiveProcessors_ = 0;
+    nShedRequests_ = 0;
+    stop_ = false;
+    ring_ = nullptr;
+    listenSocket_ = THRIFT_INVALID_SOCKET;
+    acceptArmed_ = false;
+    wakeArmed_ = false;
+    closingAll_ = false;
+    multishotRecv_ = true;
+    completions_ = createCompletions();
+  }
+
+  static std::shared_ptr<Completions> createCompletions();
+
+  /// Whether requests are written in THeaderTransport framing
+  bool getHeaderTransport();
+
+  /// Called by the ThreadManager for a task that expired in its queue
+  void expireClose(std::shared_ptr<Runnable> task);
+
+  /**
+   * Adds a task that also expires at the deadline of its request, if that
+   * comes before the task expire time.
+   */
+  void addTask(std::shared_ptr<Runnable> task, std::chrono::steady_clock::time_point deadline);
+
+  void incrementShedRequests() { ++nShedRequests_; }
+
+  void armAccept();
+  void armWake();
+  void handleAccept(int result, uint32_t flags);
+  void handleCompletion(uint64_t userData, int result, uint32_t flags);
+
+  /// Takes the connections the tasks handed back
+  void handleCompletions();
+
+  /// Drops a connection once it is closed and nothing is in flight for it
+  void releaseIfClosed(Connection* connection);
+
+  void closeAll();
+
+  /// Server socket
+  std::shared_ptr<TNonblockingServerTransport> serverTransport_;
+  THRIFT_SOCKET listenSocket_;
+
+  /// For processing via thread pool, may be nullptr
+  std::shared_ptr<ThreadManager> threadManager_;
+  bool threadPoolProcessing_;
+
+  uint32_t ringEntries_;
+  uint32_t recvBufferCount_;
+  uint32_t recvBufferSize_;
+
+  /// Limit for how large a frame may be
+  size_t maxFrameSize_;
+
+  /// Limit for number of open connections
+  size_t maxConnections_;
+
+  /// Limit for number of connections processing or awaiting process
+  size_t maxActiveProcessors_;
+
+  /// Fraction of the limits at which an overload ends
+  double overloadHysteresis_;
+
+  /// Action to take when we're overloaded.
+  TOverloadAction overloadAction_;
+
+  /// Time in milliseconds before an unperformed task expires (0 == infinite).
+  int64_t taskExpireTime_;
+
+  /// Set if we are currently in an overloaded state.
+  bool overloaded_;
+
+  /// Count of connections dropped since overload started
+  uint32_t nConnectionsDropped_;
+
+  /// Count of connections dropped on overload since server started
+  uint64_t nTotalConnectionsDropped_;
+
+  std::atomic<size_t> numConnections_;
+  std::atomic<size_t> numActiveProcessors_;
+  std::atomic<uint64_t> nShedRequests_;
+
+  std::atomic<bool> stop_;
+
+  /// The ring of the running serve(), only used on its thread
+  Ring* ring_;
+  bool acceptArmed_;
+  bool wakeArmed_;
+
+  /// Set while closeAll() waits for the ring, which is not armed again then
+  bool closingAll_;
+
+  /// Cleared if the kernel turns down multishot receives
+  bool multishotRecv_;
+
+  /// The open connections, by the address their completions carry
+  std::unordered_map<Connection*, std::shared_ptr<Connection> > connections_;
+
+  /// Where tasks hand their connections back, shared with the tasks
+  std::shared_ptr<Completions> completions_;
+};
+}
+}
+} // apache::thrift::server
+
+#endif // #ifndef _THRIFT_SERVER_TURINGSERVER_H_
@@ -147,7 +147,7 @@ uint32_t TFramedTransport::readSlow(uint8_t* buf, uint32_t len) {
   // attempting to read from it could block.
   if (have > 0) {
     memcpy(buf, rBase_, have);
-    setReadBuffer(rBuf_.get(), 0);
+    setReadBuffer(rBuf_.get() + rFrameStart_, 0);
     return have;
   }
 
@@ -169,8 +169,30 @@ uint32_t TFramedTransport::readSlow(uint8_t* buf, uint32_t len) {
 }
 
 bool TFramedTransport::readFrame() {
-  // TODO(dreiss): Think about using readv here, even though it would
-  // result in (gasp) read-ahead.
+  if (readAheadSize_ > 0) {
+    int32_t sz;
+    if (!fillReadAhead(static_cast<uint32_t>(sizeof(sz)))) {
+      // EOF before any data was read.
+      return false;
+    }
+    memcpy(&sz, rBuf_.get() + rAheadBase_, sizeof(sz));
+    sz = ntohl(sz);
+
+    if (sz < 0) {
+      throw TTransportException("Frame size has negative value");
+    }
+    if (sz > static_cast<int32_t>(maxFrameSize_)) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Received an oversized frame");
+    }
+
+    // Hand the frame out of the buffer; whatever follows it stays there for
+    // the next one
+    fillReadAhead(static_cast<uint32_t>(sizeof(sz)) + sz);
+    rFrameStart_ = rAheadBase_ + static_cast<uint32_t>(sizeof(sz));
+    setReadBuffer(rBuf_.get() + rFrameStart_, sz);
+    rAheadBase_ = rFrameStart_ + sz;
+    return true;
+  }
 
   // Read the size of the next frame.
   // We can't use readAll(&sz, sizeof(sz)), since that always throws an
@@ -207,15 +229,54 @@ bool TFramedTransport::readFrame() {
     throw TTransportException(TTransportException::CORRUPTED_DATA, "Received an oversized frame");
 
   // Read the frame payload, and reset markers.
-  if (sz > static_cast<int32_t>(rBufSize_)) {
-    rBuf_.reset(new uint8_t[sz]);
-    rBufSize_ = sz;
-  }
+  ensureReadBuffer(static_cast<uint32_t>(sz));
   transport_->readAll(rBuf_.get(), sz);
   setReadBuffer(rBuf_.get(), sz);
   return true;
 }
 
+bool TFramedTransport::fillReadAhead(uint32_t want) {
+  uint32_t have = rAheadBound_ - rAheadBase_;
+  if (have >= want) {
+    return true;
+  }
+
+  // Move what we have to the front, into a new buffer if this one is the
+  // wrong size or frames handed out of it are pinned.  A buffer grown for a
+  // large frame is shrunk back here too.
+  uint32_t size = (std::max)(readAheadSize_, want);
+  if (rAheadBase_ + want > rBufSize_ || rBufSize_ > size) {
+    if (size != rBufSize_ || rBuf_.use_count() > 1) {
+      boost::shared_array<uint8_t> buf(new uint8_t[size]);
+      if (have > 0) {
+        memcpy(buf.get(), rBuf_.get() + rAheadBase_, have);
+      }
+      rBuf_ = buf;
+      rBufSize_ = size;
+    } else if (have > 0) {
+      memmove(rBuf_.get(), rBuf_.get() + rAheadBase_, have);
+    }
+    rAheadBase_ = 0;
+    rAheadBound_ = have;
+    // The current frame is used up, but may still be pointed at
+    rFrameStart_ = 0;
+    setReadBuffer(rBuf_.get(), 0);
+  }
+
+  while (rAheadBound_ - rAheadBase_ < want) {
+    uint32_t got = transport_->read(rBuf_.get() + rAheadBound_, rBufSize_ - rAheadBound_);
+    if (got == 0) {
+      if (rAheadBound_ == rAheadBase_) {
+        return false;
+      }
+      throw TTransportException(TTransportException::END_OF_FILE,
+                                "No more data to read after partial frame.");
+    }
+    rAheadBound_ += got;
+  }
+  return true;
+}
+
 void TFramedTransport::writeSlow(const uint8_t* buf, uint32_t len) {
   // Double buffer size until sufficient.
   auto have = static_cast<uint32_t>(wBase_ - wBuf_.get());
@@ -297,14 +358,36 @@ const uint8_t* TFramedTransport::borrowSlow(uint8_t* buf, uint32_t* len) {
   return nullptr;
 }
 
+void TFramedTransport::ensureReadBuffer(uint32_t sz) {
+  if (sz > rBufSize_) {
+    rBuf_.reset(new uint8_t[sz]);
+    rBufSize_ = sz;
+  } else if (rBuf_.use_count() > 1) {
+    // Someone still holds slices of the previous frame; leave that buffer
+    // to them.
+    rBuf_.reset(new uint8_t[rBufSize_]);
+  }
+}
+
+std::shared_ptr<const void> TFramedTransport::pinReadBuffer() {
+  if (!rBuf_) {
+    return nullptr;
+  }
+  boost::shared_array<uint8_t> frame = rBuf_;
+  return std::shared_ptr<const void>(frame.get(), [frame](const void*) {});
+}
+
 uint32_t TFramedTransport::readEnd() {
   // include framing bytes
-  auto bytes_read = static_cast<uint32_t>(rBound_ - rBuf_.get() + sizeof(uint32_t));
+  auto bytes_read
+      = static_cast<uint32_t>(rBound_ - (rBuf_.get() + rFrameStart_) + sizeof(uint32_t));
 
-  if (rBufSize_ > bufReclaimThresh_) {
+  // With read-ahead, the buffer may hold the next frames already
+  if (rBufSize_ > bufReclaimThresh_ && rAheadBase_ == rAheadBound_) {
     rBufSize_ = 0;
     rBuf_.reset();
     setReadBuffer(rBuf_.get(), rBufSize_);
+    rAheadBase_ = rAheadBound_ = rFrameStart_ = 0;
   }
 
   return bytes_read;
@@ -375,6 +458,12 @@ void TMemoryBuffer::ensureCanWrite(uint32_t len) {
   // Unless the power of two exceeds maxBufferSize_:
   const uint64_t new_size = static_cast<uint64_t>((std::min)(suggested_buffer_size, static_cast<double>(maxBufferSize_)));
 
+  if (pinned_) {
+    // Slices may point into the current buffer, so it can't be realloc'ed.
+    detachPinnedBuffer(static_cast<uint32_t>(new_size));
+    return;
+  }
+
   // Allocate into a new pointer so we don't bork ours if it fails.
   auto* new_buffer = static_cast<uint8_t*>(std::realloc(buffer_, static_cast<std::size_t>(new_size)));
   if (new_buffer == nullptr) {
@@ -390,6 +479,32 @@ void TMemoryBuffer::ensureCanWrite(uint32_t len) {
   bufferSize_ = static_cast<uint32_t>(new_size);
 }
 
+void TMemoryBuffer::detachPinnedBuffer(uint32_t size) {
+  auto* new_buffer = static_cast<uint8_t*>(std::malloc(size));
+  if (new_buffer == nullptr) {
+    throw std::bad_alloc();
+  }
+  memcpy(new_buffer, buffer_, wBase_ - buffer_);
+
+  rBase_ = new_buffer + (rBase_ - buffer_);
+  rBound_ = new_buffer + (rBound_ - buffer_);
+  wBase_ = new_buffer + (wBase_ - buffer_);
+  wBound_ = new_buffer + size;
+  buffer_ = new_buffer;
+  bufferSize_ = size;
+  pinned_.reset();
+}
+
+std::shared_ptr<const void> TMemoryBuffer::pinReadBuffer() {
+  if (!owner_ || buffer_ == nullptr) {
+    return nullptr;
+  }
+  if (!pinned_) {
+    pinned_.reset(buffer_, std::free);
+  }
+  return pinned_;
+}
+
 void TMemoryBuffer::writeSlow(const uint8_t* buf, uint32_t len) {
   ensureCanWrite(len);
 
@@ -24,6 +24,7 @@
 #include <cstring>
 #include <limits>
 #include <boost/scoped_array.hpp>
+#include <boost/shared_array.hpp>
 
 #include <thrift/transport/TTransport.h>
 #include <thrift/transport/TVirtualTransport.h>
@@ -323,7 +324,11 @@ public:
       wBufSize_(DEFAULT_BUFFER_SIZE),
       rBuf_(),
       wBuf_(new uint8_t[wBufSize_]),
-      bufReclaimThresh_((std::numeric_limits<uint32_t>::max)()) {
+      bufReclaimThresh_((std::numeric_limits<uint32_t>::max)()),
+      readAheadSize_(0),
+      rAheadBase_(0),
+      rAheadBound_(0),
+      rFrameStart_(0) {
     initPointers();
   }
 
@@ -335,7 +340,11 @@ public:
       rBuf_(),
       wBuf_(new uint8_t[wBufSize_]),
       bufReclaimThresh_((std::numeric_limits<uint32_t>::max)()),
-      maxFrameSize_(configuration_->getMaxFrameSize()) {
+      maxFrameSize_(configuration_->getMaxFrameSize()),
+      readAheadSize_(0),
+      rAheadBase_(0),
+      rAheadBound_(0),
+      rFrameStart_(0) {
     initPointers();
   }
 
@@ -350,7 +359,11 @@ public:
       rBuf_(),
       wBuf_(new uint8_t[wBufSize_]),
       bufReclaimThresh_(bufReclaimThresh),
-      maxFrameSize_(configuration_->getMaxFrameSize()) {
+      maxFrameSize_(configuration_->getMaxFrameSize()),
+      readAheadSize_(0),
+      rAheadBase_(0),
+      rAheadBound_(0),
+      rFrameStart_(0) {
     initPointers();
   }
 
@@ -358,11 +371,14 @@ public:
 
   bool isOpen() const override { return transport_->isOpen(); }
 
-  bool peek() override { return (rBase_ < rBound_) || transport_->peek(); }
+  bool peek() override {
+    return (rBase_ < rBound_) || (rAheadBase_ < rAheadBound_) || transport_->peek();
+  }
 
   void close() override {
     flush();
     transport_->close();
+    rAheadBase_ = rAheadBound_ = 0;
   }
 
   uint32_t readSlow(uint8_t* buf, uint32_t len) override;
@@ -377,6 +393,12 @@ public:
 
   const uint8_t* borrowSlow(uint8_t* buf, uint32_t* len) override;
 
+  /**
+   * Pins the current frame.  The next frame is read into a new buffer if
+   * the pinned one is still referenced by then.
+   */
+  std::shared_ptr<const void> pinReadBuffer() override;
+
   std::shared_ptr<TTransport> getUnderlyingTransport() { return transport_; }
 
   /*
@@ -400,6 +422,25 @@ public:
    */
   uint32_t getMaxFrameSize() { return maxFrameSize_; }
 
+  /**
+   * Turns on read-ahead, with a read buffer of the given size.
+   *
+   * Without read-ahead, every frame takes two reads of the underlying
+   * transport, one for its size and one for its body, so that nothing past
+   * the frame is consumed.  With read-ahead, the buffer is filled with
+   * whatever the underlying transport has, and the frames in it are handed
+   * out without reading again: a batch of small pipelined frames costs one
+   * read.  A frame larger than the buffer grows it, and the buffer shrinks
+   * back the next time it is refilled.
+   *
+   * Only use read-ahead when no one else reads the underlying transport, as
+   * the bytes of the next frames are held here.  Set it before the first
+   * read.  Zero, the default, turns it off.
+   */
+  void setReadAheadSize(uint32_t readAheadSize) { readAheadSize_ = readAheadSize; }
+
+  uint32_t getReadAheadSize() const { return readAheadSize_; }
+
 protected:
   /**
    * Reads a frame of input from the underlying stream.
@@ -409,6 +450,21 @@ protected:
    */
   virtual bool readFrame();
 
+  /**
+   * Makes sure at least want bytes past rAheadBase_ are in the read-ahead
+   * buffer, reading as much as the underlying transport has.
+   *
+   * Returns false on EOF before any byte of the frame; raises a
+   * TTransportException on EOF after part of it.
+   */
+  bool fillReadAhead(uint32_t want);
+
+  /**
+   * Makes sure rBuf_ holds at least sz bytes and is not pinned by anyone
+   * else, so the next frame can be read into it.
+   */
+  void ensureReadBuffer(uint32_t sz);
+
   void initPointers() {
     setReadBuffer(nullptr, 0);
     setWriteBuffer(wBuf_.get(), wBufSize_);
@@ -422,10 +478,18 @@ protected:
 
   uint32_t rBufSize_;
   uint32_t wBufSize_;
-  boost::scoped_array<uint8_t> rBuf_;
+  // Shared with the slices handed out through pinReadBuffer().
+  boost::shared_array<uint8_t> rBuf_;
   boost::scoped_array<uint8_t> wBuf_;
   uint32_t bufReclaimThresh_;
   uint32_t maxFrameSize_;
+  uint32_t readAheadSize_;
+  // With read-ahead, rBuf_ holds the bytes read past the current frame in
+  // [rAheadBase_, rAheadBound_)
+  uint32_t rAheadBase_;
+  uint32_t rAheadBound_;
+  // Where the current frame starts in rBuf_
+  uint32_t rFrameStart_;
 };
 
 /**
@@ -434,7 +498,13 @@ protected:
  */
 class TFramedTransportFactory : public TTransportFactory {
 public:
-  TFramedTransportFactory() = default;
+  TFramedTransportFactory() : readAheadSize_(0) {}
+
+  /**
+   * Wraps transports into framed ones that read ahead with a buffer of the
+   * given size; see TFramedTransport::setReadAheadSize().
+   */
+  explicit TFramedTransportFactory(uint32_t readAheadSize) : readAheadSize_(readAheadSize) {}
 
   ~TFramedTransportFactory() override = default;
 
@@ -442,8 +512,13 @@ public:
    * Wraps the transport into a framed one.
    */
   std::shared_ptr<TTransport> getTransport(std::shared_ptr<TTransport> trans) override {
-    return std::shared_ptr<TTransport>(new TFramedTransport(trans));
+    auto* framed = new TFramedTransport(trans);
+    framed->setReadAheadSize(readAheadSize_);
+    return std::shared_ptr<TTransport>(framed);
   }
+
+private:
+  uint32_t readAheadSize_;
 };
 
 /**
@@ -563,7 +638,8 @@ public:
   }
 
   ~TMemoryBuffer() override {
-    if (owner_) {
+    // A pinned buffer is freed by whoever lets go of it last.
+    if (owner_ && !pinned_) {
       std::free(buffer_);
     }
   }
@@ -610,6 +686,9 @@ public:
     if (!owner_) {
       wBound_ = wBase_;
       bufferSize_ = 0;
+    } else if (pinned_ && pinned_.use_count() > 1) {
+      // Nor into one that slices of the previous message still point into.
+      detachPinnedBuffer(bufferSize_);
     }
   }
 
@@ -689,6 +768,14 @@ public:
   // that had been provided by getWritePtr().
   void wroteBytes(uint32_t len);
 
+  /**
+   * Pins the buffer if this TMemoryBuffer owns it.  Writing after a
+   * resetBuffer(), or growing the buffer, then moves to a new allocation
+   * while slices of the old one are alive.  Observed buffers cannot be
+   * pinned, since their lifetime is up to the caller.
+   */
+  std::shared_ptr<const void> pinReadBuffer() override;
+
   /*
    * TVirtualTransport provides a default implementation of readAll().
    * We want to use the TBufferBase version instead.
@@ -730,11 +817,16 @@ protected:
     swap(wBound_, that.wBound_);
 
     swap(owner_, that.owner_);
+    swap(pinned_, that.pinned_);
   }
 
   // Make sure there's at least 'len' bytes available for writing.
   void ensureCanWrite(uint32_t len);
 
+  // Move the contents to a fresh allocation of 'size' bytes and leave the
+  // pinned one to the slices that still reference it.
+  void detachPinnedBuffer(uint32_t size);
+
   // Compute the position and available data for reading.
   void computeRead(uint32_t len, uint8_t** out_start, uint32_t* out_give);
 
@@ -756,6 +848,10 @@ protected:
   // Is this object the owner of the buffer?
   bool owner_;
 
+  // Set once the buffer has been pinned.  Takes over freeing buffer_ from
+  // owner_, and is shared with the pinning slices.
+  std::shared_ptr<uint8_t> pinned_;
+
   // Don't forget to update constrctors, initCommon, and swap if
   // you add new members.
 };
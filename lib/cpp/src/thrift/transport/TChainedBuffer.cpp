@@ -0,0 +1,352 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include <thrift/transport/TChainedBuffer.h>
+#include <thrift/transport/TSocket.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+TChainedBuffer::TChainedBuffer(std::shared_ptr<TConfiguration> config)
+  : TVirtualTransport(config), segmentSize_(DEFAULT_SEGMENT_SIZE), readSegment_(0) {
+}
+
+TChainedBuffer::TChainedBuffer(uint32_t segmentSize, std::shared_ptr<TConfiguration> config)
+  : TVirtualTransport(config), segmentSize_(segmentSize > 0 ? segmentSize : 1), readSegment_(0) {
+}
+
+TChainedBuffer::TChainedBuffer(std::shared_ptr<TTransport> transport,
+                               uint32_t segmentSize,
+                               std::shared_ptr<TConfiguration> config)
+  : TVirtualTransport(config),
+    transport_(transport),
+    segmentSize_(segmentSize > 0 ? segmentSize : 1),
+    readSegment_(0) {
+}
+
+void TChainedBuffer::syncTail() {
+  if (!segments_.empty() && segments_.back().writable) {
+    segments_.back().length = static_cast<uint32_t>(wBase_ - segments_.back().data);
+  }
+}
+
+bool TChainedBuffer::advanceRead() {
+  syncTail();
+  if (segments_.empty()) {
+    return false;
+  }
+  for (;;) {
+    Segment& seg = segments_[readSegment_];
+    rBound_ = seg.data + seg.length;
+    if (rBase_ < rBound_) {
+      return true;
+    }
+    if (readSegment_ + 1 >= segments_.size()) {
+      return false;
+    }
+    ++readSegment_;
+    rBase_ = segments_[readSegment_].data;
+  }
+}
+
+void TChainedBuffer::addSegment(uint32_t len) {
+  syncTail();
+  if (!segments_.empty()) {
+    segments_.back().writable = false;
+  }
+  if (writeEnd() + static_cast<uint64_t>(len) > (std::numeric_limits<uint32_t>::max)()) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "Attempted to write over 4 GB to TChainedBuffer.");
+  }
+
+  // Anything bigger than a segment gets an allocation of its own, so that a
+  // single large write is still one copy.
+  uint32_t size = (std::max)(segmentSize_, len);
+  Segment seg;
+  seg.storage.reset(new uint8_t[size], std::default_delete<uint8_t[]>());
+  seg.data = seg.storage.get();
+  seg.length = 0;
+  seg.capacity = size;
+  seg.writable = true;
+  seg.owned = true;
+  segments_.push_back(seg);
+
+  setWriteBuffer(seg.data, size);
+  if (!transport_ && segments_.size() == 1) {
+    readSegment_ = 0;
+    setReadBuffer(seg.data, 0);
+  }
+}
+
+void TChainedBuffer::writeSlow(const uint8_t* buf, uint32_t len) {
+  for (;;) {
+    auto give = (std::min)(len, static_cast<uint32_t>(wBound_ - wBase_));
+    if (give > 0) {
+      std::memcpy(wBase_, buf, give);
+      wBase_ += give;
+      buf += give;
+      len -= give;
+    }
+    if (len == 0) {
+      return;
+    }
+    addSegment(len);
+  }
+}
+
+void TChainedBuffer::appendExternal(const uint8_t* buf,
+                                    uint32_t len,
+                                    std::shared_ptr<void> owner) {
+  if (len == 0) {
+    return;
+  }
+  if (buf == nullptr) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "TChainedBuffer given null buffer with non-zero size.");
+  }
+  syncTail();
+  if (writeEnd() + static_cast<uint64_t>(len) > (std::numeric_limits<uint32_t>::max)()) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "Attempted to write over 4 GB to TChainedBuffer.");
+  }
+
+  // Whatever room is left in the current segment is carved off and put
+  // after the external region, so the next write does not need a fresh
+  // allocation.
+  Segment spare;
+  spare.capacity = 0;
+  if (!segments_.empty() && segments_.back().writable) {
+    Segment& tail = segments_.back();
+    spare.storage = tail.storage;
+    spare.data = tail.data + tail.length;
+    spare.length = 0;
+    spare.capacity = static_cast<uint32_t>(wBound_ - wBase_);
+    spare.writable = true;
+    spare.owned = true;
+    tail.writable = false;
+  }
+
+  Segment ext;
+  ext.storage = std::shared_ptr<uint8_t>(owner, const_cast<uint8_t*>(buf));
+  ext.data = const_cast<uint8_t*>(buf);
+  ext.length = len;
+  ext.capacity = len;
+  ext.writable = false;
+  ext.owned = false;
+  segments_.push_back(ext);
+  if (!transport_ && segments_.size() == 1) {
+    readSegment_ = 0;
+    setReadBuffer(ext.data, 0);
+  }
+
+  if (spare.capacity > 0) {
+    segments_.push_back(spare);
+    setWriteBuffer(spare.data, spare.capacity);
+  } else {
+    setWriteBuffer(nullptr, 0);
+  }
+}
+
+uint32_t TChainedBuffer::readSlow(uint8_t* buf, uint32_t len) {
+  if (transport_) {
+    return transport_->read(buf, len);
+  }
+
+  uint32_t got = 0;
+  while (got < len && advanceRead()) {
+    auto give = (std::min)(len - got, static_cast<uint32_t>(rBound_ - rBase_));
+    std::memcpy(buf + got, rBase_, give);
+    rBase_ += give;
+    got += give;
+  }
+  return got;
+}
+
+const uint8_t* TChainedBuffer::borrowSlow(uint8_t* buf, uint32_t* len) {
+  (void)buf;
+  // Borrowing is only possible within a single segment.  Requests spanning
+  // a boundary make the protocol fall back to read().
+  if (!transport_ && advanceRead() && static_cast<ptrdiff_t>(*len) <= rBound_ - rBase_) {
+    *len = static_cast<uint32_t>(rBound_ - rBase_);
+    return rBase_;
+  }
+  return nullptr;
+}
+
+bool TChainedBuffer::peek() {
+  if (transport_) {
+    return transport_->peek();
+  }
+  return advanceRead();
+}
+
+uint32_t TChainedBuffer::available_read() const {
+  uint64_t total = 0;
+  for (size_t i = readSegment_; i < segments_.size(); ++i) {
+    const Segment& seg = segments_[i];
+    total += seg.writable ? static_cast<uint32_t>(wBase_ - seg.data) : seg.length;
+  }
+  if (!transport_ && readSegment_ < segments_.size()) {
+    total -= static_cast<uint32_t>(rBase_ - segments_[readSegment_].data);
+  }
+  return static_cast<uint32_t>(total);
+}
+
+uint32_t TChainedBuffer::getSegmentCount() const {
+  uint32_t count = 0;
+  for (const auto& seg : segments_) {
+    if ((seg.writable ? static_cast<uint32_t>(wBase_ - seg.data) : seg.length) > 0) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+void TChainedBuffer::appendBufferToString(std::string& str) {
+  syncTail();
+  for (size_t i = readSegment_; i < segments_.size(); ++i) {
+    const Segment& seg = segments_[i];
+    const uint8_t* start = seg.data;
+    if (!transport_ && i == readSegment_) {
+      start = rBase_;
+    }
+    str.append(reinterpret_cast<const char*>(start),
+               static_cast<std::string::size_type>(seg.data + seg.length - start));
+  }
+}
+
+std::string TChainedBuffer::getBufferAsString() {
+  std::string str;
+  str.reserve(available_read());
+  appendBufferToString(str);
+  return str;
+}
+
+void TChainedBuffer::resetBuffer() {
+  // Keep the first segment around if it is one of our own full-sized
+  // allocations; small messages then never touch the allocator.
+  Segment keep;
+  bool reuse = !segments_.empty() && segments_.front().owned
+               && segments_.front().data == segments_.front().storage.get()
+               && segments_.front().capacity == segmentSize_;
+  if (reuse) {
+    keep = segments_.front();
+  }
+  segments_.clear();
+  readSegment_ = 0;
+
+  if (reuse) {
+    keep.length = 0;
+    keep.writable = true;
+    segments_.push_back(keep);
+    setWriteBuffer(keep.data, keep.capacity);
+    setReadBuffer(transport_ ? nullptr : keep.data, 0);
+  } else {
+    setWriteBuffer(nullptr, 0);
+    setReadBuffer(nullptr, 0);
+  }
+}
+
+uint32_t TChainedBuffer::readEnd() {
+  if (transport_) {
+    return 0;
+  }
+
+  syncTail();
+  uint32_t bytes = 0;
+  for (size_t i = 0; i < readSegment_ && i < segments_.size(); ++i) {
+    bytes += segments_[i].length;
+  }
+  if (readSegment_ < segments_.size()) {
+    bytes += static_cast<uint32_t>(rBase_ - segments_[readSegment_].data);
+  }
+  if (available_read() == 0) {
+    resetBuffer();
+  }
+  resetConsumedMessageSize();
+  return bytes;
+}
+
+uint32_t TChainedBuffer::writeEnd() {
+  syncTail();
+  uint64_t bytes = 0;
+  for (const auto& seg : segments_) {
+    bytes += seg.length;
+  }
+  return static_cast<uint32_t>(bytes);
+}
+
+void TChainedBuffer::flushSegments() {
+#ifndef _WIN32
+  auto* socket = dynamic_cast<TSocket*>(transport_.get());
+  if (socket != nullptr) {
+    std::vector<struct iovec> iov;
+    iov.reserve(segments_.size());
+    for (const auto& seg : segments_) {
+      if (seg.length > 0) {
+        struct iovec v;
+        v.iov_base = seg.data;
+        v.iov_len = seg.length;
+        iov.push_back(v);
+      }
+    }
+    if (!iov.empty()) {
+      socket->writev(&iov[0], static_cast<int>(iov.size()));
+    }
+    return;
+  }
+#endif
+  for (const auto& seg : segments_) {
+    if (seg.length > 0) {
+      transport_->write(seg.data, seg.length);
+    }
+  }
+}
+
+void TChainedBuffer::flush() {
+  resetConsumedMessageSize();
+  if (!transport_) {
+    return;
+  }
+
+  syncTail();
+  if (writeEnd() > 0) {
+    // Note that we drop the segments even if the underlying write throws
+    // up an exception, to ensure we're in a sane state (i.e. internal
+    // buffer cleaned) afterwards.
+    try {
+      flushSegments();
+    } catch (...) {
+      resetBuffer();
+      throw;
+    }
+    resetBuffer();
+  }
+
+  // Flush the underlying transport.
+  transport_->flush();
+}
+}
+}
+} // apache::thrift::transport
@@ -0,0 +1,199 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef _THRIFT_TRANSPORT_TCHAINEDBUFFER_H_
+#define _THRIFT_TRANSPORT_TCHAINEDBUFFER_H_ 1
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <thrift/transport/TBufferTransports.h>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * A chained buffer keeps its contents in a list of segments instead of one
+ * contiguous allocation.  Writes fill the current segment and append a new
+ * one when it runs out of room, so data that has already been written is
+ * never reallocated or copied again, no matter how large the message grows.
+ *
+ * Callers can also splice memory they own into the chain with
+ * appendExternal(); those bytes are referenced rather than copied.
+ *
+ * Used on its own, TChainedBuffer behaves like TMemoryBuffer: whatever is
+ * written can be read back.  When it wraps a transport it only buffers
+ * outgoing data; flush() hands every segment to the underlying transport
+ * in one go (a single gathered sendmsg() when that transport is a TSocket)
+ * and reads pass straight through to the underlying transport.
+ */
+class TChainedBuffer : public TVirtualTransport<TChainedBuffer, TBufferBase> {
+public:
+  static const uint32_t DEFAULT_SEGMENT_SIZE = 16 * 1024;
+
+  /**
+   * Construct a standalone chained buffer with default-sized segments.
+   */
+  TChainedBuffer(std::shared_ptr<TConfiguration> config = nullptr);
+
+  /**
+   * Construct a standalone chained buffer.
+   *
+   * @param segmentSize  Size of each segment allocated for written data.
+   */
+  TChainedBuffer(uint32_t segmentSize, std::shared_ptr<TConfiguration> config = nullptr);
+
+  /**
+   * Construct a chained buffer that collects writes for, and flushes them
+   * to, the given transport.
+   */
+  TChainedBuffer(std::shared_ptr<TTransport> transport,
+                 uint32_t segmentSize = DEFAULT_SEGMENT_SIZE,
+                 std::shared_ptr<TConfiguration> config = nullptr);
+
+  ~TChainedBuffer() override = default;
+
+  bool isOpen() const override { return transport_ ? transport_->isOpen() : true; }
+
+  bool peek() override;
+
+  void open() override {
+    if (transport_) {
+      transport_->open();
+    }
+  }
+
+  void close() override {
+    if (transport_) {
+      flush();
+      transport_->close();
+    }
+  }
+
+  void flush() override;
+
+  uint32_t readEnd() override;
+
+  uint32_t writeEnd() override;
+
+  /**
+   * Appends a region of caller-owned memory to the chain without copying it.
+   *
+   * The memory must stay valid and unmodified until it has been read or
+   * flushed out of the buffer.  If owner is set, the buffer holds on to it
+   * for exactly that long, so it can be used to tie the region's lifetime
+   * to the chain.
+   */
+  void appendExternal(const uint8_t* buf, uint32_t len, std::shared_ptr<void> owner = nullptr);
+
+  /**
+   * Number of bytes written but not yet read or flushed.
+   */
+  uint32_t available_read() const;
+
+  /**
+   * Number of segments currently holding data.
+   */
+  uint32_t getSegmentCount() const;
+
+  uint32_t getSegmentSize() const { return segmentSize_; }
+
+  std::string getBufferAsString();
+
+  void appendBufferToString(std::string& str);
+
+  /**
+   * Discards all data in the chain.  The first segment allocated by the
+   * buffer is kept for the next message.
+   */
+  void resetBuffer();
+
+  std::shared_ptr<TTransport> getUnderlyingTransport() { return transport_; }
+
+  /*
+   * TVirtualTransport provides a default implementation of readAll().
+   * We want to use the TBufferBase version instead.
+   */
+  uint32_t readAll(uint8_t* buf, uint32_t len) { return TBufferBase::readAll(buf, len); }
+
+protected:
+  struct Segment {
+    // Keeps the memory alive; shared between segments carved out of the
+    // same allocation and set to the caller's owner for external memory.
+    std::shared_ptr<uint8_t> storage;
+    uint8_t* data;
+    uint32_t length;
+    uint32_t capacity;
+    // Only the last segment can be writable, and only if we allocated it.
+    bool writable;
+    // False for memory spliced in by appendExternal().
+    bool owned;
+  };
+
+  uint32_t readSlow(uint8_t* buf, uint32_t len) override;
+
+  void writeSlow(const uint8_t* buf, uint32_t len) override;
+
+  const uint8_t* borrowSlow(uint8_t* buf, uint32_t* len) override;
+
+  // Record the bytes written through the fast path in the tail segment.
+  void syncTail();
+
+  // Make the read pointers cover the unread part of the current segment,
+  // stepping over any segments that have been read completely.
+  bool advanceRead();
+
+  // Append a freshly allocated writable segment of at least len bytes.
+  void addSegment(uint32_t len);
+
+  void flushSegments();
+
+  std::shared_ptr<TTransport> transport_;
+
+  uint32_t segmentSize_;
+  std::vector<Segment> segments_;
+  // Index of the segment rBase_ points into.
+  size_t readSegment_;
+};
+
+/**
+ * Wraps a transport into a chained buffer.  Most useful as a server's
+ * output transport factory for services returning large responses.
+ */
+class TChainedBufferTransportFactory : public TTransportFactory {
+public:
+  TChainedBufferTransportFactory(uint32_t segmentSize = TChainedBuffer::DEFAULT_SEGMENT_SIZE)
+    : segmentSize_(segmentSize) {}
+
+  ~TChainedBufferTransportFactory() override = default;
+
+  std::shared_ptr<TTransport> getTransport(std::shared_ptr<TTransport> trans) override {
+    return std::shared_ptr<TTransport>(new TChainedBuffer(trans, segmentSize_));
+  }
+
+private:
+  uint32_t segmentSize_;
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef _THRIFT_TRANSPORT_TCHAINEDBUFFER_H_
@@ -40,6 +40,7 @@
 #endif
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <iostream>
 #include <limits>
 #include <memory>
@@ -49,6 +50,8 @@
 
 #ifdef _WIN32
 #include <io.h>
+#else
+#include <sys/mman.h>
 #endif
 
 namespace apache {
@@ -69,6 +72,8 @@ TFileTransport::TFileTransport(string path, bool readOnly, std::shared_ptr<TConf
     readBuff_(nullptr),
     currentEvent_(nullptr),
     readBuffSize_(DEFAULT_READ_BUFF_SIZE),
+    memoryMapped_(false),
+    mappingLen_(0),
     readTimeout_(NO_TAIL_READ_TIMEOUT),
     chunkSize_(DEFAULT_CHUNK_SIZE),
     eventBufferSize_(DEFAULT_EVENT_BUFFER_SIZE),
@@ -79,17 +84,23 @@ TFileTransport::TFileTransport(string path, bool readOnly, std::shared_ptr<TConf
     eofSleepTime_(DEFAULT_EOF_SLEEP_TIME_US),
     corruptedEventSleepTime_(DEFAULT_CORRUPTED_SLEEP_TIME_US),
     writerThreadIOErrorSleepTime_(DEFAULT_WRITER_THREAD_SLEEP_TIME_US),
-    dequeueBuffer_(nullptr),
-    enqueueBuffer_(nullptr),
+    enqueuedEvents_(0),
     notFull_(&mutex_),
     notEmpty_(&mutex_),
     closing_(false),
     flushed_(&mutex_),
-    forceFlush_(false),
+    flushRequested_(0),
+    flushCompleted_(0),
     filename_(path),
     fd_(0),
     bufferAndThreadInitialized_(false),
     offset_(0),
+    directIO_(false),
+    directFd_(-1),
+    directBuff_(nullptr),
+    directBuffLen_(0),
+    directBuffSynced_(0),
+    directBuffOffset_(0),
     lastBadChunk_(0),
     numCorruptedEventsInChunk_(0),
     readOnly_(readOnly) {
@@ -117,6 +128,7 @@ void TFileTransport::resetOutputFile(int fd, string filename, off_t offset) {
       fd_ = 0;
     }
   }
+  closeDirectIO();
 
   if (fd) {
     fd_ = fd;
@@ -140,18 +152,16 @@ TFileTransport::~TFileTransport() {
     writerThread_.reset();
   }
 
-  if (dequeueBuffer_) {
-    delete dequeueBuffer_;
-    dequeueBuffer_ = nullptr;
-  }
-
-  if (enqueueBuffer_) {
-    delete enqueueBuffer_;
-    enqueueBuffer_ = nullptr;
+  closeDirectIO();
+  if (directBuff_) {
+    free(directBuff_);
+    directBuff_ = nullptr;
   }
 
   if (readBuff_) {
-    delete[] readBuff_;
+    if (!memoryMapped_) {
+      delete[] readBuff_;
+    }
     readBuff_ = nullptr;
   }
 
@@ -183,8 +193,6 @@ bool TFileTransport::initBufferAndWriteThread() {
     writerThread_->start();
   }
 
-  dequeueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
-  enqueueBuffer_ = new TFileTransportBuffer(eventBufferSize_);
   bufferAndThreadInitialized_ = true;
 
   return true;
@@ -198,12 +206,6 @@ void TFileTransport::write(const uint8_t* buf, uint32_t len) {
   enqueueEvent(buf, len);
 }
 
-template <class _T>
-struct uniqueDeleter
-{
-  void operator()(_T *ptr) const { delete ptr; }
-};
-
 void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
   // can't enqueue more events if file is going to close
   if (closing_) {
@@ -221,15 +223,6 @@ void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
     return;
   }
 
-  std::unique_ptr<eventInfo, uniqueDeleter<eventInfo> > toEnqueue(new eventInfo());
-  toEnqueue->eventBuff_ = new uint8_t[(sizeof(uint8_t) * eventLen) + 4];
-
-  // first 4 bytes is the event length
-  memcpy(toEnqueue->eventBuff_, (void*)(&eventLen), 4);
-  // actual event contents
-  memcpy(toEnqueue->eventBuff_ + 4, buf, eventLen);
-  toEnqueue->eventSize_ = eventLen + 4;
-
   // lock mutex
   Guard g(mutex_);
 
@@ -241,41 +234,27 @@ void TFileTransport::enqueueEvent(const uint8_t* buf, uint32_t eventLen) {
   }
 
   // Can't enqueue while buffer is full
-  while (enqueueBuffer_->isFull()) {
+  while (enqueuedEvents_ >= eventBufferSize_) {
     notFull_.wait();
   }
 
-  // We shouldn't be trying to enqueue new data while a forced flush is
-  // requested.  (Otherwise the writer thread might not ever be able to finish
-  // the flush if more data keeps being enqueued.)
-  assert(!forceFlush_);
-
-  // add to the buffer
-  eventInfo* pEvent = toEnqueue.release();
-  if (!enqueueBuffer_->addEvent(pEvent)) {
-    delete pEvent;
-    return;
-  }
+  // add to the buffer: first 4 bytes is the event length, then the actual event contents
+  const auto* size = reinterpret_cast<const uint8_t*>(&eventLen);
+  enqueueBuffer_.insert(enqueueBuffer_.end(), size, size + 4);
+  enqueueBuffer_.insert(enqueueBuffer_.end(), buf, buf + eventLen);
+  ++enqueuedEvents_;
 
   // signal anybody who's waiting for the buffer to be non-empty
   notEmpty_.notify();
-
-  // this really should be a loop where it makes sure it got flushed
-  // because condition variables can get triggered by the os for no reason
-  // it is probably a non-factor for the time being
 }
 
-bool TFileTransport::swapEventBuffers(const std::chrono::time_point<std::chrono::steady_clock> *deadline) {
-  bool swap;
+bool TFileTransport::swapEventBuffers(const std::chrono::time_point<std::chrono::steady_clock> *deadline,
+                                      uint64_t& flushTicket) {
   Guard g(mutex_);
 
-  if (!enqueueBuffer_->isEmpty()) {
-    swap = true;
-  } else if (closing_) {
-    // even though there is no data to write,
-    // return immediately if the transport is closing
-    swap = false;
-  } else {
+  // even though there is no data to write,
+  // return immediately if the transport is closing or a flush is waiting
+  if (enqueueBuffer_.empty() && !closing_ && flushRequested_ == flushCompleted_) {
     if (deadline != nullptr) {
       // if we were handed a deadline time struct, do a timed wait
       notEmpty_.waitForTime(*deadline);
@@ -283,22 +262,21 @@ bool TFileTransport::swapEventBuffers(const std::chrono::time_point<std::chrono:
       // just wait until the buffer gets an item
       notEmpty_.wait();
     }
-
-    // could be empty if we timed out
-    swap = enqueueBuffer_->isEmpty();
   }
 
-  if (swap) {
-    TFileTransportBuffer* temp = enqueueBuffer_;
-    enqueueBuffer_ = dequeueBuffer_;
-    dequeueBuffer_ = temp;
-  }
+  // Every flush requested so far only waits for events that are already
+  // enqueued, so writing out this buffer is enough to satisfy all of them.
+  flushTicket = flushRequested_ != flushCompleted_ ? flushRequested_ : 0;
 
-  if (swap) {
-    notFull_.notify();
+  // could be empty if we timed out
+  if (enqueueBuffer_.empty()) {
+    return false;
   }
 
-  return swap;
+  enqueueBuffer_.swap(dequeueBuffer_);
+  enqueuedEvents_ = 0;
+  notFull_.notifyAll();
+  return true;
 }
 
 void TFileTransport::writerThread() {
@@ -336,6 +314,10 @@ void TFileTransport::writerThread() {
     }
   }
 
+  if (!hasIOError && directIO_) {
+    openDirectIO();
+  }
+
   // Figure out the next time by which a flush must take place
   auto ts_next_flush = getNextFlushTime();
   uint32_t unflushed = 0;
@@ -348,7 +330,13 @@ void TFileTransport::writerThread() {
       }
 
       // Try to empty buffers before exit
-      if (enqueueBuffer_->isEmpty() && dequeueBuffer_->isEmpty()) {
+      bool empty;
+      {
+        Guard g(mutex_);
+        empty = enqueueBuffer_.empty();
+      }
+      if (empty) {
+        closeDirectIO();
         ::THRIFT_FSYNC(fd_);
         if (-1 == ::THRIFT_CLOSE(fd_)) {
           int errno_copy = THRIFT_ERRNO;
@@ -361,133 +349,57 @@ void TFileTransport::writerThread() {
       }
     }
 
-    if (swapEventBuffers(&ts_next_flush)) {
-      eventInfo* outEvent;
-      while (nullptr != (outEvent = dequeueBuffer_->getNext())) {
-        // Remove an event from the buffer and write it out to disk. If there is any IO error, for
-        // instance,
-        // the output file is unmounted or deleted, then this event is dropped. However, the writer
-        // thread
-        // will: (1) sleep for a short while; (2) try to reopen the file; (3) if successful then
-        // start writing
-        // from the end.
-
-        while (hasIOError) {
-          T_ERROR(
-              "TFileTransport: writer thread going to sleep for %u microseconds due to IO errors",
-              writerThreadIOErrorSleepTime_);
-          THRIFT_SLEEP_USEC(writerThreadIOErrorSleepTime_);
-          if (closing_) {
-            return;
-          }
-          if (!fd_) {
-            ::THRIFT_CLOSE(fd_);
-            fd_ = 0;
-          }
-          try {
-            openLogFile();
-            seekToEnd();
-            unflushed = 0;
-            hasIOError = false;
-            T_LOG_OPER(
-                "TFileTransport: log file %s reopened by writer thread during error recovery",
-                filename_.c_str());
-          } catch (...) {
-            T_ERROR("TFileTransport: unable to reopen log file %s during error recovery",
-                    filename_.c_str());
-          }
+    uint64_t flushTicket;
+    if (swapEventBuffers(&ts_next_flush, flushTicket)) {
+      // Write the whole buffer out to disk. If there is any IO error, for instance,
+      // the output file is unmounted or deleted, then these events are dropped. However,
+      // the writer thread will: (1) sleep for a short while; (2) try to reopen the file;
+      // (3) if successful then start writing from the end.
+      while (hasIOError) {
+        T_ERROR(
+            "TFileTransport: writer thread going to sleep for %u microseconds due to IO errors",
+            writerThreadIOErrorSleepTime_);
+        THRIFT_SLEEP_USEC(writerThreadIOErrorSleepTime_);
+        if (closing_) {
+          return;
         }
-
-        // sanity check on event
-        if ((maxEventSize_ > 0) && (outEvent->eventSize_ > maxEventSize_)) {
-          T_ERROR("msg size is greater than max event size: %u > %u\n",
-                  outEvent->eventSize_,
-                  maxEventSize_);
-          continue;
+        if (!fd_) {
+          ::THRIFT_CLOSE(fd_);
+          fd_ = 0;
         }
-
-        // If chunking is required, then make sure that msg does not cross chunk boundary
-        if ((outEvent->eventSize_ > 0) && (chunkSize_ != 0)) {
-          // event size must be less than chunk size
-          if (outEvent->eventSize_ > chunkSize_) {
-            T_ERROR("TFileTransport: event size(%u) > chunk size(%u): skipping event",
-                    outEvent->eventSize_,
-                    chunkSize_);
-            continue;
-          }
-
-          int64_t chunk1 = offset_ / chunkSize_;
-          int64_t chunk2 = (offset_ + outEvent->eventSize_ - 1) / chunkSize_;
-
-          // if adding this event will cross a chunk boundary, pad the chunk with zeros
-          if (chunk1 != chunk2) {
-            // refetch the offset to keep in sync
-            offset_ = THRIFT_LSEEK(fd_, 0, SEEK_CUR);
-            auto padding = (int32_t)((offset_ / chunkSize_ + 1) * chunkSize_ - offset_);
-
-            auto* zeros = new uint8_t[padding];
-            memset(zeros, '\0', padding);
-            boost::scoped_array<uint8_t> array(zeros);
-            if (-1 == ::THRIFT_WRITE(fd_, zeros, padding)) {
-              int errno_copy = THRIFT_ERRNO;
-              GlobalOutput.perror("TFileTransport: writerThread() error while padding zeros ",
-                                  errno_copy);
-              hasIOError = true;
-              continue;
-            }
-            unflushed += padding;
-            offset_ += padding;
+        closeDirectIO();
+        try {
+          openLogFile();
+          seekToEnd();
+          if (directIO_) {
+            openDirectIO();
           }
+          unflushed = 0;
+          hasIOError = false;
+          T_LOG_OPER(
+              "TFileTransport: log file %s reopened by writer thread during error recovery",
+              filename_.c_str());
+        } catch (...) {
+          T_ERROR("TFileTransport: unable to reopen log file %s during error recovery",
+                  filename_.c_str());
         }
+      }
 
-        // write the dequeued event to the file
-        if (outEvent->eventSize_ > 0) {
-          if (-1 == ::THRIFT_WRITE(fd_, outEvent->eventBuff_, outEvent->eventSize_)) {
-            int errno_copy = THRIFT_ERRNO;
-            GlobalOutput.perror("TFileTransport: error while writing event ", errno_copy);
-            hasIOError = true;
-            continue;
-          }
-          unflushed += outEvent->eventSize_;
-          offset_ += outEvent->eventSize_;
-        }
+      off_t start = offset_;
+      if (!writeEvents()) {
+        hasIOError = true;
       }
-      dequeueBuffer_->reset();
+      unflushed += static_cast<uint32_t>(offset_ - start);
+      dequeueBuffer_.clear();
     }
 
     if (hasIOError) {
       continue;
     }
 
-    // Local variable to cache the state of forceFlush_.
-    //
-    // We only want to check the value of forceFlush_ once each time around the
-    // loop.  If we check it more than once without holding the lock the entire
-    // time, it could have changed state in between.  This will result in us
-    // making inconsistent decisions.
-    bool forced_flush = false;
-    {
-      Guard g(mutex_);
-      if (forceFlush_) {
-        if (!enqueueBuffer_->isEmpty()) {
-          // If forceFlush_ is true, we need to flush all available data.
-          // If enqueueBuffer_ is not empty, go back to the start of the loop to
-          // write it out.
-          //
-          // We know the main thread is waiting on forceFlush_ to be cleared,
-          // so no new events will be added to enqueueBuffer_ until we clear
-          // forceFlush_.  Therefore the next time around the loop enqueueBuffer_
-          // is guaranteed to be empty.  (I.e., we're guaranteed to make progress
-          // and clear forceFlush_ the next time around the loop.)
-          continue;
-        }
-        forced_flush = true;
-      }
-    }
-
     // determine if we need to perform an fsync
     bool flush = false;
-    if (forced_flush || unflushed > flushMaxBytes_) {
+    if (flushTicket || unflushed > flushMaxBytes_) {
       flush = true;
     } else {
       if (std::chrono::steady_clock::now() > ts_next_flush) {
@@ -508,36 +420,245 @@ void TFileTransport::writerThread() {
       ts_next_flush = getNextFlushTime();
 
       // notify anybody waiting for flush completion
-      if (forced_flush) {
+      if (flushTicket) {
         Guard g(mutex_);
-        forceFlush_ = false;
-        assert(enqueueBuffer_->isEmpty());
-        assert(dequeueBuffer_->isEmpty());
+        flushCompleted_ = flushTicket;
         flushed_.notifyAll();
       }
     }
   }
 }
 
+bool TFileTransport::writeEvents() {
+  const uint8_t* events = dequeueBuffer_.data();
+  size_t size = dequeueBuffer_.size();
+
+  // Consecutive events are written in a single run, which is only broken up
+  // to skip a bad event or to pad a chunk
+  size_t runStart = 0;
+  size_t pos = 0;
+  while (pos < size) {
+    uint32_t eventSize;
+    memcpy(&eventSize, events + pos, 4);
+    eventSize += 4;
+
+    bool skip = false;
+    uint32_t padding = 0;
+    if ((maxEventSize_ > 0) && (eventSize > maxEventSize_)) {
+      // sanity check on event
+      T_ERROR("msg size is greater than max event size: %u > %u\n", eventSize, maxEventSize_);
+      skip = true;
+    } else if (chunkSize_ != 0) {
+      // If chunking is required, then make sure that msg does not cross chunk boundary
+      if (eventSize > chunkSize_) {
+        // event size must be less than chunk size
+        T_ERROR("TFileTransport: event size(%u) > chunk size(%u): skipping event",
+                eventSize,
+                chunkSize_);
+        skip = true;
+      } else {
+        off_t eventOffset = offset_ + static_cast<off_t>(pos - runStart);
+        int64_t chunk1 = eventOffset / chunkSize_;
+        int64_t chunk2 = (eventOffset + eventSize - 1) / chunkSize_;
+
+        // if adding this event will cross a chunk boundary, pad the chunk with zeros
+        if (chunk1 != chunk2) {
+          padding = static_cast<uint32_t>((chunk1 + 1) * chunkSize_ - eventOffset);
+        }
+      }
+    }
+
+    if (skip || padding) {
+      if (!writeOut(events + runStart, static_cast<uint32_t>(pos - runStart))
+          || !writePadding(padding)) {
+        return false;
+      }
+      runStart = skip ? pos + eventSize : pos;
+    }
+    pos += eventSize;
+  }
+
+  if (!writeOut(events + runStart, static_cast<uint32_t>(size - runStart))) {
+    return false;
+  }
+  return directFd_ < 0 || finishDirectBatch();
+}
+
+bool TFileTransport::writeOut(const uint8_t* buf, uint32_t len) {
+  if (directFd_ >= 0) {
+    // stage into the aligned buffer, writing out whole blocks as it fills up
+    while (len > 0) {
+      uint32_t n = (std::min)(len, DIRECT_IO_BUFF_SIZE - directBuffLen_);
+      memcpy(directBuff_ + directBuffLen_, buf, n);
+      directBuffLen_ += n;
+      offset_ += n;
+      buf += n;
+      len -= n;
+      if (directBuffLen_ == DIRECT_IO_BUFF_SIZE && !writeDirectBlocks()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  while (len > 0) {
+    auto written = ::THRIFT_WRITE(fd_, buf, len);
+    if (written == -1) {
+      int errno_copy = THRIFT_ERRNO;
+      if (errno_copy == THRIFT_EINTR) {
+        continue;
+      }
+      GlobalOutput.perror("TFileTransport: error while writing events ", errno_copy);
+      return false;
+    }
+    offset_ += written;
+    buf += written;
+    len -= static_cast<uint32_t>(written);
+  }
+  return true;
+}
+
+bool TFileTransport::writePadding(uint32_t len) {
+  static const uint8_t zeros[4096] = {0};
+  while (len > 0) {
+    uint32_t n = (std::min)(len, static_cast<uint32_t>(sizeof(zeros)));
+    if (!writeOut(zeros, n)) {
+      return false;
+    }
+    len -= n;
+  }
+  return true;
+}
+
+void TFileTransport::openDirectIO() {
+#ifdef O_DIRECT
+  if (!directBuff_) {
+    void* buff;
+    if (posix_memalign(&buff, DIRECT_IO_ALIGNMENT, DIRECT_IO_BUFF_SIZE) != 0) {
+      GlobalOutput("TFileTransport: cannot allocate direct IO buffer, using buffered writes");
+      return;
+    }
+    directBuff_ = static_cast<uint8_t*>(buff);
+  }
+
+  int fd = ::THRIFT_OPEN(filename_.c_str(), O_WRONLY | O_DIRECT);
+  if (fd == -1) {
+    GlobalOutput.perror("TFileTransport: direct IO unavailable, using buffered writes: ",
+                        THRIFT_ERRNO);
+    return;
+  }
+
+  // start with the partial block at the end of the file
+  directBuffOffset_ = offset_ - offset_ % DIRECT_IO_ALIGNMENT;
+  directBuffLen_ = static_cast<uint32_t>(offset_ - directBuffOffset_);
+  if (directBuffLen_ > 0
+      && ::pread(fd_, directBuff_, directBuffLen_, directBuffOffset_)
+             != static_cast<ssize_t>(directBuffLen_)) {
+    GlobalOutput.perror("TFileTransport: direct IO unavailable, using buffered writes: ",
+                        THRIFT_ERRNO);
+    ::THRIFT_CLOSE(fd);
+    return;
+  }
+  directBuffSynced_ = directBuffLen_;
+  directFd_ = fd;
+#else
+  GlobalOutput("TFileTransport: direct IO not supported, using buffered writes");
+  directIO_ = false;
+#endif
+}
+
+void TFileTransport::closeDirectIO() {
+  if (directFd_ >= 0) {
+    ::THRIFT_CLOSE(directFd_);
+    directFd_ = -1;
+  }
+}
+
+bool TFileTransport::writeDirectBlocks() {
+#ifdef O_DIRECT
+  uint32_t blocks = directBuffLen_ - directBuffLen_ % DIRECT_IO_ALIGNMENT;
+  uint32_t done = 0;
+  while (done < blocks) {
+    auto written = ::pwrite(directFd_, directBuff_ + done, blocks - done, directBuffOffset_ + done);
+    if (written == -1) {
+      int errno_copy = THRIFT_ERRNO;
+      if (errno_copy == THRIFT_EINTR) {
+        continue;
+      }
+      GlobalOutput.perror("TFileTransport: error while writing events ", errno_copy);
+      return false;
+    }
+    done += static_cast<uint32_t>(written);
+  }
+
+  // keep the partial block at the front of the buffer
+  memmove(directBuff_, directBuff_ + blocks, directBuffLen_ - blocks);
+  directBuffOffset_ += blocks;
+  directBuffLen_ -= blocks;
+  directBuffSynced_ = directBuffSynced_ > blocks ? directBuffSynced_ - blocks : 0;
+#endif
+  return true;
+}
+
+bool TFileTransport::finishDirectBatch() {
+  if (!writeDirectBlocks()) {
+    return false;
+  }
+
+  // The partial block goes through the page cache so that the file holds every
+  // event; it is written again with O_DIRECT once the block is complete.
+  uint32_t pos = directBuffSynced_;
+  while (pos < directBuffLen_) {
+    auto written = ::THRIFT_WRITE(fd_, directBuff_ + pos, directBuffLen_ - pos);
+    if (written == -1) {
+      int errno_copy = THRIFT_ERRNO;
+      if (errno_copy == THRIFT_EINTR) {
+        continue;
+      }
+      GlobalOutput.perror("TFileTransport: error while writing events ", errno_copy);
+      return false;
+    }
+    pos += static_cast<uint32_t>(written);
+  }
+  directBuffSynced_ = directBuffLen_;
+  return true;
+}
+
 void TFileTransport::flush() {
-  resetConsumedMessageSize();
   // file must be open for writing for any flushing to take place
   if (!writerThread_.get()) {
+    resetConsumedMessageSize();
     return;
   }
   // wait for flush to take place
   Guard g(mutex_);
+  resetConsumedMessageSize();
 
-  // Indicate that we are requesting a flush
-  forceFlush_ = true;
-  // Wake up the writer thread so it will perform the flush immediately
+  // Take a ticket and wake up the writer thread so it will perform the flush
+  // immediately.  Other threads may keep writing meanwhile; their events are
+  // not waited for.
+  uint64_t ticket = ++flushRequested_;
   notEmpty_.notify();
 
-  while (forceFlush_) {
+  while (flushCompleted_ < ticket) {
     flushed_.wait();
   }
 }
 
+void TFileTransport::setMemoryMapped(bool memoryMapped) {
+#ifdef _WIN32
+  if (memoryMapped) {
+    GlobalOutput("TFileTransport: memory mapped reading not supported");
+  }
+#else
+  if (readBuff_) {
+    GlobalOutput("Cannot change memory mapping after reading started");
+    return;
+  }
+  memoryMapped_ = memoryMapped;
+#endif
+}
+
 uint32_t TFileTransport::readAll(uint8_t* buf, uint32_t len) {
   checkReadBytesAvailable(len);
   uint32_t have = 0;
@@ -601,11 +722,51 @@ uint32_t TFileTransport::read(uint8_t* buf, uint32_t len) {
   return len;
 }
 
+const uint8_t* TFileTransport::borrow_virt(uint8_t* buf, uint32_t* len) {
+  (void)buf;
+  if (!currentEvent_) {
+    currentEvent_ = readEvent();
+  }
+  if (!currentEvent_) {
+    return nullptr;
+  }
+
+  uint32_t remaining = currentEvent_->eventSize_ - currentEvent_->eventBuffPos_;
+  if (remaining < *len) {
+    return nullptr;
+  }
+  *len = remaining;
+  return currentEvent_->eventBuff_ + currentEvent_->eventBuffPos_;
+}
+
+void TFileTransport::consume_virt(uint32_t len) {
+  if (!currentEvent_ || len > currentEvent_->eventSize_ - currentEvent_->eventBuffPos_) {
+    throw TTransportException(TTransportException::BAD_ARGS, "consume did not follow a borrow.");
+  }
+  currentEvent_->eventBuffPos_ += len;
+  if (currentEvent_->eventBuffPos_ == currentEvent_->eventSize_) {
+    delete currentEvent_;
+    currentEvent_ = nullptr;
+  }
+}
+
+std::shared_ptr<const void> TFileTransport::pinReadBuffer() {
+  if (!currentEvent_) {
+    return nullptr;
+  }
+  if (!currentEvent_->owner_) {
+    // hand the event's own copy over to the pin
+    currentEvent_->owner_.reset(currentEvent_->eventBuff_,
+                                [](const void* buff) { delete[] static_cast<const uint8_t*>(buff); });
+  }
+  return currentEvent_->owner_;
+}
+
 // note caller is responsible for freeing returned events
 eventInfo* TFileTransport::readEvent() {
   int readTries = 0;
 
-  if (!readBuff_) {
+  if (!readBuff_ && !memoryMapped_) {
     readBuff_ = new uint8_t[readBuffSize_];
   }
 
@@ -614,7 +775,11 @@ eventInfo* TFileTransport::readEvent() {
     if (readState_.bufferPtr_ == readState_.bufferLen_) {
       // advance the offset pointer
       offset_ += readState_.bufferLen_;
-      readState_.bufferLen_ = static_cast<uint32_t>(::THRIFT_READ(fd_, readBuff_, readBuffSize_));
+      if (memoryMapped_) {
+        readState_.bufferLen_ = mapWindow();
+      } else {
+        readState_.bufferLen_ = static_cast<uint32_t>(::THRIFT_READ(fd_, readBuff_, readBuffSize_));
+      }
       //       if (readState_.bufferLen_) {
       //         T_DEBUG_L(1, "Amount read: %u (offset: %lu)", readState_.bufferLen_, offset_);
       //       }
@@ -691,17 +856,28 @@ eventInfo* TFileTransport::readEvent() {
         }
       } else {
         if (!readState_.event_->eventBuff_) {
-          readState_.event_->eventBuff_ = new uint8_t[readState_.event_->eventSize_];
-          readState_.event_->eventBuffPos_ = 0;
+          if (mapping_ && (uint32_t)(readState_.bufferLen_ - readState_.bufferPtr_)
+                              >= readState_.event_->eventSize_) {
+            // the whole event is mapped, so hand out the mapping itself
+            readState_.event_->eventBuff_ = readBuff_ + readState_.bufferPtr_;
+            readState_.event_->owner_ = mapping_;
+            readState_.event_->eventBuffPos_ = readState_.event_->eventSize_;
+            readState_.bufferPtr_ += readState_.event_->eventSize_;
+          } else {
+            readState_.event_->eventBuff_ = new uint8_t[readState_.event_->eventSize_];
+            readState_.event_->eventBuffPos_ = 0;
+          }
         }
         // take either the entire event or the remaining bytes in the buffer
         int reclaimBuffer = (std::min)((uint32_t)(readState_.bufferLen_ - readState_.bufferPtr_),
                                        readState_.event_->eventSize_ - readState_.event_->eventBuffPos_);
 
         // copy data from read buffer into event buffer
-        memcpy(readState_.event_->eventBuff_ + readState_.event_->eventBuffPos_,
-               readBuff_ + readState_.bufferPtr_,
-               reclaimBuffer);
+        if (reclaimBuffer > 0) {
+          memcpy(readState_.event_->eventBuff_ + readState_.event_->eventBuffPos_,
+                 readBuff_ + readState_.bufferPtr_,
+                 reclaimBuffer);
+        }
 
         // increment position ptrs
         readState_.event_->eventBuffPos_ += reclaimBuffer;
@@ -724,6 +900,49 @@ eventInfo* TFileTransport::readEvent() {
   }
 }
 
+int32_t TFileTransport::mapWindow() {
+#ifndef _WIN32
+  // map the file again once we have read all of it, in case it grew
+  if (offset_ >= mappingLen_) {
+    struct THRIFT_STAT f_info;
+    if (::THRIFT_FSTAT(fd_, &f_info) < 0) {
+      return -1;
+    }
+    if (f_info.st_size > mappingLen_) {
+      auto len = static_cast<size_t>(f_info.st_size);
+      void* mapping = ::mmap(nullptr, len, PROT_READ, MAP_SHARED, fd_, 0);
+      if (mapping == MAP_FAILED) {
+        GlobalOutput.perror("TFileTransport: mapWindow() mmap ", THRIFT_ERRNO);
+        return -1;
+      }
+      ::madvise(mapping, len, MADV_SEQUENTIAL);
+      // events handed out from the old mapping keep it alive until released
+      mapping_.reset(mapping, [len](const void* p) { ::munmap(const_cast<void*>(p), len); });
+      mappingLen_ = f_info.st_size;
+    }
+    if (offset_ >= mappingLen_) {
+      return 0;
+    }
+  }
+
+  // events never cross a chunk boundary, so a window up to the end of the
+  // chunk always holds whole events
+  off_t end = (offset_ / chunkSize_ + 1) * chunkSize_;
+  end = (std::min)(end, mappingLen_);
+  end = (std::min)(end, offset_ + static_cast<off_t>(MAX_MAP_WINDOW));
+
+  auto* base = static_cast<uint8_t*>(const_cast<void*>(mapping_.get()));
+  readBuff_ = base + offset_;
+
+  // have the kernel read the window in ahead of us
+  off_t start = offset_ - offset_ % ::sysconf(_SC_PAGESIZE);
+  ::madvise(base + start, static_cast<size_t>(end - start), MADV_WILLNEED);
+  return static_cast<int32_t>(end - offset_);
+#else
+  return -1;
+#endif
+}
+
 bool TFileTransport::isEventCorrupted() {
   // an error is triggered if:
   if ((maxEventSize_ > 0) && (readState_.event_->eventSize_ > maxEventSize_)) {
@@ -972,6 +1191,62 @@ bool TFileTransportBuffer::isEmpty() {
   return writePoint_ == 0;
 }
 
+namespace {
+
+/**
+ * Events of one chunk, or of one key's share of a chunk, on their way to a
+ * replay thread.  The pins keep the events' memory alive.
+ */
+struct ReplayBatch {
+  std::vector<std::pair<const uint8_t*, uint32_t> > events;
+  std::vector<std::shared_ptr<const void> > pins;
+};
+
+/**
+ * A bounded queue of batches for the replay threads.
+ */
+class ReplayQueue {
+public:
+  explicit ReplayQueue(size_t capacity) : capacity_(capacity), done_(false) {}
+
+  void push(std::unique_ptr<ReplayBatch> batch) {
+    Synchronized s(monitor_);
+    while (batches_.size() >= capacity_) {
+      monitor_.wait();
+    }
+    batches_.push_back(std::move(batch));
+    monitor_.notifyAll();
+  }
+
+  // returns nullptr once finished and drained
+  std::unique_ptr<ReplayBatch> pop() {
+    Synchronized s(monitor_);
+    while (batches_.empty() && !done_) {
+      monitor_.wait();
+    }
+    if (batches_.empty()) {
+      return nullptr;
+    }
+    std::unique_ptr<ReplayBatch> batch = std::move(batches_.front());
+    batches_.pop_front();
+    monitor_.notifyAll();
+    return batch;
+  }
+
+  void finish() {
+    Synchronized s(monitor_);
+    done_ = true;
+    monitor_.notifyAll();
+  }
+
+private:
+  Monitor monitor_;
+  std::deque<std::unique_ptr<ReplayBatch> > batches_;
+  size_t capacity_;
+  bool done_;
+};
+}
+
 TFileProcessor::TFileProcessor(shared_ptr<TProcessor> processor,
                                shared_ptr<TProtocolFactory> protocolFactory,
                                shared_ptr<TFileReaderTransport> inputTransport)
@@ -1045,6 +1320,110 @@ void TFileProcessor::process(uint32_t numEvents, bool tail) {
   }
 }
 
+void TFileProcessor::processParallel(uint32_t numThreads, const KeyFunction& key) {
+  if (numThreads == 0) {
+    numThreads = 1;
+  }
+
+  // one queue per thread when keeping order, otherwise one for all
+  size_t numQueues = key ? numThreads : 1;
+  std::vector<std::unique_ptr<ReplayQueue> > queues;
+  for (size_t i = 0; i < numQueues; ++i) {
+    queues.emplace_back(new ReplayQueue(2 * numThreads / numQueues));
+  }
+  std::atomic<bool> failed(false);
+
+  ThreadFactory threadFactory(false);
+  std::vector<shared_ptr<Thread> > threads;
+  for (uint32_t i = 0; i < numThreads; ++i) {
+    ReplayQueue* queue = queues[i % numQueues].get();
+    threads.push_back(threadFactory.newThread(FunctionRunner::create([this, queue, &failed] {
+      shared_ptr<TMemoryBuffer> input(new TMemoryBuffer());
+      shared_ptr<TProtocol> inputProtocol = inputProtocolFactory_->getProtocol(input);
+      shared_ptr<TProtocol> outputProtocol = outputProtocolFactory_->getProtocol(outputTransport_);
+      while (std::unique_ptr<ReplayBatch> batch = queue->pop()) {
+        for (const auto& event : batch->events) {
+          if (failed) {
+            break;
+          }
+          input->resetBuffer(const_cast<uint8_t*>(event.first), event.second);
+          try {
+            processor_->process(inputProtocol, outputProtocol, nullptr);
+          } catch (TException& te) {
+            cerr << te.what() << endl;
+            failed = true;
+          }
+        }
+      }
+    })));
+    threads.back()->start();
+  }
+
+  // replay what is in the file now rather than tailing it
+  int32_t oldReadTimeout = inputTransport_->getReadTimeout();
+  inputTransport_->setReadTimeout(TFileTransport::NO_TAIL_READ_TIMEOUT);
+
+  std::vector<std::unique_ptr<ReplayBatch> > batches(numQueues);
+  auto dispatch = [&]() {
+    for (size_t i = 0; i < numQueues; ++i) {
+      if (batches[i]) {
+        queues[i]->push(std::move(batches[i]));
+      }
+    }
+  };
+
+  try {
+    uint32_t curChunk = inputTransport_->getCurChunk();
+    while (!failed) {
+      // borrow the whole event, and pin it so it outlives the read
+      uint32_t len = 1;
+      const uint8_t* event = inputTransport_->borrow(nullptr, &len);
+      if (!event) {
+        if (inputTransport_->peek()) {
+          throw TTransportException("TFileProcessor: input transport cannot lend events");
+        }
+        break;
+      }
+      shared_ptr<const void> pin = inputTransport_->pinReadBuffer();
+      if (!pin) {
+        auto* copy = new uint8_t[len];
+        memcpy(copy, event, len);
+        pin.reset(copy, [](const void* buff) { delete[] static_cast<const uint8_t*>(buff); });
+        event = copy;
+      }
+
+      // hand out a chunk at a time
+      uint32_t chunk = inputTransport_->getCurChunk();
+      if (chunk != curChunk) {
+        dispatch();
+        curChunk = chunk;
+      }
+
+      std::unique_ptr<ReplayBatch>& batch = batches[key ? key(event, len) % numQueues : 0];
+      if (!batch) {
+        batch.reset(new ReplayBatch());
+      }
+      batch->events.emplace_back(event, len);
+      if (batch->pins.empty() || batch->pins.back() != pin) {
+        batch->pins.push_back(std::move(pin));
+      }
+      inputTransport_->consume(len);
+    }
+    dispatch();
+  } catch (TException& te) {
+    cerr << te.what() << endl;
+    failed = true;
+  }
+
+  for (auto& queue : queues) {
+    queue->finish();
+  }
+  for (auto& thread : threads) {
+    thread->join();
+  }
+  inputTransport_->setReadTimeout(oldReadTimeout);
+}
+
 void TFileProcessor::processChunk() {
   shared_ptr<TProtocol> inputProtocol = inputProtocolFactory_->getProtocol(inputTransport_);
   shared_ptr<TProtocol> outputProtocol = outputProtocolFactory_->getProtocol(outputTransport_);
@@ -25,7 +25,10 @@
 #include <thrift/TProcessor.h>
 
 #include <atomic>
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
 #include <stdio.h>
 
 #include <thrift/concurrency/Mutex.h>
@@ -48,9 +51,13 @@ typedef struct eventInfo {
   uint32_t eventSize_;
   uint32_t eventBuffPos_;
 
+  // Holds eventBuff_ when it is shared, e.g. when it points into a memory
+  // mapped file; eventBuff_ is then not ours to free
+  std::shared_ptr<const void> owner_;
+
   eventInfo() : eventBuff_(nullptr), eventSize_(0), eventBuffPos_(0){};
   ~eventInfo() {
-    if (eventBuff_) {
+    if (eventBuff_ && !owner_) {
       delete[] eventBuff_;
     }
   }
@@ -107,8 +114,9 @@ typedef struct readState {
 } readState;
 
 /**
- * TFileTransportBuffer - buffer class used by TFileTransport for queueing up events
- * to be written to disk.  Should be used in the following way:
+ * TFileTransportBuffer - buffer class for queueing up events to be written to disk.
+ * TFileTransport itself now queues events in contiguous byte buffers, so that a batch
+ * is written in one go.  Should be used in the following way:
  *  1) Buffer created
  *  2) Buffer written to (addEvent)
  *  3) Buffer read from (getNext)
@@ -116,8 +124,7 @@ typedef struct readState {
  *  5) Go back to 2, or destroy buffer
  *
  * The buffer should never be written to after it is read from, unless it is reset first.
- * Note: The above rules are enforced mainly for debugging its sole client TFileTransport
- *       which uses the buffer in this way.
+ * Note: The above rules are enforced mainly for debugging.
  *
  */
 class TFileTransportBuffer {
@@ -255,6 +262,31 @@ public:
   }
   uint32_t getEofSleepTimeUs() { return eofSleepTime_; }
 
+  /**
+   * Read the file through a memory mapping rather than read() calls.  Events
+   * are then handed out without copying: borrow() points straight into the
+   * mapping, and pinReadBuffer() keeps it mapped.  Must be set before the
+   * first read.
+   */
+  void setMemoryMapped(bool memoryMapped);
+  bool getMemoryMapped() { return memoryMapped_; }
+
+  /**
+   * Write whole file blocks with O_DIRECT, bypassing the page cache, so a
+   * busy log does not evict everything else from it.  The last partial block
+   * of each batch still goes through the page cache, so readers always see
+   * every event written.  Falls back to ordinary writes where the platform or
+   * filesystem does not support it.  Must be set before the first write.
+   */
+  void setDirectIO(bool directIO) {
+    if (bufferAndThreadInitialized_) {
+      GlobalOutput("Cannot change direct IO after writer thread started");
+      return;
+    }
+    directIO_ = directIO;
+  }
+  bool getDirectIO() { return directIO_; }
+
   /*
    * Override TTransport *_virt() functions to invoke our implementations.
    * We cannot use TVirtualTransport to provide these, since we need to inherit
@@ -264,12 +296,30 @@ public:
   uint32_t readAll_virt(uint8_t* buf, uint32_t len) override { return this->readAll(buf, len); }
   void write_virt(const uint8_t* buf, uint32_t len) override { this->write(buf, len); }
 
+  /*
+   * Borrowing hands out the rest of the current event, which is always
+   * contiguous.
+   */
+  const uint8_t* borrow_virt(uint8_t* buf, uint32_t* len) override;
+  void consume_virt(uint32_t len) override;
+  std::shared_ptr<const void> pinReadBuffer() override;
+
 private:
   // helper functions for writing to a file
   void enqueueEvent(const uint8_t* buf, uint32_t eventLen);
-  bool swapEventBuffers(const std::chrono::time_point<std::chrono::steady_clock> *deadline);
+  bool swapEventBuffers(const std::chrono::time_point<std::chrono::steady_clock> *deadline,
+                        uint64_t& flushTicket);
   bool initBufferAndWriteThread();
 
+  // helper functions for the writer thread
+  bool writeEvents();
+  bool writeOut(const uint8_t* buf, uint32_t len);
+  bool writePadding(uint32_t len);
+  void openDirectIO();
+  void closeDirectIO();
+  bool writeDirectBlocks();
+  bool finishDirectBatch();
+
   // control for writer thread
   static void* startWriterThread(void* ptr) {
     static_cast<TFileTransport*>(ptr)->writerThread();
@@ -279,6 +329,7 @@ private:
 
   // helper functions for reading from a file
   eventInfo* readEvent();
+  int32_t mapWindow();
 
   // event corruption-related functions
   bool isEventCorrupted();
@@ -296,6 +347,13 @@ private:
   uint32_t readBuffSize_;
   static const uint32_t DEFAULT_READ_BUFF_SIZE = 1 * 1024 * 1024;
 
+  // memory mapped reading: readBuff_ then points into mapping_, a window at
+  // most one chunk long so that getCurChunk() stays exact
+  bool memoryMapped_;
+  std::shared_ptr<const void> mapping_;
+  off_t mappingLen_;
+  static const uint32_t MAX_MAP_WINDOW = 1024 * 1024 * 1024;
+
   int32_t readTimeout_;
   static const int32_t DEFAULT_READ_TIMEOUT_MS = 200;
 
@@ -339,18 +397,27 @@ private:
   apache::thrift::concurrency::ThreadFactory threadFactory_;
   std::shared_ptr<apache::thrift::concurrency::Thread> writerThread_;
 
-  // buffers to hold data before it is flushed. Each element of the buffer stores a msg that
-  // needs to be written to the file.  The buffers are swapped by the writer thread.
-  TFileTransportBuffer* dequeueBuffer_;
-  TFileTransportBuffer* enqueueBuffer_;
+  // buffers to hold data before it is flushed.  Each event is stored as it will appear in the
+  // file, its 4 byte size followed by the msg, so a whole buffer is written out in one go.
+  // The buffers are swapped by the writer thread and keep their capacity.
+  //
+  // All producers share the one enqueue buffer under mutex_ rather than staging into buffers
+  // of their own.  Its order is the order of the events in the file, which flush tickets and
+  // the eventBufferSize_ limit are counted against; per-producer buffers would have to be
+  // merged back into one order by the writer.  The lock covers only the copy of the event.
+  std::vector<uint8_t> dequeueBuffer_;
+  std::vector<uint8_t> enqueueBuffer_;
+  uint32_t enqueuedEvents_;
 
   // conditions used to block when the buffer is full or empty
   Monitor notFull_, notEmpty_;
   std::atomic<bool> closing_;
 
-  // To keep track of whether the buffer has been flushed
+  // Flushes requested and flushes done.  Each flush() takes a ticket; the writer thread
+  // satisfies every ticket taken before a buffer swap with a single fsync.
   Monitor flushed_;
-  std::atomic<bool> forceFlush_;
+  uint64_t flushRequested_;
+  uint64_t flushCompleted_;
 
   // Mutex that is grabbed when enqueueing and swapping the read/write buffers
   Mutex mutex_;
@@ -365,6 +432,17 @@ private:
   // Offset within the file
   off_t offset_;
 
+  // Direct IO state, owned by the writer thread.  directBuff_ holds the file from
+  // directBuffOffset_ on, of which the first directBuffSynced_ bytes are already in the file.
+  bool directIO_;
+  int directFd_;
+  uint8_t* directBuff_;
+  uint32_t directBuffLen_;
+  uint32_t directBuffSynced_;
+  off_t directBuffOffset_;
+  static const uint32_t DIRECT_IO_ALIGNMENT = 4096;
+  static const uint32_t DIRECT_IO_BUFF_SIZE = 4 * 1024 * 1024;
+
   // event corruption information
   uint32_t lastBadChunk_;
   uint32_t numCorruptedEventsInChunk_;
@@ -424,6 +502,28 @@ public:
    */
   void processChunk();
 
+  /**
+   * Returns the key of an event; events with the same key are replayed in
+   * the order they appear in the file.
+   */
+  typedef std::function<size_t(const uint8_t* event, uint32_t len)> KeyFunction;
+
+  /**
+   * Replays the file up to its current end on numThreads threads.  The
+   * calling thread reads the events and hands them out a chunk at a time:
+   * without a key, each chunk goes to whichever thread is free; with one,
+   * events are spread over the threads by key, so that events sharing a key
+   * stay in order.  Events are not copied when the input transport can pin
+   * them, as a memory mapped TFileTransport does.
+   *
+   * The processor and the output transport are used from all threads at
+   * once, so they must be thread safe; the default null output transport is.
+   *
+   * @param numThreads number of threads to replay on
+   * @param key keeps events in order per key; without one, order is not kept
+   */
+  void processParallel(uint32_t numThreads, const KeyFunction& key = KeyFunction());
+
 private:
   std::shared_ptr<TProcessor> processor_;
   std::shared_ptr<TProtocolFactory> inputProtocolFactory_;
@@ -0,0 +1,396 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <thrift/thrift-config.h>
+
+#include <thrift/transport/THeaderTransform.h>
+#include <thrift/transport/THeaderTransport.h>
+#include <thrift/transport/TTransportException.h>
+#include <thrift/concurrency/Mutex.h>
+
+#include <limits>
+#include <map>
+#include <new>
+#include <utility>
+#include <zlib.h>
+
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#include <zstd_errors.h>
+#endif
+
+#ifdef HAVE_LZ4
+#include <lz4.h>
+#endif
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Mutex;
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+namespace {
+
+struct Registry {
+  Mutex mutex;
+  std::map<uint16_t, THeaderTransform::Factory> factories;
+};
+
+Registry& registry() {
+  static Registry* instance = [] {
+    auto* result = new Registry;
+    result->factories[THeaderTransport::ZLIB_TRANSFORM] = THeaderTransform::zlibFactory();
+#ifdef HAVE_ZSTD
+    result->factories[THeaderTransport::ZSTD_TRANSFORM] = THeaderTransform::zstdFactory();
+#endif
+#ifdef HAVE_LZ4
+    result->factories[THeaderTransport::LZ4_TRANSFORM] = THeaderTransform::lz4Factory();
+#endif
+    return result;
+  }();
+  return *instance;
+}
+
+/**
+ * Keeps one deflate and one inflate stream around and resets them between
+ * frames, which is much cheaper than deflateInit/deflateEnd every time.
+ */
+class TZlibTransform : public THeaderTransform {
+public:
+  explicit TZlibTransform(int level) : level_(level), deflating_(false), inflating_(false) {}
+
+  ~TZlibTransform() override {
+    if (deflating_) {
+      deflateEnd(&deflate_);
+    }
+    if (inflating_) {
+      inflateEnd(&inflate_);
+    }
+  }
+
+  uint32_t transformBound(uint32_t size) override {
+    initDeflate();
+    uLong bound = deflateBound(&deflate_, size);
+    if (bound > (std::numeric_limits<uint32_t>::max)()) {
+      throw TTransportException(TTransportException::BAD_ARGS, "Frame too large for zlib");
+    }
+    return static_cast<uint32_t>(bound);
+  }
+
+  uint32_t transform(const uint8_t* in, uint32_t size, uint8_t* out) override {
+    uint32_t bound = transformBound(size);
+    if (deflateReset(&deflate_) != Z_OK) {
+      throw TTransportException(TTransportException::INTERNAL_ERROR,
+                                "Error while zlib deflateReset");
+    }
+    deflate_.next_in = const_cast<Bytef*>(in);
+    deflate_.avail_in = size;
+    deflate_.next_out = out;
+    deflate_.avail_out = bound;
+    if (deflate(&deflate_, Z_FINISH) != Z_STREAM_END) {
+      throw TTransportException(TTransportException::INTERNAL_ERROR, "Error while zlib deflate");
+    }
+    return static_cast<uint32_t>(deflate_.total_out);
+  }
+
+  bool untransform(const uint8_t* in, uint32_t size, uint8_t* out, uint32_t& outSize) override {
+    initInflate();
+    if (inflateReset(&inflate_) != Z_OK) {
+      throw TTransportException(TTransportException::INTERNAL_ERROR,
+                                "Error while zlib inflateReset");
+    }
+    inflate_.next_in = const_cast<Bytef*>(in);
+    inflate_.avail_in = size;
+    inflate_.next_out = out;
+    inflate_.avail_out = outSize;
+    int err = inflate(&inflate_, Z_FINISH);
+    if (err == Z_STREAM_END) {
+      outSize = static_cast<uint32_t>(inflate_.total_out);
+      return true;
+    }
+    if (err == Z_BUF_ERROR && inflate_.avail_out == 0) {
+      return false;
+    }
+    throw TTransportException(TTransportException::CORRUPTED_DATA, "Error while zlib inflate");
+  }
+
+private:
+  void initDeflate() {
+    if (!deflating_) {
+      deflate_.zalloc = Z_NULL;
+      deflate_.zfree = Z_NULL;
+      deflate_.opaque = Z_NULL;
+      if (deflateInit(&deflate_, level_) != Z_OK) {
+        throw TTransportException(TTransportException::INTERNAL_ERROR,
+                                  "Error while zlib deflateInit");
+      }
+      deflating_ = true;
+    }
+  }
+
+  void initInflate() {
+    if (!inflating_) {
+      inflate_.zalloc = Z_NULL;
+      inflate_.zfree = Z_NULL;
+      inflate_.opaque = Z_NULL;
+      inflate_.next_in = Z_NULL;
+      inflate_.avail_in = 0;
+      if (inflateInit(&inflate_) != Z_OK) {
+        throw TTransportException(TTransportException::INTERNAL_ERROR,
+                                  "Error while zlib inflateInit");
+      }
+      inflating_ = true;
+    }
+  }
+
+  int level_;
+  bool deflating_;
+  bool inflating_;
+  z_stream deflate_;
+  z_stream inflate_;
+};
+
+#ifdef HAVE_ZSTD
+/**
+ * A dictionary digested for compression and decompression, shared by all
+ * transforms of a factory.
+ */
+struct TZstdDictionary {
+  TZstdDictionary(const std::string& dictionary, int level)
+    : cdict(ZSTD_createCDict(dictionary.data(), dictionary.size(), level)),
+      ddict(ZSTD_createDDict(dictionary.data(), dictionary.size())) {
+    if (cdict == nullptr || ddict == nullptr) {
+      ZSTD_freeCDict(cdict);
+      ZSTD_freeDDict(ddict);
+      throw TTransportException(TTransportException::BAD_ARGS, "Cannot load zstd dictionary");
+    }
+  }
+
+  ~TZstdDictionary() {
+    ZSTD_freeCDict(cdict);
+    ZSTD_freeDDict(ddict);
+  }
+
+  ZSTD_CDict* cdict;
+  ZSTD_DDict* ddict;
+};
+
+class TZstdTransform : public THeaderTransform {
+public:
+  TZstdTransform(int level, std::shared_ptr<const TZstdDictionary> dictionary)
+    : level_(level), dictionary_(std::move(dictionary)), cctx_(nullptr), dctx_(nullptr) {}
+
+  ~TZstdTransform() override {
+    ZSTD_freeCCtx(cctx_);
+    ZSTD_freeDCtx(dctx_);
+  }
+
+  uint32_t transformBound(uint32_t size) override {
+    size_t bound = ZSTD_compressBound(size);
+    if (bound > (std::numeric_limits<uint32_t>::max)()) {
+      throw TTransportException(TTransportException::BAD_ARGS, "Frame too large for zstd");
+    }
+    return static_cast<uint32_t>(bound);
+  }
+
+  uint32_t transform(const uint8_t* in, uint32_t size, uint8_t* out) override {
+    if (cctx_ == nullptr && (cctx_ = ZSTD_createCCtx()) == nullptr) {
+      throw std::bad_alloc();
+    }
+    size_t result;
+    if (dictionary_) {
+      result = ZSTD_compress_usingCDict(cctx_, out, transformBound(size), in, size,
+                                        dictionary_->cdict);
+    } else {
+      result = ZSTD_compressCCtx(cctx_, out, transformBound(size), in, size, level_);
+    }
+    if (ZSTD_isError(result)) {
+      throw TTransportException(TTransportException::INTERNAL_ERROR,
+                                std::string("Error while zstd compress: ")
+                                    + ZSTD_getErrorName(result));
+    }
+    return static_cast<uint32_t>(result);
+  }
+
+  uint32_t untransformedSize(const uint8_t* in, uint32_t size) override {
+    unsigned long long result = ZSTD_getFrameContentSize(in, size);
+    if (result == ZSTD_CONTENTSIZE_UNKNOWN || result == ZSTD_CONTENTSIZE_ERROR
+        || result > (std::numeric_limits<uint32_t>::max)()) {
+      return 0;
+    }
+    return static_cast<uint32_t>(result);
+  }
+
+  bool untransform(const uint8_t* in, uint32_t size, uint8_t* out, uint32_t& outSize) override {
+    if (dctx_ == nullptr && (dctx_ = ZSTD_createDCtx()) == nullptr) {
+      throw std::bad_alloc();
+    }
+    size_t result;
+    if (dictionary_) {
+      result = ZSTD_decompress_usingDDict(dctx_, out, outSize, in, size, dictionary_->ddict);
+    } else {
+      result = ZSTD_decompressDCtx(dctx_, out, outSize, in, size);
+    }
+    if (ZSTD_isError(result)) {
+      if (ZSTD_getErrorCode(result) == ZSTD_error_dstSize_tooSmall) {
+        return false;
+      }
+      throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                std::string("Error while zstd decompress: ")
+                                    + ZSTD_getErrorName(result));
+    }
+    outSize = static_cast<uint32_t>(result);
+    return true;
+  }
+
+private:
+  int level_;
+  std::shared_ptr<const TZstdDictionary> dictionary_;
+  ZSTD_CCtx* cctx_;
+  ZSTD_DCtx* dctx_;
+};
+#endif
+
+#ifdef HAVE_LZ4
+/**
+ * LZ4 blocks do not record their uncompressed size, so it is sent in front
+ * of the block as a big endian uint32.
+ */
+class TLz4Transform : public THeaderTransform {
+public:
+  explicit TLz4Transform(int acceleration)
+    : acceleration_(acceleration), state_(new char[LZ4_sizeofState()]) {}
+
+  uint32_t transformBound(uint32_t size) override {
+    if (size > LZ4_MAX_INPUT_SIZE) {
+      throw TTransportException(TTransportException::BAD_ARGS, "Frame too large for LZ4");
+    }
+    return sizeof(uint32_t) + static_cast<uint32_t>(LZ4_compressBound(static_cast<int>(size)));
+  }
+
+  uint32_t transform(const uint8_t* in, uint32_t size, uint8_t* out) override {
+    uint32_t bound = transformBound(size);
+    int result = LZ4_compress_fast_extState(state_.get(),
+                                            reinterpret_cast<const char*>(in),
+                                            reinterpret_cast<char*>(out) + sizeof(uint32_t),
+                                            static_cast<int>(size),
+                                            static_cast<int>(bound - sizeof(uint32_t)),
+                                            acceleration_);
+    if (result <= 0) {
+      throw TTransportException(TTransportException::INTERNAL_ERROR, "Error while LZ4 compress");
+    }
+    out[0] = static_cast<uint8_t>(size >> 24);
+    out[1] = static_cast<uint8_t>(size >> 16);
+    out[2] = static_cast<uint8_t>(size >> 8);
+    out[3] = static_cast<uint8_t>(size);
+    return sizeof(uint32_t) + static_cast<uint32_t>(result);
+  }
+
+  uint32_t untransformedSize(const uint8_t* in, uint32_t size) override {
+    if (size < sizeof(uint32_t)) {
+      return 0;
+    }
+    return (static_cast<uint32_t>(in[0]) << 24) | (static_cast<uint32_t>(in[1]) << 16)
+           | (static_cast<uint32_t>(in[2]) << 8) | static_cast<uint32_t>(in[3]);
+  }
+
+  bool untransform(const uint8_t* in, uint32_t size, uint8_t* out, uint32_t& outSize) override {
+    uint32_t expected = untransformedSize(in, size);
+    if (size < sizeof(uint32_t) || expected > LZ4_MAX_INPUT_SIZE) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Invalid LZ4 frame");
+    }
+    if (expected > outSize) {
+      return false;
+    }
+    int result = LZ4_decompress_safe(reinterpret_cast<const char*>(in) + sizeof(uint32_t),
+                                     reinterpret_cast<char*>(out),
+                                     static_cast<int>(size - sizeof(uint32_t)),
+                                     static_cast<int>(expected));
+    if (result < 0 || static_cast<uint32_t>(result) != expected) {
+      throw TTransportException(TTransportException::CORRUPTED_DATA, "Error while LZ4 decompress");
+    }
+    outSize = expected;
+    return true;
+  }
+
+private:
+  int acceleration_;
+  std::unique_ptr<char[]> state_;
+};
+#endif
+}
+
+void THeaderTransform::registerFactory(uint16_t transId, Factory factory) {
+  Registry& r = registry();
+  Guard g(r.mutex);
+  if (factory) {
+    r.factories[transId] = std::move(factory);
+  } else {
+    r.factories.erase(transId);
+  }
+}
+
+std::unique_ptr<THeaderTransform> THeaderTransform::create(uint16_t transId) {
+  Factory factory;
+  {
+    Registry& r = registry();
+    Guard g(r.mutex);
+    auto it = r.factories.find(transId);
+    if (it == r.factories.end()) {
+      return nullptr;
+    }
+    factory = it->second;
+  }
+  return factory();
+}
+
+THeaderTransform::Factory THeaderTransform::zlibFactory(int level) {
+  return [level] { return std::unique_ptr<THeaderTransform>(new TZlibTransform(level)); };
+}
+
+THeaderTransform::Factory THeaderTransform::zstdFactory(int level, const std::string& dictionary) {
+#ifdef HAVE_ZSTD
+  std::shared_ptr<const TZstdDictionary> digested;
+  if (!dictionary.empty()) {
+    digested = std::make_shared<TZstdDictionary>(dictionary, level);
+  }
+  return [level, digested] {
+    return std::unique_ptr<THeaderTransform>(new TZstdTransform(level, digested));
+  };
+#else
+  (void)level;
+  (void)dictionary;
+  throw TTransportException(TTransportException::BAD_ARGS, "Thrift was built without zstd");
+#endif
+}
+
+THeaderTransform::Factory THeaderTransform::lz4Factory(int acceleration) {
+#ifdef HAVE_LZ4
+  return [acceleration] {
+    return std::unique_ptr<THeaderTransform>(new TLz4Transform(acceleration));
+  };
+#else
+  (void)acceleration;
+  throw TTransportException(TTransportException::BAD_ARGS, "Thrift was built without LZ4");
+#endif
+}
+}
+}
+} // apache::thrift::transport
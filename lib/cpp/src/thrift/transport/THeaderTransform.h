@@ -0,0 +1,123 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#ifndef THRIFT_TRANSPORT_THEADERTRANSFORM_H_
+#define THRIFT_TRANSPORT_THEADERTRANSFORM_H_ 1
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace apache {
+namespace thrift {
+namespace transport {
+
+/**
+ * A transform THeaderTransport applies to the payload of its frames, such as
+ * a compression codec.  Transforms are identified on the wire by the IDs in
+ * THeaderTransport::TRANSFORMS.
+ *
+ * A transport creates one instance per transform ID on first use and keeps it
+ * for its lifetime, so implementations should hold on to their codec state
+ * instead of setting it up for every frame.  An instance is only ever used by
+ * one transport and need not be thread safe.
+ */
+class THeaderTransform {
+public:
+  typedef std::function<std::unique_ptr<THeaderTransform>()> Factory;
+
+  virtual ~THeaderTransform() = default;
+
+  /**
+   * The most bytes transform() can produce from size bytes of input.
+   */
+  virtual uint32_t transformBound(uint32_t size) = 0;
+
+  /**
+   * Transforms size bytes at in into out, which holds at least
+   * transformBound(size) bytes, and returns the size of the result.
+   */
+  virtual uint32_t transform(const uint8_t* in, uint32_t size, uint8_t* out) = 0;
+
+  /**
+   * The size untransform() will produce from the given input, or 0 if the
+   * format does not record it.
+   */
+  virtual uint32_t untransformedSize(const uint8_t* in, uint32_t size) {
+    (void)in;
+    (void)size;
+    return 0;
+  }
+
+  /**
+   * Reverses transform().  out holds outSize bytes; on success outSize is set
+   * to the size of the result.  Returns false if out was too small, in which
+   * case the caller retries with a larger buffer.
+   *
+   * @throws TTransportException if the input is corrupt
+   */
+  virtual bool untransform(const uint8_t* in, uint32_t size, uint8_t* out, uint32_t& outSize) = 0;
+
+  /**
+   * Makes new transports use the given factory for transId, replacing any
+   * previous one.  This is how applications add their own transforms, or
+   * configure the built in ones, e.g. with a zstd dictionary.  Both ends of
+   * a connection must agree on what an ID means.  An empty factory removes
+   * the registration.
+   */
+  static void registerFactory(uint16_t transId, Factory factory);
+
+  /**
+   * Creates the transform registered for transId, or returns nullptr if
+   * there is none.
+   */
+  static std::unique_ptr<THeaderTransform> create(uint16_t transId);
+
+  /**
+   * zlib at the given level (Z_DEFAULT_COMPRESSION is -1).  Registered for
+   * ZLIB_TRANSFORM by default.
+   */
+  static Factory zlibFactory(int level = -1);
+
+  /**
+   * zstd at the given level, optionally with a dictionary.  The dictionary
+   * is digested once and shared by all transforms the factory creates.
+   * Registered for ZSTD_TRANSFORM without a dictionary by default when
+   * Thrift is built with zstd.
+   *
+   * @throws TTransportException if Thrift was built without zstd or the
+   *         dictionary cannot be loaded
+   */
+  static Factory zstdFactory(int level = 1, const std::string& dictionary = std::string());
+
+  /**
+   * LZ4 with the given acceleration, where larger values trade ratio for
+   * speed.  Registered for LZ4_TRANSFORM by default when Thrift is built
+   * with LZ4.
+   *
+   * @throws TTransportException if Thrift was built without LZ4
+   */
+  static Factory lz4Factory(int acceleration = 1);
+};
+}
+}
+} // apache::thrift::transport
+
+#endif // #ifndef THRIFT_TRANSPORT_THEADERTRANSFORM_H_
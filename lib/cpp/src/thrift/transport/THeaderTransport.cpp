@@ -19,15 +19,16 @@
 
 #include <thrift/transport/THeaderTransport.h>
 #include <thrift/TApplicationException.h>
+#include <thrift/TRequestDeadline.h>
 #include <thrift/protocol/TProtocolTypes.h>
 #include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/protocol/TCompactProtocol.h>
 
+#include <algorithm>
 #include <limits>
 #include <utility>
 #include <string>
 #include <string.h>
-#include <zlib.h>
 
 using std::map;
 using std::string;
@@ -61,13 +62,6 @@ uint16_t THeaderTransport::getProtocolId() const {
   }
 }
 
-void THeaderTransport::ensureReadBuffer(uint32_t sz) {
-  if (sz > rBufSize_) {
-    rBuf_.reset(new uint8_t[sz]);
-    rBufSize_ = sz;
-  }
-}
-
 bool THeaderTransport::readFrame() {
   // szN is network byte order of sz
   uint32_t szN;
@@ -256,63 +250,85 @@ void THeaderTransport::readHeaderFormat(uint16_t headerSize, uint32_t sz) {
     }
   }
 
+  // A server reading a request takes on the deadline its client sent
+  if (!readHeaders_.empty()) {
+    TRequestDeadline::Clock::time_point deadline;
+    if (TRequestDeadline::fromHeaders(readHeaders_, TRequestDeadline::Clock::now(), deadline)) {
+      TRequestDeadline::tighten(deadline);
+    }
+  }
+
   // Untransform the data section.  rBuf will contain result.
   untransform(data, safe_numeric_cast<uint32_t>(static_cast<ptrdiff_t>(sz) - (data - rBuf_.get())));
 }
 
-void THeaderTransport::untransform(uint8_t* ptr, uint32_t sz) {
-  // Update the transform buffer size if needed
-  resizeTransformBuffer();
-
-  for (vector<uint16_t>::const_iterator it = readTrans_.begin(); it != readTrans_.end(); ++it) {
-    const uint16_t transId = *it;
-
-    if (transId == ZLIB_TRANSFORM) {
-      z_stream stream;
-      int err;
-
-      stream.next_in = ptr;
-      stream.avail_in = sz;
-
-      // Setting these to 0 means use the default free/alloc functions
-      stream.zalloc = (alloc_func)nullptr;
-      stream.zfree = (free_func)nullptr;
-      stream.opaque = (voidpf)nullptr;
-      err = inflateInit(&stream);
-      if (err != Z_OK) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib deflateInit");
-      }
-      stream.next_out = tBuf_.get();
-      stream.avail_out = tBufSize_;
-      err = inflate(&stream, Z_FINISH);
-      if (err != Z_STREAM_END || stream.avail_out == 0) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib deflate");
-      }
-      sz = stream.total_out;
+THeaderTransform* THeaderTransport::getTransform(uint16_t transId) {
+  for (auto& entry : transforms_) {
+    if (entry.first == transId) {
+      return entry.second.get();
+    }
+  }
+  std::unique_ptr<THeaderTransform> transform = THeaderTransform::create(transId);
+  if (!transform) {
+    return nullptr;
+  }
+  transforms_.emplace_back(transId, std::move(transform));
+  return transforms_.back().second.get();
+}
 
-      err = inflateEnd(&stream);
-      if (err != Z_OK) {
-        throw TApplicationException(TApplicationException::MISSING_RESULT,
-                                    "Error while zlib deflateEnd");
-      }
+void THeaderTransport::ensureTransformBuffer(uint32_t sz) {
+  if (tBufSize_ < sz) {
+    tBuf_.reset(new uint8_t[sz]);
+    tBufSize_ = sz;
+  }
+}
 
-      memcpy(ptr, tBuf_.get(), sz);
-    } else {
+void THeaderTransport::untransform(uint8_t* ptr, uint32_t sz) {
+  // Undo the transforms in the reverse order of their application
+  for (vector<uint16_t>::const_reverse_iterator it = readTrans_.rbegin(); it != readTrans_.rend();
+       ++it) {
+    THeaderTransform* transform = getTransform(*it);
+    if (transform == nullptr) {
       throw TApplicationException(TApplicationException::MISSING_RESULT, "Unknown transform");
     }
+
+    // Guess the size if the format does not tell, and grow until it fits,
+    // but never beyond what we would accept as a frame.
+    uint32_t outSize = transform->untransformedSize(ptr, sz);
+    if (outSize == 0) {
+      outSize = (std::max)(sz, static_cast<uint32_t>(DEFAULT_BUFFER_SIZE)) * 4;
+    }
+    if (outSize > maxFrameSize_) {
+      outSize = maxFrameSize_;
+    }
+    for (;;) {
+      ensureTransformBuffer(outSize);
+      uint32_t resultSize = outSize;
+      if (transform->untransform(ptr, sz, tBuf_.get(), resultSize)) {
+        sz = resultSize;
+        break;
+      }
+      if (outSize >= maxFrameSize_) {
+        throw TTransportException(TTransportException::CORRUPTED_DATA,
+                                  "Untransformed frame is too large");
+      }
+      outSize = outSize > maxFrameSize_ / 2 ? maxFrameSize_ : outSize * 2;
+    }
+
+    // The frame has been consumed, so its buffer can take the result.
+    ensureReadBuffer(sz);
+    memcpy(rBuf_.get(), tBuf_.get(), sz);
+    ptr = rBuf_.get();
   }
 
   setReadBuffer(ptr, sz);
 }
 
 /**
- * We may have updated the wBuf size, update the tBuf size to match.
- * Should be called in transform.
+ * Grows tBuf_ to slightly more than the write buffer size.
  *
- * The buffer should be slightly larger than write buffer size due to
- * compression transforms (that may slightly grow on small frame sizes)
+ * transform() and untransform() size tBuf_ as they go, so this only
+ * preallocates it.
  */
 void THeaderTransport::resizeTransformBuffer(uint32_t additionalSize) {
   if (tBufSize_ < wBufSize_ + DEFAULT_BUFFER_SIZE) {
@@ -324,50 +340,26 @@ void THeaderTransport::resizeTransformBuffer(uint32_t additionalSize) {
 }
 
 void THeaderTransport::transform(uint8_t* ptr, uint32_t sz) {
-  // Update the transform buffer size if needed
-  resizeTransformBuffer();
-
+  bool swapped = false;
   for (vector<uint16_t>::const_iterator it = writeTrans_.begin(); it != writeTrans_.end(); ++it) {
-    const uint16_t transId = *it;
-
-    if (transId == ZLIB_TRANSFORM) {
-      z_stream stream;
-      int err;
-
-      stream.next_in = ptr;
-      stream.avail_in = sz;
-
-      stream.zalloc = (alloc_func)nullptr;
-      stream.zfree = (free_func)nullptr;
-      stream.opaque = (voidpf)nullptr;
-      err = deflateInit(&stream, Z_DEFAULT_COMPRESSION);
-      if (err != Z_OK) {
-        throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                  "Error while zlib deflateInit");
-      }
-      uint32_t tbuf_size = 0;
-      while (err == Z_OK) {
-        resizeTransformBuffer(tbuf_size);
-
-        stream.next_out = tBuf_.get();
-        stream.avail_out = tBufSize_;
-        err = deflate(&stream, Z_FINISH);
-        tbuf_size += DEFAULT_BUFFER_SIZE;
-      }
-      sz = stream.total_out;
-
-      err = deflateEnd(&stream);
-      if (err != Z_OK) {
-        throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                  "Error while zlib deflateEnd");
-      }
-
-      memcpy(ptr, tBuf_.get(), sz);
-    } else {
+    THeaderTransform* transform = getTransform(*it);
+    if (transform == nullptr) {
       throw TTransportException(TTransportException::CORRUPTED_DATA, "Unknown transform");
     }
+
+    // Transform into tBuf_ and swap it with the write buffer, which saves
+    // copying the result back and lets it outgrow the original.
+    ensureTransformBuffer(transform->transformBound(sz));
+    sz = transform->transform(ptr, sz, tBuf_.get());
+    wBuf_.swap(tBuf_);
+    std::swap(wBufSize_, tBufSize_);
+    ptr = wBuf_.get();
+    swapped = true;
   }
 
+  if (swapped) {
+    setWriteBuffer(wBuf_.get(), wBufSize_);
+  }
   wBase_ = wBuf_.get() + sz;
 }
 
@@ -441,19 +433,13 @@ void THeaderTransport::flush() {
     // add approximate size of info headers
     headerSize += getMaxWriteHeadersSize();
 
-    // Pkt size
-    uint32_t maxSzHbo = headerSize + haveBytes // thrift header + payload
-                        + 10;                  // common header section
+    // Only the headers go through tBuf_, the payload is written from wBuf_
+    ensureTransformBuffer(headerSize + 10); // thrift header + common header section
     uint8_t* pkt = tBuf_.get();
     uint8_t* headerStart;
     uint8_t* headerSizePtr;
     uint8_t* pktStart = pkt;
 
-    if (maxSzHbo > tBufSize_) {
-      throw TTransportException(TTransportException::CORRUPTED_DATA,
-                                "Attempting to header frame that is too large");
-    }
-
     uint32_t szHbo;
     uint32_t szNbo;
     uint16_t headerSizeN;
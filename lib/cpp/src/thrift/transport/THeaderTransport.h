@@ -22,6 +22,8 @@
 
 #include <bitset>
 #include <limits>
+#include <memory>
+#include <utility>
 #include <vector>
 #include <stdexcept>
 #include <string>
@@ -37,6 +39,7 @@
 
 #include <thrift/protocol/TProtocolTypes.h>
 #include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/THeaderTransform.h>
 #include <thrift/transport/TTransport.h>
 #include <thrift/transport/TVirtualTransport.h>
 
@@ -137,6 +140,10 @@ public:
    * At conclusion of function the write buffer is set to the
    * transformed data.
    *
+   * Each transform runs with the instance this transport created for its
+   * ID on first use, so codec state is set up once per connection rather
+   * than once per frame (see THeaderTransform).
+   *
    * @param ptr Ptr to data to transform
    * @param sz Size of data buffer
    */
@@ -168,6 +175,11 @@ public:
 
   enum TRANSFORMS {
     ZLIB_TRANSFORM = 0x01,
+    // Reserved for compatibility with other header implementations; no
+    // transform is registered for it unless the application provides one.
+    SNAPPY_TRANSFORM = 0x03,
+    ZSTD_TRANSFORM = 0x05,
+    LZ4_TRANSFORM = 0x06,
   };
 
 protected:
@@ -179,7 +191,6 @@ protected:
    */
   bool readFrame() override;
 
-  void ensureReadBuffer(uint32_t sz);
   uint32_t getWriteBytes();
 
   void initBuffers() {
@@ -225,6 +236,19 @@ protected:
   uint32_t tBufSize_;
   boost::scoped_array<uint8_t> tBuf_;
 
+  /**
+   * Makes sure tBuf_ holds at least sz bytes.  Does not preserve its contents.
+   */
+  void ensureTransformBuffer(uint32_t sz);
+
+  /**
+   * Returns this transport's instance of the transform, creating it on first
+   * use, or nullptr if no transform is registered for transId.
+   */
+  THeaderTransform* getTransform(uint16_t transId);
+
+  std::vector<std::pair<uint16_t, std::unique_ptr<THeaderTransform> > > transforms_;
+
   void readString(uint8_t*& ptr, /* out */ std::string& str, uint8_t const* headerBoundary);
 
   void writeString(uint8_t*& ptr, const std::string& str);
@@ -94,6 +94,7 @@ TNonblockingServerSocket::TNonblockingServerSocket(int port)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -109,6 +110,7 @@ TNonblockingServerSocket::TNonblockingServerSocket(int port, int sendTimeout, in
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -125,6 +127,7 @@ TNonblockingServerSocket::TNonblockingServerSocket(const string& address, int po
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -141,6 +144,7 @@ TNonblockingServerSocket::TNonblockingServerSocket(const string& path)
     tcpSendBuffer_(0),
     tcpRecvBuffer_(0),
     keepAlive_(false),
+    reusePort_(false),
     listening_(false) {
 }
 
@@ -205,14 +209,14 @@ void TNonblockingServerSocket::setTcpRecvBuffer(int tcpRecvBuffer) {
   tcpRecvBuffer_ = tcpRecvBuffer;
 }
 
-void TNonblockingServerSocket::_setup_sockopts() {
+void TNonblockingServerSocket::_setup_sockopts(THRIFT_SOCKET s) {
   int one = 1;
   if (!isUnixDomainSocket()) {
     // Set THRIFT_NO_SOCKET_CACHING to prevent 2MSL delay on accept.
     // This does not work with Domain sockets on most platforms. And
     // on Windows it completely breaks the socket. Therefore do not
     // use this on Domain sockets.
-    if (-1 == setsockopt(serverSocket_,
+    if (-1 == setsockopt(s,
                          SOL_SOCKET,
                          THRIFT_NO_SOCKET_CACHING,
                          cast_sockopt(&one),
@@ -230,9 +234,23 @@ void TNonblockingServerSocket::_setup_sockopts() {
     }
   }
 
+#ifdef SO_REUSEPORT
+  // Lets listenShard() bind more sockets to the same address
+  if (reusePort_) {
+    if (-1 == setsockopt(s, SOL_SOCKET, SO_REUSEPORT, cast_sockopt(&one), sizeof(one))) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      GlobalOutput.perror("TNonblockingServerSocket::listen() setsockopt() SO_REUSEPORT ", errno_copy);
+      close();
+      throw TTransportException(TTransportException::NOT_OPEN,
+                                "Could not set SO_REUSEPORT",
+                                errno_copy);
+    }
+  }
+#endif
+
   // Set TCP buffer sizes
   if (tcpSendBuffer_ > 0) {
-    if (-1 == setsockopt(serverSocket_,
+    if (-1 == setsockopt(s,
                          SOL_SOCKET,
                          SO_SNDBUF,
                          cast_sockopt(&tcpSendBuffer_),
@@ -247,7 +265,7 @@ void TNonblockingServerSocket::_setup_sockopts() {
   }
 
   if (tcpRecvBuffer_ > 0) {
-    if (-1 == setsockopt(serverSocket_,
+    if (-1 == setsockopt(s,
                          SOL_SOCKET,
                          SO_RCVBUF,
                          cast_sockopt(&tcpRecvBuffer_),
@@ -263,7 +281,7 @@ void TNonblockingServerSocket::_setup_sockopts() {
 
   // Turn linger off, don't want to block on calls to close
   struct linger ling = {0, 0};
-  if (-1 == setsockopt(serverSocket_, SOL_SOCKET, SO_LINGER, cast_sockopt(&ling), sizeof(ling))) {
+  if (-1 == setsockopt(s, SOL_SOCKET, SO_LINGER, cast_sockopt(&ling), sizeof(ling))) {
     int errno_copy = THRIFT_GET_SOCKET_ERROR;
     GlobalOutput.perror("TNonblockingServerSocket::listen() setsockopt() SO_LINGER ", errno_copy);
     close();
@@ -271,7 +289,7 @@ void TNonblockingServerSocket::_setup_sockopts() {
   }
 
   // Keepalive to ensure full result flushing
-  if (-1 == setsockopt(serverSocket_, SOL_SOCKET, SO_KEEPALIVE, const_cast_sockopt(&one), sizeof(one))) {
+  if (-1 == setsockopt(s, SOL_SOCKET, SO_KEEPALIVE, const_cast_sockopt(&one), sizeof(one))) {
     int errno_copy = THRIFT_GET_SOCKET_ERROR;
     GlobalOutput.perror("TNonblockingServerSocket::listen() setsockopt() SO_KEEPALIVE ", errno_copy);
     close();
@@ -281,7 +299,7 @@ void TNonblockingServerSocket::_setup_sockopts() {
   }
 
 #ifdef SO_NOSIGPIPE
-  if (-1 == setsockopt(serverSocket_, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one))) {
+  if (-1 == setsockopt(s, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one))) {
     int errno_copy = THRIFT_GET_SOCKET_ERROR;
     GlobalOutput.perror("TNonblockingServerSocket::listen() setsockopt() SO_NOSIGPIPE", errno_copy);
     close();
@@ -292,7 +310,7 @@ void TNonblockingServerSocket::_setup_sockopts() {
 #endif
 
   // Set NONBLOCK on the accept socket
-  int flags = THRIFT_FCNTL(serverSocket_, THRIFT_F_GETFL, 0);
+  int flags = THRIFT_FCNTL(s, THRIFT_F_GETFL, 0);
   if (flags == -1) {
     int errno_copy = THRIFT_GET_SOCKET_ERROR;
     GlobalOutput.perror("TNonblockingServerSocket::listen() THRIFT_FCNTL() THRIFT_F_GETFL ", errno_copy);
@@ -302,7 +320,7 @@ void TNonblockingServerSocket::_setup_sockopts() {
                               errno_copy);
   }
 
-  if (-1 == THRIFT_FCNTL(serverSocket_, THRIFT_F_SETFL, flags | THRIFT_O_NONBLOCK)) {
+  if (-1 == THRIFT_FCNTL(s, THRIFT_F_SETFL, flags | THRIFT_O_NONBLOCK)) {
     int errno_copy = THRIFT_GET_SOCKET_ERROR;
     GlobalOutput.perror("TNonblockingServerSocket::listen() THRIFT_FCNTL() THRIFT_O_NONBLOCK ", errno_copy);
     close();
@@ -315,7 +333,7 @@ void TNonblockingServerSocket::_setup_sockopts() {
 void TNonblockingServerSocket::_setup_unixdomain_sockopts() {
 }
 
-void TNonblockingServerSocket::_setup_tcp_sockopts() {
+void TNonblockingServerSocket::_setup_tcp_sockopts(THRIFT_SOCKET s) {
   int one = 1;
 
   // Set TCP nodelay if available, MAC OS X Hack
@@ -323,7 +341,7 @@ void TNonblockingServerSocket::_setup_tcp_sockopts() {
 #ifndef TCP_NOPUSH
   // TCP Nodelay, speed over bandwidth
   if (-1
-      == setsockopt(serverSocket_, IPPROTO_TCP, TCP_NODELAY, cast_sockopt(&one), sizeof(one))) {
+      == setsockopt(s, IPPROTO_TCP, TCP_NODELAY, cast_sockopt(&one), sizeof(one))) {
     int errno_copy = THRIFT_GET_SOCKET_ERROR;
     GlobalOutput.perror("TNonblockingServerSocket::listen() setsockopt() TCP_NODELAY ", errno_copy);
     close();
@@ -396,7 +414,7 @@ void TNonblockingServerSocket::listen() {
                                 errno_copy);
     }
 
-    _setup_sockopts();
+    _setup_sockopts(serverSocket_);
     _setup_unixdomain_sockopts();
 
     // Windows supports Unix domain sockets since it ships the header
@@ -438,8 +456,8 @@ void TNonblockingServerSocket::listen() {
         continue;
       }
 
-      _setup_sockopts();
-      _setup_tcp_sockopts();
+      _setup_sockopts(serverSocket_);
+      _setup_tcp_sockopts(serverSocket_);
 
 #ifdef IPV6_V6ONLY
       if (trybind->ai_family == AF_INET6) {
@@ -526,6 +544,70 @@ void TNonblockingServerSocket::listen() {
   listening_ = true;
 }
 
+THRIFT_SOCKET TNonblockingServerSocket::listenShard() {
+#ifdef SO_REUSEPORT
+  if (!reusePort_ || !listening_) {
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "listenShard() needs setReusePort(true) and listen()");
+  }
+
+  // Bind to exactly what listen() got, including an ephemeral port
+  struct sockaddr_storage sa;
+  socklen_t len = sizeof(sa);
+  std::memset(&sa, 0, len);
+  if (::getsockname(serverSocket_, reinterpret_cast<struct sockaddr*>(&sa), &len) < 0) {
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    GlobalOutput.perror("TNonblockingServerSocket::listenShard() getsockname() ", errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN, "Could not get socket name", errno_copy);
+  }
+
+  THRIFT_SOCKET shard = socket(sa.ss_family, SOCK_STREAM, IPPROTO_TCP);
+  if (shard == THRIFT_INVALID_SOCKET) {
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    GlobalOutput.perror("TNonblockingServerSocket::listenShard() socket() ", errno_copy);
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "Could not create server socket.",
+                              errno_copy);
+  }
+
+  try {
+    _setup_sockopts(shard);
+    _setup_tcp_sockopts(shard);
+
+#ifdef IPV6_V6ONLY
+    if (sa.ss_family == AF_INET6) {
+      int zero = 0;
+      if (-1 == setsockopt(shard, IPPROTO_IPV6, IPV6_V6ONLY, cast_sockopt(&zero), sizeof(zero))) {
+        GlobalOutput.perror("TNonblockingServerSocket::listenShard() IPV6_V6ONLY ", THRIFT_GET_SOCKET_ERROR);
+      }
+    }
+#endif // #ifdef IPV6_V6ONLY
+
+    if (0 != ::bind(shard, reinterpret_cast<struct sockaddr*>(&sa), len)) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      GlobalOutput.perror("TNonblockingServerSocket::listenShard() bind() ", errno_copy);
+      throw TTransportException(TTransportException::NOT_OPEN, "Could not bind", errno_copy);
+    }
+
+    if (listenCallback_)
+      listenCallback_(shard);
+
+    if (-1 == ::listen(shard, acceptBacklog_)) {
+      int errno_copy = THRIFT_GET_SOCKET_ERROR;
+      GlobalOutput.perror("TNonblockingServerSocket::listenShard() listen() ", errno_copy);
+      throw TTransportException(TTransportException::NOT_OPEN, "Could not listen", errno_copy);
+    }
+  } catch (...) {
+    ::THRIFT_CLOSESOCKET(shard);
+    throw;
+  }
+
+  return shard;
+#else
+  throw TTransportException(TTransportException::NOT_OPEN, "SO_REUSEPORT is not supported");
+#endif
+}
+
 int TNonblockingServerSocket::getPort() {
   return port_;
 }
@@ -542,16 +624,38 @@ bool TNonblockingServerSocket::isUnixDomainSocket() const {
     return !path_.empty();
 }
 
+bool TNonblockingServerSocket::setReusePort(bool reusePort) {
+#ifdef SO_REUSEPORT
+  if (!isUnixDomainSocket()) {
+    reusePort_ = reusePort;
+    return true;
+  }
+#endif
+  reusePort_ = false;
+  return !reusePort;
+}
+
 shared_ptr<TSocket> TNonblockingServerSocket::acceptImpl() {
   if (serverSocket_ == THRIFT_INVALID_SOCKET) {
     throw TTransportException(TTransportException::NOT_OPEN,
                               "TNonblockingServerSocket not listening");
   }
+  return acceptFrom(serverSocket_);
+}
+
+shared_ptr<TSocket> TNonblockingServerSocket::acceptShardImpl(THRIFT_SOCKET listener) {
+  if (serverSocket_ == THRIFT_INVALID_SOCKET) {
+    throw TTransportException(TTransportException::NOT_OPEN,
+                              "TNonblockingServerSocket not listening");
+  }
+  return acceptFrom(listener);
+}
 
+shared_ptr<TSocket> TNonblockingServerSocket::acceptFrom(THRIFT_SOCKET listener) {
   struct sockaddr_storage clientAddress;
   int size = sizeof(clientAddress);
   THRIFT_SOCKET clientSocket
-      = ::accept(serverSocket_, (struct sockaddr*)&clientAddress, (socklen_t*)&size);
+      = ::accept(listener, (struct sockaddr*)&clientAddress, (socklen_t*)&size);
 
   if (clientSocket == THRIFT_INVALID_SOCKET) {
     int errno_copy = THRIFT_GET_SOCKET_ERROR;
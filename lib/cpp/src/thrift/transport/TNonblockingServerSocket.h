@@ -85,6 +85,8 @@ public:
 
   void setKeepAlive(bool keepAlive) { keepAlive_ = keepAlive; }
 
+  bool setReusePort(bool reusePort) override;
+
   void setTcpSendBuffer(int tcpSendBuffer);
   void setTcpRecvBuffer(int tcpRecvBuffer);
 
@@ -110,16 +112,19 @@ public:
   bool isUnixDomainSocket() const;
 
   void listen() override;
+  THRIFT_SOCKET listenShard() override;
   void close() override;
 
 protected:
   std::shared_ptr<TSocket> acceptImpl() override;
+  std::shared_ptr<TSocket> acceptShardImpl(THRIFT_SOCKET listener) override;
   virtual std::shared_ptr<TSocket> createSocket(THRIFT_SOCKET client);
 
 private:
-  void _setup_sockopts();
+  std::shared_ptr<TSocket> acceptFrom(THRIFT_SOCKET listener);
+  void _setup_sockopts(THRIFT_SOCKET s);
   void _setup_unixdomain_sockopts();
-  void _setup_tcp_sockopts();
+  void _setup_tcp_sockopts(THRIFT_SOCKET s);
 
   int port_;
   int listenPort_;
@@ -134,6 +139,7 @@ private:
   int tcpSendBuffer_;
   int tcpRecvBuffer_;
   bool keepAlive_;
+  bool reusePort_;
   bool listening_;
 
   socket_func_t listenCallback_;
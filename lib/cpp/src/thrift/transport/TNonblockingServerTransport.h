@@ -63,6 +63,44 @@ public:
     return result;
   }
 
+  /**
+   * Accepts a connection on a socket opened by listenShard().
+   *
+   * @return A new TTransport object
+   * @throws TTransportException if there is an error
+   */
+  std::shared_ptr<TSocket> acceptShard(THRIFT_SOCKET listener) {
+    std::shared_ptr<TSocket> result = acceptShardImpl(listener);
+    if (!result) {
+      throw TTransportException("acceptShard() may not return nullptr");
+    }
+    return result;
+  }
+
+  /**
+   * Asks listen() to bind with SO_REUSEPORT, so that listenShard() can open
+   * more sockets on the same address.  Must be called before listen().
+   *
+   * @return false if the transport cannot do that
+   */
+  virtual bool setReusePort(bool reusePort) {
+    (void)reusePort;
+    return false;
+  }
+
+  /**
+   * Opens another socket that listens on the address bound by listen().  The
+   * kernel spreads new connections over all of them, so a server can accept
+   * on several threads without handing connections from one to another.
+   * Requires setReusePort(true) before listen().
+   *
+   * @return the listening socket, which the caller has to close
+   * @throw TTransportException if an error occurs
+   */
+  virtual THRIFT_SOCKET listenShard() {
+    throw TTransportException(TTransportException::NOT_OPEN, "listenShard() is not supported");
+  }
+
   /**
   * Utility method
   * 
@@ -92,6 +130,15 @@ protected:
    */
   virtual std::shared_ptr<TSocket> acceptImpl() = 0;
 
+  /**
+   * Subclasses that support listenShard() implement this function to accept
+   * on the sockets it returns.
+   */
+  virtual std::shared_ptr<TSocket> acceptShardImpl(THRIFT_SOCKET listener) {
+    (void)listener;
+    throw TTransportException(TTransportException::NOT_OPEN, "acceptShard() is not supported");
+  }
+
 };
 }
 }
@@ -20,6 +20,7 @@
 #include <thrift/thrift-config.h>
 
 #include <cstring>
+#include <ctime>
 #include <errno.h>
 #include <memory>
 #include <string>
@@ -169,6 +170,10 @@ void cleanupOpenSSL() {
 static void buildErrors(string& message, int errno_copy = 0, int sslerrno = 0);
 static bool matchName(const char* host, const char* pattern, int size);
 static char uppercase(char c);
+static int newSessionCallback(SSL* ssl, SSL_SESSION* session);
+
+// Sessions resumed on a server must come from the same application
+static const unsigned char SESSION_ID_CONTEXT[] = "thrift";
 
 // SSLContext implementation
 SSLContext::SSLContext(const SSLProtocol& protocol) {
@@ -202,9 +207,19 @@ SSLContext::SSLContext(const SSLProtocol& protocol) {
       SSL_CTX_set_options(ctx_, SSL_OP_NO_SSLv2);
       SSL_CTX_set_options(ctx_, SSL_OP_NO_SSLv3);   // THRIFT-3164
   }
+
+  // Without a session id context, a server that verifies its clients fails
+  // the handshakes that try to resume a session
+  SSL_CTX_set_session_id_context(ctx_, SESSION_ID_CONTEXT, sizeof(SESSION_ID_CONTEXT) - 1);
+  SSL_CTX_set_app_data(ctx_, this);
+  SSL_CTX_sess_set_new_cb(ctx_, newSessionCallback);
 }
 
 SSLContext::~SSLContext() {
+  for (auto& session : sessions_) {
+    SSL_SESSION_free(session.second);
+  }
+  sessions_.clear();
   if (ctx_ != nullptr) {
     SSL_CTX_free(ctx_);
     ctx_ = nullptr;
@@ -221,6 +236,49 @@ SSL* SSLContext::createSSL() {
   return ssl;
 }
 
+SSL_SESSION* SSLContext::getSession(const std::string& key) {
+  Guard guard(sessionsMutex_);
+  auto found = sessions_.find(key);
+  if (found == sessions_.end()) {
+    return nullptr;
+  }
+  SSL_SESSION* session = found->second;
+  bool expired = time(nullptr) >= SSL_SESSION_get_time(session) + SSL_SESSION_get_timeout(session);
+#ifdef TLS1_3_VERSION
+  // TLS 1.3 tickets are for one use (RFC 8446, C.4); the new connection
+  // brings its own
+  bool singleUse = SSL_SESSION_get_protocol_version(session) == TLS1_3_VERSION;
+#else
+  bool singleUse = false;
+#endif
+  if (expired || singleUse) {
+    sessions_.erase(found);
+    if (expired) {
+      SSL_SESSION_free(session);
+      return nullptr;
+    }
+    return session;
+  }
+  SSL_SESSION_up_ref(session);
+  return session;
+}
+
+void SSLContext::putSession(const std::string& key, SSL_SESSION* session) {
+  Guard guard(sessionsMutex_);
+  auto found = sessions_.find(key);
+  if (found != sessions_.end()) {
+    SSL_SESSION_free(found->second);
+    found->second = session;
+    return;
+  }
+  long limit = SSL_CTX_sess_get_cache_size(ctx_);
+  if (limit > 0 && sessions_.size() >= static_cast<size_t>(limit)) {
+    SSL_SESSION_free(sessions_.begin()->second);
+    sessions_.erase(sessions_.begin());
+  }
+  sessions_[key] = session;
+}
+
 // TSSLSocket implementation
 TSSLSocket::TSSLSocket(std::shared_ptr<SSLContext> ctx, std::shared_ptr<TConfiguration> config)
   : TSocket(config), server_(false), ssl_(nullptr), ctx_(ctx) {
@@ -278,6 +336,30 @@ void TSSLSocket::init() {
   eventSafe_ = false;
 }
 
+bool TSSLSocket::isSessionReused() const {
+  return ssl_ != nullptr && SSL_session_reused(ssl_) == 1;
+}
+
+bool TSSLSocket::isKernelTLSSend() const {
+#ifdef BIO_get_ktls_send
+  return ssl_ != nullptr && BIO_get_ktls_send(SSL_get_wbio(ssl_));
+#else
+  return false;
+#endif
+}
+
+bool TSSLSocket::isKernelTLSRecv() const {
+#ifdef BIO_get_ktls_recv
+  return ssl_ != nullptr && BIO_get_ktls_recv(SSL_get_rbio(ssl_));
+#else
+  return false;
+#endif
+}
+
+std::string TSSLSocket::getSessionKey() const {
+  return getHost() + ":" + to_string(getPort());
+}
+
 bool TSSLSocket::isOpen() const {
   if (ssl_ == nullptr || !TSocket::isOpen()) {
     return false;
@@ -572,6 +654,48 @@ uint32_t TSSLSocket::write_partial(const uint8_t* buf, uint32_t len) {
   return written;
 }
 
+#ifndef _WIN32
+/*
+ * Gathered writes cannot bypass the SSL session, so the buffers are handed
+ * to SSL_write one at a time, unless the kernel encrypts them.
+ */
+void TSSLSocket::writev(const struct iovec* iov, int iovcnt) {
+  initializeHandshake();
+  if (!checkHandshake())
+    return;
+  if (isKernelTLSSend()) {
+    TSocket::writev(iov, iovcnt);
+    return;
+  }
+  for (int i = 0; i < iovcnt; ++i) {
+    write(static_cast<const uint8_t*>(iov[i].iov_base), static_cast<uint32_t>(iov[i].iov_len));
+  }
+}
+
+uint32_t TSSLSocket::writev_partial(const struct iovec* iov, int iovcnt) {
+  initializeHandshake();
+  if (!checkHandshake())
+    return 0;
+  for (int i = 0; i < iovcnt; ++i) {
+    if (iov[i].iov_len == 0) {
+      continue;
+    }
+    if (isKernelTLSSend()) {
+      // One sendmsg() for all of them, as with a plain socket
+      uint32_t written;
+      while ((written = TSocket::writev_partial(&iov[i], iovcnt - i)) == 0
+             && !isLibeventSafe()) {
+        waitForEvent(false);
+      }
+      return written;
+    }
+    return write_partial(static_cast<const uint8_t*>(iov[i].iov_base),
+                         static_cast<uint32_t>(iov[i].iov_len));
+  }
+  return 0;
+}
+#endif
+
 void TSSLSocket::flush() {
   resetConsumedMessageSize();
   // Don't throw exception if not open. Thrift servers close socket twice.
@@ -606,6 +730,17 @@ void TSSLSocket::initializeHandshakeParams() {
   ssl_ = ctx_->createSSL();
 
   SSL_set_fd(ssl_, static_cast<int>(socket_));
+  SSL_set_app_data(ssl_, this);
+
+  // Resume the last session with the same peer, if there is one
+  if (!server() && !getHost().empty()
+      && (SSL_CTX_get_session_cache_mode(ctx_->get()) & SSL_SESS_CACHE_CLIENT)) {
+    SSL_SESSION* session = ctx_->getSession(getSessionKey());
+    if (session != nullptr) {
+      SSL_set_session(ssl_, session);
+      SSL_SESSION_free(session);
+    }
+  }
 }
 
 bool TSSLSocket::checkHandshake() {
@@ -939,6 +1074,59 @@ void TSSLSocketFactory::setup(std::shared_ptr<TSSLSocket> ssl) {
   }
 }
 
+void TSSLSocketFactory::sessionCache(bool enable) {
+  long mode = SSL_SESS_CACHE_OFF;
+  if (enable) {
+    // Clients look their sessions up by peer rather than by session id
+    mode = server() ? SSL_SESS_CACHE_SERVER
+                    : SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE;
+  }
+  SSL_CTX_set_session_cache_mode(ctx_->get(), mode);
+}
+
+void TSSLSocketFactory::sessionCacheSize(long size) {
+  SSL_CTX_sess_set_cache_size(ctx_->get(), size);
+}
+
+void TSSLSocketFactory::sessionTimeout(long seconds) {
+  SSL_CTX_set_timeout(ctx_->get(), seconds);
+}
+
+void TSSLSocketFactory::sessionTickets(bool enable) {
+  if (enable) {
+    SSL_CTX_clear_options(ctx_->get(), SSL_OP_NO_TICKET);
+  } else {
+    SSL_CTX_set_options(ctx_->get(), SSL_OP_NO_TICKET);
+  }
+}
+
+void TSSLSocketFactory::ticketKeys(const string& keys) {
+  long length = SSL_CTX_get_tlsext_ticket_keys(ctx_->get(), nullptr, 0);
+  if (static_cast<long>(keys.size()) != length) {
+    throw TTransportException(TTransportException::BAD_ARGS,
+                              "ticketKeys: keys must be " + to_string(length) + " bytes");
+  }
+  if (SSL_CTX_set_tlsext_ticket_keys(ctx_->get(), const_cast<char*>(keys.data()), length) != 1) {
+    string errors;
+    buildErrors(errors);
+    throw TSSLException("SSL_CTX_set_tlsext_ticket_keys: " + errors);
+  }
+}
+
+void TSSLSocketFactory::kernelTLS(bool enable) {
+#ifdef SSL_OP_ENABLE_KTLS
+  if (enable) {
+    SSL_CTX_set_options(ctx_->get(), SSL_OP_ENABLE_KTLS);
+  } else {
+    SSL_CTX_clear_options(ctx_->get(), SSL_OP_ENABLE_KTLS);
+  }
+#else
+  if (enable) {
+    throw TSSLException("kernelTLS: not supported by this OpenSSL");
+  }
+#endif
+}
+
 void TSSLSocketFactory::ciphers(const string& enable) {
   int rc = SSL_CTX_set_cipher_list(ctx_->get(), enable.c_str());
   if (ERR_peek_error() != 0) {
@@ -1120,6 +1308,21 @@ int TSSLSocketFactory::passwordCallback(char* password, int size, int, void* dat
   return length;
 }
 
+/**
+ * Caches the sessions of client connections, including those a TLS 1.3
+ * server sends after the handshake.  Returns 1 if it keeps the session.
+ */
+int newSessionCallback(SSL* ssl, SSL_SESSION* session) {
+  auto* socket = static_cast<TSSLSocket*>(SSL_get_app_data(ssl));
+  auto* ctx = static_cast<SSLContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+  if (socket == nullptr || ctx == nullptr || socket->server() || socket->getHost().empty()
+      || !(SSL_CTX_get_session_cache_mode(ctx->get()) & SSL_SESS_CACHE_CLIENT)) {
+    return 0;
+  }
+  ctx->putSession(socket->getSessionKey(), session);
+  return 1;
+}
+
 // extract error messages from error queue
 void buildErrors(string& errors, int errno_copy, int sslerrno) {
   unsigned long errorCode;
@@ -23,6 +23,7 @@
 // Put this first to avoid WIN32 build failure
 #include <thrift/transport/TSocket.h>
 
+#include <map>
 #include <openssl/ssl.h>
 #include <string>
 #include <thrift/concurrency/Mutex.h>
@@ -81,6 +82,10 @@ public:
   uint32_t read(uint8_t* buf, uint32_t len) override;
   void write(const uint8_t* buf, uint32_t len) override;
   uint32_t write_partial(const uint8_t* buf, uint32_t len) override;
+#ifndef _WIN32
+  void writev(const struct iovec* iov, int iovcnt) override;
+  uint32_t writev_partial(const struct iovec* iov, int iovcnt) override;
+#endif
   void flush() override;
   /**
   * Set whether to use client or server side SSL handshake protocol.
@@ -106,6 +111,23 @@ public:
    * Determines whether SSL Socket is libevent safe or not.
    */
   bool isLibeventSafe() const { return eventSafe_; }
+  /**
+   * Determine whether the handshake resumed an earlier session.
+   */
+  bool isSessionReused() const;
+  /**
+   * Determine whether the kernel encrypts what is sent (kTLS).  Writes then
+   * bypass OpenSSL, and gathered writes go to the socket as they are.
+   */
+  bool isKernelTLSSend() const;
+  /**
+   * Determine whether the kernel decrypts what is received (kTLS).
+   */
+  bool isKernelTLSRecv() const;
+  /**
+   * The key client sessions of this socket are cached by: its host and port.
+   */
+  std::string getSessionKey() const;
 
 protected:
   /**
@@ -300,6 +322,50 @@ public:
    * @return true, if server mode, or, false, if client mode
    */
   virtual bool server() const { return server_; }
+  /**
+   * Enable/Disable the session cache, so that reconnecting peers resume their
+   * session with an abbreviated handshake.  A client keeps the last session
+   * of each host and port it connected to; a server, whose cache is on by
+   * default, the sessions of its clients.  Call after server().
+   *
+   * @param enable Cache sessions if true
+   */
+  virtual void sessionCache(bool enable);
+  /**
+   * Set the maximum number of sessions cached, 0 for no limit.
+   *
+   * @param size Maximum number of cached sessions
+   */
+  virtual void sessionCacheSize(long size);
+  /**
+   * Set how long a session may be resumed for.
+   *
+   * @param seconds Session lifetime in seconds
+   */
+  virtual void sessionTimeout(long seconds);
+  /**
+   * Enable/Disable session tickets, with which a server resumes sessions
+   * that are not in its cache, or that another server issued.  On by default.
+   *
+   * @param enable Issue and accept session tickets if true
+   */
+  virtual void sessionTickets(bool enable);
+  /**
+   * Set the keys session tickets are protected with.  Servers that share the
+   * keys resume each other's sessions.  Each server has random keys otherwise.
+   *
+   * @param keys Key material, of the length OpenSSL requires (80 bytes)
+   */
+  virtual void ticketKeys(const std::string& keys);
+  /**
+   * Enable/Disable kernel TLS.  After the handshake, OpenSSL hands the keys
+   * to the kernel, which encrypts and decrypts on the socket, if the kernel
+   * and the negotiated cipher allow it; the connection stays in user space
+   * otherwise.  Needs Linux and OpenSSL 3.0 or later.
+   *
+   * @param enable Offload records to the kernel if true
+   */
+  virtual void kernelTLS(bool enable);
   /**
    * Set AccessManager.
    *
@@ -358,9 +424,21 @@ public:
   virtual ~SSLContext();
   SSL* createSSL();
   SSL_CTX* get() { return ctx_; }
+  /**
+   * Get the cached session of client connections to the given peer, or
+   * nullptr.  The caller must free the session.
+   */
+  SSL_SESSION* getSession(const std::string& key);
+  /**
+   * Cache the session of a client connection to the given peer, in place of
+   * the previous one.  The cache takes over the reference.
+   */
+  void putSession(const std::string& key, SSL_SESSION* session);
 
 private:
   SSL_CTX* ctx_;
+  concurrency::Mutex sessionsMutex_;
+  std::map<std::string, SSL_SESSION*> sessions_;
 };
 
 /**
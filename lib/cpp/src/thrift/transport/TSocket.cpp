@@ -19,8 +19,11 @@
 
 #include <thrift/thrift-config.h>
 
+#include <climits>
 #include <cstring>
+#include <limits>
 #include <sstream>
+#include <vector>
 #ifdef HAVE_SYS_IOCTL_H
 #include <sys/ioctl.h>
 #ifdef __sun
@@ -70,6 +73,10 @@ inline SOCKOPT_CAST_T* cast_sockopt(T* v) {
   return reinterpret_cast<SOCKOPT_CAST_T*>(v);
 }
 
+#if !defined(_WIN32) && !defined(IOV_MAX)
+#define IOV_MAX 1024
+#endif
+
 using std::string;
 
 namespace apache {
@@ -687,6 +694,105 @@ uint32_t TSocket::write_partial(const uint8_t* buf, uint32_t len) {
   return b;
 }
 
+#ifndef _WIN32
+void TSocket::writev(const struct iovec* iov, int iovcnt) {
+  // sendmsg() may stop anywhere, so work on a private copy of the vector
+  // that can be advanced past whatever has already been sent.
+  std::vector<struct iovec> pending(iov, iov + iovcnt);
+  size_t first = 0;
+
+  while (first < pending.size()) {
+    if (pending[first].iov_len == 0) {
+      ++first;
+      continue;
+    }
+    uint32_t b = writev_partial(&pending[first], static_cast<int>(pending.size() - first));
+    if (b == 0) {
+      // This should only happen if the timeout set with SO_SNDTIMEO expired.
+      // Raise an exception.
+      throw TTransportException(TTransportException::TIMED_OUT, "send timeout expired");
+    }
+    while (b > 0) {
+      if (b >= pending[first].iov_len) {
+        b -= static_cast<uint32_t>(pending[first].iov_len);
+        ++first;
+      } else {
+        pending[first].iov_base = static_cast<uint8_t*>(pending[first].iov_base) + b;
+        pending[first].iov_len -= b;
+        b = 0;
+      }
+    }
+  }
+}
+
+uint32_t TSocket::writev_partial(const struct iovec* iov, int iovcnt) {
+  if (socket_ == THRIFT_INVALID_SOCKET) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Called write on non-open socket");
+  }
+
+  if (iovcnt <= 0) {
+    return 0;
+  }
+
+  // Never hand the kernel more than it accepts in one call, nor more bytes
+  // than we can report back.
+  size_t total = 0;
+  int count = 0;
+  while (count < iovcnt && count < IOV_MAX) {
+    if (total + iov[count].iov_len > (std::numeric_limits<uint32_t>::max)()) {
+      break;
+    }
+    total += iov[count].iov_len;
+    ++count;
+  }
+  struct iovec head;
+  if (count == 0) {
+    // The first buffer alone is too large; send as much of it as we can
+    head.iov_base = iov[0].iov_base;
+    head.iov_len = (std::numeric_limits<uint32_t>::max)();
+    iov = &head;
+    total = head.iov_len;
+    count = 1;
+  }
+
+  struct msghdr msg;
+  std::memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = const_cast<struct iovec*>(iov);
+  msg.msg_iovlen = count;
+
+  int flags = 0;
+#ifdef MSG_NOSIGNAL
+  // Note the use of MSG_NOSIGNAL to suppress SIGPIPE errors, instead we
+  // check for the THRIFT_EPIPE return condition and close the socket in that case
+  flags |= MSG_NOSIGNAL;
+#endif // ifdef MSG_NOSIGNAL
+
+  auto b = static_cast<ssize_t>(sendmsg(socket_, &msg, flags));
+
+  if (b < 0) {
+    if (THRIFT_GET_SOCKET_ERROR == THRIFT_EWOULDBLOCK || THRIFT_GET_SOCKET_ERROR == THRIFT_EAGAIN) {
+      return 0;
+    }
+    // Fail on a send error
+    int errno_copy = THRIFT_GET_SOCKET_ERROR;
+    GlobalOutput.perror("TSocket::writev_partial() sendmsg() " + getSocketInfo(), errno_copy);
+
+    if (errno_copy == THRIFT_EPIPE || errno_copy == THRIFT_ECONNRESET
+        || errno_copy == THRIFT_ENOTCONN) {
+      throw TTransportException(TTransportException::NOT_OPEN, "writev() sendmsg()", errno_copy);
+    }
+
+    throw TTransportException(TTransportException::UNKNOWN, "writev() sendmsg()", errno_copy);
+  }
+
+  // Fail on blocked send
+  if (b == 0 && total > 0) {
+    throw TTransportException(TTransportException::NOT_OPEN, "Socket sendmsg returned 0.");
+  }
+  return static_cast<uint32_t>(b);
+}
+#endif
+
 std::string TSocket::getHost() const {
   return host_;
 }
@@ -36,6 +36,9 @@
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
 
 namespace apache {
 namespace thrift {
@@ -136,6 +139,20 @@ public:
    */
   virtual uint32_t write_partial(const uint8_t* buf, uint32_t len);
 
+#ifndef _WIN32
+  /**
+   * Writes a sequence of buffers to the underlying socket, gathering them
+   * into as few sendmsg() calls as possible.  Loops until done or fail.
+   */
+  virtual void writev(const struct iovec* iov, int iovcnt);
+
+  /**
+   * Gathers a sequence of buffers into a single sendmsg() and returns the
+   * number of bytes sent.  At most IOV_MAX buffers are sent per call.
+   */
+  virtual uint32_t writev_partial(const struct iovec* iov, int iovcnt);
+#endif
+
   /**
    * Get the host that the socket is connected to
    *
@@ -238,6 +238,21 @@ public:
     throw TTransportException(TTransportException::NOT_OPEN, "Base TTransport cannot consume.");
   }
 
+  /**
+   * Keeps the memory handed out by borrow() valid beyond the next read.
+   *
+   * Protocols use this to return slices that point straight into the
+   * receive buffer instead of copying out of it.  While the returned handle
+   * (or any copy of it) is alive, the transport must neither free nor
+   * overwrite the buffer that borrow() currently returns pointers into;
+   * it allocates a fresh one for subsequent data instead.
+   *
+   * @return A handle owning the current read buffer, or nullptr if this
+   *         transport cannot give that guarantee.  Callers then have to
+   *         copy what they borrowed.
+   */
+  virtual std::shared_ptr<const void> pinReadBuffer() { return nullptr; }
+
   /**
    * Returns the origin of the transports call. The value depends on the
    * transport used. An IP based transport for example will return the
@@ -17,228 +17,594 @@
  * under the License.
  */
 
-#ifdef HAVE_CONFIG_H
-#include <config.h>
-#endif
+/**
+ * Protocol and transport microbenchmarks.
+ *
+ * Every benchmark is named <op>/<protocol>/<transport>/<payload>, where op
+ * is "encode" (write a message and flush it through the transport) or
+ * "decode" (read it back).  Each op is timed on its own, so besides the
+ * mean the results give the p50 and p99 latency, and the heap allocations
+ * it made.
+ *
+ * Usage: Benchmark [--filter=<regex>] [--min_time=<seconds>]
+ *                  [--format=console|json] [--out=<file>]
+ *                  [--baseline=<json file> [--threshold=<percent>]]
+ *
+ * With --baseline, the p50 of each benchmark is compared to the one in a
+ * file written earlier with --format=json, and the exit status is 1 if any
+ * got slower by more than the threshold (10% by default).
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
 #include <iostream>
-#define _USE_MATH_DEFINES
-#include <math.h>
+#include <map>
 #include <memory>
-#include "thrift/protocol/TBinaryProtocol.h"
-#include "thrift/transport/TBufferTransports.h"
-#include "gen-cpp/DebugProtoTest_types.h"
-
-#ifdef HAVE_SYS_TIME_H
-#include <sys/time.h>
+#include <new>
+#include <regex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/protocol/TJSONProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#ifdef BENCHMARK_WITH_ZLIB
+#include <thrift/protocol/THeaderProtocol.h>
+#include <thrift/transport/THeaderTransport.h>
+#include <thrift/transport/TZlibTransport.h>
 #endif
+#include "gen-cpp/DebugProtoTest_types.h"
+#include "gen-cpp/Recursive_types.h"
 
-class Timer {
-public:
-  timeval vStart;
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::transport;
+using std::shared_ptr;
+using std::string;
 
-  Timer() { THRIFT_GETTIMEOFDAY(&vStart, nullptr); }
-  void start() { THRIFT_GETTIMEOFDAY(&vStart, nullptr); }
+// Counts heap allocations, so each op can report how many it made
+static std::atomic<uint64_t> allocations(0);
 
-  double frame() {
-    timeval vEnd;
-    THRIFT_GETTIMEOFDAY(&vEnd, nullptr);
-    double dstart = vStart.tv_sec + ((double)vStart.tv_usec / 1000000.0);
-    double dend = vEnd.tv_sec + ((double)vEnd.tv_usec / 1000000.0);
-    return dend - dstart;
+void* operator new(size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  void* p = std::malloc(size ? size : 1);
+  if (!p) {
+    throw std::bad_alloc();
   }
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * A writer and a reader protocol, each with its own transport stack over the
+ * same memory buffer.
+ */
+struct Stack {
+  shared_ptr<TMemoryBuffer> wire;
+  shared_ptr<TProtocol> writer;
+  shared_ptr<TProtocol> reader;
 };
 
-int main() {
-  using namespace thrift::test::debug;
-  using namespace apache::thrift::transport;
-  using namespace apache::thrift::protocol;
-  using std::cout;
-  using std::endl;
+typedef std::function<Stack()> StackFactory;
+
+template <typename Protocol>
+StackFactory memoryStack() {
+  return [] {
+    Stack stack;
+    stack.wire.reset(new TMemoryBuffer());
+    stack.writer.reset(new Protocol(stack.wire));
+    stack.reader.reset(new Protocol(stack.wire));
+    return stack;
+  };
+}
+
+template <typename Transport>
+StackFactory layeredStack() {
+  return [] {
+    Stack stack;
+    stack.wire.reset(new TMemoryBuffer());
+    stack.writer.reset(new TBinaryProtocol(std::make_shared<Transport>(stack.wire)));
+    stack.reader.reset(new TBinaryProtocol(std::make_shared<Transport>(stack.wire)));
+    return stack;
+  };
+}
 
-  OneOfEach ooe;
+#ifdef BENCHMARK_WITH_ZLIB
+StackFactory headerStack(bool zlib) {
+  return [zlib] {
+    Stack stack;
+    stack.wire.reset(new TMemoryBuffer());
+    shared_ptr<THeaderProtocol> writer(new THeaderProtocol(stack.wire, T_BINARY_PROTOCOL));
+    if (zlib) {
+      std::static_pointer_cast<THeaderTransport>(writer->getTransport())
+          ->setTransform(THeaderTransport::ZLIB_TRANSFORM);
+    }
+    stack.writer = writer;
+    stack.reader.reset(new THeaderProtocol(stack.wire, T_BINARY_PROTOCOL));
+    return stack;
+  };
+}
+#endif
+
+/**
+ * A payload shape: writes its struct, or reads it into a reused instance.
+ */
+struct Payload {
+  std::function<void(TProtocol*)> write;
+  std::function<void(TProtocol*)> read;
+};
+
+template <typename Struct>
+Payload makePayload(const Struct& value) {
+  shared_ptr<Struct> source(new Struct(value));
+  shared_ptr<Struct> target(new Struct());
+  Payload payload;
+  payload.write = [source](TProtocol* prot) { source->write(prot); };
+  payload.read = [target](TProtocol* prot) { target->read(prot); };
+  return payload;
+}
+
+thrift::test::debug::OneOfEach smallStruct() {
+  thrift::test::debug::OneOfEach ooe;
   ooe.im_true = true;
   ooe.im_false = false;
   ooe.a_bite = 0x7f;
   ooe.integer16 = 27000;
   ooe.integer32 = 1 << 24;
   ooe.integer64 = (uint64_t)6000 * 1000 * 1000;
-  ooe.double_precision = M_PI;
+  ooe.double_precision = 3.14159265358979323846;
   ooe.some_characters = "JSON THIS! \"\1";
   ooe.zomg_unicode = "\xd7\n\a\t";
   ooe.base64 = "\1\2\3\255";
+  return ooe;
+}
 
-  int num = 100000;
-  std::shared_ptr<TMemoryBuffer> buf(new TMemoryBuffer(num*1000));
-
-  uint8_t* data = nullptr;
-  uint32_t datasize = 0;
+// Some fifty fields, most of them containers
+thrift::test::debug::CompactProtoTestStruct wideStruct() {
+  thrift::test::debug::CompactProtoTestStruct wide;
+  wide.a_byte = 127;
+  wide.a_i16 = 32000;
+  wide.a_i32 = 1000000000;
+  wide.a_i64 = 0xffffffffffLL;
+  wide.a_double = 5.6789;
+  wide.a_string = "my string";
+  wide.a_binary = "\1\2\3\4";
+  wide.true_field = true;
+  wide.false_field = false;
+  for (int8_t i = 0; i < 8; ++i) {
+    wide.byte_list.push_back(i);
+    wide.i32_list.push_back(i * 100000);
+    wide.string_list.push_back("element");
+    wide.i32_byte_map[i * 1000] = i;
+  }
+  return wide;
+}
 
-  {
-    buf->resetBuffer();
-    TBinaryProtocolT<TMemoryBuffer> prot(buf);
-    double elapsed = 0.0;
-    Timer timer;
+RecTree deepStruct(int depth) {
+  RecTree tree;
+  tree.item = static_cast<int16_t>(depth);
+  if (depth > 1) {
+    tree.children.push_back(deepStruct(depth - 1));
+  }
+  return tree;
+}
 
-    for (int i = 0; i < num; i++) {
-      ooe.write(&prot);
-    }
-    elapsed = timer.frame();
-    cout << "Write big endian: " << num / (1000 * elapsed) << " kHz" << endl;
+thrift::test::debug::Bonk stringStruct(size_t size) {
+  thrift::test::debug::Bonk bonk;
+  bonk.type = 1;
+  for (size_t i = 0; i < size; ++i) {
+    bonk.message += static_cast<char>('a' + i % 26);
   }
+  return bonk;
+}
 
-  buf->getBuffer(&data, &datasize);
+thrift::test::debug::ListDoublePerf listStruct(int size) {
+  thrift::test::debug::ListDoublePerf list;
+  for (int i = 0; i < size; ++i) {
+    list.field.push_back(i * 1.5);
+  }
+  return list;
+}
 
-  {
-    std::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
-    TBinaryProtocolT<TMemoryBuffer> prot(buf2);
-    OneOfEach ooe2;
-    double elapsed = 0.0;
-    Timer timer;
-
-    for (int i = 0; i < num; i++) {
-      ooe2.read(&prot);
-    }
-    elapsed = timer.frame();
-    cout << " Read big endian: " << num / (1000 * elapsed) << " kHz" << endl;
+thrift::test::debug::SingleMapTestStruct mapStruct(int size) {
+  thrift::test::debug::SingleMapTestStruct map;
+  for (int i = 0; i < size; ++i) {
+    map.i32_map[i * 7919] = i;
   }
+  return map;
+}
 
-  {
-    buf->resetBuffer();
-    TBinaryProtocolT<TMemoryBuffer, TNetworkLittleEndian> prot(buf);
-    double elapsed = 0.0;
-    Timer timer;
+/**
+ * One benchmark: setup runs untimed before each op.
+ */
+struct Benchmark {
+  string name;
+  std::function<void()> setup;
+  std::function<void()> op;
+  std::function<uint64_t()> bytesPerOp;
+};
+
+struct Result {
+  string name;
+  uint64_t iterations;
+  uint64_t bytesPerOp;
+  double meanNs;
+  double p50Ns;
+  double p99Ns;
+  double allocsPerOp;
+};
 
-    for (int i = 0; i < num; i++) {
-      ooe.write(&prot);
+void addMessageBenchmarks(std::vector<Benchmark>& benchmarks,
+                          const string& protocol,
+                          const string& transport,
+                          const StackFactory& factory,
+                          const string& payloadName,
+                          const Payload& payload) {
+  // Separate stacks, as the encode benchmark leaves its writer far ahead of
+  // any reader
+  shared_ptr<Stack> encodeStack(new Stack(factory()));
+  shared_ptr<Stack> decodeStack(new Stack(factory()));
+  shared_ptr<uint64_t> bytes(new uint64_t(0));
+
+  auto encode = [payload](Stack& stack) {
+    TProtocol* prot = stack.writer.get();
+    prot->writeMessageBegin("bench", T_CALL, 0);
+    payload.write(prot);
+    prot->writeMessageEnd();
+    prot->getTransport()->writeEnd();
+    prot->getTransport()->flush();
+  };
+  auto decode = [decodeStack, payload] {
+    TProtocol* prot = decodeStack->reader.get();
+    string name;
+    TMessageType type;
+    int32_t seqid;
+    prot->readMessageBegin(name, type, seqid);
+    payload.read(prot);
+    prot->readMessageEnd();
+    prot->getTransport()->readEnd();
+  };
+
+
+  Benchmark encodeBenchmark;
+  encodeBenchmark.name = "encode/" + protocol + "/" + transport + "/" + payloadName;
+  // Nothing reads the messages, so drop each before the next
+  encodeBenchmark.setup = [encodeStack, bytes] {
+    if (encodeStack->wire->available_read()) {
+      *bytes = encodeStack->wire->available_read();
     }
-    elapsed = timer.frame();
-    cout << "Write little endian: " << num / (1000 * elapsed) << " kHz" << endl;
-  }
+    encodeStack->wire->resetBuffer();
+  };
+  encodeBenchmark.op = [encodeStack, encode] { encode(*encodeStack); };
+  encodeBenchmark.bytesPerOp = [bytes] { return *bytes; };
+  benchmarks.push_back(encodeBenchmark);
+
+  Benchmark decodeBenchmark;
+  decodeBenchmark.name = "decode/" + protocol + "/" + transport + "/" + payloadName;
+  decodeBenchmark.setup = [decodeStack, encode, bytes] {
+    decodeStack->wire->resetBuffer();
+    encode(*decodeStack);
+    *bytes = decodeStack->wire->available_read();
+  };
+  decodeBenchmark.op = decode;
+  decodeBenchmark.bytesPerOp = [bytes] { return *bytes; };
+  benchmarks.push_back(decodeBenchmark);
+}
 
+// Compact lists of varints of every length, read element by element and in bulk
+void addCompactArrayBenchmarks(std::vector<Benchmark>& benchmarks) {
+  const uint32_t count = 4096;
+  shared_ptr<TMemoryBuffer> wire(new TMemoryBuffer());
   {
-    OneOfEach ooe2;
-    std::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
-    TBinaryProtocolT<TMemoryBuffer, TNetworkLittleEndian> prot(buf2);
-    double elapsed = 0.0;
-    Timer timer;
-
-    for (int i = 0; i < num; i++) {
-      ooe2.read(&prot);
+    TCompactProtocolT<TMemoryBuffer> prot(wire);
+    prot.writeListBegin(T_I64, count);
+    for (uint32_t x = 0; x < count; ++x) {
+      prot.writeI64(static_cast<int64_t>((x * 2654435761ULL) >> (x % 64)));
     }
-    elapsed = timer.frame();
-    cout << " Read little endian: " << num / (1000 * elapsed) << " kHz" << endl;
+    prot.writeListEnd();
   }
+  shared_ptr<string> encoded(new string(wire->getBufferAsString()));
+  shared_ptr<TCompactProtocolT<TMemoryBuffer> > prot(new TCompactProtocolT<TMemoryBuffer>(wire));
+  shared_ptr<std::vector<int64_t> > values(new std::vector<int64_t>(count));
+
+  auto setup = [wire, encoded] {
+    wire->resetBuffer((uint8_t*)&(*encoded)[0], static_cast<uint32_t>(encoded->size()));
+  };
+  auto bytes = [encoded] { return static_cast<uint64_t>(encoded->size()); };
+
+  Benchmark single;
+  single.name = "decode/compact/memory/i64_list";
+  single.setup = setup;
+  single.op = [prot, values] {
+    TType type;
+    uint32_t size;
+    prot->readListBegin(type, size);
+    for (uint32_t x = 0; x < size; ++x) {
+      prot->readI64((*values)[x]);
+    }
+    prot->readListEnd();
+  };
+  single.bytesPerOp = bytes;
+  benchmarks.push_back(single);
+
+  Benchmark bulk;
+  bulk.name = "decode/compact/memory/i64_list_bulk";
+  bulk.setup = setup;
+  bulk.op = [prot, values] {
+    TType type;
+    uint32_t size;
+    prot->readListBegin(type, size);
+    prot->readI64Array(&(*values)[0], size);
+    prot->readListEnd();
+  };
+  bulk.bytesPerOp = bytes;
+  benchmarks.push_back(bulk);
+}
 
-  {
-    buf->resetBuffer();
-    TBinaryProtocolT<TMemoryBuffer> prot(buf);
-    double elapsed = 0.0;
-    Timer timer;
+std::vector<Benchmark> allBenchmarks() {
+  std::vector<std::pair<string, Payload> > payloads;
+  payloads.push_back(std::make_pair("small", makePayload(smallStruct())));
+  payloads.push_back(std::make_pair("wide", makePayload(wideStruct())));
+  payloads.push_back(std::make_pair("deep", makePayload(deepStruct(64))));
+  payloads.push_back(std::make_pair("string_64k", makePayload(stringStruct(64 * 1024))));
+  payloads.push_back(std::make_pair("double_list", makePayload(listStruct(4096))));
+  payloads.push_back(std::make_pair("i32_map", makePayload(mapStruct(1024))));
+
+  struct Stacks {
+    string protocol;
+    string transport;
+    StackFactory factory;
+  };
+  std::vector<Stacks> stacks;
+  stacks.push_back({"binary", "memory", memoryStack<TBinaryProtocol>()});
+  stacks.push_back({"compact", "memory", memoryStack<TCompactProtocol>()});
+  stacks.push_back({"json", "memory", memoryStack<TJSONProtocol>()});
+  stacks.push_back({"binary", "framed", layeredStack<TFramedTransport>()});
+  stacks.push_back({"binary", "buffered", layeredStack<TBufferedTransport>()});
+#ifdef BENCHMARK_WITH_ZLIB
+  stacks.push_back({"binary", "zlib", layeredStack<TZlibTransport>()});
+  stacks.push_back({"header", "header", headerStack(false)});
+  stacks.push_back({"header", "header_zlib", headerStack(true)});
+#endif
 
-    for (int i = 0; i < num; i++) {
-      ooe.write(&prot);
+  std::vector<Benchmark> benchmarks;
+  for (const auto& stack : stacks) {
+    for (const auto& payload : payloads) {
+      addMessageBenchmarks(benchmarks,
+                           stack.protocol,
+                           stack.transport,
+                           stack.factory,
+                           payload.first,
+                           payload.second);
     }
-    elapsed = timer.frame();
-    cout << "Write big endian: " << num / (1000 * elapsed) << " kHz" << endl;
   }
+  addCompactArrayBenchmarks(benchmarks);
+  return benchmarks;
+}
 
-  {
-    std::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
-    TBinaryProtocolT<TMemoryBuffer> prot(buf2);
-    OneOfEach ooe2;
-    double elapsed = 0.0;
-    Timer timer;
-
-    for (int i = 0; i < num; i++) {
-      ooe2.read(&prot);
-    }
-    elapsed = timer.frame();
-    cout << " Read big endian: " << num / (1000 * elapsed) << " kHz" << endl;
+Result run(const Benchmark& benchmark, double minTime) {
+  // Warm up caches and buffers, and make sure the op works at all
+  for (int i = 0; i < 10; ++i) {
+    benchmark.setup();
+    benchmark.op();
   }
 
-
-  data = nullptr;
-  datasize = 0;
-  num = 10000000;
-
-  ListDoublePerf listDoublePerf;
-  listDoublePerf.field.reserve(num);
-  for (int x = 0; x < num; ++x)
-    listDoublePerf.field.push_back(double(x));
-
-  buf.reset(new TMemoryBuffer(num * 100));
-
-  {
-    buf->resetBuffer();
-    TBinaryProtocolT<TMemoryBuffer> prot(buf);
-    double elapsed = 0.0;
-    Timer timer;
-
-    listDoublePerf.write(&prot);
-    elapsed = timer.frame();
-    cout << "Double write big endian: " << num / (1000 * elapsed) << " kHz" << endl;
+  std::vector<double> samples;
+  uint64_t allocated = 0;
+  const auto deadline = Clock::now() + std::chrono::duration<double>(minTime);
+  do {
+    benchmark.setup();
+    uint64_t before = allocations.load(std::memory_order_relaxed);
+    auto start = Clock::now();
+    benchmark.op();
+    auto end = Clock::now();
+    allocated += allocations.load(std::memory_order_relaxed) - before;
+    samples.push_back(std::chrono::duration<double, std::nano>(end - start).count());
+  } while (samples.size() < 10 || (Clock::now() < deadline && samples.size() < 10000000));
+
+  Result result;
+  result.name = benchmark.name;
+  result.iterations = samples.size();
+  result.bytesPerOp = benchmark.bytesPerOp();
+  double total = 0;
+  for (double sample : samples) {
+    total += sample;
   }
+  result.meanNs = total / samples.size();
+  std::sort(samples.begin(), samples.end());
+  result.p50Ns = samples[samples.size() / 2];
+  result.p99Ns = samples[std::min(samples.size() - 1, samples.size() * 99 / 100)];
+  result.allocsPerOp = static_cast<double>(allocated) / samples.size();
+  return result;
+}
 
-  buf->getBuffer(&data, &datasize);
-
-  {
-    std::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
-    TBinaryProtocolT<TMemoryBuffer> prot(buf2);
-    ListDoublePerf listDoublePerf2;
-    double elapsed = 0.0;
-    Timer timer;
+double bytesPerSecond(const Result& result) {
+  return result.bytesPerOp * 1e9 / result.meanNs;
+}
 
-    listDoublePerf2.read(&prot);
-    elapsed = timer.frame();
-    cout << " Double read big endian: " << num / (1000 * elapsed) << " kHz" << endl;
+void printConsole(std::ostream& out, const std::vector<Result>& results) {
+  char line[256];
+  snprintf(line, sizeof(line), "%-44s %10s %10s %10s %12s %9s %10s\n", "Benchmark",
+           "p50 ns", "p99 ns", "mean ns", "MB/s", "allocs", "iterations");
+  out << line;
+  for (const Result& result : results) {
+    snprintf(line, sizeof(line), "%-44s %10.0f %10.0f %10.0f %12.1f %9.1f %10llu\n",
+             result.name.c_str(), result.p50Ns, result.p99Ns, result.meanNs,
+             bytesPerSecond(result) / 1e6, result.allocsPerOp,
+             static_cast<unsigned long long>(result.iterations));
+    out << line;
   }
+}
 
-  {
-    buf->resetBuffer();
-    TBinaryProtocolT<TMemoryBuffer, TNetworkLittleEndian> prot(buf);
-    double elapsed = 0.0;
-    Timer timer;
-
-    listDoublePerf.write(&prot);
-    elapsed = timer.frame();
-    cout << "Double write little endian: " << num / (1000 * elapsed) << " kHz" << endl;
+// One benchmark per line, so that readBaseline() doesn't need a JSON parser
+void printJSON(std::ostream& out, const std::vector<Result>& results) {
+  char date[64];
+  time_t now = time(nullptr);
+  strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+
+  out << "{\n";
+  out << "  \"context\": {\"date\": \"" << date << "\", \"num_cpus\": "
+      << std::thread::hardware_concurrency() << "},\n";
+  out << "  \"benchmarks\": [\n";
+  char line[512];
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& result = results[i];
+    snprintf(line, sizeof(line),
+             "    {\"name\": \"%s\", \"iterations\": %llu, \"bytes_per_op\": %llu, "
+             "\"mean_ns\": %.1f, \"p50_ns\": %.1f, \"p99_ns\": %.1f, "
+             "\"bytes_per_second\": %.0f, \"items_per_second\": %.0f, "
+             "\"allocs_per_op\": %.2f}%s\n",
+             result.name.c_str(), static_cast<unsigned long long>(result.iterations),
+             static_cast<unsigned long long>(result.bytesPerOp), result.meanNs, result.p50Ns,
+             result.p99Ns, bytesPerSecond(result), 1e9 / result.meanNs, result.allocsPerOp,
+             i + 1 < results.size() ? "," : "");
+    out << line;
   }
+  out << "  ]\n}\n";
+}
 
-  {
-    ListDoublePerf listDoublePerf2;
-    std::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
-    TBinaryProtocolT<TMemoryBuffer, TNetworkLittleEndian> prot(buf2);
-    double elapsed = 0.0;
-    Timer timer;
+// Reads the p50 of each benchmark from the output of printJSON()
+std::map<string, double> readBaseline(const string& path) {
+  std::map<string, double> baseline;
+  std::ifstream in(path.c_str());
+  if (!in) {
+    throw std::runtime_error("cannot read baseline " + path);
+  }
+  const std::regex name("\"name\": \"([^\"]*)\"");
+  const std::regex p50("\"p50_ns\": ([0-9.eE+-]+)");
+  string line;
+  while (std::getline(in, line)) {
+    std::smatch nameMatch;
+    std::smatch p50Match;
+    if (std::regex_search(line, nameMatch, name) && std::regex_search(line, p50Match, p50)) {
+      baseline[nameMatch[1]] = std::atof(p50Match[1].str().c_str());
+    }
+  }
+  return baseline;
+}
 
-    listDoublePerf2.read(&prot);
-    elapsed = timer.frame();
-    cout << " Double read little endian: " << num / (1000 * elapsed) << " kHz" << endl;
+// Returns the number of benchmarks slower than the baseline by more than threshold
+int compare(const std::vector<Result>& results,
+            const std::map<string, double>& baseline,
+            double threshold) {
+  int regressions = 0;
+  for (const Result& result : results) {
+    auto old = baseline.find(result.name);
+    if (old == baseline.end() || old->second <= 0) {
+      continue;
+    }
+    double change = (result.p50Ns - old->second) * 100 / old->second;
+    if (change > threshold) {
+      char line[256];
+      snprintf(line, sizeof(line), "REGRESSION %-44s p50 %.0f ns -> %.0f ns (%+.1f%%)\n",
+               result.name.c_str(), old->second, result.p50Ns, change);
+      std::cerr << line;
+      ++regressions;
+    }
   }
+  return regressions;
+}
 
-  {
-    buf->resetBuffer();
-    TBinaryProtocolT<TMemoryBuffer> prot(buf);
-    double elapsed = 0.0;
-    Timer timer;
+bool option(const string& arg, const char* name, string& value) {
+  string prefix = string("--") + name + "=";
+  if (arg.compare(0, prefix.size(), prefix) != 0) {
+    return false;
+  }
+  value = arg.substr(prefix.size());
+  return true;
+}
 
-    listDoublePerf.write(&prot);
-    elapsed = timer.frame();
-    cout << "Double write big endian: " << num / (1000 * elapsed) << " kHz" << endl;
+} // namespace
+
+int main(int argc, char** argv) {
+  string filter;
+  string format = "console";
+  string outPath;
+  string baselinePath;
+  double minTime = 0.2;
+  double threshold = 10;
+
+  for (int i = 1; i < argc; ++i) {
+    string arg = argv[i];
+    string value;
+    if (option(arg, "filter", value)) {
+      filter = value;
+    } else if (option(arg, "min_time", value)) {
+      minTime = std::atof(value.c_str());
+    } else if (option(arg, "format", value) && (value == "console" || value == "json")) {
+      format = value;
+    } else if (option(arg, "out", value)) {
+      outPath = value;
+    } else if (option(arg, "baseline", value)) {
+      baselinePath = value;
+    } else if (option(arg, "threshold", value)) {
+      threshold = std::atof(value.c_str());
+    } else {
+      std::cerr << "Usage: " << argv[0]
+                << " [--filter=<regex>] [--min_time=<seconds>] [--format=console|json]"
+                   " [--out=<file>] [--baseline=<json file> [--threshold=<percent>]]"
+                << std::endl;
+      return 2;
+    }
   }
 
-  {
-    std::shared_ptr<TMemoryBuffer> buf2(new TMemoryBuffer(data, datasize));
-    TBinaryProtocolT<TMemoryBuffer> prot(buf2);
-    ListDoublePerf listDoublePerf2;
-    double elapsed = 0.0;
-    Timer timer;
+  try {
+    std::map<string, double> baseline;
+    if (!baselinePath.empty()) {
+      baseline = readBaseline(baselinePath);
+    }
 
-    listDoublePerf2.read(&prot);
-    elapsed = timer.frame();
-    cout << " Double read big endian: " << num / (1000 * elapsed) << " kHz" << endl;
-  }
+    const std::regex pattern(filter);
+    std::vector<Result> results;
+    for (const Benchmark& benchmark : allBenchmarks()) {
+      if (filter.empty() || std::regex_search(benchmark.name, pattern)) {
+        results.push_back(run(benchmark, minTime));
+      }
+    }
 
+    std::ofstream file;
+    if (!outPath.empty()) {
+      file.open(outPath.c_str());
+      if (!file) {
+        throw std::runtime_error("cannot write " + outPath);
+      }
+    }
+    std::ostream& out = outPath.empty() ? std::cout : file;
+    if (format == "json") {
+      printJSON(out, results);
+    } else {
+      printConsole(out, results);
+    }
 
+    if (!baseline.empty() && compare(results, baseline, threshold) > 0) {
+      return 1;
+    }
+  } catch (const std::exception& e) {
+    std::cerr << "Benchmark failed: " << e.what() << std::endl;
+    return 1;
+  }
   return 0;
 }
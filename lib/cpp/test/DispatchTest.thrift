@@ -0,0 +1,38 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+namespace cpp dispatchtest
+
+// For use in TDispatchProcessorTest.cpp
+struct Point {
+  1: string name,
+  4: byte tag,
+  9: i32 x,
+  11: i64 y
+}
+
+service Base {
+  i32 Janky(1: i32 arg),
+  void reversed(4: string first, 3: i16 second, 2: i32 third, 1: i64 fourth)
+}
+
+service Derived extends Base {
+  i32 identity(1: i32 arg)
+}
@@ -19,7 +19,9 @@
 
 #define _USE_MATH_DEFINES
 #include <cmath>
+#include <cstring>
 #include <iomanip>
+#include <limits>
 #include <sstream>
 #include <thrift/protocol/TJSONProtocol.h>
 #include <memory>
@@ -350,3 +352,87 @@ BOOST_AUTO_TEST_CASE(test_json_unicode_escaped_missing_hi_surrogate) {
   BOOST_CHECK_THROW(ooe2.read(proto.get()),
     apache::thrift::protocol::TProtocolException);
 }
+
+BOOST_AUTO_TEST_CASE(test_json_long_strings) {
+  // Characters that need escaping on either side of 16 byte boundaries
+  std::string str;
+  for (int i = 0; i < 200; ++i) {
+    str += std::string(i % 19, 'a');
+    str += (i % 3 == 0 ? '"' : (i % 3 == 1 ? '\\' : static_cast<char>(i % 31 + 1)));
+  }
+  std::string binary;
+  for (int i = 0; i < 1000; ++i) {
+    binary += static_cast<char>(i * 7);
+  }
+
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  std::shared_ptr<TJSONProtocol> proto(new TJSONProtocol(buffer));
+  proto->writeString(str);
+  proto->writeBinary(binary);
+
+  std::string str2;
+  std::string binary2;
+  proto->readString(str2);
+  proto->readBinary(binary2);
+  BOOST_CHECK(str == str2);
+  BOOST_CHECK(binary == binary2);
+  BOOST_CHECK_EQUAL(0u, buffer->available_read());
+}
+
+BOOST_AUTO_TEST_CASE(test_json_integer_range) {
+  const char* json_strings[] = {"{\"1\":{\"tf\":2}}",
+                                "{\"1\":{\"tf\":-1}}",
+                                "{\"4\":{\"i16\":32768}}",
+                                "{\"5\":{\"i32\":-2147483649}}",
+                                "{\"6\":{\"i64\":9223372036854775808}}",
+                                "{\"6\":{\"i64\":1-2}}"};
+
+  for (const char* json_string : json_strings) {
+    std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(
+      (uint8_t*)(json_string), static_cast<uint32_t>(strlen(json_string))));
+    std::shared_ptr<TJSONProtocol> proto(new TJSONProtocol(buffer));
+
+    OneOfEach ooe2;
+    BOOST_CHECK_THROW(ooe2.read(proto.get()),
+      apache::thrift::protocol::TProtocolException);
+  }
+
+  const char json_string[] =
+  "{\"4\":{\"i16\":-32768},\"5\":{\"i32\":-2147483648},"
+  "\"6\":{\"i64\":-9223372036854775808}}";
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer(
+    (uint8_t*)(json_string), sizeof(json_string)));
+  std::shared_ptr<TJSONProtocol> proto(new TJSONProtocol(buffer));
+
+  OneOfEach ooe2;
+  ooe2.read(proto.get());
+  BOOST_CHECK_EQUAL(-32768, ooe2.integer16);
+  BOOST_CHECK_EQUAL((std::numeric_limits<int32_t>::min)(), ooe2.integer32);
+  BOOST_CHECK_EQUAL((std::numeric_limits<int64_t>::min)(), ooe2.integer64);
+}
+
+BOOST_AUTO_TEST_CASE(test_json_double_round_trip) {
+  const double values[] = {0.1, -2.5, 1e22, 123456789.125, 4.35, 1e23,
+                           5e-324, 1.7976931348623157e308, -0.0};
+
+  std::shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  std::shared_ptr<TJSONProtocol> proto(new TJSONProtocol(buffer));
+  const uint32_t count = sizeof(values) / sizeof(values[0]);
+  proto->writeListBegin(apache::thrift::protocol::T_DOUBLE, count);
+  for (double value : values) {
+    proto->writeDouble(value);
+  }
+  proto->writeListEnd();
+
+  apache::thrift::protocol::TType type;
+  uint32_t size;
+  proto->readListBegin(type, size);
+  BOOST_REQUIRE_EQUAL(count, size);
+  for (double value : values) {
+    double value2;
+    proto->readDouble(value2);
+    BOOST_CHECK_EQUAL(value, value2);
+    BOOST_CHECK_EQUAL(std::signbit(value), std::signbit(value2));
+  }
+  proto->readListEnd();
+}
@@ -0,0 +1,38 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+namespace cpp pooledtest
+
+// Generated with cpp:pooled_args, for use in TPooledTest.cpp
+struct Batch {
+  1: list<string> names,
+  2: map<i32, string> values,
+  3: optional string note,
+  4: string label = "unlabeled",
+  5: i32 priority = 3
+}
+
+exception Rejected {
+  1: string reason
+}
+
+service PooledService {
+  i32 submit(1: Batch batch, 2: optional i64 deadline) throws (1: Rejected rejected)
+}
@@ -0,0 +1,217 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <string>
+#include <thrift/TArena.h>
+#include <thrift/TToString.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/ArenaService.h"
+
+BOOST_AUTO_TEST_SUITE(TArenaTest)
+
+using apache::thrift::TArena;
+using apache::thrift::TArenaAllocator;
+using apache::thrift::TArenaScope;
+using apache::thrift::TArenaString;
+using apache::thrift::TArenaVector;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using std::shared_ptr;
+
+static arenatest::Request makeRequest() {
+  arenatest::Request request;
+  for (int i = 0; i < 20; ++i) {
+    arenatest::Item item;
+    std::string name = "item number " + std::to_string(i) + " with a name too long for SSO";
+    item.name.assign(name.data(), name.size());
+    item.data.assign(static_cast<size_t>(i) * 10, static_cast<char>(i));
+    for (int j = 0; j < i; ++j) {
+      item.values.push_back(static_cast<int64_t>(j) << 40);
+      item.flags.push_back(j % 3 == 0);
+    }
+    item.plain = "plain";
+    request.items.push_back(item);
+    request.tags[item.name].insert("tag");
+  }
+  return request;
+}
+
+BOOST_AUTO_TEST_CASE(test_allocate) {
+  TArena arena(64);
+  void* a = arena.allocate(1, 1);
+  void* b = arena.allocate(8, 8);
+  BOOST_CHECK_EQUAL(0u, reinterpret_cast<uintptr_t>(b) % 8);
+  BOOST_CHECK(a != b);
+
+  // Only the last allocation can be handed back.
+  size_t before = arena.bytesAllocated();
+  arena.deallocate(a, 1);
+  BOOST_CHECK_EQUAL(before, arena.bytesAllocated());
+  arena.deallocate(b, 8);
+  BOOST_CHECK_EQUAL(before - 8, arena.bytesAllocated());
+  BOOST_CHECK(arena.allocate(8, 8) == b);
+
+  // Larger than any block.
+  char* big = static_cast<char*>(arena.allocate(100000, 16));
+  big[0] = big[99999] = 1;
+  BOOST_CHECK_EQUAL(0u, reinterpret_cast<uintptr_t>(big) % 16);
+  // The current block is still used after an oversized allocation.
+  void* c = arena.allocate(8, 8);
+  BOOST_CHECK_EQUAL(static_cast<char*>(b) + 8, static_cast<char*>(c));
+
+  arena.reset();
+  BOOST_CHECK_EQUAL(0u, arena.bytesAllocated());
+}
+
+BOOST_AUTO_TEST_CASE(test_reset_reuses_memory) {
+  TArena arena(256);
+  for (int i = 0; i < 100; ++i) {
+    arena.allocate(100);
+  }
+  arena.reset();
+  // Everything should now fit into the single block kept by reset().
+  void* first = arena.allocate(100);
+  for (int i = 0; i < 99; ++i) {
+    arena.allocate(100);
+  }
+  arena.reset();
+  BOOST_CHECK(arena.allocate(100) == first);
+}
+
+BOOST_AUTO_TEST_CASE(test_scopes) {
+  BOOST_CHECK(TArena::current() == nullptr);
+  {
+    TArenaScope outer;
+    TArena* request = TArena::current();
+    BOOST_REQUIRE(request != nullptr);
+    {
+      TArenaScope nested;
+      BOOST_CHECK(TArena::current() == request);
+      {
+        TArenaScope heap(nullptr);
+        BOOST_CHECK(TArena::current() == nullptr);
+      }
+      BOOST_CHECK(TArena::current() == request);
+    }
+    TArenaVector<int> values(10);
+    // Still alive, the nested scope must not have reset the arena.
+    BOOST_CHECK_EQUAL(request->bytesAllocated(), 10 * sizeof(int));
+
+    TArena own;
+    {
+      TArenaScope scope(&own);
+      BOOST_CHECK(TArena::current() == &own);
+    }
+    BOOST_CHECK(TArena::current() == request);
+  }
+  BOOST_CHECK(TArena::current() == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(test_copy_leaves_arena) {
+  TArenaString copy;
+  {
+    TArenaScope scope;
+    TArenaString str("a string that does not fit into the small buffer");
+    BOOST_CHECK(str.get_allocator().arena() == TArena::current());
+    TArenaScope heap(nullptr);
+    copy = TArenaString(str);
+  }
+  BOOST_CHECK(copy.get_allocator().arena() == nullptr);
+  BOOST_CHECK_EQUAL("a string that does not fit into the small buffer", std::string(copy.c_str()));
+}
+
+static void checkRoundTrip(shared_ptr<TMemoryBuffer> buffer, TProtocol& prot) {
+  const arenatest::Request expected = makeRequest();
+  TArenaScope scope;
+  TArena* arena = TArena::current();
+  expected.write(&prot);
+
+  size_t before = arena->bytesAllocated();
+  arenatest::Request actual;
+  actual.read(&prot);
+  BOOST_CHECK(arena->bytesAllocated() > before);
+  BOOST_CHECK(actual.items.get_allocator().arena() == arena);
+  BOOST_CHECK(actual.items[1].name.get_allocator().arena() == arena);
+  BOOST_CHECK(expected == actual);
+  BOOST_CHECK_EQUAL(to_string(expected), to_string(actual));
+  BOOST_CHECK_EQUAL(0u, buffer->available_read());
+}
+
+BOOST_AUTO_TEST_CASE(test_round_trip_binary) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol prot(buffer);
+  checkRoundTrip(buffer, prot);
+}
+
+BOOST_AUTO_TEST_CASE(test_round_trip_compact) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TCompactProtocol prot(buffer);
+  checkRoundTrip(buffer, prot);
+}
+
+class ArenaHandler : public arenatest::ArenaServiceIf {
+public:
+  ArenaHandler() : arena(nullptr) {}
+
+  void echo(arenatest::Request& _return, const arenatest::Request& request) override {
+    arena = TArena::current();
+    BOOST_CHECK(arena != nullptr);
+    BOOST_CHECK(request.items.get_allocator().arena() == arena);
+    _return = request;
+    BOOST_CHECK(_return.items[0].name.get_allocator().arena() == arena);
+    TArenaScope heap(nullptr);
+    kept = request;
+  }
+
+  TArena* arena;
+  arenatest::Request kept;
+};
+
+BOOST_AUTO_TEST_CASE(test_processor_scope) {
+  shared_ptr<TMemoryBuffer> requests(new TMemoryBuffer());
+  shared_ptr<TMemoryBuffer> responses(new TMemoryBuffer());
+  shared_ptr<TProtocol> requestProt(new TBinaryProtocol(requests));
+  shared_ptr<TProtocol> responseProt(new TBinaryProtocol(responses));
+  shared_ptr<ArenaHandler> handler(new ArenaHandler());
+  arenatest::ArenaServiceProcessor processor(handler);
+  arenatest::ArenaServiceClient client(responseProt, requestProt);
+
+  const arenatest::Request expected = makeRequest();
+  for (int i = 0; i < 3; ++i) {
+    client.send_echo(expected);
+    BOOST_CHECK(processor.process(requestProt, responseProt, nullptr));
+    BOOST_CHECK(TArena::current() == nullptr);
+    // The call's memory has been released.
+    BOOST_CHECK_EQUAL(0u, handler->arena->bytesAllocated());
+
+    arenatest::Request actual;
+    client.recv_echo(actual);
+    BOOST_CHECK(expected == actual);
+    BOOST_CHECK(expected == handler->kept);
+    BOOST_CHECK(handler->kept.items.get_allocator().arena() == nullptr);
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
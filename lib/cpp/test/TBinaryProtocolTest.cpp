@@ -0,0 +1,130 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+BOOST_AUTO_TEST_SUITE(TBinaryProtocolTest)
+
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TBinaryProtocolT;
+using apache::thrift::protocol::TLEBinaryProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TTransportException;
+using std::shared_ptr;
+using std::string;
+using std::vector;
+
+static vector<int32_t> i32Values() {
+  vector<int32_t> values;
+  for (int i = 0; i < 2000; ++i) {
+    values.push_back(static_cast<int32_t>(i * 2654435761u));
+  }
+  return values;
+}
+
+static vector<int64_t> i64Values() {
+  vector<int64_t> values;
+  for (int i = 0; i < 2000; ++i) {
+    values.push_back(static_cast<int64_t>(i * 0x9e3779b97f4a7c15ULL));
+  }
+  return values;
+}
+
+static vector<double> doubleValues() {
+  vector<double> values;
+  for (int i = 0; i < 2000; ++i) {
+    values.push_back(i * -1.25e-3);
+  }
+  return values;
+}
+
+/**
+ * Checks that the bulk methods read and write exactly what the element-wise
+ * ones do.
+ */
+static void checkArrays(shared_ptr<TMemoryBuffer> buffer, TProtocol& prot) {
+  vector<int32_t> i32s = i32Values();
+  vector<int64_t> i64s = i64Values();
+  vector<double> doubles = doubleValues();
+
+  for (int32_t value : i32s) {
+    prot.writeI32(value);
+  }
+  for (int64_t value : i64s) {
+    prot.writeI64(value);
+  }
+  for (double value : doubles) {
+    prot.writeDouble(value);
+  }
+  string elementwise = buffer->getBufferAsString();
+  buffer->resetBuffer();
+
+  uint32_t size = prot.writeI32Array(i32s.data(), static_cast<uint32_t>(i32s.size()));
+  size += prot.writeI64Array(i64s.data(), static_cast<uint32_t>(i64s.size()));
+  size += prot.writeDoubleArray(doubles.data(), static_cast<uint32_t>(doubles.size()));
+  BOOST_CHECK_EQUAL(elementwise.size(), size);
+  BOOST_CHECK(elementwise == buffer->getBufferAsString());
+
+  vector<int32_t> i32s2(i32s.size());
+  vector<int64_t> i64s2(i64s.size());
+  vector<double> doubles2(doubles.size());
+  prot.readI32Array(i32s2.data(), static_cast<uint32_t>(i32s2.size()));
+  prot.readI64Array(i64s2.data(), static_cast<uint32_t>(i64s2.size()));
+  prot.readDoubleArray(doubles2.data(), static_cast<uint32_t>(doubles2.size()));
+  BOOST_CHECK(i32s == i32s2);
+  BOOST_CHECK(i64s == i64s2);
+  BOOST_CHECK(doubles == doubles2);
+  BOOST_CHECK_EQUAL(0u, buffer->available_read());
+}
+
+BOOST_AUTO_TEST_CASE(test_arrays_big_endian) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol prot(buffer);
+  checkArrays(buffer, prot);
+}
+
+BOOST_AUTO_TEST_CASE(test_arrays_little_endian) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TLEBinaryProtocol prot(buffer);
+  checkArrays(buffer, prot);
+}
+
+BOOST_AUTO_TEST_CASE(test_arrays_concrete_transport) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocolT<TMemoryBuffer> prot(buffer);
+  checkArrays(buffer, prot);
+}
+
+BOOST_AUTO_TEST_CASE(test_read_array_truncated) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol prot(buffer);
+  prot.writeI64(1);
+  prot.writeI64(2);
+
+  int64_t values[3];
+  BOOST_CHECK_THROW(prot.readI64Array(values, 3), TTransportException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
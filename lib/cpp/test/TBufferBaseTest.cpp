@@ -27,6 +27,8 @@ using std::shared_ptr;
 using apache::thrift::transport::TMemoryBuffer;
 using apache::thrift::transport::TBufferedTransport;
 using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TTransport;
+using apache::thrift::transport::TVirtualTransport;
 using apache::thrift::transport::test::TShortReadTransport;
 using std::string;
 
@@ -172,6 +174,21 @@ void init_data() {
   data_str.assign((char*)data, sizeof(data));
 }
 
+// Counts the reads of the transport it wraps.
+class TCountingReadTransport : public TVirtualTransport<TCountingReadTransport> {
+public:
+  TCountingReadTransport(shared_ptr<TTransport> transport)
+    : transport_(transport), reads(0) {}
+
+  uint32_t read(uint8_t* buf, uint32_t len) {
+    ++reads;
+    return transport_->read(buf, len);
+  }
+
+  shared_ptr<TTransport> transport_;
+  int reads;
+};
+
 
 BOOST_AUTO_TEST_SUITE( TBufferBaseTest )
 
@@ -604,6 +621,72 @@ BOOST_AUTO_TEST_CASE( test_FramedTransport_Write_Read ) {
   }
 }
 
+BOOST_AUTO_TEST_CASE( test_FramedTransport_Read_Ahead ) {
+  init_data();
+
+  // Frames smaller and larger than the read-ahead buffer
+  int sizes[] = { 1, 17, 100, 3000, 5, 1023, 1024, 1025, 20000, 12, 12, 12, 700, };
+
+  double probs[] = { 1.0, 0.5, 0.1, };
+
+  for (double prob : probs) {
+    shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+    TFramedTransport writer(buffer);
+    int offset = 0;
+    for (int size : sizes) {
+      writer.write(&data[offset], size);
+      writer.flush();
+      offset += size;
+    }
+
+    TFramedTransport trans(shared_ptr<TTransport>(new TShortReadTransport(buffer, prob)));
+    trans.setReadAheadSize(1024);
+    std::vector<uint8_t> data_out(sizeof(data), 0);
+    offset = 0;
+    for (int size : sizes) {
+      trans.readAll(&data_out[offset], size);
+      BOOST_CHECK(!memcmp(&data[offset], &data_out[offset], size));
+      BOOST_CHECK_EQUAL(trans.readEnd(), (unsigned int)size + 4);
+      offset += size;
+    }
+    uint8_t byte;
+    BOOST_CHECK_EQUAL(trans.read(&byte, 1), 0u);
+  }
+}
+
+BOOST_AUTO_TEST_CASE( test_FramedTransport_Read_Ahead_Batches ) {
+  init_data();
+
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TFramedTransport writer(buffer);
+  for (int i = 0; i < 100; ++i) {
+    writer.write(&data[i * 10], 10);
+    writer.flush();
+  }
+  string frames = buffer->getBufferAsString();
+
+  // Two reads per frame without read-ahead, and one for them all with it
+  shared_ptr<TCountingReadTransport> counting(new TCountingReadTransport(buffer));
+  TFramedTransport plain(counting);
+  uint8_t data_out[10];
+  for (int i = 0; i < 100; ++i) {
+    plain.readAll(data_out, 10);
+    BOOST_CHECK(!memcmp(&data[i * 10], data_out, 10));
+  }
+  BOOST_CHECK_EQUAL(counting->reads, 200);
+
+  buffer->resetBuffer((uint8_t*)frames.data(), (uint32_t)frames.size());
+  counting.reset(new TCountingReadTransport(buffer));
+  TFramedTransport ahead(counting);
+  ahead.setReadAheadSize(4096);
+  for (int i = 0; i < 100; ++i) {
+    ahead.readAll(data_out, 10);
+    BOOST_CHECK(!memcmp(&data[i * 10], data_out, 10));
+  }
+  BOOST_CHECK_EQUAL(counting->reads, 1);
+  BOOST_CHECK(!ahead.peek());
+}
+
 BOOST_AUTO_TEST_CASE( test_FramedTransport_Empty_Flush ) {
   init_data();
 
@@ -0,0 +1,201 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TChainedBuffer.h>
+#include <thrift/transport/TSocket.h>
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#include "gen-cpp/ThriftTest_types.h"
+
+BOOST_AUTO_TEST_SUITE(TChainedBufferTest)
+
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::transport::TChainedBuffer;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TSocket;
+using std::shared_ptr;
+using std::string;
+
+BOOST_AUTO_TEST_CASE(test_write_spans_segments) {
+  TChainedBuffer uut(16);
+  std::vector<uint8_t> buf(1000);
+  for (size_t i = 0; i < buf.size(); ++i) {
+    buf[i] = static_cast<uint8_t>(i);
+  }
+
+  for (uint32_t i = 1; i < 100; i += 7) {
+    uut.write(&buf[0], i);
+  }
+  BOOST_CHECK(uut.getSegmentCount() > 1);
+
+  std::vector<uint8_t> verify(100);
+  for (uint32_t i = 1; i < 100; i += 7) {
+    BOOST_CHECK_EQUAL(i, uut.read(&verify[0], i));
+    BOOST_CHECK_EQUAL(0, ::memcmp(&verify[0], &buf[0], i));
+  }
+  BOOST_CHECK_EQUAL(0u, uut.available_read());
+  BOOST_CHECK(!uut.peek());
+}
+
+BOOST_AUTO_TEST_CASE(test_append_external) {
+  TChainedBuffer uut;
+  string external(10000, 'x');
+  bool released = false;
+  shared_ptr<void> owner(static_cast<void*>(nullptr), [&released](void*) { released = true; });
+
+  uut.write(reinterpret_cast<const uint8_t*>("head"), 4);
+  uut.appendExternal(reinterpret_cast<const uint8_t*>(external.data()),
+                     static_cast<uint32_t>(external.size()),
+                     owner);
+  uut.write(reinterpret_cast<const uint8_t*>("tail"), 4);
+  owner.reset();
+
+  BOOST_CHECK(!released);
+  BOOST_CHECK_EQUAL(3u, uut.getSegmentCount());
+  BOOST_CHECK_EQUAL(4u + external.size() + 4u, uut.available_read());
+  BOOST_CHECK_EQUAL("head" + external + "tail", uut.getBufferAsString());
+
+  uut.resetBuffer();
+  BOOST_CHECK(released);
+  BOOST_CHECK_EQUAL(0u, uut.available_read());
+}
+
+BOOST_AUTO_TEST_CASE(test_roundtrip) {
+  shared_ptr<TChainedBuffer> chain(new TChainedBuffer(32));
+  shared_ptr<TBinaryProtocol> protocol(new TBinaryProtocol(chain));
+
+  thrift::test::Xtruct a;
+  a.i32_thing = 10;
+  a.i64_thing = 30;
+  a.string_thing = string(1000, 'a');
+
+  a.write(protocol.get());
+
+  thrift::test::Xtruct b;
+  b.read(protocol.get());
+  BOOST_CHECK(a == b);
+}
+
+BOOST_AUTO_TEST_CASE(test_flush_to_transport) {
+  shared_ptr<TMemoryBuffer> sink(new TMemoryBuffer());
+  TChainedBuffer uut(sink, 8);
+  string external(100, 'e');
+
+  uut.write(reinterpret_cast<const uint8_t*>("0123456789"), 10);
+  uut.appendExternal(reinterpret_cast<const uint8_t*>(external.data()),
+                     static_cast<uint32_t>(external.size()));
+  uut.write(reinterpret_cast<const uint8_t*>("abc"), 3);
+  BOOST_CHECK_EQUAL(113u, uut.writeEnd());
+  BOOST_CHECK_EQUAL(0u, sink->available_read());
+
+  uut.flush();
+  BOOST_CHECK_EQUAL(0u, uut.available_read());
+  BOOST_CHECK_EQUAL("0123456789" + external + "abc", sink->getBufferAsString());
+
+  // Reads come from the wrapped transport, not from the chain.
+  uut.write(reinterpret_cast<const uint8_t*>("xyz"), 3);
+  uint8_t verify[10];
+  BOOST_CHECK_EQUAL(10u, uut.read(verify, 10));
+  BOOST_CHECK_EQUAL(0, ::memcmp(verify, "0123456789", 10));
+}
+
+#ifndef _WIN32
+namespace {
+
+/**
+ * Reads everything the peer of a socket pair sends, until it closes.
+ */
+string readAll(int fd) {
+  string data;
+  char buf[4096];
+  for (;;) {
+    ssize_t n = ::read(fd, buf, sizeof(buf));
+    if (n <= 0) {
+      return data;
+    }
+    data.append(buf, static_cast<size_t>(n));
+  }
+}
+}
+
+BOOST_AUTO_TEST_CASE(test_writev_socket) {
+  int fds[2];
+  BOOST_REQUIRE_EQUAL(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  TSocket socket(fds[0]);
+
+  // Nothing to send is not an error, and sends nothing
+  BOOST_CHECK_EQUAL(0u, socket.writev_partial(nullptr, 0));
+  socket.writev(nullptr, 0);
+
+  // More than the socket buffers hold, so writev() resumes after partial
+  // sends, across the buffers and within them
+  string first(100000, 'a');
+  string second(300000, 'b');
+  struct iovec iov[4];
+  iov[0].iov_base = const_cast<char*>("head");
+  iov[0].iov_len = 4;
+  iov[1].iov_base = &first[0];
+  iov[1].iov_len = first.size();
+  iov[2].iov_base = nullptr;
+  iov[2].iov_len = 0;
+  iov[3].iov_base = &second[0];
+  iov[3].iov_len = second.size();
+
+  string received;
+  std::thread reader([&received, &fds]() { received = readAll(fds[1]); });
+  socket.writev(iov, 4);
+  socket.close();
+  reader.join();
+  ::close(fds[1]);
+  BOOST_CHECK(received == "head" + first + second);
+}
+
+BOOST_AUTO_TEST_CASE(test_flush_to_socket) {
+  int fds[2];
+  BOOST_REQUIRE_EQUAL(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+  shared_ptr<TSocket> socket(new TSocket(fds[0]));
+  TChainedBuffer uut(socket, 8);
+  string external(100000, 'e');
+
+  uut.write(reinterpret_cast<const uint8_t*>("0123456789"), 10);
+  uut.appendExternal(reinterpret_cast<const uint8_t*>(external.data()),
+                     static_cast<uint32_t>(external.size()));
+  uut.write(reinterpret_cast<const uint8_t*>("abc"), 3);
+
+  string received;
+  std::thread reader([&received, &fds]() { received = readAll(fds[1]); });
+  uut.flush();
+  socket->close();
+  reader.join();
+  ::close(fds[1]);
+  BOOST_CHECK(received == "0123456789" + external + "abc");
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
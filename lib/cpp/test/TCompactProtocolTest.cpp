@@ -0,0 +1,178 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <limits>
+#include <memory>
+#include <vector>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TVirtualTransport.h>
+
+BOOST_AUTO_TEST_SUITE(TCompactProtocolTest)
+
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TCompactProtocolT;
+using apache::thrift::protocol::TProtocolException;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TVirtualTransport;
+using std::shared_ptr;
+using std::vector;
+
+/**
+ * Reads from a memory buffer without ever letting the protocol borrow.
+ */
+class NoBorrowTransport : public TVirtualTransport<NoBorrowTransport> {
+public:
+  NoBorrowTransport(shared_ptr<TMemoryBuffer> buffer) : buffer_(buffer) {}
+
+  uint32_t read(uint8_t* buf, uint32_t len) { return buffer_->read(buf, len); }
+
+private:
+  shared_ptr<TMemoryBuffer> buffer_;
+};
+
+template <typename T>
+static vector<T> interestingValues() {
+  vector<T> values;
+  values.push_back(0);
+  values.push_back(1);
+  values.push_back(-1);
+  values.push_back((std::numeric_limits<T>::max)());
+  values.push_back((std::numeric_limits<T>::min)());
+  // Every varint length, positive and negative.
+  for (int shift = 0; shift < std::numeric_limits<T>::digits; shift += 3) {
+    T value = static_cast<T>(T(1) << shift);
+    values.push_back(value);
+    values.push_back(-value);
+    values.push_back(static_cast<T>(value + 63));
+  }
+  return values;
+}
+
+static void writeValues(TCompactProtocol& prot, const vector<int32_t>& values) {
+  for (int32_t value : values) {
+    prot.writeI32(value);
+  }
+}
+
+static void writeValues(TCompactProtocol& prot, const vector<int64_t>& values) {
+  for (int64_t value : values) {
+    prot.writeI64(value);
+  }
+}
+
+static uint32_t readArray(TCompactProtocol& prot, int32_t* values, uint32_t count) {
+  return prot.readI32Array(values, count);
+}
+
+static uint32_t readArray(TCompactProtocol& prot, int64_t* values, uint32_t count) {
+  return prot.readI64Array(values, count);
+}
+
+template <typename T>
+static void checkRoundTrip() {
+  vector<T> expected = interestingValues<T>();
+
+  // Start at every offset so each value ends up close to the end of the
+  // buffer at some point.
+  for (size_t start = 0; start < expected.size(); ++start) {
+    vector<T> values(expected.begin() + start, expected.end());
+    shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+    TCompactProtocol prot(buffer);
+    writeValues(prot, values);
+    prot.writeByte(42);
+    uint32_t written = buffer->available_read();
+
+    vector<T> actual(values.size());
+    BOOST_CHECK_EQUAL(written - 1, readArray(prot, &actual[0], static_cast<uint32_t>(actual.size())));
+    BOOST_CHECK(values == actual);
+
+    int8_t trailer;
+    prot.readByte(trailer);
+    BOOST_CHECK_EQUAL(42, trailer);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_read_i32_array) {
+  checkRoundTrip<int32_t>();
+}
+
+BOOST_AUTO_TEST_CASE(test_read_i64_array) {
+  checkRoundTrip<int64_t>();
+}
+
+BOOST_AUTO_TEST_CASE(test_read_array_across_frames) {
+  vector<int64_t> values = interestingValues<int64_t>();
+  shared_ptr<TMemoryBuffer> encoded(new TMemoryBuffer());
+  TCompactProtocol encoder(encoded);
+  writeValues(encoder, values);
+  std::string bytes = encoded->getBufferAsString();
+
+  // Split the encoded values in the middle of a multi byte varint, so the
+  // reader has to finish it from the next frame.
+  size_t split = bytes.size() / 2;
+  while (!(bytes[split - 1] & 0x80)) {
+    ++split;
+  }
+
+  shared_ptr<TMemoryBuffer> pipe(new TMemoryBuffer());
+  TFramedTransport writer(pipe);
+  writer.write(reinterpret_cast<const uint8_t*>(bytes.data()), static_cast<uint32_t>(split));
+  writer.flush();
+  writer.write(reinterpret_cast<const uint8_t*>(bytes.data()) + split,
+               static_cast<uint32_t>(bytes.size() - split));
+  writer.flush();
+
+  shared_ptr<TFramedTransport> reader(new TFramedTransport(pipe));
+  TCompactProtocol in(reader);
+  vector<int64_t> actual(values.size());
+  in.readI64Array(&actual[0], static_cast<uint32_t>(actual.size()));
+  BOOST_CHECK(values == actual);
+}
+
+BOOST_AUTO_TEST_CASE(test_read_array_without_borrow) {
+  vector<int32_t> values = interestingValues<int32_t>();
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TCompactProtocol out(buffer);
+  writeValues(out, values);
+
+  shared_ptr<NoBorrowTransport> trans(new NoBorrowTransport(buffer));
+  TCompactProtocolT<NoBorrowTransport> in(trans);
+  vector<int32_t> actual(values.size());
+  in.readI32Array(&actual[0], static_cast<uint32_t>(actual.size()));
+  BOOST_CHECK(values == actual);
+}
+
+BOOST_AUTO_TEST_CASE(test_read_array_overlong_varint) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TCompactProtocol prot(buffer);
+  prot.writeI64(1);
+  const uint8_t overlong[] = {0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01};
+  buffer->write(overlong, sizeof(overlong));
+  for (int i = 0; i < 8; ++i) {
+    prot.writeI64(1);
+  }
+
+  int64_t values[10];
+  BOOST_CHECK_THROW(prot.readI64Array(values, 10), TProtocolException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,207 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <string>
+#include <thrift/TDispatchProcessor.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/Derived.h"
+
+BOOST_AUTO_TEST_SUITE(TDispatchProcessorTest)
+
+using apache::thrift::TApplicationException;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using std::shared_ptr;
+using std::string;
+
+BOOST_AUTO_TEST_CASE(test_hash_is_stable) {
+  // The compiler computes the same hash to lay out the generated dispatch
+  // switch, so it must not change behind its back.
+  BOOST_CHECK_EQUAL(2166136261u ^ (2166136261u >> 16),
+                    apache::thrift::detail::hashMethodName("", 0));
+  BOOST_CHECK_EQUAL(0x445d6f53u, apache::thrift::detail::hashMethodName("testVoid", 29));
+}
+
+class CountingHandler : public dispatchtest::DerivedNull {
+public:
+  CountingHandler() : calls(0) {}
+
+  int32_t identity(const int32_t arg) override {
+    ++calls;
+    return arg;
+  }
+
+  int32_t Janky(const int32_t arg) override {
+    ++calls;
+    return -arg;
+  }
+
+  int calls;
+};
+
+BOOST_AUTO_TEST_CASE(test_dispatch) {
+  shared_ptr<TMemoryBuffer> requests(new TMemoryBuffer());
+  shared_ptr<TMemoryBuffer> responses(new TMemoryBuffer());
+  shared_ptr<TProtocol> requestProt(new TBinaryProtocol(requests));
+  shared_ptr<TProtocol> responseProt(new TBinaryProtocol(responses));
+  shared_ptr<CountingHandler> handler(new CountingHandler());
+  dispatchtest::DerivedProcessor processor(handler);
+  dispatchtest::DerivedClient client(responseProt, requestProt);
+
+  // Own method, and one the parent processor has to handle.
+  client.send_identity(42);
+  BOOST_CHECK(processor.process(requestProt, responseProt, nullptr));
+  BOOST_CHECK_EQUAL(42, client.recv_identity());
+  client.send_Janky(7);
+  BOOST_CHECK(processor.process(requestProt, responseProt, nullptr));
+  BOOST_CHECK_EQUAL(-7, client.recv_Janky());
+  BOOST_CHECK_EQUAL(2, handler->calls);
+
+  // Same length and case insensitively equal names must not match.
+  const char* unknown[] = {"janky", "Jankx", "", "identityX", "Base:Janky"};
+  for (const char* name : unknown) {
+    requestProt->writeMessageBegin(name, apache::thrift::protocol::T_CALL, 1);
+    requestProt->writeStructBegin("args");
+    requestProt->writeFieldStop();
+    requestProt->writeStructEnd();
+    requestProt->writeMessageEnd();
+    BOOST_CHECK(processor.process(requestProt, responseProt, nullptr));
+
+    string fname;
+    apache::thrift::protocol::TMessageType mtype;
+    int32_t seqid;
+    responseProt->readMessageBegin(fname, mtype, seqid);
+    BOOST_CHECK_EQUAL(apache::thrift::protocol::T_EXCEPTION, mtype);
+    TApplicationException x;
+    x.read(responseProt.get());
+    responseProt->readMessageEnd();
+    BOOST_CHECK_EQUAL(TApplicationException::UNKNOWN_METHOD, x.getType());
+  }
+  BOOST_CHECK_EQUAL(2, handler->calls);
+}
+
+class ReverseHandler : public dispatchtest::DerivedNull {
+public:
+  void reversed(const string& first, const int16_t second, const int32_t third, const int64_t fourth)
+      override {
+    this->first = first;
+    this->second = second;
+    this->third = third;
+    this->fourth = fourth;
+  }
+
+  string first;
+  int16_t second = 0;
+  int32_t third = 0;
+  int64_t fourth = 0;
+};
+
+BOOST_AUTO_TEST_CASE(test_args_declared_out_of_order) {
+  shared_ptr<TMemoryBuffer> requests(new TMemoryBuffer());
+  shared_ptr<TMemoryBuffer> responses(new TMemoryBuffer());
+  shared_ptr<TProtocol> requestProt(new TCompactProtocol(requests));
+  shared_ptr<TProtocol> responseProt(new TCompactProtocol(responses));
+  shared_ptr<ReverseHandler> handler(new ReverseHandler());
+  dispatchtest::DerivedProcessor processor(handler);
+  dispatchtest::DerivedClient client(responseProt, requestProt);
+
+  client.send_reversed("first", 2, 3, 4);
+  BOOST_CHECK(processor.process(requestProt, responseProt, nullptr));
+  client.recv_reversed();
+  BOOST_CHECK_EQUAL("first", handler->first);
+  BOOST_CHECK_EQUAL(2, handler->second);
+  BOOST_CHECK_EQUAL(3, handler->third);
+  BOOST_CHECK_EQUAL(4, handler->fourth);
+}
+
+/**
+ * Writes the fields of a Point in the given order, with an unknown field
+ * and a field of the wrong type thrown in.
+ */
+static void writePoint(TProtocol& prot, const int* order, size_t count) {
+  prot.writeStructBegin("Point");
+  for (size_t i = 0; i < count; ++i) {
+    switch (order[i]) {
+    case 1:
+      prot.writeFieldBegin("name", apache::thrift::protocol::T_STRING, 1);
+      prot.writeString("string");
+      break;
+    case 4:
+      prot.writeFieldBegin("tag", apache::thrift::protocol::T_BYTE, 4);
+      prot.writeByte(4);
+      break;
+    case 9:
+      prot.writeFieldBegin("x", apache::thrift::protocol::T_I32, 9);
+      prot.writeI32(9);
+      break;
+    case 11:
+      prot.writeFieldBegin("y", apache::thrift::protocol::T_I64, 11);
+      prot.writeI64(11);
+      break;
+    case 100:
+      prot.writeFieldBegin("unknown", apache::thrift::protocol::T_I32, 100);
+      prot.writeI32(100);
+      break;
+    case -4:
+      // Expected id, unexpected type.
+      prot.writeFieldBegin("tag", apache::thrift::protocol::T_STRING, 4);
+      prot.writeString("wrong");
+      break;
+    }
+    prot.writeFieldEnd();
+  }
+  prot.writeFieldStop();
+  prot.writeStructEnd();
+}
+
+BOOST_AUTO_TEST_CASE(test_read_fields_in_any_order) {
+  const int orders[][6] = {{1, 4, 9, 11, 0, 0},
+                           {11, 9, 4, 1, 0, 0},
+                           {1, 100, 4, 9, 11, 0},
+                           {1, -4, 4, 9, 100, 11},
+                           {4, 1, 11, 9, 0, 0}};
+  for (const int* order : orders) {
+    size_t count = 0;
+    while (count < 6 && order[count] != 0) {
+      ++count;
+    }
+    shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+    TBinaryProtocol prot(buffer);
+    writePoint(prot, order, count);
+
+    dispatchtest::Point point;
+    point.read(&prot);
+    BOOST_CHECK_EQUAL("string", point.name);
+    BOOST_CHECK_EQUAL(4, point.tag);
+    BOOST_CHECK_EQUAL(9, point.x);
+    BOOST_CHECK_EQUAL(11, point.y);
+    BOOST_CHECK(point.__isset.name && point.__isset.tag
+                && point.__isset.x && point.__isset.y);
+    BOOST_CHECK_EQUAL(0u, buffer->available_read());
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
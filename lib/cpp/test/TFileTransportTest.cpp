@@ -28,6 +28,13 @@
 #include <getopt.h>
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <thrift/protocol/TBinaryProtocol.h>
 #include <thrift/transport/TFileTransport.h>
 
 #ifdef __MINGW32__
@@ -336,6 +343,261 @@ BOOST_AUTO_TEST_CASE(test_noop_flush) {
   }
 }
 
+/**
+ * An event naming its writer and its sequence number, with a varying amount of
+ * filler so that events pack unevenly into chunks.
+ */
+std::string make_event(int writer, int seq) {
+  std::string event = std::to_string(writer) + ":" + std::to_string(seq) + ":";
+  event.append((seq * 37) % 1000, static_cast<char>('a' + seq % 26));
+  return event;
+}
+
+/**
+ * Read back every event, checking that each writer's events are all there, in order.
+ * A memory mapped reader is read through borrow(), which must hand out events straight
+ * from the mapping.
+ */
+void check_events(const char* path,
+                  uint32_t chunk_size,
+                  int writers,
+                  int events_per_writer,
+                  bool memory_mapped = false) {
+  TFileTransport reader(path, true);
+  reader.setChunkSize(chunk_size);
+  reader.setMemoryMapped(memory_mapped);
+
+  std::vector<int> next(writers, 0);
+  uint8_t buf[2048];
+  int bad = 0;
+  int mappings = 0;
+  std::shared_ptr<const void> mapping;
+  while (true) {
+    std::string event;
+    if (memory_mapped) {
+      uint32_t len = 1;
+      const uint8_t* borrowed = reader.borrow(nullptr, &len);
+      if (!borrowed) {
+        break;
+      }
+      std::shared_ptr<const void> pin = reader.pinReadBuffer();
+      if (pin != mapping) {
+        ++mappings;
+        mapping = pin;
+      }
+      event.assign(reinterpret_cast<const char*>(borrowed), len);
+      reader.consume(len);
+    } else {
+      uint32_t len = reader.read(buf, sizeof(buf));
+      if (len == 0) {
+        break;
+      }
+      event.assign(reinterpret_cast<char*>(buf), len);
+    }
+    int writer = atoi(event.c_str());
+    if (writer < 0 || writer >= writers
+        || event != make_event(writer, next[writer])) {
+      ++bad;
+      continue;
+    }
+    ++next[writer];
+  }
+  BOOST_CHECK_EQUAL(0, bad);
+  if (memory_mapped) {
+    // the file is complete, so it is mapped once
+    BOOST_CHECK_EQUAL(1, mappings);
+  }
+  for (int writer = 0; writer < writers; ++writer) {
+    BOOST_CHECK_EQUAL(events_per_writer, next[writer]);
+  }
+}
+
+/**
+ * Write events_per_writer events from each of writers threads at once.
+ */
+void write_events(TFileTransport& transport, int writers, int events_per_writer) {
+  std::vector<std::thread> threads;
+  for (int writer = 0; writer < writers; ++writer) {
+    threads.push_back(std::thread([&transport, writer, events_per_writer] {
+      for (int seq = 0; seq < events_per_writer; ++seq) {
+        std::string event = make_event(writer, seq);
+        transport.write(reinterpret_cast<const uint8_t*>(event.data()),
+                        static_cast<uint32_t>(event.size()));
+        if (seq % 1000 == 999) {
+          transport.flush();
+        }
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+/**
+ * Write from several threads at once, with a chunk size that needs frequent
+ * padding, and make sure every event can be read back.
+ */
+void test_write_read_impl(bool direct_io) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  // Not a multiple of the block size, so padding falls mid block
+  const uint32_t chunk_size = 3 * 4096 + 100;
+  const int writers = 4;
+  const int events_per_writer = 5000;
+
+  {
+    TFileTransport transport(f.getPath());
+    transport.setChunkSize(chunk_size);
+    transport.setEventBufferSize(100);
+    transport.setDirectIO(direct_io);
+    write_events(transport, writers, events_per_writer);
+
+    // Everything is in the file once flush() returns
+    transport.flush();
+    check_events(f.getPath(), chunk_size, writers, events_per_writer);
+  }
+
+  check_events(f.getPath(), chunk_size, writers, events_per_writer);
+  check_events(f.getPath(), chunk_size, writers, events_per_writer, true);
+}
+
+BOOST_AUTO_TEST_CASE(test_write_read) {
+  test_write_read_impl(false);
+}
+
+BOOST_AUTO_TEST_CASE(test_write_read_direct_io) {
+  test_write_read_impl(true);
+}
+
+/**
+ * Records the events it is given, by writer.
+ */
+class RecordingProcessor : public apache::thrift::TProcessor {
+public:
+  RecordingProcessor(int writers) : events_(writers) {}
+
+  bool process(std::shared_ptr<apache::thrift::protocol::TProtocol> in,
+               std::shared_ptr<apache::thrift::protocol::TProtocol> out,
+               void* connectionContext) override {
+    (void)out;
+    (void)connectionContext;
+    uint8_t buf[2048];
+    uint32_t len = in->getTransport()->read(buf, sizeof(buf));
+    std::string event(reinterpret_cast<char*>(buf), len);
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_[atoi(event.c_str())].push_back(event);
+    return true;
+  }
+
+  std::vector<std::vector<std::string> > events_;
+
+private:
+  std::mutex mutex_;
+};
+
+/**
+ * Replay a file on several threads, with and without keeping order per writer.
+ */
+void test_process_parallel_impl(bool memory_mapped, bool keep_order) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  const uint32_t chunk_size = 3 * 4096 + 100;
+  const int writers = 4;
+  const int events_per_writer = 5000;
+  {
+    TFileTransport transport(f.getPath());
+    transport.setChunkSize(chunk_size);
+    write_events(transport, writers, events_per_writer);
+  }
+
+  std::shared_ptr<TFileTransport> reader(new TFileTransport(f.getPath(), true));
+  reader->setChunkSize(chunk_size);
+  reader->setMemoryMapped(memory_mapped);
+  std::shared_ptr<RecordingProcessor> processor(new RecordingProcessor(writers));
+  TFileProcessor fileProcessor(processor,
+                               std::make_shared<apache::thrift::protocol::TBinaryProtocolFactory>(),
+                               reader);
+
+  TFileProcessor::KeyFunction key;
+  if (keep_order) {
+    key = [](const uint8_t* event, uint32_t len) {
+      return static_cast<size_t>(atoi(std::string(reinterpret_cast<const char*>(event), len).c_str()));
+    };
+  }
+  fileProcessor.processParallel(4, key);
+
+  for (int writer = 0; writer < writers; ++writer) {
+    std::vector<std::string>& events = processor->events_[writer];
+    BOOST_CHECK_EQUAL(static_cast<size_t>(events_per_writer), events.size());
+    if (!keep_order) {
+      std::sort(events.begin(), events.end(), [](const std::string& a, const std::string& b) {
+        return atoi(a.c_str() + a.find(':') + 1) < atoi(b.c_str() + b.find(':') + 1);
+      });
+    }
+    int bad = 0;
+    for (size_t seq = 0; seq < events.size(); ++seq) {
+      if (events[seq] != make_event(writer, static_cast<int>(seq))) {
+        ++bad;
+      }
+    }
+    BOOST_CHECK_EQUAL(0, bad);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(test_process_parallel) {
+  test_process_parallel_impl(false, false);
+}
+
+BOOST_AUTO_TEST_CASE(test_process_parallel_keep_order) {
+  test_process_parallel_impl(false, true);
+}
+
+BOOST_AUTO_TEST_CASE(test_process_parallel_memory_mapped) {
+  test_process_parallel_impl(true, true);
+}
+
+/**
+ * Make sure concurrent flush() calls all return, sharing fsyncs.
+ */
+BOOST_AUTO_TEST_CASE(test_concurrent_flush) {
+  TempFile f(tmp_dir, "thrift.TFileTransportTest.");
+
+  FsyncLog log;
+  fsync_log = &log;
+
+  const uint32_t chunk_size = 1024 * 1024;
+  const int writers = 8;
+  const int flushes_per_writer = 200;
+  {
+    TFileTransport transport(f.getPath());
+    transport.setChunkSize(chunk_size);
+    transport.setFlushMaxBytes(0xffffffff);
+
+    std::vector<std::thread> threads;
+    for (int writer = 0; writer < writers; ++writer) {
+      threads.push_back(std::thread([&transport, writer, flushes_per_writer] {
+        for (int seq = 0; seq < flushes_per_writer; ++seq) {
+          std::string event = make_event(writer, seq);
+          transport.write(reinterpret_cast<const uint8_t*>(event.data()),
+                          static_cast<uint32_t>(event.size()));
+          transport.flush();
+        }
+      }));
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+
+  fsync_log = nullptr;
+
+  // Flushes requested while another was in progress share the next fsync
+  BOOST_WARN_LT(log.getCalls()->size(),
+                static_cast<FsyncLog::CallList::size_type>(writers * flushes_per_writer));
+  check_events(f.getPath(), chunk_size, writers, flushes_per_writer);
+}
+
 /**************************************************************************
  * General Initialization
  **************************************************************************/
@@ -0,0 +1,223 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE THeaderTransportTest
+#include <boost/test/unit_test.hpp>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <thrift/thrift-config.h>
+#include <thrift/TApplicationException.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/THeaderTransform.h>
+#include <thrift/transport/THeaderTransport.h>
+
+using apache::thrift::TApplicationException;
+using apache::thrift::transport::THeaderTransform;
+using apache::thrift::transport::THeaderTransport;
+using apache::thrift::transport::TMemoryBuffer;
+using apache::thrift::transport::TTransportException;
+using std::shared_ptr;
+using std::string;
+
+static const uint16_t XOR_TRANSFORM = 0x7f;
+
+/**
+ * Flips every byte, and counts how often it was created.
+ */
+class XorTransform : public THeaderTransform {
+public:
+  static int created;
+
+  XorTransform() { ++created; }
+
+  uint32_t transformBound(uint32_t size) override { return size; }
+
+  uint32_t transform(const uint8_t* in, uint32_t size, uint8_t* out) override {
+    for (uint32_t i = 0; i < size; ++i) {
+      out[i] = in[i] ^ 0xff;
+    }
+    return size;
+  }
+
+  bool untransform(const uint8_t* in, uint32_t size, uint8_t* out, uint32_t& outSize) override {
+    if (size > outSize) {
+      return false;
+    }
+    outSize = transform(in, size, out);
+    return true;
+  }
+};
+
+int XorTransform::created = 0;
+
+static string compressible(size_t size) {
+  string result;
+  while (result.size() < size) {
+    result += "field" + std::to_string(result.size() % 97) + ";";
+  }
+  result.resize(size);
+  return result;
+}
+
+static string incompressible(size_t size) {
+  string result(size, '\0');
+  uint32_t state = 2463534242u;
+  for (size_t i = 0; i < size; ++i) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    result[i] = static_cast<char>(state);
+  }
+  return result;
+}
+
+/**
+ * Sends each payload through a writer with the given transforms and reads
+ * it back with a separate reader, so both sides reuse their contexts.
+ */
+static void checkRoundTrip(const std::vector<uint16_t>& transIds,
+                           const std::vector<string>& payloads) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  THeaderTransport writer(buffer);
+  THeaderTransport reader(buffer);
+  for (uint16_t transId : transIds) {
+    writer.setTransform(transId);
+  }
+
+  for (const string& payload : payloads) {
+    writer.write(reinterpret_cast<const uint8_t*>(payload.data()),
+                 static_cast<uint32_t>(payload.size()));
+    writer.flush();
+
+    reader.resetProtocol();
+    string result(payload.size(), '\0');
+    reader.readAll(reinterpret_cast<uint8_t*>(&result[0]), static_cast<uint32_t>(result.size()));
+    BOOST_CHECK(result == payload);
+    BOOST_CHECK_EQUAL(0u, buffer->available_read());
+  }
+}
+
+static void checkTransform(uint16_t transId) {
+  std::vector<string> payloads;
+  payloads.push_back("x");
+  payloads.push_back(compressible(100));
+  payloads.push_back(compressible(1024 * 1024));
+  payloads.push_back(incompressible(100000));
+  payloads.push_back(compressible(3));
+  checkRoundTrip(std::vector<uint16_t>(1, transId), payloads);
+}
+
+BOOST_AUTO_TEST_CASE(test_zlib) {
+  checkTransform(THeaderTransport::ZLIB_TRANSFORM);
+}
+
+BOOST_AUTO_TEST_CASE(test_zlib_compresses) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  THeaderTransport writer(buffer);
+  writer.setTransform(THeaderTransport::ZLIB_TRANSFORM);
+  string payload = compressible(64 * 1024);
+  writer.write(reinterpret_cast<const uint8_t*>(payload.data()),
+               static_cast<uint32_t>(payload.size()));
+  writer.flush();
+  BOOST_CHECK_LT(buffer->available_read(), payload.size() / 4);
+}
+
+BOOST_AUTO_TEST_CASE(test_custom_transform) {
+  THeaderTransform::registerFactory(XOR_TRANSFORM, [] {
+    return std::unique_ptr<THeaderTransform>(new XorTransform);
+  });
+  XorTransform::created = 0;
+  checkTransform(XOR_TRANSFORM);
+  // One instance per transport, not one per frame
+  BOOST_CHECK_EQUAL(2, XorTransform::created);
+}
+
+BOOST_AUTO_TEST_CASE(test_chained_transforms) {
+  THeaderTransform::registerFactory(XOR_TRANSFORM, [] {
+    return std::unique_ptr<THeaderTransform>(new XorTransform);
+  });
+  std::vector<uint16_t> transIds;
+  transIds.push_back(XOR_TRANSFORM);
+  transIds.push_back(THeaderTransport::ZLIB_TRANSFORM);
+  std::vector<string> payloads;
+  payloads.push_back(compressible(5000));
+  payloads.push_back(incompressible(5000));
+  checkRoundTrip(transIds, payloads);
+}
+
+BOOST_AUTO_TEST_CASE(test_unknown_transform) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  THeaderTransport writer(buffer);
+  writer.setTransform(0x7e);
+  writer.write(reinterpret_cast<const uint8_t*>("abc"), 3);
+  BOOST_CHECK_THROW(writer.flush(), TTransportException);
+}
+
+BOOST_AUTO_TEST_CASE(test_unknown_transform_received) {
+  THeaderTransform::registerFactory(XOR_TRANSFORM, [] {
+    return std::unique_ptr<THeaderTransform>(new XorTransform);
+  });
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  THeaderTransport writer(buffer);
+  writer.setTransform(XOR_TRANSFORM);
+  writer.write(reinterpret_cast<const uint8_t*>("abc"), 3);
+  writer.flush();
+
+  THeaderTransform::registerFactory(XOR_TRANSFORM, nullptr);
+  THeaderTransport reader(buffer);
+  BOOST_CHECK_THROW(reader.resetProtocol(), TApplicationException);
+}
+
+BOOST_AUTO_TEST_CASE(test_untransformed_size_limit) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  THeaderTransport writer(buffer);
+  writer.setTransform(THeaderTransport::ZLIB_TRANSFORM);
+  string payload(1024 * 1024, 'a');
+  writer.write(reinterpret_cast<const uint8_t*>(payload.data()),
+               static_cast<uint32_t>(payload.size()));
+  writer.flush();
+
+  THeaderTransport reader(buffer);
+  reader.setMaxFrameSize(64 * 1024);
+  BOOST_CHECK_THROW(reader.resetProtocol(), TTransportException);
+}
+
+#ifdef HAVE_ZSTD
+BOOST_AUTO_TEST_CASE(test_zstd) {
+  checkTransform(THeaderTransport::ZSTD_TRANSFORM);
+}
+
+BOOST_AUTO_TEST_CASE(test_zstd_dictionary) {
+  THeaderTransform::Factory previous = THeaderTransform::zstdFactory();
+  THeaderTransform::registerFactory(THeaderTransport::ZSTD_TRANSFORM,
+                                    THeaderTransform::zstdFactory(3, compressible(4096)));
+  checkTransform(THeaderTransport::ZSTD_TRANSFORM);
+  THeaderTransform::registerFactory(THeaderTransport::ZSTD_TRANSFORM, previous);
+}
+#endif
+
+#ifdef HAVE_LZ4
+BOOST_AUTO_TEST_CASE(test_lz4) {
+  checkTransform(THeaderTransport::LZ4_TRANSFORM);
+}
+#endif
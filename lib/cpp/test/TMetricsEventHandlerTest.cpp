@@ -0,0 +1,161 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <thrift/TApplicationException.h>
+#include <thrift/processor/TMetricsEventHandler.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/PooledService.h"
+
+BOOST_AUTO_TEST_SUITE(TMetricsEventHandlerTest)
+
+using apache::thrift::TApplicationException;
+using apache::thrift::processor::TMetricsEventHandler;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using std::shared_ptr;
+
+typedef TMetricsEventHandler::Histogram Histogram;
+
+BOOST_AUTO_TEST_CASE(test_histogram_buckets) {
+  for (size_t bucket = 0; bucket < Histogram::BUCKETS; ++bucket) {
+    BOOST_CHECK_EQUAL(bucket, Histogram::bucketOf(Histogram::bucketLowest(bucket)));
+    BOOST_CHECK_EQUAL(bucket, Histogram::bucketOf(Histogram::bucketHighest(bucket)));
+    if (bucket > 0) {
+      BOOST_CHECK_EQUAL(Histogram::bucketHighest(bucket - 1) + 1, Histogram::bucketLowest(bucket));
+    }
+  }
+  // Within 1/8 of the value, and capped at the last bucket
+  uint64_t value = 1234567;
+  size_t bucket = Histogram::bucketOf(value);
+  BOOST_CHECK(Histogram::bucketHighest(bucket) - Histogram::bucketLowest(bucket) < value / 8);
+  BOOST_CHECK_EQUAL(Histogram::BUCKETS - 1, Histogram::bucketOf(~static_cast<uint64_t>(0)));
+}
+
+class MetricsHandler : public pooledtest::PooledServiceIf {
+public:
+  int32_t submit(const pooledtest::Batch& batch, const int64_t deadline) override {
+    (void)deadline;
+    if (batch.label == "fail") {
+      throw std::runtime_error("undeclared");
+    }
+    if (batch.names.empty()) {
+      pooledtest::Rejected rejected;
+      rejected.reason = "empty";
+      throw rejected;
+    }
+    return static_cast<int32_t>(batch.names.size());
+  }
+};
+
+BOOST_AUTO_TEST_CASE(test_processor_calls) {
+  shared_ptr<TMemoryBuffer> requests(new TMemoryBuffer());
+  shared_ptr<TMemoryBuffer> responses(new TMemoryBuffer());
+  shared_ptr<TProtocol> requestProt(new TBinaryProtocol(requests));
+  shared_ptr<TProtocol> responseProt(new TBinaryProtocol(responses));
+  pooledtest::PooledServiceProcessor processor(std::make_shared<MetricsHandler>());
+  pooledtest::PooledServiceClient client(responseProt, requestProt);
+  shared_ptr<TMetricsEventHandler> metrics(new TMetricsEventHandler());
+  processor.setEventHandler(metrics);
+
+  BOOST_CHECK(metrics->getMetrics().empty());
+
+  pooledtest::Batch batch;
+  batch.names.push_back("a");
+  batch.names.push_back("b");
+  for (int i = 0; i < 3; ++i) {
+    client.send_submit(batch, 0);
+    BOOST_CHECK(processor.process(requestProt, responseProt, nullptr));
+    BOOST_CHECK_EQUAL(2, client.recv_submit());
+  }
+
+  // A declared exception is a reply like any other
+  client.send_submit(pooledtest::Batch(), 0);
+  BOOST_CHECK(processor.process(requestProt, responseProt, nullptr));
+  BOOST_CHECK_THROW(client.recv_submit(), pooledtest::Rejected);
+
+  pooledtest::Batch failing;
+  failing.label = "fail";
+  client.send_submit(failing, 0);
+  BOOST_CHECK(processor.process(requestProt, responseProt, nullptr));
+  BOOST_CHECK_THROW(client.recv_submit(), TApplicationException);
+
+  std::map<std::string, TMetricsEventHandler::MethodMetrics> snapshot = metrics->getMetrics();
+  BOOST_REQUIRE_EQUAL(1u, snapshot.size());
+  BOOST_CHECK_EQUAL("PooledService.submit", snapshot.begin()->first);
+  const TMetricsEventHandler::MethodMetrics& submit = snapshot.begin()->second;
+  BOOST_CHECK_EQUAL(5u, submit.calls);
+  BOOST_CHECK_EQUAL(1u, submit.errors);
+  BOOST_CHECK(submit.bytesRead > 0);
+  BOOST_CHECK(submit.bytesWritten > 0);
+  BOOST_CHECK_EQUAL(5u, submit.readLatency.count());
+  BOOST_CHECK_EQUAL(5u, submit.handlerLatency.count());
+  // The failed call writes its TApplicationException without preWrite()
+  BOOST_CHECK_EQUAL(4u, submit.writeLatency.count());
+  BOOST_CHECK(submit.handlerLatency.percentile(50) <= submit.handlerLatency.percentile(100));
+  BOOST_CHECK_EQUAL(submit.handlerLatency.max(), submit.handlerLatency.percentile(100));
+}
+
+BOOST_AUTO_TEST_CASE(test_threads) {
+  shared_ptr<TMetricsEventHandler> metrics(new TMetricsEventHandler());
+  const int threadCount = 4;
+  const int callCount = 10000;
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < threadCount; ++t) {
+    threads.push_back(std::thread([&metrics, t]() {
+      const char* names[] = {"Service.even", "Service.odd"};
+      for (int i = 0; i < callCount; ++i) {
+        const char* name = names[(t + i) % 2];
+        void* ctx = metrics->getContext(name, nullptr);
+        metrics->preRead(ctx, name);
+        metrics->postRead(ctx, name, 10);
+        metrics->preWrite(ctx, name);
+        metrics->postWrite(ctx, name, 20);
+        metrics->freeContext(ctx, name);
+      }
+    }));
+  }
+  // Snapshots may be taken while the threads record
+  for (int i = 0; i < 10; ++i) {
+    metrics->getMetrics();
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  std::map<std::string, TMetricsEventHandler::MethodMetrics> snapshot = metrics->getMetrics();
+  BOOST_REQUIRE_EQUAL(2u, snapshot.size());
+  for (const auto& method : snapshot) {
+    BOOST_CHECK_EQUAL(threadCount * callCount / 2, method.second.calls);
+    BOOST_CHECK_EQUAL(0u, method.second.errors);
+    BOOST_CHECK_EQUAL(10u * threadCount * callCount / 2, method.second.bytesRead);
+    BOOST_CHECK_EQUAL(20u * threadCount * callCount / 2, method.second.bytesWritten);
+    BOOST_CHECK_EQUAL(threadCount * callCount / 2, method.second.writeLatency.count());
+  }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
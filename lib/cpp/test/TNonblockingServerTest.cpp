@@ -19,16 +19,26 @@
 
 #define BOOST_TEST_MODULE TNonblockingServerTest
 #include <boost/test/unit_test.hpp>
+#include <chrono>
+#include <climits>
 #include <memory>
+#include <set>
+#include <thread>
 
+#include "thrift/TRequestDeadline.h"
 #include "thrift/concurrency/Monitor.h"
 #include "thrift/concurrency/Thread.h"
+#include "thrift/concurrency/ThreadManager.h"
 #include "thrift/server/TNonblockingServer.h"
 #include "thrift/transport/TNonblockingServerSocket.h"
+#ifdef TNONBLOCKINGSERVERTEST_WITH_ZLIB
+#include "thrift/protocol/THeaderProtocol.h"
+#endif
 
 #include "gen-cpp/ParentService.h"
 
 #include <event.h>
+#include <sys/socket.h>
 
 using apache::thrift::concurrency::Guard;
 using apache::thrift::concurrency::Monitor;
@@ -36,6 +46,7 @@ using apache::thrift::concurrency::Mutex;
 using apache::thrift::concurrency::ThreadFactory;
 using apache::thrift::concurrency::Runnable;
 using apache::thrift::concurrency::Thread;
+using apache::thrift::concurrency::ThreadManager;
 using apache::thrift::concurrency::ThreadFactory;
 using apache::thrift::server::TServerEventHandler;
 using std::make_shared;
@@ -48,10 +59,19 @@ struct Handler : public test::ParentServiceIf {
   void getStrings(std::vector<std::string>& _return) override { _return = strings_; }
   std::vector<std::string> strings_;
 
+  // the time left until the request's deadline, or -1 if it has none
+  int32_t getGeneration() override {
+    if (!TRequestDeadline::isSet()) {
+      return -1;
+    }
+    return static_cast<int32_t>(TRequestDeadline::remaining().count());
+  }
+  void getDataWait(std::string&, const int32_t length) override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(length));
+  }
+
   // dummy overrides not used in this test
   int32_t incrementGeneration() override { return 0; }
-  int32_t getGeneration() override { return 0; }
-  void getDataWait(std::string&, const int32_t) override {}
   void onewayWait() override {}
   void exceptionWait(const std::string&) override {}
   void unexpectedExceptionWait(const std::string&) override {}
@@ -75,6 +95,14 @@ private:
 
   struct Runner : public Runnable {
     int port;
+    size_t numIOThreads;
+    bool useReusePortListeners;
+    bool useCompletionQueue;
+    bool useHeaderProtocol;
+    uint32_t pipelineDepth;
+    bool pipelineInOrder;
+    size_t idleReadBufferLimit;
+    shared_ptr<ThreadManager> threadManager;
     shared_ptr<event_base> userEventBase;
     shared_ptr<TProcessor> processor;
     shared_ptr<server::TNonblockingServer> server;
@@ -84,6 +112,12 @@ private:
 
     Runner() {
       port = 0;
+      numIOThreads = 1;
+      useReusePortListeners = false;
+      useCompletionQueue = false;
+      useHeaderProtocol = false;
+      pipelineDepth = 1;
+      pipelineInOrder = false;
       listenHandler.reset(new ListenEventHandler(&mutex_));
     }
 
@@ -106,6 +140,23 @@ private:
         socket.reset(new transport::TNonblockingServerSocket(port));
         server.reset(new server::TNonblockingServer(processor, socket));
         server->setServerEventHandler(listenHandler);
+        server->setNumIOThreads(numIOThreads);
+        server->setUseReusePortListeners(useReusePortListeners);
+        server->setUseCompletionQueue(useCompletionQueue);
+        server->setPipelineDepth(pipelineDepth);
+        server->setPipelineInOrder(pipelineInOrder);
+        if (idleReadBufferLimit > 0) {
+          server->setIdleReadBufferLimit(idleReadBufferLimit);
+        }
+#ifdef TNONBLOCKINGSERVERTEST_WITH_ZLIB
+        if (useHeaderProtocol) {
+          server->setInputProtocolFactory(make_shared<protocol::THeaderProtocolFactory>());
+          server->setOutputProtocolFactory(shared_ptr<protocol::TProtocolFactory>());
+        }
+#endif
+        if (threadManager) {
+          server->setThreadManager(threadManager);
+        }
         if (userEventBase) {
           server->registerEvents(userEventBase.get());
         }
@@ -126,7 +177,15 @@ private:
   };
 
 protected:
-  Fixture() : processor(new test::ParentServiceProcessor(make_shared<Handler>())) {}
+  Fixture()
+    : numIOThreads(1),
+      useReusePortListeners(false),
+      useCompletionQueue(false),
+      useHeaderProtocol(false),
+      pipelineDepth(1),
+      pipelineInOrder(false),
+      idleReadBufferLimit(0),
+      processor(new test::ParentServiceProcessor(make_shared<Handler>())) {}
 
   ~Fixture() {
     if (server) {
@@ -144,6 +203,14 @@ protected:
   int startServer(int port) {
     shared_ptr<Runner> runner(new Runner);
     runner->port = port;
+    runner->numIOThreads = numIOThreads;
+    runner->useReusePortListeners = useReusePortListeners;
+    runner->useCompletionQueue = useCompletionQueue;
+    runner->useHeaderProtocol = useHeaderProtocol;
+    runner->pipelineDepth = pipelineDepth;
+    runner->pipelineInOrder = pipelineInOrder;
+    runner->idleReadBufferLimit = idleReadBufferLimit;
+    runner->threadManager = threadManager;
     runner->processor = processor;
     runner->userEventBase = userEventBase_;
 
@@ -168,6 +235,55 @@ protected:
     return strings.size() == 1 && !(strings[0].compare("foo"));
   }
 
+  // Responses far larger than the socket buffers are written in pieces
+  static void checkLargeResponses(int port) {
+    shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+    socket->open();
+    test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+        make_shared<transport::TFramedTransport>(socket)));
+
+    const std::string large(1 << 20, 'x');
+    client.addString(large);
+    for (int i = 0; i < 8; ++i) {
+      client.send_getStrings();
+    }
+    for (int i = 0; i < 8; ++i) {
+      std::vector<std::string> strings;
+      client.recv_getStrings(strings);
+      BOOST_REQUIRE_EQUAL(1u, strings.size());
+      BOOST_CHECK(strings[0] == large);
+    }
+  }
+
+  // Reads a reply without knowing which call it answers
+  static std::string readReplyName(shared_ptr<protocol::TProtocol> protocol) {
+    std::string name;
+    protocol::TMessageType type;
+    int32_t seqid;
+    protocol->readMessageBegin(name, type, seqid);
+    protocol->skip(protocol::T_STRUCT);
+    protocol->readMessageEnd();
+    protocol->getTransport()->readEnd();
+    return name;
+  }
+
+#ifdef TNONBLOCKINGSERVERTEST_WITH_ZLIB
+  shared_ptr<protocol::THeaderProtocol> headerProtocol(int serverPort) {
+    shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", serverPort));
+    socket->open();
+    return make_shared<protocol::THeaderProtocol>(socket);
+  }
+#endif
+
+protected:
+  size_t numIOThreads;
+  bool useReusePortListeners;
+  bool useCompletionQueue;
+  bool useHeaderProtocol;
+  uint32_t pipelineDepth;
+  bool pipelineInOrder;
+  size_t idleReadBufferLimit;
+  shared_ptr<ThreadManager> threadManager;
 private:
   shared_ptr<event_base> userEventBase_;
   shared_ptr<test::ParentServiceProcessor> processor;
@@ -212,4 +328,316 @@ BOOST_FIXTURE_TEST_CASE(provide_event_base, Fixture) {
 #endif
 }
 
+BOOST_FIXTURE_TEST_CASE(reuse_port_listeners, Fixture) {
+  numIOThreads = 4;
+  useReusePortListeners = true;
+  startServer(0);
+  int port = server->getListenPort();
+
+  // The kernel spreads these over the listen sockets of all IO threads
+  std::vector<shared_ptr<test::ParentServiceClient> > clients;
+  for (int i = 0; i < 32; ++i) {
+    shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+    socket->open();
+    clients.push_back(make_shared<test::ParentServiceClient>(make_shared<protocol::TBinaryProtocol>(
+        make_shared<transport::TFramedTransport>(socket))));
+  }
+  for (auto& client : clients) {
+    client->addString("foo");
+  }
+
+  std::vector<std::string> strings;
+  clients[0]->getStrings(strings);
+  BOOST_CHECK_EQUAL(clients.size(), strings.size());
+
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(completion_queue, Fixture) {
+  numIOThreads = 2;
+  useCompletionQueue = true;
+  threadManager = ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  startServer(0);
+  int port = server->getListenPort();
+
+  std::vector<shared_ptr<test::ParentServiceClient> > clients;
+  for (int i = 0; i < 8; ++i) {
+    shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+    socket->open();
+    clients.push_back(make_shared<test::ParentServiceClient>(make_shared<protocol::TBinaryProtocol>(
+        make_shared<transport::TFramedTransport>(socket))));
+  }
+  for (int i = 0; i < 50; ++i) {
+    for (auto& client : clients) {
+      client->addString("foo");
+    }
+  }
+
+  std::vector<std::string> strings;
+  clients[0]->getStrings(strings);
+  BOOST_CHECK_EQUAL(50 * clients.size(), strings.size());
+
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(pipelining, Fixture) {
+  pipelineDepth = 8;
+  threadManager = ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  startServer(0);
+
+  shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", server->getListenPort()));
+  socket->open();
+  shared_ptr<protocol::TProtocol> protocol = make_shared<protocol::TBinaryProtocol>(
+      make_shared<transport::TFramedTransport>(socket));
+  test::ParentServiceClient client(protocol);
+
+  // The requests of one connection run at once, and the quick one is
+  // answered first
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 3; ++i) {
+    client.send_getDataWait(300);
+  }
+  client.send_getGeneration();
+  BOOST_CHECK_EQUAL("getGeneration", readReplyName(protocol));
+  for (int i = 0; i < 3; ++i) {
+    BOOST_CHECK_EQUAL("getDataWait", readReplyName(protocol));
+  }
+  BOOST_CHECK_LT(std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - start).count(),
+                 800);
+
+  // Oneway requests mix in, and the connection goes on as usual
+  client.onewayWait();
+  client.addString("foo");
+  std::vector<std::string> strings;
+  client.getStrings(strings);
+  BOOST_CHECK_EQUAL(1u, strings.size());
+
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(large_responses, Fixture) {
+  threadManager = ThreadManager::newSimpleThreadManager(2);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  startServer(0);
+  checkLargeResponses(server->getListenPort());
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(pipelining_large_responses, Fixture) {
+  pipelineDepth = 8;
+  threadManager = ThreadManager::newSimpleThreadManager(2);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  startServer(0);
+  checkLargeResponses(server->getListenPort());
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(pipelining_in_order, Fixture) {
+  pipelineDepth = 8;
+  pipelineInOrder = true;
+  threadManager = ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  startServer(0);
+
+  shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", server->getListenPort()));
+  socket->open();
+  shared_ptr<protocol::TProtocol> protocol = make_shared<protocol::TBinaryProtocol>(
+      make_shared<transport::TFramedTransport>(socket));
+  test::ParentServiceClient client(protocol);
+
+  client.send_getDataWait(200);
+  client.send_getGeneration();
+  client.send_getDataWait(100);
+  BOOST_CHECK_EQUAL("getDataWait", readReplyName(protocol));
+  BOOST_CHECK_EQUAL("getGeneration", readReplyName(protocol));
+  BOOST_CHECK_EQUAL("getDataWait", readReplyName(protocol));
+
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(pipelining_half_close, Fixture) {
+  pipelineDepth = 8;
+  threadManager = ThreadManager::newSimpleThreadManager(2);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  startServer(0);
+
+  // The client is done sending while its requests run, and still gets the
+  // responses before the server closes
+  shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", server->getListenPort()));
+  socket->setRecvTimeout(5000);
+  socket->open();
+  shared_ptr<protocol::TProtocol> protocol = make_shared<protocol::TBinaryProtocol>(
+      make_shared<transport::TFramedTransport>(socket));
+  test::ParentServiceClient client(protocol);
+  client.send_getDataWait(100);
+  client.send_getDataWait(100);
+  client.send_getGeneration();
+  BOOST_REQUIRE_EQUAL(0, ::shutdown(socket->getSocketFD(), SHUT_WR));
+
+  std::multiset<std::string> names;
+  for (int i = 0; i < 3; ++i) {
+    names.insert(readReplyName(protocol));
+  }
+  BOOST_CHECK_EQUAL(2u, names.count("getDataWait"));
+  BOOST_CHECK_EQUAL(1u, names.count("getGeneration"));
+  uint8_t byte;
+  BOOST_CHECK_EQUAL(0u, socket->read(&byte, 1));
+
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(pipelining_idle_read_buffer_limit, Fixture) {
+  pipelineDepth = 4;
+  idleReadBufferLimit = 1024;
+  threadManager = ThreadManager::newSimpleThreadManager(2);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  startServer(0);
+
+  // Frames past the limit are freed once answered, and read into new
+  // buffers after
+  shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", server->getListenPort()));
+  socket->open();
+  test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+      make_shared<transport::TFramedTransport>(socket)));
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 4; ++i) {
+      client.send_addString(std::string(i % 2 ? 10000 : 10, 'a' + i));
+    }
+    for (int i = 0; i < 4; ++i) {
+      client.recv_addString();
+    }
+  }
+  std::vector<std::string> strings;
+  client.getStrings(strings);
+  BOOST_CHECK_EQUAL(12u, strings.size());
+
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(pipelining_close, Fixture) {
+  pipelineDepth = 8;
+  threadManager = ThreadManager::newSimpleThreadManager(2);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  startServer(0);
+  int port = server->getListenPort();
+
+  // The client leaves while its requests run
+  {
+    shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+    socket->open();
+    test::ParentServiceClient client(make_shared<protocol::TBinaryProtocol>(
+        make_shared<transport::TFramedTransport>(socket)));
+    client.send_getDataWait(100);
+    client.send_getDataWait(100);
+    socket->close();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(300));
+  BOOST_CHECK_EQUAL(0u, server->getNumActiveProcessors());
+  BOOST_CHECK(canCommunicate(port));
+
+  server->stop();
+}
+
+#ifdef TNONBLOCKINGSERVERTEST_WITH_ZLIB
+BOOST_FIXTURE_TEST_CASE(request_deadline, Fixture) {
+  useHeaderProtocol = true;
+  startServer(0);
+  shared_ptr<protocol::THeaderProtocol> protocol = headerProtocol(server->getListenPort());
+  test::ParentServiceClient client(protocol);
+
+  // Headers are sent with the next call only
+  BOOST_CHECK_EQUAL(-1, client.getGeneration());
+  protocol->setHeader(TRequestDeadline::HEADER, "10000");
+  int32_t remaining = client.getGeneration();
+  BOOST_CHECK_GT(remaining, 0);
+  BOOST_CHECK_LE(remaining, 10000);
+
+  // A request that has expired on arrival gets no reply, and the connection
+  // goes on with the next one
+  protocol->setHeader(TRequestDeadline::HEADER, "0");
+  client.send_addString("late");
+  client.addString("foo");
+  std::vector<std::string> strings;
+  client.getStrings(strings);
+  BOOST_REQUIRE_EQUAL(1u, strings.size());
+  BOOST_CHECK_EQUAL("foo", strings[0]);
+  BOOST_CHECK_EQUAL(1u, server->getShedRequestCount());
+
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(request_deadline_out_of_range, Fixture) {
+  useHeaderProtocol = true;
+  startServer(0);
+  shared_ptr<protocol::THeaderProtocol> protocol = headerProtocol(server->getListenPort());
+  test::ParentServiceClient client(protocol);
+
+  // A timeout past the limit means no deadline, rather than one that has
+  // wrapped around into the past
+  protocol->setHeader(TRequestDeadline::HEADER, std::to_string(LLONG_MAX));
+  BOOST_CHECK_EQUAL(-1, client.getGeneration());
+
+  // Negative ones have expired, however large
+  protocol->setHeader(TRequestDeadline::HEADER, "-5");
+  client.send_addString("late");
+  protocol->setHeader(TRequestDeadline::HEADER, std::to_string(LLONG_MIN));
+  client.send_addString("later");
+  client.addString("foo");
+  std::vector<std::string> strings;
+  client.getStrings(strings);
+  BOOST_REQUIRE_EQUAL(1u, strings.size());
+  BOOST_CHECK_EQUAL("foo", strings[0]);
+  BOOST_CHECK_EQUAL(2u, server->getShedRequestCount());
+
+  std::chrono::milliseconds timeout;
+  BOOST_CHECK(!TRequestDeadline::parseTimeout(std::to_string(LLONG_MAX), timeout));
+  BOOST_CHECK(!TRequestDeadline::parseTimeout("99999999999999999999", timeout));
+  BOOST_CHECK(TRequestDeadline::parseTimeout(std::to_string(LLONG_MIN), timeout));
+  BOOST_CHECK_EQUAL(0, timeout.count());
+
+  server->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(request_deadline_queued, Fixture) {
+  useHeaderProtocol = true;
+  threadManager = ThreadManager::newSimpleThreadManager(1);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  startServer(0);
+  int port = server->getListenPort();
+
+  // Keep the only worker busy, so the next request expires in the queue
+  test::ParentServiceClient busy(headerProtocol(port));
+  busy.send_getDataWait(300);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  shared_ptr<protocol::THeaderProtocol> protocol = headerProtocol(port);
+  test::ParentServiceClient client(protocol);
+  protocol->setHeader(TRequestDeadline::HEADER, "50");
+  client.send_addString("late");
+
+  std::string data;
+  busy.recv_getDataWait(data);
+  client.addString("foo");
+  std::vector<std::string> strings;
+  client.getStrings(strings);
+  BOOST_REQUIRE_EQUAL(1u, strings.size());
+  BOOST_CHECK_EQUAL("foo", strings[0]);
+  BOOST_CHECK_EQUAL(1u, server->getShedRequestCount());
+
+  server->stop();
+}
+#endif
+
 BOOST_AUTO_TEST_SUITE_END()
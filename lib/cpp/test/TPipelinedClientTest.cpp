@@ -0,0 +1,291 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE TPipelinedClientTest
+#include <boost/test/unit_test.hpp>
+
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <thrift/TApplicationException.h>
+#include <thrift/async/TPipelinedClient.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TSocket.h>
+
+using apache::thrift::TApplicationException;
+using apache::thrift::async::TPipelinedClient;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TBinaryProtocolFactory;
+using apache::thrift::protocol::TMessageType;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TSocket;
+using apache::thrift::transport::TTransportException;
+using std::shared_ptr;
+
+/**
+ * One call read by the fake server.
+ */
+struct Call {
+  std::string name;
+  int32_t seqid;
+  int32_t value;
+};
+
+/**
+ * A hand written "double" call, with an i32 argument and an i32 result.
+ */
+static void writeArgs(TProtocol* prot, int32_t value) {
+  prot->writeStructBegin("double_args");
+  prot->writeFieldBegin("value", apache::thrift::protocol::T_I32, 1);
+  prot->writeI32(value);
+  prot->writeFieldEnd();
+  prot->writeFieldStop();
+  prot->writeStructEnd();
+}
+
+static int32_t readResult(TProtocol* prot) {
+  std::string name;
+  apache::thrift::protocol::TType type;
+  int16_t id;
+  int32_t value = -1;
+  prot->readStructBegin(name);
+  while (true) {
+    prot->readFieldBegin(name, type, id);
+    if (type == apache::thrift::protocol::T_STOP) {
+      break;
+    }
+    if (id != 0) {
+      return -1;
+    }
+    prot->readI32(value);
+    prot->readFieldEnd();
+  }
+  prot->readStructEnd();
+  prot->readMessageEnd();
+  return value;
+}
+
+static std::future<shared_ptr<TProtocol> > callDouble(TPipelinedClient& client, int32_t value) {
+  return client.call("double", [value](TProtocol* prot) { writeArgs(prot, value); });
+}
+
+/**
+ * The server end of a socket pair, speaking framed binary.
+ */
+class FakeServer {
+public:
+  explicit FakeServer(int fd)
+    : socket_(new TSocket(fd)),
+      transport_(new TFramedTransport(socket_)),
+      prot_(new TBinaryProtocol(transport_)) {}
+
+  Call read() {
+    Call call;
+    TMessageType type;
+    prot_->readMessageBegin(call.name, type, call.seqid);
+    std::string name;
+    apache::thrift::protocol::TType ftype;
+    int16_t id;
+    prot_->readStructBegin(name);
+    prot_->readFieldBegin(name, ftype, id);
+    prot_->readI32(call.value);
+    prot_->readFieldEnd();
+    prot_->readFieldBegin(name, ftype, id);
+    prot_->readStructEnd();
+    prot_->readMessageEnd();
+    transport_->readEnd();
+    return call;
+  }
+
+  void reply(const Call& call) {
+    prot_->writeMessageBegin(call.name, apache::thrift::protocol::T_REPLY, call.seqid);
+    prot_->writeStructBegin("double_result");
+    prot_->writeFieldBegin("success", apache::thrift::protocol::T_I32, 0);
+    prot_->writeI32(call.value * 2);
+    prot_->writeFieldEnd();
+    prot_->writeFieldStop();
+    prot_->writeStructEnd();
+    prot_->writeMessageEnd();
+    transport_->writeEnd();
+    transport_->flush();
+  }
+
+  void replyException(const Call& call) {
+    TApplicationException x(TApplicationException::INTERNAL_ERROR, "no");
+    prot_->writeMessageBegin(call.name, apache::thrift::protocol::T_EXCEPTION, call.seqid);
+    x.write(prot_.get());
+    prot_->writeMessageEnd();
+    transport_->writeEnd();
+    transport_->flush();
+  }
+
+  void close() { socket_->close(); }
+
+private:
+  shared_ptr<TSocket> socket_;
+  shared_ptr<TFramedTransport> transport_;
+  shared_ptr<TBinaryProtocol> prot_;
+};
+
+class Fixture {
+public:
+  Fixture() {
+    int fds[2];
+    BOOST_REQUIRE_EQUAL(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+    server.reset(new FakeServer(fds[0]));
+    clientFd = fds[1];
+  }
+
+  void connect(uint32_t maxInFlight) {
+    client.reset(new TPipelinedClient(shared_ptr<TSocket>(new TSocket(clientFd)),
+                                      std::make_shared<TBinaryProtocolFactory>(),
+                                      maxInFlight));
+    client->open();
+  }
+
+  ~Fixture() {
+    if (client) {
+      client->close();
+    }
+    if (serverThread.joinable()) {
+      serverThread.join();
+    }
+  }
+
+  int clientFd;
+  std::unique_ptr<FakeServer> server;
+  std::unique_ptr<TPipelinedClient> client;
+  std::thread serverThread;
+};
+
+BOOST_FIXTURE_TEST_SUITE(TPipelinedClientTest, Fixture)
+
+BOOST_AUTO_TEST_CASE(out_of_order_replies) {
+  connect(64);
+  std::vector<std::future<shared_ptr<TProtocol> > > replies;
+  for (int32_t i = 0; i < 64; ++i) {
+    replies.push_back(callDouble(*client, i));
+  }
+  BOOST_CHECK_EQUAL(64u, client->getInFlight());
+
+  std::vector<Call> calls;
+  for (int i = 0; i < 64; ++i) {
+    calls.push_back(server->read());
+    BOOST_CHECK_EQUAL(i, calls.back().value);
+  }
+  std::reverse(calls.begin(), calls.end());
+  for (const Call& call : calls) {
+    server->reply(call);
+  }
+
+  for (int32_t i = 0; i < 64; ++i) {
+    BOOST_CHECK_EQUAL(2 * i, readResult(replies[i].get().get()));
+  }
+  BOOST_CHECK_EQUAL(0u, client->getInFlight());
+}
+
+BOOST_AUTO_TEST_CASE(many_threads) {
+  const int threads = 8;
+  const int callsPerThread = 2000;
+  connect(16);
+  serverThread = std::thread([this, threads, callsPerThread] {
+    for (int i = 0; i < threads * callsPerThread; ++i) {
+      server->reply(server->read());
+    }
+  });
+
+  std::vector<std::thread> callers;
+  std::vector<int> failures(threads, 0);
+  for (int t = 0; t < threads; ++t) {
+    callers.push_back(std::thread([this, t, callsPerThread, &failures] {
+      // Keep a few calls outstanding per thread, so callers contend for slots
+      std::vector<std::pair<int32_t, std::future<shared_ptr<TProtocol> > > > pending;
+      for (int i = 0; i < callsPerThread; ++i) {
+        int32_t value = t * callsPerThread + i;
+        pending.push_back(std::make_pair(value, callDouble(*client, value)));
+        if (pending.size() == 4 || i + 1 == callsPerThread) {
+          for (auto& reply : pending) {
+            if (readResult(reply.second.get().get()) != 2 * reply.first) {
+              ++failures[t];
+            }
+          }
+          pending.clear();
+        }
+      }
+    }));
+  }
+  for (auto& caller : callers) {
+    caller.join();
+  }
+  for (int t = 0; t < threads; ++t) {
+    BOOST_CHECK_EQUAL(0, failures[t]);
+  }
+  BOOST_CHECK_EQUAL(0u, client->getInFlight());
+}
+
+BOOST_AUTO_TEST_CASE(application_exception) {
+  connect(4);
+  auto reply = callDouble(*client, 1);
+  server->replyException(server->read());
+  BOOST_CHECK_THROW(reply.get(), TApplicationException);
+
+  // The connection is still usable
+  auto next = callDouble(*client, 2);
+  server->reply(server->read());
+  BOOST_CHECK_EQUAL(4, readResult(next.get().get()));
+}
+
+BOOST_AUTO_TEST_CASE(bad_seqid) {
+  connect(4);
+  auto reply = callDouble(*client, 1);
+  Call call = server->read();
+  call.seqid += 1;
+  server->reply(call);
+  BOOST_CHECK_THROW(reply.get(), TApplicationException);
+  BOOST_CHECK_THROW(callDouble(*client, 2), TTransportException);
+}
+
+BOOST_AUTO_TEST_CASE(connection_lost) {
+  connect(4);
+  auto first = callDouble(*client, 1);
+  auto second = callDouble(*client, 2);
+  server->read();
+  server->close();
+  BOOST_CHECK_THROW(first.get(), TTransportException);
+  BOOST_CHECK_THROW(second.get(), TTransportException);
+  BOOST_CHECK_THROW(callDouble(*client, 3), TTransportException);
+}
+
+BOOST_AUTO_TEST_CASE(close_fails_pending_calls) {
+  connect(4);
+  auto reply = callDouble(*client, 1);
+  client->close();
+  BOOST_CHECK_THROW(reply.get(), TTransportException);
+  BOOST_CHECK_THROW(callDouble(*client, 2), TTransportException);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
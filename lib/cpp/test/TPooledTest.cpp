@@ -0,0 +1,141 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <string>
+#include <thrift/TPooled.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+#include "gen-cpp/PooledService.h"
+
+BOOST_AUTO_TEST_SUITE(TPooledTest)
+
+using apache::thrift::TPooled;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TProtocol;
+using apache::thrift::transport::TMemoryBuffer;
+using std::shared_ptr;
+
+static pooledtest::Batch makeBatch(int size) {
+  pooledtest::Batch batch;
+  for (int i = 0; i < size; ++i) {
+    batch.names.push_back("name " + std::to_string(i));
+    batch.values[i] = "value";
+  }
+  return batch;
+}
+
+BOOST_AUTO_TEST_CASE(test_clear) {
+  pooledtest::Batch batch = makeBatch(100);
+  batch.__set_note("note");
+  batch.label = "a label long enough to live on the heap";
+  batch.priority = 7;
+  const std::string* names = batch.names.data();
+
+  batch.__clear();
+  BOOST_CHECK(batch == pooledtest::Batch());
+  BOOST_CHECK(!batch.__isset.note);
+  BOOST_CHECK_EQUAL("unlabeled", batch.label);
+  BOOST_CHECK_EQUAL(3, batch.priority);
+  // The list keeps its buffer.
+  BOOST_CHECK_EQUAL(0u, batch.names.size());
+  BOOST_CHECK(batch.names.capacity() >= 100);
+  batch.names.push_back("again");
+  BOOST_CHECK(batch.names.data() == names);
+}
+
+BOOST_AUTO_TEST_CASE(test_nested_borrow) {
+  pooledtest::Batch* pooled;
+  {
+    TPooled<pooledtest::Batch> outer;
+    pooled = &*outer;
+    outer->names.push_back("outer");
+    TPooled<pooledtest::Batch> inner;
+    BOOST_CHECK(&*inner != pooled);
+    BOOST_CHECK(inner->names.empty());
+  }
+  TPooled<pooledtest::Batch> again;
+  BOOST_CHECK(&*again == pooled);
+  BOOST_CHECK(again->names.empty());
+}
+
+class PooledHandler : public pooledtest::PooledServiceIf {
+public:
+  PooledHandler() : batch(nullptr), names(nullptr), hasDeadline(false), hasNote(false) {}
+
+  int32_t submit(const pooledtest::Batch& batch, const int64_t deadline) override {
+    this->batch = &batch;
+    names = batch.names.data();
+    hasDeadline = deadline != 0;
+    hasNote = batch.__isset.note;
+    if (batch.names.empty()) {
+      pooledtest::Rejected rejected;
+      rejected.reason = "empty";
+      throw rejected;
+    }
+    return static_cast<int32_t>(batch.names.size());
+  }
+
+  const pooledtest::Batch* batch;
+  const std::string* names;
+  bool hasDeadline;
+  bool hasNote;
+};
+
+BOOST_AUTO_TEST_CASE(test_processor_reuses_args) {
+  shared_ptr<TMemoryBuffer> requests(new TMemoryBuffer());
+  shared_ptr<TMemoryBuffer> responses(new TMemoryBuffer());
+  shared_ptr<TProtocol> requestProt(new TBinaryProtocol(requests));
+  shared_ptr<TProtocol> responseProt(new TBinaryProtocol(responses));
+  shared_ptr<PooledHandler> handler(new PooledHandler());
+  pooledtest::PooledServiceProcessor processor(handler);
+  pooledtest::PooledServiceClient client(responseProt, requestProt);
+
+  pooledtest::Batch first = makeBatch(50);
+  first.__set_note("note");
+  client.send_submit(first, 1000);
+  BOOST_CHECK(processor.process(requestProt, responseProt, nullptr));
+  BOOST_CHECK_EQUAL(50, client.recv_submit());
+  BOOST_CHECK(handler->hasNote);
+  BOOST_CHECK(handler->hasDeadline);
+  const pooledtest::Batch* batch = handler->batch;
+  const std::string* names = handler->names;
+
+  // A smaller request lands in the same struct and the same list buffer,
+  // without anything left over from the first one.
+  client.send_submit(makeBatch(20), 0);
+  BOOST_CHECK(processor.process(requestProt, responseProt, nullptr));
+  BOOST_CHECK_EQUAL(20, client.recv_submit());
+  BOOST_CHECK(handler->batch == batch);
+  BOOST_CHECK(handler->names == names);
+  BOOST_CHECK(!handler->hasNote);
+  BOOST_CHECK(!handler->hasDeadline);
+
+  // The exception from this call must not show up in the next result.
+  client.send_submit(makeBatch(0), 0);
+  BOOST_CHECK(processor.process(requestProt, responseProt, nullptr));
+  BOOST_CHECK_THROW(client.recv_submit(), pooledtest::Rejected);
+  client.send_submit(makeBatch(5), 0);
+  BOOST_CHECK(processor.process(requestProt, responseProt, nullptr));
+  BOOST_CHECK_EQUAL(5, client.recv_submit());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,384 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE TSSLSessionTest
+#include <boost/test/unit_test.hpp>
+#include <boost/format.hpp>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <openssl/pem.h>
+#include <openssl/x509v3.h>
+#include <thrift/transport/TSSLServerSocket.h>
+#include <thrift/transport/TSSLSocket.h>
+#ifdef HAVE_SIGNAL_H
+#include <signal.h>
+#endif
+
+using apache::thrift::transport::SSLProtocol;
+using apache::thrift::transport::TSSLServerSocket;
+using apache::thrift::transport::TSSLSocket;
+using apache::thrift::transport::TSSLSocketFactory;
+using apache::thrift::transport::TTransportException;
+
+using std::shared_ptr;
+
+/**
+ * A self-signed certificate for localhost, valid for a day, which the
+ * servers and clients present and trust alike.  It is made afresh for each
+ * run, so the test does not depend on the expiry of checked in keys.
+ */
+std::string certificate;
+std::string privateKey;
+
+void check(bool ok, const char* what)
+{
+  if (!ok)
+  {
+    throw std::runtime_error(std::string("Generating the test certificate failed: ") + what);
+  }
+}
+
+std::string toPem(const std::function<int(BIO*)>& write)
+{
+  BIO* bio = BIO_new(BIO_s_mem());
+  check(bio != nullptr, "BIO_new");
+  check(write(bio) == 1, "PEM_write");
+  char* data;
+  long length = BIO_get_mem_data(bio, &data);
+  std::string pem(data, length);
+  BIO_free(bio);
+  return pem;
+}
+
+void addExtension(X509* cert, int nid, const char* value)
+{
+  X509V3_CTX ctx;
+  X509V3_set_ctx_nodb(&ctx);
+  X509V3_set_ctx(&ctx, cert, cert, nullptr, nullptr, 0);
+  X509_EXTENSION* extension = X509V3_EXT_conf_nid(nullptr, &ctx, nid, const_cast<char*>(value));
+  check(extension != nullptr, "X509V3_EXT_conf_nid");
+  X509_add_ext(cert, extension, -1);
+  X509_EXTENSION_free(extension);
+}
+
+void generateCertificate()
+{
+  // RSA, as the kernel TLS test picks an RSA cipher suite
+  EVP_PKEY* key = nullptr;
+  EVP_PKEY_CTX* keyCtx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+  check(keyCtx != nullptr, "EVP_PKEY_CTX_new_id");
+  check(EVP_PKEY_keygen_init(keyCtx) == 1, "EVP_PKEY_keygen_init");
+  check(EVP_PKEY_CTX_set_rsa_keygen_bits(keyCtx, 2048) == 1, "EVP_PKEY_CTX_set_rsa_keygen_bits");
+  check(EVP_PKEY_keygen(keyCtx, &key) == 1, "EVP_PKEY_keygen");
+  EVP_PKEY_CTX_free(keyCtx);
+
+  X509* cert = X509_new();
+  X509_set_version(cert, 2);
+  ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+  X509_gmtime_adj(X509_get_notBefore(cert), -60 * 60);
+  X509_gmtime_adj(X509_get_notAfter(cert), 24 * 60 * 60);
+  X509_set_pubkey(cert, key);
+  X509_NAME* name = X509_get_subject_name(cert);
+  X509_NAME_add_entry_by_txt(name,
+                             "CN",
+                             MBSTRING_ASC,
+                             reinterpret_cast<const unsigned char*>("localhost"),
+                             -1,
+                             -1,
+                             0);
+  X509_set_issuer_name(cert, name);
+  addExtension(cert, NID_basic_constraints, "critical,CA:TRUE");
+  addExtension(cert, NID_subject_alt_name, "DNS:localhost,IP:127.0.0.1,IP:::1");
+  check(X509_sign(cert, key, EVP_sha256()) > 0, "X509_sign");
+
+  certificate = toPem([cert](BIO* bio) { return PEM_write_bio_X509(bio, cert); });
+  privateKey = toPem([key](BIO* bio) {
+    return PEM_write_bio_PrivateKey(bio, key, nullptr, nullptr, 0, nullptr, nullptr);
+  });
+  X509_free(cert);
+  EVP_PKEY_free(key);
+}
+
+struct GlobalFixture
+{
+  GlobalFixture()
+  {
+#ifdef __linux__
+    // OpenSSL calls send() without MSG_NOSIGPIPE so writing to a socket that has
+    // disconnected can cause a SIGPIPE signal...
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    TSSLSocketFactory::setManualOpenSSLInitialization(true);
+    apache::thrift::transport::initializeOpenSSL();
+
+    generateCertificate();
+  }
+
+  virtual ~GlobalFixture()
+  {
+    apache::thrift::transport::cleanupOpenSSL();
+#ifdef __linux__
+    signal(SIGPIPE, SIG_DFL);
+#endif
+  }
+};
+
+#if (BOOST_VERSION >= 105900)
+BOOST_GLOBAL_FIXTURE(GlobalFixture);
+#else
+BOOST_GLOBAL_FIXTURE(GlobalFixture)
+#endif
+
+shared_ptr<TSSLSocketFactory> serverFactory(SSLProtocol protocol = apache::thrift::transport::SSLTLS)
+{
+  shared_ptr<TSSLSocketFactory> factory(new TSSLSocketFactory(protocol));
+  factory->loadCertificateFromBuffer(certificate.c_str());
+  factory->loadPrivateKeyFromBuffer(privateKey.c_str());
+  factory->server(true);
+  return factory;
+}
+
+shared_ptr<TSSLSocketFactory> clientFactory(SSLProtocol protocol = apache::thrift::transport::SSLTLS)
+{
+  shared_ptr<TSSLSocketFactory> factory(new TSSLSocketFactory(protocol));
+  factory->authenticate(true);
+  factory->loadTrustedCertificatesFromBuffer(certificate.c_str());
+  return factory;
+}
+
+/**
+ * Answers each connection with "OK", or hands it to a handler, until
+ * destroyed.
+ */
+class Server
+{
+public:
+  typedef std::function<void(shared_ptr<TSSLSocket>)> Handler;
+
+  Server(shared_ptr<TSSLSocketFactory> factory, int port = 0, Handler handler = Handler())
+    : socket_(new TSSLServerSocket("localhost", port, factory)), handler_(handler)
+  {
+    socket_->listen();
+    port_ = socket_->getPort();
+    thread_ = std::thread([this]() { serve(); });
+  }
+
+  ~Server()
+  {
+    socket_->interrupt();
+    thread_.join();
+    socket_->close();
+  }
+
+  int getPort() const { return port_; }
+
+private:
+  void serve()
+  {
+    for (;;)
+    {
+      shared_ptr<TSSLSocket> client;
+      try
+      {
+        client = std::static_pointer_cast<TSSLSocket>(socket_->accept());
+      }
+      catch (TTransportException&)
+      {
+        return;
+      }
+      try
+      {
+        if (handler_)
+        {
+          handler_(client);
+        }
+        else
+        {
+          client->write(reinterpret_cast<const uint8_t*>("OK"), 2);
+          client->flush();
+        }
+        // Until the client is done
+        uint8_t byte;
+        client->read(&byte, 1);
+      }
+      catch (TTransportException&)
+      {
+      }
+      client->close();
+    }
+  }
+
+  shared_ptr<TSSLServerSocket> socket_;
+  Handler handler_;
+  int port_;
+  std::thread thread_;
+};
+
+/**
+ * Connects, reads the server's "OK", and returns whether the session was
+ * resumed.
+ */
+bool connect(shared_ptr<TSSLSocketFactory> factory, int port)
+{
+  shared_ptr<TSSLSocket> socket = factory->createSocket("localhost", port);
+  socket->open();
+  uint8_t buf[2];
+  BOOST_CHECK_EQUAL(2u, socket->read(buf, 2));
+  BOOST_CHECK_EQUAL(0, memcmp(buf, "OK", 2));
+  bool reused = socket->isSessionReused();
+  socket->close();
+  return reused;
+}
+
+BOOST_AUTO_TEST_SUITE(TSSLSessionTest)
+
+BOOST_AUTO_TEST_CASE(client_session_cache)
+{
+  Server server(serverFactory());
+  shared_ptr<TSSLSocketFactory> client = clientFactory();
+  client->sessionCache(true);
+
+  BOOST_CHECK(!connect(client, server.getPort()));
+  // Each connection resumes with the ticket of the one before
+  BOOST_CHECK(connect(client, server.getPort()));
+  BOOST_CHECK(connect(client, server.getPort()));
+}
+
+BOOST_AUTO_TEST_CASE(client_session_cache_off)
+{
+  Server server(serverFactory());
+  shared_ptr<TSSLSocketFactory> client = clientFactory();
+
+  BOOST_CHECK(!connect(client, server.getPort()));
+  BOOST_CHECK(!connect(client, server.getPort()));
+}
+
+BOOST_AUTO_TEST_CASE(server_session_cache)
+{
+  // Without tickets, TLS 1.2 sessions are resumed from the server's cache
+  shared_ptr<TSSLSocketFactory> factory = serverFactory(apache::thrift::transport::TLSv1_2);
+  factory->sessionTickets(false);
+  Server server(factory);
+  shared_ptr<TSSLSocketFactory> client = clientFactory(apache::thrift::transport::TLSv1_2);
+  client->sessionCache(true);
+
+  BOOST_CHECK(!connect(client, server.getPort()));
+  BOOST_CHECK(connect(client, server.getPort()));
+
+  shared_ptr<TSSLSocketFactory> uncached = serverFactory(apache::thrift::transport::TLSv1_2);
+  uncached->sessionTickets(false);
+  uncached->sessionCache(false);
+  Server uncachedServer(uncached);
+  BOOST_CHECK(!connect(client, uncachedServer.getPort()));
+  BOOST_CHECK(!connect(client, uncachedServer.getPort()));
+}
+
+BOOST_AUTO_TEST_CASE(client_authentication)
+{
+  // Resumption on a server that verifies its clients
+  shared_ptr<TSSLSocketFactory> factory = serverFactory();
+  factory->authenticate(true);
+  factory->loadTrustedCertificatesFromBuffer(certificate.c_str());
+  Server server(factory);
+  shared_ptr<TSSLSocketFactory> client = clientFactory();
+  client->loadCertificateFromBuffer(certificate.c_str());
+  client->loadPrivateKeyFromBuffer(privateKey.c_str());
+  client->sessionCache(true);
+
+  BOOST_CHECK(!connect(client, server.getPort()));
+  BOOST_CHECK(connect(client, server.getPort()));
+}
+
+BOOST_AUTO_TEST_CASE(ticket_keys)
+{
+  BOOST_CHECK_THROW(serverFactory()->ticketKeys("short"), TTransportException);
+
+  const std::string keys(80, 'k');
+  shared_ptr<TSSLSocketFactory> client = clientFactory();
+  client->sessionCache(true);
+  int port;
+  {
+    shared_ptr<TSSLSocketFactory> factory = serverFactory();
+    factory->ticketKeys(keys);
+    Server server(factory);
+    port = server.getPort();
+    BOOST_CHECK(!connect(client, port));
+  }
+
+  // A server restarted with the same keys resumes the session of the first
+  {
+    shared_ptr<TSSLSocketFactory> factory = serverFactory();
+    factory->ticketKeys(keys);
+    Server server(factory, port);
+    BOOST_CHECK(connect(client, port));
+  }
+
+  // One with other keys does not
+  {
+    shared_ptr<TSSLSocketFactory> factory = serverFactory();
+    factory->ticketKeys(std::string(80, 'x'));
+    Server server(factory, port);
+    BOOST_CHECK(!connect(client, port));
+  }
+}
+
+BOOST_AUTO_TEST_CASE(kernel_tls)
+{
+#ifdef SSL_OP_ENABLE_KTLS
+  shared_ptr<TSSLSocketFactory> factory = serverFactory(apache::thrift::transport::TLSv1_2);
+  factory->kernelTLS(true);
+  factory->ciphers("ECDHE-RSA-AES128-GCM-SHA256");
+  std::atomic<bool> kernelSend(false);
+  Server server(factory, 0, [&kernelSend](shared_ptr<TSSLSocket> socket) {
+    uint8_t byte;
+    socket->read(&byte, 1);
+    kernelSend = socket->isKernelTLSSend();
+    // Gathered, whether the kernel encrypts or OpenSSL does
+    struct iovec iov[2];
+    iov[0].iov_base = const_cast<char*>("O");
+    iov[0].iov_len = 1;
+    iov[1].iov_base = const_cast<char*>("K");
+    iov[1].iov_len = 1;
+    socket->writev(iov, 2);
+    socket->flush();
+  });
+
+  shared_ptr<TSSLSocketFactory> client = clientFactory(apache::thrift::transport::TLSv1_2);
+  client->kernelTLS(true);
+  shared_ptr<TSSLSocket> socket = client->createSocket("localhost", server.getPort());
+  socket->open();
+  socket->write(reinterpret_cast<const uint8_t*>("?"), 1);
+  uint8_t buf[2];
+  socket->readAll(buf, 2);
+  BOOST_CHECK_EQUAL(0, memcmp(buf, "OK", 2));
+  BOOST_TEST_MESSAGE(boost::format("kTLS send: server %1%, client %2%, client receive %3%")
+                     % kernelSend.load() % socket->isKernelTLSSend() % socket->isKernelTLSRecv());
+  socket->close();
+#else
+  BOOST_CHECK_THROW(clientFactory()->kernelTLS(true), TTransportException);
+#endif
+}
+
+BOOST_AUTO_TEST_SUITE_END()
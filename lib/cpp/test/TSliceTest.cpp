@@ -0,0 +1,178 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <thrift/TSlice.h>
+#include <thrift/TToString.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/protocol/TJSONProtocol.h>
+#include <thrift/transport/TBufferTransports.h>
+
+#include "gen-cpp/SliceTest_types.h"
+
+BOOST_AUTO_TEST_SUITE(TSliceTest)
+
+using apache::thrift::TSlice;
+using apache::thrift::protocol::TBinaryProtocol;
+using apache::thrift::protocol::TCompactProtocol;
+using apache::thrift::protocol::TJSONProtocol;
+using apache::thrift::transport::TFramedTransport;
+using apache::thrift::transport::TMemoryBuffer;
+using std::shared_ptr;
+using std::string;
+
+static_assert(std::is_same<decltype(slicetest::Blob::data), TSlice>::value,
+              "binary fields are generated as slices");
+static_assert(std::is_same<decltype(slicetest::Blob::copied), string>::value,
+              "cpp.type overrides slices");
+
+static slicetest::Blob makeBlob(char fill) {
+  slicetest::Blob blob;
+  blob.name = string(20, fill);
+  blob.data = string(1000, fill);
+  blob.chunks.push_back(string(10, fill));
+  blob.chunks.push_back(string());
+  blob.tags[string(5, fill)] = 42;
+  blob.copied = string(3, fill);
+  return blob;
+}
+
+static bool pointsInto(const TSlice& slice, const uint8_t* buf, uint32_t size) {
+  auto* p = reinterpret_cast<const uint8_t*>(slice.data());
+  return p >= buf && p + slice.size() <= buf + size;
+}
+
+BOOST_AUTO_TEST_CASE(test_slice_basics) {
+  TSlice empty;
+  TSlice a("abc");
+  TSlice b(string("abd"));
+  TSlice c = a;
+
+  BOOST_CHECK(empty.empty());
+  BOOST_CHECK_EQUAL(0, ::memcmp(empty.data(), "", 1));
+  BOOST_CHECK_EQUAL(3u, a.size());
+  BOOST_CHECK(a == c);
+  BOOST_CHECK_EQUAL(a.data(), c.data());
+  BOOST_CHECK(a != b);
+  BOOST_CHECK(a < b);
+  BOOST_CHECK(empty < a);
+  BOOST_CHECK_EQUAL("abd", b.str());
+  BOOST_CHECK_EQUAL("abc", apache::thrift::to_string(a));
+}
+
+BOOST_AUTO_TEST_CASE(test_memory_buffer_slices_outlive_message) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol protocol(buffer);
+
+  slicetest::Blob a = makeBlob('a');
+  a.write(&protocol);
+
+  uint8_t* buf;
+  uint32_t size;
+  buffer->getBuffer(&buf, &size);
+
+  slicetest::Blob b;
+  b.read(&protocol);
+  BOOST_CHECK(a == b);
+  BOOST_CHECK(pointsInto(b.data, buf, size));
+  BOOST_CHECK(pointsInto(b.chunks[0], buf, size));
+
+  // Reusing the buffer for the next message must not touch the slices.
+  buffer->readEnd();
+  slicetest::Blob c = makeBlob('c');
+  c.write(&protocol);
+  buffer->getBuffer(&buf, &size);
+  BOOST_CHECK(!pointsInto(b.data, buf, size));
+  BOOST_CHECK(a == b);
+
+  slicetest::Blob d;
+  d.read(&protocol);
+  BOOST_CHECK(c == d);
+  BOOST_CHECK(a == b);
+}
+
+BOOST_AUTO_TEST_CASE(test_framed_slices_keep_frame) {
+  shared_ptr<TMemoryBuffer> pipe(new TMemoryBuffer());
+  shared_ptr<TFramedTransport> writer(new TFramedTransport(pipe));
+  TCompactProtocol out(writer);
+
+  slicetest::Blob a = makeBlob('a');
+  slicetest::Blob c = makeBlob('c');
+  a.write(&out);
+  writer->flush();
+  c.write(&out);
+  writer->flush();
+
+  shared_ptr<TFramedTransport> reader(new TFramedTransport(pipe));
+  TCompactProtocol in(reader);
+
+  slicetest::Blob b;
+  b.read(&in);
+  reader->readEnd();
+  BOOST_CHECK(a == b);
+
+  // The second frame has the same size, so without the pin it would be read
+  // into the same buffer.
+  slicetest::Blob d;
+  d.read(&in);
+  reader->readEnd();
+  BOOST_CHECK(c == d);
+  BOOST_CHECK(a == b);
+  BOOST_CHECK(b.data.data() != d.data.data());
+}
+
+BOOST_AUTO_TEST_CASE(test_observed_buffer_is_copied) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TBinaryProtocol protocol(buffer);
+  slicetest::Blob a = makeBlob('a');
+  a.write(&protocol);
+
+  string bytes = buffer->getBufferAsString();
+  shared_ptr<TMemoryBuffer> observed(
+      new TMemoryBuffer(reinterpret_cast<uint8_t*>(&bytes[0]), static_cast<uint32_t>(bytes.size())));
+  TBinaryProtocol in(observed);
+
+  slicetest::Blob b;
+  b.read(&in);
+  BOOST_CHECK(a == b);
+  BOOST_CHECK(!pointsInto(b.data, reinterpret_cast<uint8_t*>(&bytes[0]),
+                          static_cast<uint32_t>(bytes.size())));
+
+  bytes.assign(bytes.size(), 'x');
+  BOOST_CHECK(a == b);
+}
+
+BOOST_AUTO_TEST_CASE(test_protocol_without_slices) {
+  shared_ptr<TMemoryBuffer> buffer(new TMemoryBuffer());
+  TJSONProtocol protocol(buffer);
+
+  slicetest::Blob a = makeBlob('a');
+  a.write(&protocol);
+
+  slicetest::Blob b;
+  b.read(&protocol);
+  BOOST_CHECK(a == b);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,381 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+#define BOOST_TEST_MODULE TUringServerTest
+#include <boost/test/unit_test.hpp>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "thrift/concurrency/Monitor.h"
+#include "thrift/concurrency/ThreadFactory.h"
+#include "thrift/concurrency/ThreadManager.h"
+#include "thrift/protocol/TBinaryProtocol.h"
+#include "thrift/server/TUringServer.h"
+#include "thrift/transport/TBufferTransports.h"
+#include "thrift/transport/TNonblockingServerSocket.h"
+#include "thrift/transport/TSocket.h"
+
+#include "gen-cpp/ParentService.h"
+
+using apache::thrift::concurrency::Guard;
+using apache::thrift::concurrency::Monitor;
+using apache::thrift::concurrency::Mutex;
+using apache::thrift::concurrency::ThreadFactory;
+using apache::thrift::concurrency::ThreadManager;
+using apache::thrift::server::TServerEventHandler;
+using apache::thrift::server::TUringServer;
+using std::make_shared;
+using std::shared_ptr;
+
+using namespace apache::thrift;
+
+struct Handler : public test::ParentServiceIf {
+  void addString(const std::string& s) override {
+    Guard g(mutex_);
+    strings_.push_back(s);
+  }
+  void getStrings(std::vector<std::string>& _return) override {
+    Guard g(mutex_);
+    _return = strings_;
+  }
+  int32_t incrementGeneration() override { return ++generation_; }
+  int32_t getGeneration() override { return generation_; }
+  void getDataWait(std::string&, const int32_t length) override {
+    std::this_thread::sleep_for(std::chrono::milliseconds(length));
+  }
+  void onewayWait() override { ++onewayCalls_; }
+
+  // dummy overrides not used in this test
+  void exceptionWait(const std::string&) override {}
+  void unexpectedExceptionWait(const std::string&) override {}
+
+  Mutex mutex_;
+  std::vector<std::string> strings_;
+  std::atomic<int32_t> generation_{0};
+  std::atomic<int> onewayCalls_{0};
+};
+
+class Fixture {
+private:
+  struct ListenEventHandler : public TServerEventHandler {
+  public:
+    ListenEventHandler(bool failContexts) : ready_(false), failContexts_(failContexts) {}
+
+    void preServe() override {
+      Guard g(listenMonitor_.mutex());
+      ready_ = true;
+      listenMonitor_.notify();
+    }
+
+    void waitReady() {
+      Guard g(listenMonitor_.mutex());
+      while (!ready_) {
+        listenMonitor_.wait();
+      }
+    }
+
+    void* createContext(shared_ptr<protocol::TProtocol>,
+                        shared_ptr<protocol::TProtocol>) override {
+      if (failContexts_) {
+        throw TException("no context");
+      }
+      return nullptr;
+    }
+
+    Monitor listenMonitor_;
+    bool ready_;
+    bool failContexts_;
+  };
+
+protected:
+  Fixture() : handler(make_shared<Handler>()), failContexts(false), serveFailed(false), served(false) {}
+
+  ~Fixture() {
+    if (server) {
+      server->stop();
+    }
+    if (thread.joinable()) {
+      thread.join();
+    }
+  }
+
+  int startServer() {
+    shared_ptr<transport::TNonblockingServerSocket> socket(
+        new transport::TNonblockingServerSocket(0));
+    server.reset(new TUringServer(make_shared<test::ParentServiceProcessor>(handler), socket));
+    if (threadManager) {
+      server->setThreadManager(threadManager);
+    }
+    if (configure) {
+      configure(*server);
+    }
+    shared_ptr<ListenEventHandler> listenHandler(new ListenEventHandler(failContexts));
+    server->setServerEventHandler(listenHandler);
+    thread = std::thread([this]() {
+      try {
+        server->serve();
+      } catch (const TException&) {
+        serveFailed = true;
+      }
+      served = true;
+    });
+    listenHandler->waitReady();
+    return server->getListenPort();
+  }
+
+  static shared_ptr<test::ParentServiceClient> connect(int port) {
+    shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+    socket->setRecvTimeout(5000);
+    socket->open();
+    return make_shared<test::ParentServiceClient>(make_shared<protocol::TBinaryProtocol>(
+        make_shared<transport::TFramedTransport>(socket)));
+  }
+
+  static bool canCommunicate(int port) {
+    try {
+      connect(port)->getGeneration();
+      return true;
+    } catch (const TException&) {
+      return false;
+    }
+  }
+
+  static bool waitFor(const std::function<bool()>& condition) {
+    for (int i = 0; i < 200 && !condition(); ++i) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return condition();
+  }
+
+  shared_ptr<Handler> handler;
+  shared_ptr<ThreadManager> threadManager;
+  std::function<void(TUringServer&)> configure;
+  bool failContexts;
+  shared_ptr<TUringServer> server;
+  std::thread thread;
+  std::atomic<bool> serveFailed;
+  std::atomic<bool> served;
+};
+
+// The kernel may not provide io_uring, or forbid it
+#define REQUIRE_IO_URING()                                                                         \
+  if (!TUringServer::isSupported()) {                                                              \
+    BOOST_TEST_MESSAGE("io_uring is not available, skipping");                                     \
+    return;                                                                                        \
+  }
+
+BOOST_AUTO_TEST_SUITE(TUringServerTest)
+
+BOOST_FIXTURE_TEST_CASE(calls, Fixture) {
+  REQUIRE_IO_URING();
+  int port = startServer();
+
+  shared_ptr<test::ParentServiceClient> client = connect(port);
+  client->addString("foo");
+  client->addString("bar");
+  BOOST_CHECK_EQUAL(1, client->incrementGeneration());
+  client->onewayWait();
+  std::vector<std::string> strings;
+  client->getStrings(strings);
+  BOOST_REQUIRE_EQUAL(2u, strings.size());
+  BOOST_CHECK_EQUAL("foo", strings[0]);
+  BOOST_CHECK_EQUAL("bar", strings[1]);
+  BOOST_CHECK_EQUAL(1, handler->onewayCalls_.load());
+
+  // Connections come and go
+  for (int i = 0; i < 20; ++i) {
+    BOOST_CHECK(canCommunicate(port));
+  }
+  BOOST_CHECK(waitFor([this]() { return server->getNumConnections() == 1; }));
+  client.reset();
+  BOOST_CHECK(waitFor([this]() { return server->getNumConnections() == 0; }));
+}
+
+BOOST_FIXTURE_TEST_CASE(pipelined_oneway, Fixture) {
+  REQUIRE_IO_URING();
+  // Frames sent ahead all at once are taken one after the other, however
+  // many there are
+  configure = [](TUringServer& server) { server.setRecvBufferSize(1 << 20); };
+  int port = startServer();
+
+  shared_ptr<transport::TMemoryBuffer> frames(new transport::TMemoryBuffer());
+  test::ParentServiceClient writer(make_shared<protocol::TBinaryProtocol>(
+      make_shared<transport::TFramedTransport>(frames)));
+  const int count = 100000;
+  for (int i = 0; i < count; ++i) {
+    writer.send_onewayWait();
+  }
+  shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+  socket->open();
+  uint8_t* buffer;
+  uint32_t size;
+  frames->getBuffer(&buffer, &size);
+  socket->write(buffer, size);
+  socket->flush();
+
+  BOOST_CHECK(waitFor([this]() { return handler->onewayCalls_ == count; }));
+  BOOST_CHECK(canCommunicate(port));
+}
+
+BOOST_FIXTURE_TEST_CASE(small_receive_buffers, Fixture) {
+  REQUIRE_IO_URING();
+  // Frames span many receives, and the buffers run out under the load
+  configure = [](TUringServer& server) {
+    server.setRecvBufferCount(4);
+    server.setRecvBufferSize(64);
+  };
+  int port = startServer();
+
+  std::vector<std::thread> clients;
+  for (int t = 0; t < 4; ++t) {
+    clients.push_back(std::thread([port, t]() {
+      shared_ptr<test::ParentServiceClient> client = connect(port);
+      const std::string s(5000 + t, 'a' + t);
+      for (int i = 0; i < 20; ++i) {
+        client->addString(s);
+      }
+    }));
+  }
+  for (auto& client : clients) {
+    client.join();
+  }
+  std::vector<std::string> strings;
+  connect(port)->getStrings(strings);
+  BOOST_CHECK_EQUAL(80u, strings.size());
+}
+
+BOOST_FIXTURE_TEST_CASE(thread_manager, Fixture) {
+  REQUIRE_IO_URING();
+  threadManager = ThreadManager::newSimpleThreadManager(4);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  int port = startServer();
+
+  // The slow calls run side by side, and the IO thread goes on meanwhile
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> clients;
+  for (int t = 0; t < 4; ++t) {
+    clients.push_back(std::thread([port]() {
+      std::string data;
+      connect(port)->getDataWait(data, 300);
+    }));
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  BOOST_CHECK(canCommunicate(port));
+  for (auto& client : clients) {
+    client.join();
+  }
+  BOOST_CHECK_LT(std::chrono::duration_cast<std::chrono::milliseconds>(
+                     std::chrono::steady_clock::now() - start).count(),
+                 1000);
+  BOOST_CHECK(waitFor([this]() { return server->getNumActiveProcessors() == 0; }));
+}
+
+BOOST_FIXTURE_TEST_CASE(large_responses, Fixture) {
+  REQUIRE_IO_URING();
+  threadManager = ThreadManager::newSimpleThreadManager(2);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  int port = startServer();
+
+  // Requests sent ahead wait their turn behind responses many sends long
+  shared_ptr<test::ParentServiceClient> client = connect(port);
+  const std::string large(1 << 20, 'x');
+  client->addString(large);
+  for (int i = 0; i < 8; ++i) {
+    client->send_getStrings();
+  }
+  for (int i = 0; i < 8; ++i) {
+    std::vector<std::string> strings;
+    client->recv_getStrings(strings);
+    BOOST_REQUIRE_EQUAL(1u, strings.size());
+    BOOST_CHECK(strings[0] == large);
+  }
+}
+
+BOOST_FIXTURE_TEST_CASE(frame_too_large, Fixture) {
+  REQUIRE_IO_URING();
+  configure = [](TUringServer& server) { server.setMaxFrameSize(1024); };
+  int port = startServer();
+
+  shared_ptr<test::ParentServiceClient> client = connect(port);
+  BOOST_CHECK_THROW(client->addString(std::string(2048, 'x')), transport::TTransportException);
+  BOOST_CHECK(canCommunicate(port));
+}
+
+BOOST_FIXTURE_TEST_CASE(overload_close_on_accept, Fixture) {
+  REQUIRE_IO_URING();
+  configure = [](TUringServer& server) {
+    server.setMaxConnections(1);
+    server.setOverloadAction(server::T_OVERLOAD_CLOSE_ON_ACCEPT);
+  };
+  int port = startServer();
+
+  shared_ptr<test::ParentServiceClient> first = connect(port);
+  BOOST_CHECK_EQUAL(0, first->getGeneration());
+  shared_ptr<test::ParentServiceClient> second = connect(port);
+  BOOST_CHECK_EQUAL(0, second->getGeneration());
+  // Both are let in, as the limit is only exceeded past them
+  shared_ptr<test::ParentServiceClient> third = connect(port);
+  BOOST_CHECK_THROW(third->getGeneration(), transport::TTransportException);
+
+  // The overload ends once connections are gone
+  first.reset();
+  second.reset();
+  BOOST_CHECK(waitFor([this]() { return server->getNumConnections() == 0; }));
+  BOOST_CHECK(canCommunicate(port));
+}
+
+BOOST_FIXTURE_TEST_CASE(stop_with_open_connections, Fixture) {
+  REQUIRE_IO_URING();
+  threadManager = ThreadManager::newSimpleThreadManager(1);
+  threadManager->threadFactory(make_shared<ThreadFactory>());
+  threadManager->start();
+  int port = startServer();
+
+  shared_ptr<test::ParentServiceClient> idle = connect(port);
+  BOOST_CHECK_EQUAL(0, idle->getGeneration());
+  shared_ptr<test::ParentServiceClient> busy = connect(port);
+  busy->send_getDataWait(200);
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+  // The task in flight finishes on a connection the server has dropped
+  server->stop();
+  thread.join();
+  BOOST_CHECK_EQUAL(0u, server->getNumConnections());
+  threadManager->stop();
+}
+
+BOOST_FIXTURE_TEST_CASE(serve_failure, Fixture) {
+  REQUIRE_IO_URING();
+  // serve() gives up on an exception, and passes it on once the ring is idle
+  failContexts = true;
+  int port = startServer();
+
+  shared_ptr<transport::TSocket> socket(new transport::TSocket("localhost", port));
+  socket->open();
+  BOOST_CHECK(waitFor([this]() { return served.load(); }));
+  BOOST_CHECK(serveFailed);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
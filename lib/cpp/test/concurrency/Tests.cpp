@@ -149,6 +149,41 @@ int main(int argc, char** argv) {
       std::cerr << "\t\tTimerManager tests FAILED" << std::endl;
       return 1;
     }
+
+    std::cout << "\t\tTimerManager test05" << std::endl;
+
+    if (!timerManagerTests.test05()) {
+      std::cerr << "\t\tTimerManager tests FAILED" << std::endl;
+      return 1;
+    }
+  }
+
+  if (runAll || args[0].compare("timing-wheel") == 0) {
+
+    std::cout << "TimerManager timing wheel tests..." << std::endl;
+
+    // A millisecond tick makes the longer tests cascade from the second level
+    TimerManagerTests timerManagerTests(std::chrono::milliseconds(1));
+    bool (TimerManagerTests::*tests[])(uint64_t) = {&TimerManagerTests::test00,
+                                                    &TimerManagerTests::test01,
+                                                    &TimerManagerTests::test02,
+                                                    &TimerManagerTests::test03,
+                                                    &TimerManagerTests::test04};
+    for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i) {
+      std::cout << "\t\tTimerManager timing wheel test0" << i << std::endl;
+
+      if (!(timerManagerTests.*tests[i])(1000LL)) {
+        std::cerr << "\t\tTimerManager timing wheel tests FAILED" << std::endl;
+        return 1;
+      }
+    }
+
+    std::cout << "\t\tTimerManager timing wheel test05" << std::endl;
+
+    if (!timerManagerTests.test05()) {
+      std::cerr << "\t\tTimerManager timing wheel tests FAILED" << std::endl;
+      return 1;
+    }
   }
 
   if (runAll || args[0].compare("thread-manager") == 0) {
@@ -187,6 +222,42 @@ int main(int argc, char** argv) {
     }
   }
 
+  if (runAll || args[0].compare("work-stealing-thread-manager") == 0) {
+
+    std::cout << "WorkStealingThreadManager tests..." << std::endl;
+
+    {
+      size_t workerCount = 10 * WEIGHT;
+      size_t taskCount = 500 * WEIGHT;
+      int64_t delay = 10LL;
+
+      ThreadManagerTests threadManagerTests(&ThreadManager::newWorkStealingThreadManager);
+
+      std::cout << "\t\tWorkStealingThreadManager api test:" << std::endl;
+
+      if (!threadManagerTests.apiTest()) {
+        std::cerr << "\t\tWorkStealingThreadManager apiTest FAILED" << std::endl;
+        return 1;
+      }
+
+      std::cout << "\t\tWorkStealingThreadManager load test: worker count: " << workerCount
+                << " task count: " << taskCount << " delay: " << delay << std::endl;
+
+      if (!threadManagerTests.loadTest(taskCount, delay, workerCount)) {
+        std::cerr << "\t\tWorkStealingThreadManager loadTest FAILED" << std::endl;
+        return 1;
+      }
+
+      std::cout << "\t\tWorkStealingThreadManager block test: worker count: " << workerCount
+                << " delay: " << delay << std::endl;
+
+      if (!threadManagerTests.blockTest(delay, workerCount)) {
+        std::cerr << "\t\tWorkStealingThreadManager blockTest FAILED" << std::endl;
+        return 1;
+      }
+    }
+  }
+
   if (runAll || args[0].compare("thread-manager-benchmark") == 0) {
 
     std::cout << "ThreadManager benchmark tests..." << std::endl;
@@ -22,9 +22,11 @@
 #include <thrift/concurrency/Monitor.h>
 
 #include <assert.h>
+#include <atomic>
 #include <chrono>
 #include <thread>
 #include <iostream>
+#include <vector>
 
 namespace apache {
 namespace thrift {
@@ -36,6 +38,13 @@ using namespace apache::thrift::concurrency;
 class TimerManagerTests {
 
 public:
+  /**
+   * Runs the tests against a timer manager with the given tick; zero tests
+   * the default ordered map.
+   */
+  TimerManagerTests(const std::chrono::milliseconds& tick = std::chrono::milliseconds(0))
+    : _tick(tick) {}
+
   class Task : public Runnable {
   public:
     Task(Monitor& monitor, uint64_t timeout)
@@ -80,7 +89,7 @@ public:
         = shared_ptr<TimerManagerTests::Task>(new TimerManagerTests::Task(_monitor, 10 * timeout));
 
     {
-      TimerManager timerManager;
+      TimerManager timerManager(_tick);
       timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
       timerManager.start();
       if (timerManager.state() != TimerManager::STARTED) {
@@ -125,7 +134,7 @@ public:
    * task when the manager goes out of scope and its destructor is called.
    */
   bool test01(uint64_t timeout = 1000LL) {
-    TimerManager timerManager;
+    TimerManager timerManager(_tick);
     timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
     timerManager.start();
     assert(timerManager.state() == TimerManager::STARTED);
@@ -158,7 +167,7 @@ public:
    * and its destructor is called.
    */
   bool test02(uint64_t timeout = 1000LL) {
-    TimerManager timerManager;
+    TimerManager timerManager(_tick);
     timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
     timerManager.start();
     assert(timerManager.state() == TimerManager::STARTED);
@@ -191,7 +200,7 @@ public:
    * task when the manager goes out of scope and its destructor is called.
    */
   bool test03(uint64_t timeout = 1000LL) {
-    TimerManager timerManager;
+    TimerManager timerManager(_tick);
     timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
     timerManager.start();
     assert(timerManager.state() == TimerManager::STARTED);
@@ -228,7 +237,7 @@ public:
    * This test creates one task, and tries to remove it after it has expired.
    */
   bool test04(uint64_t timeout = 1000LL) {
-    TimerManager timerManager;
+    TimerManager timerManager(_tick);
     timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
     timerManager.start();
     assert(timerManager.state() == TimerManager::STARTED);
@@ -262,8 +271,91 @@ public:
     return true;
   }
 
+  /**
+   * Counts how many tasks ran and how many of them ran before they were due.
+   */
+  class CountingTask : public Runnable {
+  public:
+    CountingTask(const std::chrono::time_point<std::chrono::steady_clock>& due,
+                 std::atomic<size_t>& ran,
+                 std::atomic<size_t>& early)
+      : _due(due), _ran(ran), _early(early), _done(false) {}
+
+    void run() override {
+      if (std::chrono::steady_clock::now() < _due) {
+        ++_early;
+      }
+      _done = true;
+      ++_ran;
+    }
+
+    std::chrono::time_point<std::chrono::steady_clock> _due;
+    std::atomic<size_t>& _ran;
+    std::atomic<size_t>& _early;
+    std::atomic<bool> _done;
+  };
+
+  /**
+   * This test adds many tasks spread over the timeout, cancels every other one through its
+   * handle, and verifies that all the others run, none of them early.
+   */
+  bool test05(uint64_t timeout = 1000LL, size_t count = 20000) {
+    TimerManager timerManager(_tick);
+    timerManager.threadFactory(shared_ptr<ThreadFactory>(new ThreadFactory()));
+    timerManager.start();
+    assert(timerManager.state() == TimerManager::STARTED);
+
+    std::atomic<size_t> ran(0);
+    std::atomic<size_t> early(0);
+    std::vector<shared_ptr<CountingTask> > tasks;
+    std::vector<TimerManager::Timer> timers;
+
+    // The tasks to cancel are due in the second half, so they are still pending when removed
+    // once the next task has been added
+    for (size_t i = 0; i < count; ++i) {
+      uint64_t delay = 1 + (i * 7919) % (timeout / 2);
+      if (i % 2 == 1) {
+        delay += timeout / 2;
+      }
+      auto due = std::chrono::steady_clock::now() + std::chrono::milliseconds(delay);
+      tasks.push_back(std::make_shared<CountingTask>(due, ran, early));
+      timers.push_back(timerManager.add(tasks.back(), due));
+      if (i % 2 == 0 && i > 0) {
+        timerManager.remove(timers[i - 1]);
+      }
+    }
+    timerManager.remove(timers[count - 1]);
+    auto start = std::chrono::steady_clock::now();
+    if (timerManager.taskCount() > count / 2) {
+      std::cerr << "cancelled tasks are still pending" << std::endl;
+      return false;
+    }
+
+    // Wait for the others, and then long enough for the cancelled ones to have run
+    auto deadline = start + std::chrono::milliseconds(timeout * 3);
+    while (ran < count - count / 2 && std::chrono::steady_clock::now() < deadline) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::this_thread::sleep_until(start + std::chrono::milliseconds(timeout + timeout / 10));
+
+    for (size_t i = 0; i < count; ++i) {
+      if (tasks[i]->_done != (i % 2 == 0)) {
+        std::cerr << "task " << i << (i % 2 == 0 ? " did not run" : " ran after it was cancelled")
+                  << std::endl;
+        return false;
+      }
+    }
+    if (early != 0) {
+      std::cerr << early << " tasks ran early" << std::endl;
+      return false;
+    }
+
+    return true;
+  }
+
   friend class TestTask;
 
+  std::chrono::milliseconds _tick;
   Monitor _monitor;
 };
 
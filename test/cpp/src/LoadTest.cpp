@@ -0,0 +1,619 @@
+/*
+ * Licensed to the Apache Software Foundation (ASF) under one
+ * or more contributor license agreements. See the NOTICE file
+ * distributed with this work for additional information
+ * regarding copyright ownership. The ASF licenses this file
+ * to you under the Apache License, Version 2.0 (the
+ * "License"); you may not use this file except in compliance
+ * with the License. You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing,
+ * software distributed under the License is distributed on an
+ * "AS IS" BASIS, WITHOUT WARRANTIES OR CONDITIONS OF ANY
+ * KIND, either express or implied. See the License for the
+ * specific language governing permissions and limitations
+ * under the License.
+ */
+
+/**
+ * Load generator for the C++ servers.
+ *
+ * Runs one of the servers on loopback with a ThriftTest handler, and drives
+ * it with testBinary calls from a number of connections, each on its own
+ * thread.  In closed loop each connection sends its next call as soon as the
+ * last one returns; in open loop the connections together send a fixed
+ * number of calls per second, and latency is measured from when a call was
+ * due to be sent, so a server that falls behind is charged for the time the
+ * calls spent waiting.
+ *
+ * Latencies go into HdrHistogram style histograms, and can be written out as
+ * a percentile distribution in the .hgrm format.
+ */
+
+#include <thrift/concurrency/Monitor.h>
+#include <thrift/concurrency/ThreadFactory.h>
+#include <thrift/concurrency/ThreadManager.h>
+#include <thrift/protocol/TBinaryProtocol.h>
+#include <thrift/protocol/TCompactProtocol.h>
+#include <thrift/server/TNonblockingServer.h>
+#include <thrift/server/TSimpleServer.h>
+#include <thrift/server/TThreadPoolServer.h>
+#include <thrift/server/TThreadedServer.h>
+#include <thrift/transport/TBufferTransports.h>
+#include <thrift/transport/TNonblockingServerSocket.h>
+#include <thrift/transport/TServerSocket.h>
+#include <thrift/transport/TSocket.h>
+
+#include "ThriftTest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+using namespace apache::thrift;
+using namespace apache::thrift::concurrency;
+using namespace apache::thrift::protocol;
+using namespace apache::thrift::server;
+using namespace apache::thrift::transport;
+
+using namespace thrift::test;
+
+typedef std::chrono::steady_clock Clock;
+
+/**
+ * Counts of latencies in nanoseconds, in the layout of an HdrHistogram: each
+ * power of two is split into 128 linear buckets, so every value is kept to
+ * within 1%, at a fixed size for any range.
+ */
+class LatencyHistogram {
+public:
+  LatencyHistogram() : counts_(BUCKETS, 0), total_(0), max_(0), sum_(0) {}
+
+  void record(uint64_t value) {
+    ++counts_[index(value)];
+    ++total_;
+    max_ = (std::max)(max_, value);
+    sum_ += static_cast<double>(value);
+  }
+
+  void add(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      counts_[i] += other.counts_[i];
+    }
+    total_ += other.total_;
+    max_ = (std::max)(max_, other.max_);
+    sum_ += other.sum_;
+  }
+
+  uint64_t total() const { return total_; }
+
+  uint64_t max() const { return max_; }
+
+  double mean() const { return total_ ? sum_ / total_ : 0; }
+
+  /**
+   * The highest value that can be in the same bucket as the value at the
+   * given percentile.
+   */
+  uint64_t percentile(double percentile) const {
+    uint64_t wanted = static_cast<uint64_t>(std::ceil(percentile / 100 * total_));
+    wanted = (std::max)(wanted, static_cast<uint64_t>(1));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      seen += counts_[i];
+      if (seen >= wanted) {
+        return (std::min)(highest(i), max_);
+      }
+    }
+    return max_;
+  }
+
+  /**
+   * Writes the percentile distribution as HdrHistogram does, with five
+   * percentile ticks in each halving of the distance to 100%.  Values are in
+   * microseconds.
+   */
+  void writeDistribution(ostream& out) const {
+    char line[128];
+    snprintf(line, sizeof(line), "%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount",
+             "1/(1-Percentile)");
+    out << line;
+    if (total_ == 0) {
+      return;
+    }
+    for (int tick = 0;; ++tick) {
+      double remaining = std::pow(0.5, tick / 5);
+      double percentile = 100 * (1 - remaining + remaining / 2 * (tick % 5) / 5);
+      uint64_t count = static_cast<uint64_t>(std::ceil(percentile / 100 * total_));
+      bool last = count >= total_;
+      if (last) {
+        percentile = 100;
+        count = total_;
+      }
+      double inverse = 1 / (1 - percentile / 100);
+      if (last) {
+        snprintf(line, sizeof(line), "%12.3f %14.12f %10llu\n", max_ / 1000.0, 1.0,
+                 static_cast<unsigned long long>(count));
+      } else {
+        snprintf(line, sizeof(line), "%12.3f %14.12f %10llu %14.2f\n",
+                 this->percentile(percentile) / 1000.0, percentile / 100,
+                 static_cast<unsigned long long>((std::max)(count, static_cast<uint64_t>(1))),
+                 inverse);
+      }
+      out << line;
+      if (last) {
+        break;
+      }
+    }
+    double variance = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      if (counts_[i]) {
+        double delta = (lowest(i) + highest(i)) / 2.0 - mean();
+        variance += delta * delta * counts_[i];
+      }
+    }
+    snprintf(line, sizeof(line), "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n", mean() / 1000,
+             std::sqrt(variance / total_) / 1000);
+    out << line;
+    snprintf(line, sizeof(line), "#[Max     = %12.3f, Total count    = %12llu]\n", max_ / 1000.0,
+             static_cast<unsigned long long>(total_));
+    out << line;
+    snprintf(line, sizeof(line), "#[Buckets = %12d, SubBuckets     = %12d]\n",
+             static_cast<int>(BUCKETS / SUB_BUCKETS), SUB_BUCKETS);
+    out << line;
+  }
+
+private:
+  static const int SUB_BITS = 7;
+  static const int SUB_BUCKETS = 1 << SUB_BITS;
+  static const size_t BUCKETS = (64 - SUB_BITS) * SUB_BUCKETS + SUB_BUCKETS;
+
+  // Values below 2 * SUB_BUCKETS have a bucket each; above that, a value
+  // with its top bit at position SUB_BITS + shift goes into bucket
+  // shift * SUB_BUCKETS + (value >> shift)
+  static size_t index(uint64_t value) {
+    if (value < 2 * SUB_BUCKETS) {
+      return static_cast<size_t>(value);
+    }
+    int shift = 63 - __builtin_clzll(value) - SUB_BITS;
+    return static_cast<size_t>(shift) * SUB_BUCKETS + static_cast<size_t>(value >> shift);
+  }
+
+  static uint64_t lowest(size_t index) {
+    if (index < 2 * SUB_BUCKETS) {
+      return index;
+    }
+    size_t shift = index / SUB_BUCKETS - 1;
+    return static_cast<uint64_t>(index - shift * SUB_BUCKETS) << shift;
+  }
+
+  static uint64_t highest(size_t index) {
+    if (index < 2 * SUB_BUCKETS) {
+      return index;
+    }
+    size_t shift = index / SUB_BUCKETS - 1;
+    return lowest(index) + (static_cast<uint64_t>(1) << shift) - 1;
+  }
+
+  std::vector<uint64_t> counts_;
+  uint64_t total_;
+  uint64_t max_;
+  double sum_;
+};
+
+/**
+ * Echoes testBinary payloads, after an optional delay that stands in for
+ * the work of a real handler.
+ */
+class LoadTestHandler : public ThriftTestNull {
+public:
+  explicit LoadTestHandler(std::chrono::microseconds delay) : delay_(delay) {}
+
+  void testBinary(string& _return, const string& thing) override {
+    if (delay_.count() > 0) {
+      std::this_thread::sleep_for(delay_);
+    }
+    _return = thing;
+  }
+
+private:
+  std::chrono::microseconds delay_;
+};
+
+class TStartObserver : public TServerEventHandler {
+public:
+  TStartObserver() : awake_(false) {}
+  void preServe() override {
+    Synchronized s(m_);
+    awake_ = true;
+    m_.notifyAll();
+  }
+  void waitForService() {
+    Synchronized s(m_);
+    while (!awake_)
+      m_.waitForever();
+  }
+
+private:
+  Monitor m_;
+  bool awake_;
+};
+
+struct Options {
+  Options()
+    : host("127.0.0.1"),
+      port(9092),
+      runServer(true),
+      serverType("thread-pool"),
+      protocolType("binary"),
+      workers(8),
+      ioThreads(1),
+      connections(8),
+      qps(0),
+      duration(10),
+      warmup(1),
+      payload(64),
+      handlerDelay(0) {}
+
+  string host;
+  int port;
+  bool runServer;
+  string serverType;
+  string protocolType;
+  size_t workers;
+  size_t ioThreads;
+  size_t connections;
+  double qps;
+  double duration;
+  double warmup;
+  size_t payload;
+  int64_t handlerDelay;
+  string hgrmPath;
+};
+
+std::shared_ptr<TProtocolFactory> makeProtocolFactory(const string& protocolType) {
+  if (protocolType == "binary") {
+    return std::make_shared<TBinaryProtocolFactory>();
+  } else if (protocolType == "compact") {
+    return std::make_shared<TCompactProtocolFactory>();
+  }
+  throw invalid_argument("Unknown protocol type " + protocolType);
+}
+
+/**
+ * What one connection measured.
+ */
+struct ConnectionResult {
+  ConnectionResult() : calls(0), errors(0) {}
+
+  LatencyHistogram latency;
+  uint64_t calls;
+  uint64_t errors;
+  string error;
+};
+
+/**
+ * Makes calls on one connection from start until end, recording the
+ * latency of those due after measureFrom.  With an interval, calls are due
+ * that far apart from start on, and are timed from when they were due.
+ */
+void runConnection(const Options& options,
+                   Clock::time_point start,
+                   Clock::time_point measureFrom,
+                   Clock::time_point end,
+                   std::chrono::nanoseconds interval,
+                   ConnectionResult& result) {
+  try {
+    std::shared_ptr<TSocket> socket(new TSocket(options.host, options.port));
+    std::shared_ptr<TTransport> transport(new TFramedTransport(socket));
+    ThriftTestClient client(makeProtocolFactory(options.protocolType)->getProtocol(transport));
+    transport->open();
+
+    const string payload(options.payload, 'x');
+    string reply;
+    std::this_thread::sleep_until(start);
+    Clock::time_point due = start;
+    while (true) {
+      Clock::time_point sent;
+      if (interval.count() > 0) {
+        if (due >= end) {
+          break;
+        }
+        std::this_thread::sleep_until(due);
+        sent = due;
+        due += interval;
+      } else {
+        sent = Clock::now();
+        if (sent >= end) {
+          break;
+        }
+      }
+
+      client.testBinary(reply, payload);
+      if (reply.size() != payload.size()) {
+        throw TException("testBinary returned a different payload");
+      }
+
+      ++result.calls;
+      if (sent >= measureFrom) {
+        result.latency.record(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sent).count());
+      }
+    }
+    transport->close();
+  } catch (const TException& e) {
+    ++result.errors;
+    result.error = e.what();
+  }
+}
+
+void printReport(const Options& options,
+                 const std::vector<ConnectionResult>& results,
+                 double seconds) {
+  LatencyHistogram latency;
+  uint64_t errors = 0;
+  for (const ConnectionResult& result : results) {
+    latency.add(result.latency);
+    errors += result.errors;
+    if (result.errors) {
+      cerr << "Connection failed: " << result.error << endl;
+    }
+  }
+
+  cout << "server " << (options.runServer ? options.serverType : options.host) << ", protocol "
+       << options.protocolType << ", " << options.connections << " connections, ";
+  if (options.qps > 0) {
+    cout << "open loop at " << options.qps << " calls/s";
+  } else {
+    cout << "closed loop";
+  }
+  cout << ", " << options.payload << " byte payload, " << options.handlerDelay
+       << " us handler delay, " << std::thread::hardware_concurrency() << " cpus" << endl;
+
+  char line[256];
+  snprintf(line, sizeof(line), "%llu calls measured in %.2f s (%.1f calls/s), %llu errors\n",
+           static_cast<unsigned long long>(latency.total()), seconds, latency.total() / seconds,
+           static_cast<unsigned long long>(errors));
+  cout << line;
+  snprintf(line, sizeof(line),
+           "latency us: mean %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  p99.99 %.1f  max %.1f\n",
+           latency.mean() / 1000, latency.percentile(50) / 1000.0, latency.percentile(90) / 1000.0,
+           latency.percentile(99) / 1000.0, latency.percentile(99.9) / 1000.0,
+           latency.percentile(99.99) / 1000.0, latency.max() / 1000.0);
+  cout << line;
+
+  if (!options.hgrmPath.empty()) {
+    ofstream out(options.hgrmPath.c_str());
+    latency.writeDistribution(out);
+  }
+}
+
+int main(int argc, char** argv) {
+  Options options;
+
+  ostringstream usage;
+  usage << argv[0] << " [--server=<true|false>] [--host=<host>] [--port=<port>] "
+                      "[--server-type=<server-type>] [--protocol-type=<protocol-type>] "
+                      "[--workers=<worker-count>] [--io-threads=<count>] "
+                      "[--connections=<count>] [--qps=<calls per second>] "
+                      "[--duration=<seconds>] [--warmup=<seconds>] [--payload=<bytes>] "
+                      "[--handler-delay=<microseconds>] [--hgrm=<file>]" << endl
+        << "\tserver         Run the server in this process, or only the clients against "
+                            "--host.  Default is " << options.runServer << endl
+        << "\thost           Host the clients connect to.  Default is " << options.host << endl
+        << "\tport           Port of the server, 0 for any free one.  Default is "
+        << options.port << endl
+        << "\tserver-type    \"simple\", \"threaded\", \"thread-pool\" or \"nonblocking\".  "
+                            "Default is " << options.serverType << endl
+        << "\tprotocol-type  \"binary\" or \"compact\".  Default is " << options.protocolType
+        << endl
+        << "\tworkers        Threads running the handler, for the thread-pool and "
+                            "nonblocking servers.  Default is " << options.workers << endl
+        << "\tio-threads     I/O threads of the nonblocking server.  Default is "
+        << options.ioThreads << endl
+        << "\tconnections    Client connections, each on its own thread; 0 runs only the "
+                            "server.  Default is " << options.connections << endl
+        << "\tqps            Calls per second across all connections, in open loop; 0 for "
+                            "closed loop.  Default is " << options.qps << endl
+        << "\tduration       Seconds to measure for.  Default is " << options.duration << endl
+        << "\twarmup         Seconds of calls before measuring.  Default is " << options.warmup
+        << endl
+        << "\tpayload        Bytes sent, and echoed back, per call.  Default is "
+        << options.payload << endl
+        << "\thandler-delay  Microseconds the handler sleeps per call.  Default is "
+        << options.handlerDelay << endl
+        << "\thgrm           Write the latency percentile distribution to this file." << endl
+        << endl
+        << "The simple server serves one connection at a time." << endl;
+
+  map<string, string> args;
+
+  for (int ix = 1; ix < argc; ix++) {
+    string arg(argv[ix]);
+    if (arg.compare(0, 2, "--") != 0) {
+      cerr << "Unexpected command line token: " << arg << endl << usage.str();
+      return 1;
+    }
+    size_t end = arg.find_first_of("=", 2);
+    string key = string(arg, 2, end - 2);
+    if (end != string::npos) {
+      args[key] = string(arg, end + 1);
+    } else {
+      args[key] = "true";
+    }
+  }
+
+  try {
+    for (const auto& arg : args) {
+      const string& value = arg.second;
+      if (arg.first == "help") {
+        cerr << usage.str();
+        return 0;
+      } else if (arg.first == "server") {
+        options.runServer = value == "true";
+      } else if (arg.first == "host") {
+        options.host = value;
+      } else if (arg.first == "port") {
+        options.port = stoi(value);
+      } else if (arg.first == "server-type") {
+        options.serverType = value;
+        if (value != "simple" && value != "threaded" && value != "thread-pool"
+            && value != "nonblocking") {
+          throw invalid_argument("Unknown server type " + value);
+        }
+      } else if (arg.first == "protocol-type") {
+        options.protocolType = value;
+        makeProtocolFactory(value);
+      } else if (arg.first == "workers") {
+        options.workers = stoul(value);
+      } else if (arg.first == "io-threads") {
+        options.ioThreads = stoul(value);
+      } else if (arg.first == "connections") {
+        options.connections = stoul(value);
+      } else if (arg.first == "qps") {
+        options.qps = stod(value);
+      } else if (arg.first == "duration") {
+        options.duration = stod(value);
+      } else if (arg.first == "warmup") {
+        options.warmup = stod(value);
+      } else if (arg.first == "payload") {
+        options.payload = stoul(value);
+      } else if (arg.first == "handler-delay") {
+        options.handlerDelay = stoll(value);
+      } else if (arg.first == "hgrm") {
+        options.hgrmPath = value;
+      } else {
+        throw invalid_argument("Unknown option --" + arg.first);
+      }
+    }
+  } catch (std::exception& e) {
+    cerr << e.what() << endl << usage.str();
+    return 1;
+  }
+
+  std::shared_ptr<TServer> server;
+  std::shared_ptr<Thread> serverThread;
+  std::shared_ptr<ThreadFactory> threadFactory(new ThreadFactory());
+
+  if (options.runServer) {
+    std::shared_ptr<LoadTestHandler> handler(
+        new LoadTestHandler(std::chrono::microseconds(options.handlerDelay)));
+    std::shared_ptr<TProcessor> processor(new ThriftTestProcessor(handler));
+    std::shared_ptr<TProtocolFactory> protocolFactory = makeProtocolFactory(options.protocolType);
+    std::shared_ptr<TTransportFactory> transportFactory(new TFramedTransportFactory());
+    std::shared_ptr<TServerSocket> serverSocket;
+    std::shared_ptr<TNonblockingServerSocket> nonblockingSocket;
+
+    if (options.serverType == "nonblocking") {
+      nonblockingSocket.reset(new TNonblockingServerSocket(options.port));
+      std::shared_ptr<TNonblockingServer> nonblockingServer(
+          new TNonblockingServer(processor, protocolFactory, nonblockingSocket));
+      nonblockingServer->setNumIOThreads(options.ioThreads);
+      if (options.workers > 0) {
+        std::shared_ptr<ThreadManager> threadManager
+            = ThreadManager::newSimpleThreadManager(options.workers);
+        threadManager->threadFactory(threadFactory);
+        threadManager->start();
+        nonblockingServer->setThreadManager(threadManager);
+      }
+      server = nonblockingServer;
+    } else {
+      serverSocket.reset(new TServerSocket(options.port));
+      if (options.serverType == "simple") {
+        server.reset(new TSimpleServer(processor, serverSocket, transportFactory, protocolFactory));
+      } else if (options.serverType == "threaded") {
+        server.reset(
+            new TThreadedServer(processor, serverSocket, transportFactory, protocolFactory));
+      } else {
+        std::shared_ptr<ThreadManager> threadManager
+            = ThreadManager::newSimpleThreadManager(options.workers);
+        threadManager->threadFactory(threadFactory);
+        threadManager->start();
+        server.reset(new TThreadPoolServer(processor,
+                                           serverSocket,
+                                           transportFactory,
+                                           protocolFactory,
+                                           threadManager));
+      }
+    }
+
+    std::shared_ptr<TStartObserver> observer(new TStartObserver);
+    server->setServerEventHandler(observer);
+    serverThread = threadFactory->newThread(server);
+    serverThread->start();
+    observer->waitForService();
+
+    options.port = nonblockingSocket ? nonblockingSocket->getListenPort() : serverSocket->getPort();
+    cerr << "Started the " << options.serverType << " server on port " << options.port << endl;
+
+    if (options.connections == 0) {
+      serverThread->join();
+      return 0;
+    }
+  }
+
+  std::vector<ConnectionResult> results(options.connections);
+  std::vector<std::thread> connections;
+
+  // Calls are spread evenly over the connections, and the connections'
+  // schedules are staggered over one interval
+  std::chrono::nanoseconds interval(0);
+  if (options.qps > 0) {
+    interval = std::chrono::nanoseconds(
+        static_cast<int64_t>(1e9 * options.connections / options.qps));
+  }
+  Clock::time_point start = Clock::now() + std::chrono::milliseconds(100);
+  Clock::time_point measureFrom
+      = start + std::chrono::duration_cast<Clock::duration>(
+                    std::chrono::duration<double>(options.warmup));
+  Clock::time_point end
+      = measureFrom + std::chrono::duration_cast<Clock::duration>(
+                          std::chrono::duration<double>(options.duration));
+
+  for (size_t i = 0; i < options.connections; ++i) {
+    Clock::time_point connectionStart = start;
+    if (interval.count() > 0) {
+      connectionStart += interval * i / options.connections;
+    }
+    connections.push_back(std::thread(runConnection,
+                                      std::cref(options),
+                                      connectionStart,
+                                      measureFrom,
+                                      end,
+                                      interval,
+                                      std::ref(results[i])));
+  }
+  for (auto& connection : connections) {
+    connection.join();
+  }
+
+  if (server) {
+    server->stop();
+    serverThread->join();
+  }
+
+  printReport(options, results, options.duration);
+
+  uint64_t errors = 0;
+  uint64_t calls = 0;
+  for (const ConnectionResult& result : results) {
+    errors += result.errors;
+    calls += result.calls;
+  }
+  return (errors || calls == 0) ? 1 : 0;
+}